@@ -69,6 +69,8 @@ category_mapping = {
 	'storage.hpp': 'Custom Storage',
 	'storage_defs.hpp': 'Storage',
 	'file_storage.hpp': 'Storage',
+	'resume_store.hpp': 'Storage',
+	'metadata_cache.hpp': 'Storage',
 	'file_pool.hpp': 'Custom Storage',
 	'extensions.hpp': 'Plugins',
 	'ut_metadata.hpp': 'Plugins',
@@ -1804,10 +1804,12 @@ int main(int argc, char* argv[])
 		}
 
 		// loop through the alert queue to see if anything has happened.
-		std::deque<alert*> alerts;
+		// The alerts are owned by the session and stay valid until the
+		// next call to pop_alerts()
+		std::vector<alert*> alerts;
 		ses.pop_alerts(&alerts);
 		std::string now = timestamp();
-		for (std::deque<alert*>::iterator i = alerts.begin()
+		for (std::vector<alert*>::iterator i = alerts.begin()
 			, end(alerts.end()); i != end; ++i)
 		{
 			TORRENT_TRY
@@ -1821,7 +1823,6 @@ int main(int argc, char* argv[])
 					if (events.size() >= 20) events.pop_front();
 				}
 			} TORRENT_CATCH(std::exception& e) {}
-			delete *i;
 		}
 		alerts.clear();
 
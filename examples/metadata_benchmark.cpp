@@ -0,0 +1,732 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+// metadata_benchmark measures how long it takes a session to download the
+// metadata of magnet links (ut_metadata) from a swarm of simulated peers.
+// The peers run in the same process and listen on the loopback interface.
+// Each peer answers metadata requests after a configurable delay, some
+// peers are much slower than the others and some never answer at all. At
+// the end of the run a single JSON object with the time-to-metadata
+// distribution and the number of redundant responses is printed.
+
+#include "libtorrent/session.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/torrent_handle.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/entry.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/io_service.hpp"
+#include "libtorrent/socket.hpp"
+#include "libtorrent/address.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/io.hpp"
+#include "libtorrent/thread.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/deadline_timer.hpp"
+#include "libtorrent/version.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+
+#if BOOST_ASIO_DYN_LINK
+#if BOOST_VERSION >= 104500
+#include <boost/asio/impl/src.hpp>
+#elif BOOST_VERSION >= 104400
+#include <boost/asio/impl/src.cpp>
+#endif
+#endif
+
+using namespace libtorrent;
+using namespace libtorrent::detail; // for write_* and read_*
+
+namespace
+{
+	int const block_size = 0x4000;
+
+	// the extended message id the simulated peers want ut_metadata
+	// messages sent to
+	int const ut_metadata_id = 3;
+
+	// these are only touched from the thread running the simulated peers
+	boost::int64_t total_requests = 0;
+	boost::int64_t total_responses = 0;
+
+	struct metadata_config
+	{
+		metadata_config()
+			: num_peers(10)
+			, num_slow(2)
+			, num_dead(1)
+			, num_torrents(20)
+			, metadata_size(512)
+			, latency(50)
+			, slow_factor(20)
+			, timeout(120)
+			, output(0)
+		{}
+
+		int num_peers;
+		// the number of peers (out of num_peers) that respond
+		// slow_factor times slower than the others
+		int num_slow;
+		// the number of peers (out of num_peers) that never respond
+		// to metadata requests
+		int num_dead;
+		int num_torrents;
+		// in kiB
+		int metadata_size;
+		// milliseconds from receiving a request until responding
+		int latency;
+		int slow_factor;
+		// in seconds
+		int timeout;
+		char const* output;
+	};
+
+	// the info dictionaries of all torrents, indexed by info-hash
+	std::map<sha1_hash, std::string> torrents;
+
+	struct sim_seed;
+
+	// a connection from the session to one of the simulated peers
+	struct sim_connection : boost::noncopyable
+	{
+		sim_connection(io_service& ios, sim_seed const& seed)
+			: m_socket(ios)
+			, m_seed(seed)
+			, m_recv(64 * 1024)
+			, m_recv_end(0)
+			, m_writing(false)
+			, m_handshake(false)
+			, m_closed(false)
+			, m_message_index(0)
+			, m_metadata(0)
+		{}
+
+		~sim_connection()
+		{
+			for (int i = 0; i < int(m_timers.size()); ++i)
+				delete m_timers[i];
+		}
+
+		tcp::socket& socket() { return m_socket; }
+
+		void start()
+		{
+			error_code ignore;
+			m_socket.set_option(tcp::no_delay(true), ignore);
+			start_read();
+		}
+
+		void close()
+		{
+			if (m_closed) return;
+			m_closed = true;
+			error_code ignore;
+			m_socket.close(ignore);
+			for (int i = 0; i < int(m_timers.size()); ++i)
+				m_timers[i]->cancel(ignore);
+		}
+
+	private:
+
+		void send(char const* buf, int len)
+		{
+			m_send.insert(m_send.end(), buf, buf + len);
+			if (!m_writing) flush();
+		}
+
+		void flush()
+		{
+			if (m_send.empty() || m_closed) return;
+			m_sending.swap(m_send);
+			m_send.clear();
+			m_writing = true;
+			boost::asio::async_write(m_socket
+				, boost::asio::buffer(&m_sending[0], m_sending.size())
+				, boost::bind(&sim_connection::on_write, this, _1));
+		}
+
+		void on_write(error_code const& ec)
+		{
+			m_writing = false;
+			if (ec) return close();
+			flush();
+		}
+
+		void start_read()
+		{
+			if (m_closed) return;
+			m_socket.async_read_some(boost::asio::buffer(&m_recv[m_recv_end]
+				, m_recv.size() - m_recv_end)
+				, boost::bind(&sim_connection::on_read, this, _1, _2));
+		}
+
+		void on_read(error_code const& ec, std::size_t bytes_transferred)
+		{
+			if (ec) return close();
+			m_recv_end += bytes_transferred;
+
+			int consumed = 0;
+			for (;;)
+			{
+				int const n = dispatch(&m_recv[consumed], m_recv_end - consumed);
+				if (n == 0 || m_closed) break;
+				consumed += n;
+			}
+			if (m_closed) return;
+
+			std::memmove(&m_recv[0], &m_recv[consumed], m_recv_end - consumed);
+			m_recv_end -= consumed;
+			if (m_recv_end == int(m_recv.size())) return close();
+			start_read();
+		}
+
+		// handles the next handshake or message. Returns the number of
+		// bytes consumed, or 0 if more data is needed
+		int dispatch(char const* ptr, int len)
+		{
+			if (!m_handshake)
+			{
+				if (len < 68) return 0;
+				std::map<sha1_hash, std::string>::const_iterator i
+					= torrents.find(sha1_hash(ptr + 28));
+				if (i == torrents.end())
+				{
+					close();
+					return 0;
+				}
+				m_metadata = &i->second;
+				m_handshake = true;
+				write_handshake(i->first);
+				return 68;
+			}
+
+			if (len < 4) return 0;
+			char const* p = ptr;
+			int const msg_len = read_int32(p);
+			if (msg_len < 0 || msg_len + 4 > int(m_recv.size()))
+			{
+				close();
+				return 0;
+			}
+			if (len < 4 + msg_len) return 0;
+			// messages other than extended ones are not interesting
+			if (msg_len >= 2 && read_uint8(p) == 20)
+				on_extended(p, msg_len - 1);
+			return 4 + msg_len;
+		}
+
+		void write_handshake(sha1_hash const& ih)
+		{
+			char handshake[] = "\x13" "BitTorrent protocol\0\0\0\0\0\x10\0\0"
+				"                    " // space for info-hash
+				"-MB0000-            "; // peer-id
+			std::memcpy(handshake + 28, &ih[0], 20);
+			std::generate(handshake + 56, handshake + 68, &rand);
+			send(handshake, sizeof(handshake) - 1);
+
+			entry e;
+			e["m"]["ut_metadata"] = ut_metadata_id;
+			e["metadata_size"] = int(m_metadata->size());
+			send_extended(0, e, 0, 0);
+		}
+
+		void send_extended(int id, entry const& e, char const* payload, int size)
+		{
+			std::vector<char> msg(6);
+			bencode(std::back_inserter(msg), e);
+			msg.insert(msg.end(), payload, payload + size);
+			char* ptr = &msg[0];
+			write_uint32(msg.size() - 4, ptr);
+			write_uint8(20, ptr);
+			write_uint8(id, ptr);
+			send(&msg[0], msg.size());
+		}
+
+		void on_extended(char const* ptr, int len)
+		{
+			int const id = read_uint8(ptr);
+			entry const e = bdecode(ptr, ptr + len - 1);
+			if (e.type() != entry::dictionary_t) return;
+
+			if (id == 0)
+			{
+				// the session's extension handshake. Pick up the id it
+				// wants ut_metadata messages sent to
+				entry const* m = e.find_key("m");
+				entry const* ut = m && m->type() == entry::dictionary_t
+					? m->find_key("ut_metadata") : 0;
+				if (ut && ut->type() == entry::int_t)
+					m_message_index = int(ut->integer());
+				return;
+			}
+
+			if (id != ut_metadata_id) return;
+			entry const* type = e.find_key("msg_type");
+			entry const* piece = e.find_key("piece");
+			if (type == 0 || type->type() != entry::int_t || type->integer() != 0
+				|| piece == 0 || piece->type() != entry::int_t)
+				return;
+
+			++total_requests;
+			respond(int(piece->integer()));
+		}
+
+		void respond(int piece);
+
+		void on_timer(error_code const& ec, int piece, deadline_timer* t)
+		{
+			m_timers.erase(std::find(m_timers.begin(), m_timers.end(), t));
+			delete t;
+			if (ec || m_closed) return;
+			write_piece(piece);
+		}
+
+		void write_piece(int piece)
+		{
+			if (m_message_index == 0) return;
+			int const size = int(m_metadata->size());
+			int const offset = piece * block_size;
+
+			entry e;
+			e["piece"] = piece;
+			if (piece < 0 || offset >= size)
+			{
+				e["msg_type"] = 2;
+				send_extended(m_message_index, e, 0, 0);
+				return;
+			}
+
+			++total_responses;
+			e["msg_type"] = 1;
+			e["total_size"] = size;
+			send_extended(m_message_index, e, m_metadata->c_str() + offset
+				, (std::min)(block_size, size - offset));
+		}
+
+		tcp::socket m_socket;
+		sim_seed const& m_seed;
+
+		std::vector<char> m_recv;
+		int m_recv_end;
+
+		// bytes waiting for the current write to complete
+		std::vector<char> m_send;
+		// the bytes currently being written
+		std::vector<char> m_sending;
+		bool m_writing;
+
+		bool m_handshake;
+		bool m_closed;
+
+		// the extended message id the session wants ut_metadata
+		// messages sent to
+		int m_message_index;
+
+		// the info dictionary of the torrent this connection is for
+		std::string const* m_metadata;
+
+		// one timer per delayed response
+		std::vector<deadline_timer*> m_timers;
+	};
+
+	// a simulated peer that has the metadata for every torrent. It accepts
+	// any number of connections and responds to metadata requests after
+	// its configured delay. A delay of -1 means it never responds.
+	struct sim_seed : boost::noncopyable
+	{
+		sim_seed(io_service& ios, int delay)
+			: m_ios(ios)
+			, m_acceptor(ios)
+			, m_delay(delay)
+		{}
+
+		~sim_seed()
+		{
+			for (int i = 0; i < int(m_connections.size()); ++i)
+				delete m_connections[i];
+		}
+
+		int listen(error_code& ec)
+		{
+			tcp::endpoint ep(address_v4::loopback(), 0);
+			m_acceptor.open(ep.protocol(), ec);
+			if (ec) return 0;
+			m_acceptor.bind(ep, ec);
+			if (ec) return 0;
+			m_acceptor.listen(100, ec);
+			if (ec) return 0;
+			int const port = m_acceptor.local_endpoint(ec).port();
+			start_accept();
+			return port;
+		}
+
+		void close()
+		{
+			error_code ignore;
+			m_acceptor.close(ignore);
+			for (int i = 0; i < int(m_connections.size()); ++i)
+				m_connections[i]->close();
+		}
+
+		// the delay of the next response, in milliseconds. There is some
+		// jitter to make the peers' round-trip times less uniform
+		int delay() const
+		{
+			if (m_delay <= 0) return m_delay;
+			return m_delay / 2 + rand() % (m_delay + 1);
+		}
+
+		io_service& get_io_service() const { return m_ios; }
+
+	private:
+
+		void start_accept()
+		{
+			sim_connection* c = new sim_connection(m_ios, *this);
+			m_connections.push_back(c);
+			m_acceptor.async_accept(c->socket()
+				, boost::bind(&sim_seed::on_accept, this, _1, c));
+		}
+
+		void on_accept(error_code const& ec, sim_connection* c)
+		{
+			if (ec) return;
+			c->start();
+			start_accept();
+		}
+
+		io_service& m_ios;
+		tcp::acceptor m_acceptor;
+		int m_delay;
+		std::vector<sim_connection*> m_connections;
+	};
+
+	void sim_connection::respond(int piece)
+	{
+		int const delay = m_seed.delay();
+		if (delay < 0) return;
+		if (delay == 0) return write_piece(piece);
+
+		deadline_timer* t = new deadline_timer(m_seed.get_io_service());
+		m_timers.push_back(t);
+		t->expires_from_now(milliseconds(delay));
+		t->async_wait(boost::bind(&sim_connection::on_timer, this, _1, piece, t));
+	}
+
+	void run_peers(io_service* ios)
+	{
+		ios->run();
+	}
+
+	// builds the info dictionary of a single file torrent, large enough
+	// for its bencoded form to be about the specified size
+	std::string make_info_section(int n, int size)
+	{
+		int const num_pieces = (std::max)(1, size / 20);
+		std::string hashes(num_pieces * 20, '\0');
+		std::generate(hashes.begin(), hashes.end(), &rand);
+
+		char name[100];
+		snprintf(name, sizeof(name), "metadata_benchmark_%d", n);
+
+		entry info;
+		info["name"] = name;
+		info["piece length"] = block_size;
+		info["length"] = boost::int64_t(num_pieces) * block_size;
+		info["pieces"] = hashes;
+
+		std::string ret;
+		bencode(std::back_inserter(ret), info);
+		return ret;
+	}
+
+	int percentile(std::vector<int>& v, int p)
+	{
+		if (v.empty()) return 0;
+		std::vector<int>::iterator i = v.begin() + (v.size() - 1) * p / 100;
+		std::nth_element(v.begin(), i, v.end());
+		return *i;
+	}
+}
+
+void print_usage()
+{
+	fprintf(stderr, "usage: metadata_benchmark [options]\n\n"
+		"adds a number of magnet links to a session and measures the time\n"
+		"it takes to download their metadata from simulated peers running\n"
+		"in the same process, over the loopback interface. The results are\n"
+		"printed as a JSON object.\n\n"
+		"options:\n"
+		"-c <num>     the number of simulated peers (default 10)\n"
+		"-S <num>     how many of the peers are slow (default 2)\n"
+		"-u <num>     how many of the peers never respond (default 1)\n"
+		"-n <num>     the number of magnet links (default 20)\n"
+		"-s <size>    size of the metadata in kiB (default 512)\n"
+		"-l <ms>      response delay of the peers (default 50)\n"
+		"-f <num>     how many times slower the slow peers are (default 20)\n"
+		"-t <sec>     give up after this long (default 120)\n"
+		"-o <file>    write the results to <file> instead of stdout\n");
+	exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+	metadata_config cfg;
+
+	++argv;
+	--argc;
+
+	while (argc > 0)
+	{
+		char const* optname = argv[0];
+		++argv;
+		--argc;
+
+		if (optname[0] != '-' || strlen(optname) != 2) print_usage();
+		if (optname[1] == 'h') print_usage();
+
+		if (argc == 0)
+		{
+			fprintf(stderr, "missing argument for option: %s\n", optname);
+			print_usage();
+		}
+
+		char const* optarg = argv[0];
+		++argv;
+		--argc;
+
+		switch (optname[1])
+		{
+			case 'c': cfg.num_peers = atoi(optarg); break;
+			case 'S': cfg.num_slow = atoi(optarg); break;
+			case 'u': cfg.num_dead = atoi(optarg); break;
+			case 'n': cfg.num_torrents = atoi(optarg); break;
+			case 's': cfg.metadata_size = atoi(optarg); break;
+			case 'l': cfg.latency = atoi(optarg); break;
+			case 'f': cfg.slow_factor = atoi(optarg); break;
+			case 't': cfg.timeout = atoi(optarg); break;
+			case 'o': cfg.output = optarg; break;
+			default:
+				fprintf(stderr, "unknown option: %s\n", optname);
+				print_usage();
+		}
+	}
+
+	if (cfg.num_peers <= 0 || cfg.num_slow < 0 || cfg.num_dead < 0
+		|| cfg.num_slow + cfg.num_dead >= cfg.num_peers
+		|| cfg.num_torrents <= 0 || cfg.metadata_size <= 0
+		|| cfg.latency < 0 || cfg.slow_factor <= 0 || cfg.timeout <= 0)
+	{
+		fprintf(stderr, "invalid arguments\n");
+		print_usage();
+	}
+
+	std::vector<sha1_hash> info_hashes;
+	int metadata_size = 0;
+	for (int i = 0; i < cfg.num_torrents; ++i)
+	{
+		std::string info = make_info_section(i, cfg.metadata_size * 1024);
+		sha1_hash const ih = hasher(info.c_str(), info.size()).final();
+		metadata_size = info.size();
+		torrents[ih].swap(info);
+		info_hashes.push_back(ih);
+	}
+
+	io_service ios;
+	std::vector<boost::shared_ptr<sim_seed> > seeds;
+	std::vector<tcp::endpoint> endpoints;
+	error_code ec;
+	for (int i = 0; i < cfg.num_peers; ++i)
+	{
+		int delay = cfg.latency;
+		if (i < cfg.num_dead) delay = -1;
+		else if (i < cfg.num_dead + cfg.num_slow) delay = cfg.latency * cfg.slow_factor;
+
+		seeds.push_back(boost::shared_ptr<sim_seed>(new sim_seed(ios, delay)));
+		int const port = seeds.back()->listen(ec);
+		if (ec)
+		{
+			fprintf(stderr, "failed to listen: %s\n", ec.message().c_str());
+			return 1;
+		}
+		endpoints.push_back(tcp::endpoint(address_v4::loopback(), port));
+	}
+
+	// the slow and unresponsive peers are first in the list. Shuffle it so
+	// the order the session connects in doesn't favor the fast peers
+	std::random_shuffle(endpoints.begin(), endpoints.end());
+
+	thread peers(boost::bind(&run_peers, &ios));
+
+	int const num_connections = cfg.num_torrents * cfg.num_peers;
+	settings_pack pack;
+	pack.set_str(settings_pack::listen_interfaces, "127.0.0.1:0");
+	pack.set_int(settings_pack::alert_mask, alert::error_notification
+		| alert::status_notification);
+	pack.set_bool(settings_pack::allow_multiple_connections_per_ip, true);
+	pack.set_bool(settings_pack::enable_outgoing_utp, false);
+	pack.set_bool(settings_pack::enable_incoming_utp, false);
+	pack.set_int(settings_pack::connections_limit, num_connections + 10);
+	pack.set_int(settings_pack::connection_speed, num_connections);
+	pack.set_int(settings_pack::max_metadata_size, (std::max)(metadata_size
+		, pack.get_int(settings_pack::max_metadata_size)));
+
+	session ses(pack, fingerprint("LT", LIBTORRENT_VERSION_MAJOR
+		, LIBTORRENT_VERSION_MINOR, 0, 0), 0);
+
+	ptime const start = time_now_hires();
+	std::vector<ptime> added;
+	std::map<sha1_hash, int> pending;
+	for (int i = 0; i < int(info_hashes.size()); ++i)
+	{
+		add_torrent_params p;
+		p.info_hash = info_hashes[i];
+		p.save_path = ".";
+		// we're only interested in the metadata. Don't download or check
+		// anything once we have it
+		p.flags &= ~(add_torrent_params::flag_paused
+			| add_torrent_params::flag_auto_managed);
+		p.flags |= add_torrent_params::flag_upload_mode;
+		torrent_handle h = ses.add_torrent(p, ec);
+		if (ec)
+		{
+			fprintf(stderr, "failed to add torrent: %s\n", ec.message().c_str());
+			return 1;
+		}
+		added.push_back(time_now_hires());
+		pending[info_hashes[i]] = i;
+		for (int k = 0; k < int(endpoints.size()); ++k)
+			h.connect_peer(endpoints[k]);
+	}
+
+	// time to metadata of each torrent, in milliseconds
+	std::vector<int> times;
+	int num_failed = 0;
+	std::vector<alert*> alerts;
+	while (!pending.empty()
+		&& total_seconds(time_now_hires() - start) < cfg.timeout)
+	{
+		if (ses.wait_for_alert(seconds(1)) == 0) continue;
+
+		ses.pop_alerts(&alerts);
+		for (std::vector<alert*>::iterator i = alerts.begin()
+			, end(alerts.end()); i != end; ++i)
+		{
+			if (metadata_received_alert* a = alert_cast<metadata_received_alert>(*i))
+			{
+				std::map<sha1_hash, int>::iterator j
+					= pending.find(a->handle.info_hash());
+				if (j == pending.end()) continue;
+				times.push_back(int(total_milliseconds(time_now_hires() - added[j->second])));
+				pending.erase(j);
+			}
+			else if (alert_cast<metadata_failed_alert>(*i))
+			{
+				++num_failed;
+			}
+		}
+	}
+	ptime const end = time_now_hires();
+
+	ios.stop();
+	peers.join();
+	for (int i = 0; i < int(seeds.size()); ++i)
+		seeds[i]->close();
+
+	int const blocks = (metadata_size + block_size - 1) / block_size;
+	boost::int64_t const needed = boost::int64_t(times.size()) * blocks;
+	boost::int64_t total_ms = 0;
+	for (int i = 0; i < int(times.size()); ++i) total_ms += times[i];
+
+	FILE* out = stdout;
+	if (cfg.output)
+	{
+		out = fopen(cfg.output, "w+");
+		if (out == 0)
+		{
+			fprintf(stderr, "failed to open \"%s\": %s\n", cfg.output, strerror(errno));
+			return 1;
+		}
+	}
+
+	fprintf(out, "{\n"
+		"\t\"version\": \"%s\",\n"
+		"\t\"peers\": %d,\n"
+		"\t\"slow_peers\": %d,\n"
+		"\t\"unresponsive_peers\": %d,\n"
+		"\t\"latency_ms\": %d,\n"
+		"\t\"torrents\": %d,\n"
+		"\t\"metadata_size\": %d,\n"
+		"\t\"completed\": %d,\n"
+		"\t\"hash_failures\": %d,\n"
+		"\t\"duration\": %.3f,\n"
+		"\t\"requests\": %" PRId64 ",\n"
+		"\t\"responses\": %" PRId64 ",\n"
+		"\t\"redundant_responses\": %" PRId64 ",\n"
+		"\t\"time_to_metadata_mean_ms\": %d,\n"
+		"\t\"time_to_metadata_p50_ms\": %d,\n"
+		"\t\"time_to_metadata_p90_ms\": %d,\n"
+		"\t\"time_to_metadata_max_ms\": %d\n"
+		"}\n"
+		, LIBTORRENT_VERSION
+		, cfg.num_peers
+		, cfg.num_slow
+		, cfg.num_dead
+		, cfg.latency
+		, cfg.num_torrents
+		, metadata_size
+		, int(times.size())
+		, num_failed
+		, total_microseconds(end - start) / 1000000.0
+		, total_requests
+		, total_responses
+		, (std::max)(boost::int64_t(0), total_responses - needed)
+		, times.empty() ? 0 : int(total_ms / times.size())
+		, percentile(times, 50)
+		, percentile(times, 90)
+		, percentile(times, 100));
+
+	if (out != stdout) fclose(out);
+	return pending.empty() ? 0 : 1;
+}
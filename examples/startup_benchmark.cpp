@@ -0,0 +1,507 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+// startup_benchmark measures how long it takes a session to come up with a
+// large number of torrents in it. The first time it runs, it creates the
+// torrents (one small file each), checks them and saves their resume data
+// in a resume_store. Every run after that starts a new session, adds all
+// torrents from the store and reports:
+//
+// * how long it took until all torrents were added
+// * how long it took until the first torrent was seeding, i.e. ready to
+//   upload
+// * how long it took until all the torrents the queue started were seeding
+//
+// By default the torrents are added from their resume data alone, and the
+// session loads the .torrent files on demand, through its load function.
+// With -e, every .torrent file is loaded and parsed up-front instead, the
+// way a client without a load function would start.
+
+#include "libtorrent/session.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/torrent_handle.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/create_torrent.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/resume_store.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/escape_string.hpp" // for to_hex
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/version.hpp"
+#include "libtorrent/file.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+
+using namespace libtorrent;
+
+namespace
+{
+	struct startup_config
+	{
+		startup_config()
+			: num_torrents(1000)
+			, file_size(64)
+			, active(8)
+			, eager(false)
+			, data_path("startup_benchmark_data")
+			, output(0)
+		{}
+
+		int num_torrents;
+		// in kiB
+		int file_size;
+		// active_seeds, and the number of torrents the queue starts
+		int active;
+		// load all .torrent files up-front
+		bool eager;
+		char const* data_path;
+		char const* output;
+	};
+
+	// peak resident set size, in kiB
+	boost::int64_t peak_memory()
+	{
+#ifndef _WIN32
+		rusage ru;
+		if (getrusage(RUSAGE_SELF, &ru) == 0)
+		{
+#ifdef __APPLE__
+			return ru.ru_maxrss / 1024;
+#else
+			return ru.ru_maxrss;
+#endif
+		}
+#endif
+		return -1;
+	}
+
+	int load_file(std::string const& filename, std::vector<char>& v)
+	{
+		FILE* f = fopen(filename.c_str(), "rb");
+		if (f == 0) return -1;
+		fseek(f, 0, SEEK_END);
+		long const s = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		if (s < 0)
+		{
+			fclose(f);
+			return -1;
+		}
+		v.resize(s);
+		int const r = s == 0 ? 0 : int(fread(&v[0], 1, v.size(), f));
+		fclose(f);
+		return r == s ? 0 : -1;
+	}
+
+	int save_file(std::string const& filename, std::vector<char> const& v)
+	{
+		FILE* f = fopen(filename.c_str(), "wb+");
+		if (f == 0) return -1;
+		int const w = v.empty() ? 0 : int(fwrite(&v[0], 1, v.size(), f));
+		fclose(f);
+		return w == int(v.size()) ? 0 : -1;
+	}
+
+	std::string torrent_filename(std::string const& dir, sha1_hash const& ih)
+	{
+		return combine_path(dir, to_hex(ih.to_string()) + ".torrent");
+	}
+
+	// this is the session's load function. It's called the first time a
+	// torrent added without its metadata is needed
+	void load_torrent(std::string const& dir, sha1_hash const& ih
+		, std::vector<char>& buf, error_code& ec)
+	{
+		if (load_file(torrent_filename(dir, ih), buf) != 0)
+			ec.assign(errno, boost::system::generic_category());
+	}
+
+	settings_pack benchmark_settings(startup_config const& cfg)
+	{
+		settings_pack pack;
+		pack.set_str(settings_pack::listen_interfaces, "127.0.0.1:48300");
+		pack.set_int(settings_pack::max_retry_port_bind, 100);
+		pack.set_int(settings_pack::alert_mask, alert::error_notification
+			| alert::status_notification | alert::storage_notification);
+		pack.set_int(settings_pack::alert_queue_size, cfg.num_torrents * 4 + 1000);
+		pack.set_bool(settings_pack::enable_dht, false);
+		pack.set_bool(settings_pack::enable_lsd, false);
+		pack.set_bool(settings_pack::enable_upnp, false);
+		pack.set_bool(settings_pack::enable_natpmp, false);
+		pack.set_int(settings_pack::active_seeds, cfg.active);
+		pack.set_int(settings_pack::active_downloads, cfg.active);
+		pack.set_int(settings_pack::active_limit, cfg.active);
+		return pack;
+	}
+
+	// creates the torrents and their data, checks them and saves their resume
+	// data to the store. This is only done when the store doesn't already
+	// have the expected number of torrents
+	int prepare(startup_config const& cfg, resume_store& store)
+	{
+		std::string const path = complete(cfg.data_path);
+		std::string const files_dir = combine_path(path, "files");
+		std::string const torrent_dir = combine_path(path, "torrents");
+
+		error_code ec;
+		create_directories(files_dir, ec);
+		create_directories(torrent_dir, ec);
+
+		fprintf(stderr, "creating %d torrents in \"%s\"\n", cfg.num_torrents, path.c_str());
+
+		session ses(benchmark_settings(cfg), fingerprint("LT", LIBTORRENT_VERSION_MAJOR
+			, LIBTORRENT_VERSION_MINOR, 0, 0), 0);
+
+		std::vector<char> block(cfg.file_size * 1024);
+		for (int i = 0; i < cfg.num_torrents; ++i)
+		{
+			char name[50];
+			snprintf(name, sizeof(name), "t%d", i);
+
+			std::generate(block.begin(), block.end(), &rand);
+			if (save_file(combine_path(files_dir, name), block) != 0)
+			{
+				fprintf(stderr, "failed to write \"%s\": %s\n", name, strerror(errno));
+				return 1;
+			}
+
+			file_storage fs;
+			fs.add_file(name, block.size());
+			create_torrent t(fs, 16 * 1024);
+			set_piece_hashes(t, files_dir, ec);
+			if (ec)
+			{
+				fprintf(stderr, "failed to hash \"%s\": %s\n", name, ec.message().c_str());
+				return 1;
+			}
+			std::vector<char> buf;
+			bencode(std::back_inserter(buf), t.generate());
+
+			add_torrent_params p;
+			p.ti = boost::make_shared<torrent_info>(&buf[0], int(buf.size()), boost::ref(ec), 0);
+			if (ec)
+			{
+				fprintf(stderr, "failed to load torrent: %s\n", ec.message().c_str());
+				return 1;
+			}
+			if (save_file(torrent_filename(torrent_dir, p.ti->info_hash()), buf) != 0)
+			{
+				fprintf(stderr, "failed to save torrent: %s\n", strerror(errno));
+				return 1;
+			}
+			p.save_path = files_dir;
+			p.flags = 0;
+			ses.async_add_torrent(p);
+		}
+
+		// wait for all torrents to be checked, then save their resume data
+		int checked = 0;
+		int saved = 0;
+		std::vector<alert*> alerts;
+		while (saved < cfg.num_torrents)
+		{
+			if (ses.wait_for_alert(seconds(10)) == 0)
+			{
+				fprintf(stderr, "timed out waiting for the torrents to be checked\n");
+				return 1;
+			}
+			ses.pop_alerts(&alerts);
+			for (std::vector<alert*>::iterator i = alerts.begin()
+				, end(alerts.end()); i != end; ++i)
+			{
+				if (torrent_checked_alert* a = alert_cast<torrent_checked_alert>(*i))
+				{
+					a->handle.save_resume_data(torrent_handle::save_bencoded);
+					++checked;
+				}
+				else if (save_resume_data_alert* a = alert_cast<save_resume_data_alert>(*i))
+				{
+					store.save(*a, ec);
+					if (ec)
+					{
+						fprintf(stderr, "failed to save resume data: %s\n", ec.message().c_str());
+						return 1;
+					}
+					++saved;
+				}
+				else if (save_resume_data_failed_alert* a = alert_cast<save_resume_data_failed_alert>(*i))
+				{
+					fprintf(stderr, "failed to save resume data: %s\n", a->error.message().c_str());
+					return 1;
+				}
+				else if (torrent_error_alert* a = alert_cast<torrent_error_alert>(*i))
+				{
+					fprintf(stderr, "%s\n", a->message().c_str());
+					return 1;
+				}
+			}
+		}
+		store.flush(ec);
+		return 0;
+	}
+}
+
+void print_usage()
+{
+	fprintf(stderr, "usage: startup_benchmark [options]\n\n"
+		"starts a session with a large number of torrents, added from a\n"
+		"resume_store, and prints how long it took for the session to be\n"
+		"ready as a JSON object. The torrents are created on the first run.\n\n"
+		"options:\n"
+		"-n <num>     the number of torrents (default 1000)\n"
+		"-s <size>    the size of each torrent, in kiB (default 64)\n"
+		"-a <num>     the number of active seeds (default 8)\n"
+		"-d <path>    directory to put the test data in\n"
+		"             (default startup_benchmark_data)\n"
+		"-o <file>    write the results to <file> instead of stdout\n"
+		"-e           load all .torrent files up-front, instead of\n"
+		"             adding the torrents from their resume data alone\n");
+	exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+	startup_config cfg;
+
+	++argv;
+	--argc;
+
+	while (argc > 0)
+	{
+		char const* optname = argv[0];
+		++argv;
+		--argc;
+
+		if (optname[0] != '-' || strlen(optname) != 2) print_usage();
+
+		// options with no arguments
+		switch (optname[1])
+		{
+			case 'e': cfg.eager = true; continue;
+			case 'h': print_usage();
+		}
+
+		if (argc == 0)
+		{
+			fprintf(stderr, "missing argument for option: %s\n", optname);
+			print_usage();
+		}
+
+		char const* optarg = argv[0];
+		++argv;
+		--argc;
+
+		switch (optname[1])
+		{
+			case 'n': cfg.num_torrents = atoi(optarg); break;
+			case 's': cfg.file_size = atoi(optarg); break;
+			case 'a': cfg.active = atoi(optarg); break;
+			case 'd': cfg.data_path = optarg; break;
+			case 'o': cfg.output = optarg; break;
+			default:
+				fprintf(stderr, "unknown option: %s\n", optname);
+				print_usage();
+		}
+	}
+
+	if (cfg.num_torrents <= 0 || cfg.file_size <= 0 || cfg.active <= 0)
+	{
+		fprintf(stderr, "invalid arguments\n");
+		print_usage();
+	}
+
+	std::string const path = complete(cfg.data_path);
+	std::string const torrent_dir = combine_path(path, "torrents");
+	std::string const store_path = combine_path(path, "resume.dat");
+
+	error_code ec;
+	create_directories(path, ec);
+	{
+		resume_store store;
+		store.open(store_path, ec);
+		if (ec)
+		{
+			fprintf(stderr, "failed to open \"%s\": %s\n", store_path.c_str(), ec.message().c_str());
+			return 1;
+		}
+		if (store.num_torrents() != cfg.num_torrents)
+		{
+			store.close();
+			remove(store_path, ec);
+			store.open(store_path, ec);
+			if (ec || prepare(cfg, store) != 0) return 1;
+		}
+	}
+
+	// everything up to here was setup. This is where a client would start
+	ptime const start = time_now_hires();
+
+	session ses(benchmark_settings(cfg), fingerprint("LT", LIBTORRENT_VERSION_MAJOR
+		, LIBTORRENT_VERSION_MINOR, 0, 0), 0);
+	if (!cfg.eager)
+		ses.set_load_function(boost::bind(&load_torrent, torrent_dir, _1, _2, _3));
+
+	resume_store store;
+	store.open(store_path, ec);
+	if (ec)
+	{
+		fprintf(stderr, "failed to open \"%s\": %s\n", store_path.c_str(), ec.message().c_str());
+		return 1;
+	}
+
+	std::vector<sha1_hash> torrents;
+	store.torrents(torrents);
+	for (std::vector<sha1_hash>::iterator i = torrents.begin()
+		, end(torrents.end()); i != end; ++i)
+	{
+		add_torrent_params p;
+		p.info_hash = *i;
+		p.save_path = combine_path(path, "files");
+		if (!store.load(*i, p.resume_data, ec))
+		{
+			fprintf(stderr, "failed to load resume data: %s\n", ec.message().c_str());
+			return 1;
+		}
+
+		if (cfg.eager)
+		{
+			std::vector<char> buf;
+			if (load_file(torrent_filename(torrent_dir, *i), buf) != 0)
+			{
+				fprintf(stderr, "failed to load torrent: %s\n", strerror(errno));
+				return 1;
+			}
+			p.ti = boost::make_shared<torrent_info>(&buf[0], int(buf.size()), boost::ref(ec), 0);
+			if (ec)
+			{
+				fprintf(stderr, "failed to load torrent: %s\n", ec.message().c_str());
+				return 1;
+			}
+		}
+		// pinned torrents are always loaded, which defeats the point
+		if (!cfg.eager) p.flags &= ~add_torrent_params::flag_pinned;
+		ses.async_add_torrent(p);
+	}
+
+	int const num_active = (std::min)(cfg.active, int(torrents.size()));
+	int added = 0;
+	int seeding = 0;
+	ptime all_added = start;
+	ptime first_seeding = start;
+	ptime all_seeding = start;
+
+	std::vector<alert*> alerts;
+	while (added < int(torrents.size()) || seeding < num_active)
+	{
+		if (ses.wait_for_alert(seconds(30)) == 0)
+		{
+			fprintf(stderr, "timed out: %d torrents added, %d seeding\n", added, seeding);
+			return 1;
+		}
+		ses.pop_alerts(&alerts);
+		ptime const now = time_now_hires();
+		for (std::vector<alert*>::iterator i = alerts.begin()
+			, end(alerts.end()); i != end; ++i)
+		{
+			if (add_torrent_alert* a = alert_cast<add_torrent_alert>(*i))
+			{
+				if (a->error)
+				{
+					fprintf(stderr, "failed to add torrent: %s\n", a->error.message().c_str());
+					return 1;
+				}
+				if (++added == int(torrents.size())) all_added = now;
+			}
+			else if (state_changed_alert* a = alert_cast<state_changed_alert>(*i))
+			{
+				if (a->state != torrent_status::seeding) continue;
+				if (seeding == 0) first_seeding = now;
+				if (++seeding == num_active) all_seeding = now;
+			}
+			else if (torrent_error_alert* a = alert_cast<torrent_error_alert>(*i))
+			{
+				fprintf(stderr, "%s\n", a->message().c_str());
+				return 1;
+			}
+		}
+	}
+
+	FILE* out = stdout;
+	if (cfg.output)
+	{
+		out = fopen(cfg.output, "w+");
+		if (out == 0)
+		{
+			fprintf(stderr, "failed to open \"%s\": %s\n", cfg.output, strerror(errno));
+			return 1;
+		}
+	}
+
+	fprintf(out, "{\n"
+		"\t\"version\": \"%s\",\n"
+		"\t\"torrents\": %d,\n"
+		"\t\"active\": %d,\n"
+		"\t\"eager\": %s,\n"
+		"\t\"all_added_ms\": %.3f,\n"
+		"\t\"first_seeding_ms\": %.3f,\n"
+		"\t\"all_active_seeding_ms\": %.3f,\n"
+		"\t\"peak_memory_kib\": %" PRId64 "\n"
+		"}\n"
+		, LIBTORRENT_VERSION
+		, int(torrents.size())
+		, num_active
+		, cfg.eager ? "true" : "false"
+		, total_microseconds(all_added - start) / 1000.0
+		, total_microseconds(first_seeding - start) / 1000.0
+		, total_microseconds(all_seeding - start) / 1000.0
+		, peak_memory());
+
+	if (out != stdout) fclose(out);
+	return 0;
+}
@@ -0,0 +1,885 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+// swarm_benchmark starts one seeding session and a configurable number of
+// simulated downloading peers in the same process, connected over the
+// loopback interface. No network access is required. The peers speak just
+// enough of the bittorrent protocol (and optionally the encrypted handshake)
+// to keep a pipeline of block requests open against the session. At the end
+// of the run a single JSON object with throughput, CPU cost, request latency
+// and memory usage is printed, to make it easy to compare builds and
+// settings from a script.
+
+#include "libtorrent/session.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/torrent_handle.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/create_torrent.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/pe_crypto.hpp"
+#include "libtorrent/io_service.hpp"
+#include "libtorrent/socket.hpp"
+#include "libtorrent/address.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/io.hpp"
+#include "libtorrent/thread.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/deadline_timer.hpp"
+#include "libtorrent/version.hpp"
+#include "libtorrent/file.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#endif
+
+#if BOOST_ASIO_DYN_LINK
+#if BOOST_VERSION >= 104500
+#include <boost/asio/impl/src.hpp>
+#elif BOOST_VERSION >= 104400
+#include <boost/asio/impl/src.cpp>
+#endif
+#endif
+
+using namespace libtorrent;
+using namespace libtorrent::detail; // for write_* and read_*
+
+namespace
+{
+	int const block_size = 0x4000;
+
+	// these are only touched from the thread running the simulated peers
+	boost::int64_t total_payload = 0;
+	boost::int64_t total_requests = 0;
+	int num_failed_peers = 0;
+	// request round-trip times, in microseconds
+	std::vector<boost::uint32_t> request_latency;
+
+	struct swarm_config
+	{
+		swarm_config()
+			: num_peers(20)
+			, piece_size(256 * 1024)
+			, torrent_size(256)
+			, cache_size(-1)
+			, queue_depth(64)
+			, duration(20)
+			, encryption(false)
+			, high_performance(false)
+			, port(48200)
+			, data_path("swarm_benchmark_data")
+			, output(0)
+		{}
+
+		int num_peers;
+		int piece_size;
+		// in MiB
+		int torrent_size;
+		// in 16 kiB blocks, -1 means the session default
+		int cache_size;
+		// number of outstanding block requests per peer
+		int queue_depth;
+		// in seconds
+		int duration;
+		bool encryption;
+		bool high_performance;
+		int port;
+		char const* data_path;
+		char const* output;
+	};
+
+	struct request_t
+	{
+		int piece;
+		int start;
+		int length;
+		ptime sent;
+	};
+
+	// a single simulated downloader. It requests every block of the torrent
+	// in order, starting at a random piece, and wraps around at the end. The
+	// seed is expected to have all pieces and to unchoke us.
+	struct sim_peer : boost::noncopyable
+	{
+		sim_peer(io_service& ios, swarm_config const& cfg, torrent_info const& ti
+			, tcp::endpoint const& ep)
+			: m_socket(ios)
+			, m_cfg(cfg)
+			, m_ti(ti)
+			, m_endpoint(ep)
+			, m_recv(256 * 1024)
+			, m_recv_start(0)
+			, m_recv_end(0)
+			, m_writing(false)
+			, m_state(connecting)
+			, m_choked(true)
+			, m_closed(false)
+			, m_piece(rand() % ti.num_pieces())
+			, m_block(0)
+		{}
+
+		void start()
+		{
+			m_socket.async_connect(m_endpoint
+				, boost::bind(&sim_peer::on_connect, this, _1));
+		}
+
+		void close(char const* fmt, error_code const& ec)
+		{
+			if (m_closed) return;
+			m_closed = true;
+			if (fmt)
+			{
+				fprintf(stderr, fmt, ec.message().c_str());
+				fprintf(stderr, "\n");
+				++num_failed_peers;
+			}
+			error_code ignore;
+			m_socket.close(ignore);
+		}
+
+	private:
+
+		enum state_t
+		{
+			connecting,
+			// waiting for the responder's public key
+			pe_read_key,
+			// scanning for the encrypted verification constant
+			pe_sync,
+			// reading crypto_select and the responder's padding
+			pe_header,
+			read_handshake,
+			read_message
+		};
+
+		void on_connect(error_code const& ec)
+		{
+			if (ec) return close("ERROR CONNECT: %s", ec);
+
+			error_code ignore;
+			m_socket.set_option(tcp::no_delay(true), ignore);
+
+#ifndef TORRENT_DISABLE_ENCRYPTION
+			if (m_cfg.encryption)
+			{
+				m_dh.reset(new dh_key_exchange);
+				send(m_dh->get_local_key(), 96);
+				m_state = pe_read_key;
+			}
+			else
+#endif
+			{
+				write_handshake();
+				m_state = read_handshake;
+			}
+			start_read();
+		}
+
+		void write_handshake()
+		{
+			char handshake[] = "\x13" "BitTorrent protocol\0\0\0\0\0\0\0\0"
+				"                    " // space for info-hash
+				"-SB0000-            " // peer-id
+				"\0\0\0\x01\x02"; // interested
+			std::memcpy(handshake + 28, &m_ti.info_hash()[0], 20);
+			std::generate(handshake + 56, handshake + 68, &rand);
+			send(handshake, sizeof(handshake) - 1);
+		}
+
+		void send(char const* buf, int len)
+		{
+			int const pos = m_send.size();
+			m_send.insert(m_send.end(), buf, buf + len);
+#ifndef TORRENT_DISABLE_ENCRYPTION
+			if (m_rc4) m_rc4->encrypt(&m_send[pos], len);
+#endif
+			if (!m_writing) flush();
+		}
+
+		void flush()
+		{
+			if (m_send.empty() || m_closed) return;
+			m_sending.swap(m_send);
+			m_send.clear();
+			m_writing = true;
+			boost::asio::async_write(m_socket
+				, boost::asio::buffer(&m_sending[0], m_sending.size())
+				, boost::bind(&sim_peer::on_write, this, _1));
+		}
+
+		void on_write(error_code const& ec)
+		{
+			m_writing = false;
+			if (ec) return close(m_closed ? 0 : "ERROR WRITE: %s", ec);
+			flush();
+		}
+
+		void start_read()
+		{
+			if (m_closed) return;
+
+			// move the unconsumed bytes to the front of the receive buffer
+			if (m_recv_start > 0)
+			{
+				std::memmove(&m_recv[0], &m_recv[m_recv_start], m_recv_end - m_recv_start);
+				m_recv_end -= m_recv_start;
+				m_recv_start = 0;
+			}
+			m_socket.async_read_some(boost::asio::buffer(&m_recv[m_recv_end]
+				, m_recv.size() - m_recv_end)
+				, boost::bind(&sim_peer::on_read, this, _1, _2));
+		}
+
+		void on_read(error_code const& ec, std::size_t bytes_transferred)
+		{
+			if (ec) return close(m_closed ? 0 : "ERROR READ: %s", ec);
+
+#ifndef TORRENT_DISABLE_ENCRYPTION
+			if (m_rc4 && m_state > pe_sync)
+				m_rc4->decrypt(&m_recv[m_recv_end], bytes_transferred);
+#endif
+			m_recv_end += bytes_transferred;
+
+			while (!m_closed && dispatch());
+			start_read();
+		}
+
+		int available() const { return m_recv_end - m_recv_start; }
+
+		// handles the next unit of input in the receive buffer. Returns false
+		// if more data is needed
+		bool dispatch()
+		{
+			char const* ptr = &m_recv[m_recv_start];
+			switch (m_state)
+			{
+#ifndef TORRENT_DISABLE_ENCRYPTION
+				case pe_read_key:
+				{
+					if (available() < 96) return false;
+					if (m_dh->compute_secret(ptr) != 0)
+					{
+						close("ERROR: %s", error_code(errors::no_memory));
+						return false;
+					}
+					m_recv_start += 96;
+					write_pe_request();
+					m_state = pe_sync;
+					return true;
+				}
+				case pe_sync:
+				{
+					// the responder's pad is at most 512 bytes
+					int const len = available();
+					char const* end = ptr + len;
+					char const* i = std::search(ptr, end, m_sync_vc, m_sync_vc + 8);
+					if (i == end)
+					{
+						if (len > 512 + 8)
+							close("ERROR: %s", error_code(errors::invalid_encryption_constant));
+						return false;
+					}
+					m_recv_start += i - ptr;
+
+					// everything from the verification constant and on is encrypted
+					m_rc4->decrypt(&m_recv[m_recv_start], available());
+					m_state = pe_header;
+					return true;
+				}
+				case pe_header:
+				{
+					// vc, crypto_select, len(pad), pad
+					if (available() < 14) return false;
+					ptr += 8;
+					int const crypto_select = read_uint32(ptr);
+					int const pad_len = read_uint16(ptr);
+					if (available() < 14 + pad_len) return false;
+					if (crypto_select != settings_pack::pe_rc4)
+					{
+						close("ERROR: %s", error_code(errors::unsupported_encryption_mode_selected));
+						return false;
+					}
+					m_recv_start += 14 + pad_len;
+					write_handshake();
+					m_state = read_handshake;
+					return true;
+				}
+#endif
+				case read_handshake:
+				{
+					if (available() < 68) return false;
+					if (std::memcmp(ptr + 28, &m_ti.info_hash()[0], 20) != 0)
+					{
+						close("ERROR: %s", error_code(errors::invalid_info_hash));
+						return false;
+					}
+					m_recv_start += 68;
+					m_state = read_message;
+					return true;
+				}
+				case read_message:
+				{
+					if (available() < 4) return false;
+					int const len = read_int32(ptr);
+					if (len < 0 || len + 4 > int(m_recv.size()))
+					{
+						close("ERROR: %s", error_code(errors::packet_too_large));
+						return false;
+					}
+					if (available() < 4 + len) return false;
+					m_recv_start += 4 + len;
+					if (len > 0) on_message(ptr, len);
+					return true;
+				}
+				default:
+					return false;
+			}
+		}
+
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		// sends hash('req1', S), hash('req2', SKEY) xor hash('req3', S) and
+		// the encrypted vc, crypto_provide, len(pad) and len(IA). The
+		// bittorrent handshake is sent once the responder has selected rc4
+		void write_pe_request()
+		{
+			char const* secret = m_dh->get_secret();
+			sha1_hash const& info_hash = m_ti.info_hash();
+
+			hasher h;
+			h.update("req1", 4);
+			h.update(secret, 96);
+			sha1_hash const sync_hash = h.final();
+
+			h.reset();
+			h.update("req2", 4);
+			h.update((char const*)&info_hash[0], 20);
+			sha1_hash obfuscated_hash = h.final();
+
+			h.reset();
+			h.update("req3", 4);
+			h.update(secret, 96);
+			obfuscated_hash ^= h.final();
+
+			send((char const*)&sync_hash[0], 20);
+			send((char const*)&obfuscated_hash[0], 20);
+
+			h.reset();
+			h.update("keyA", 4);
+			h.update(secret, 96);
+			h.update((char const*)&info_hash[0], 20);
+			sha1_hash const local_key = h.final();
+
+			h.reset();
+			h.update("keyB", 4);
+			h.update(secret, 96);
+			h.update((char const*)&info_hash[0], 20);
+			sha1_hash const remote_key = h.final();
+
+			m_rc4.reset(new rc4_handler);
+			m_rc4->set_outgoing_key(&local_key[0], 20);
+			m_rc4->set_incoming_key(&remote_key[0], 20);
+
+			// the verification constant is 8 zero bytes, so its encrypted
+			// form is the first 8 bytes of the incoming key stream
+			rc4_handler vc;
+			vc.set_incoming_key(&remote_key[0], 20);
+			std::memset(m_sync_vc, 0, 8);
+			vc.decrypt(m_sync_vc, 8);
+
+			char msg[8 + 4 + 2 + 2];
+			char* ptr = msg;
+			std::memset(ptr, 0, 8);
+			ptr += 8;
+			write_uint32(settings_pack::pe_rc4, ptr);
+			write_uint16(0, ptr); // len(pad)
+			write_uint16(0, ptr); // len(IA)
+			send(msg, sizeof(msg));
+
+			m_dh.reset();
+		}
+#endif
+
+		void on_message(char const* ptr, int len)
+		{
+			int const msg = read_uint8(ptr);
+			switch (msg)
+			{
+				case 0: // choke
+					// without the fast extension, all outstanding requests
+					// are implicitly rejected
+					m_choked = true;
+					m_requests.clear();
+					break;
+				case 1: // unchoke
+					m_choked = false;
+					write_requests();
+					break;
+				case 7: // piece
+				{
+					if (len < 9) break;
+					int const piece = read_int32(ptr);
+					int const start = read_int32(ptr);
+					std::deque<request_t>::iterator i = m_requests.begin();
+					for (; i != m_requests.end(); ++i)
+						if (i->piece == piece && i->start == start) break;
+					if (i == m_requests.end()) break;
+					request_latency.push_back(boost::uint32_t(
+						total_microseconds(time_now_hires() - i->sent)));
+					total_payload += len - 9;
+					m_requests.erase(i);
+					write_requests();
+					break;
+				}
+				default:
+					// have, bitfield, extension messages etc. are not
+					// interesting. The seed has everything
+					break;
+			}
+		}
+
+		void write_requests()
+		{
+			if (m_choked) return;
+			ptime const now = time_now_hires();
+			char buf[17];
+			while (int(m_requests.size()) < m_cfg.queue_depth)
+			{
+				int const piece_size = m_ti.piece_size(m_piece);
+				request_t r;
+				r.piece = m_piece;
+				r.start = m_block * block_size;
+				r.length = (std::min)(block_size, piece_size - r.start);
+				r.sent = now;
+				m_requests.push_back(r);
+				++total_requests;
+
+				char* ptr = buf;
+				write_uint32(13, ptr);
+				write_uint8(6, ptr);
+				write_uint32(r.piece, ptr);
+				write_uint32(r.start, ptr);
+				write_uint32(r.length, ptr);
+				send(buf, sizeof(buf));
+
+				++m_block;
+				if (m_block * block_size >= piece_size)
+				{
+					m_block = 0;
+					m_piece = (m_piece + 1) % m_ti.num_pieces();
+				}
+			}
+		}
+
+		tcp::socket m_socket;
+		swarm_config const& m_cfg;
+		torrent_info const& m_ti;
+		tcp::endpoint m_endpoint;
+
+		std::vector<char> m_recv;
+		int m_recv_start;
+		int m_recv_end;
+
+		// bytes waiting for the current write to complete
+		std::vector<char> m_send;
+		// the bytes currently being written
+		std::vector<char> m_sending;
+		bool m_writing;
+
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		boost::scoped_ptr<dh_key_exchange> m_dh;
+		boost::scoped_ptr<rc4_handler> m_rc4;
+		char m_sync_vc[8];
+#endif
+
+		int m_state;
+		bool m_choked;
+		bool m_closed;
+		std::deque<request_t> m_requests;
+		int m_piece;
+		int m_block;
+	};
+
+	double thread_cpu_time()
+	{
+#if !defined _WIN32 && defined CLOCK_THREAD_CPUTIME_ID
+		timespec ts;
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+			return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+		return 0.0;
+	}
+
+	double process_cpu_time()
+	{
+#ifndef _WIN32
+		rusage ru;
+		if (getrusage(RUSAGE_SELF, &ru) == 0)
+		{
+			return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0
+				+ ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0;
+		}
+#endif
+		return 0.0;
+	}
+
+	// peak resident set size, in kiB
+	boost::int64_t peak_memory()
+	{
+#ifndef _WIN32
+		rusage ru;
+		if (getrusage(RUSAGE_SELF, &ru) == 0)
+		{
+#ifdef __APPLE__
+			return ru.ru_maxrss / 1024;
+#else
+			return ru.ru_maxrss;
+#endif
+		}
+#endif
+		return -1;
+	}
+
+	double peer_cpu_time = 0.0;
+
+	void run_peers(io_service* ios, swarm_config const* cfg
+		, torrent_info const* ti, tcp::endpoint ep, ptime* start, ptime* end)
+	{
+		std::vector<boost::shared_ptr<sim_peer> > peers;
+		for (int i = 0; i < cfg->num_peers; ++i)
+		{
+			peers.push_back(boost::shared_ptr<sim_peer>(new sim_peer(*ios, *cfg, *ti, ep)));
+			peers.back()->start();
+		}
+
+		deadline_timer timer(*ios);
+		timer.expires_from_now(seconds(cfg->duration));
+		timer.async_wait(boost::bind(&io_service::stop, ios));
+
+		*start = time_now_hires();
+		ios->run();
+		*end = time_now_hires();
+
+		for (int i = 0; i < int(peers.size()); ++i)
+			peers[i]->close(0, error_code());
+		peer_cpu_time = thread_cpu_time();
+	}
+
+	int create_data(swarm_config const& cfg, std::string& buf)
+	{
+		boost::int64_t const size = boost::int64_t(cfg.torrent_size) * 1024 * 1024;
+		std::string const path = complete(cfg.data_path);
+		std::string const filename = combine_path(path, "data");
+
+#ifndef _WIN32
+		mkdir(path.c_str(), 0777);
+#endif
+		FILE* f = fopen(filename.c_str(), "rb");
+		boost::int64_t existing = 0;
+		if (f)
+		{
+			fseek(f, 0, SEEK_END);
+			existing = ftell(f);
+			fclose(f);
+		}
+
+		if (existing != size)
+		{
+			f = fopen(filename.c_str(), "wb+");
+			if (f == 0)
+			{
+				fprintf(stderr, "failed to create \"%s\": %s\n", filename.c_str(), strerror(errno));
+				return 1;
+			}
+			std::vector<char> block(block_size);
+			for (boost::int64_t i = 0; i < size; i += block_size)
+			{
+				std::generate(block.begin(), block.end(), &rand);
+				int const len = int((std::min)(boost::int64_t(block_size), size - i));
+				fwrite(&block[0], 1, len, f);
+			}
+			fclose(f);
+		}
+
+		file_storage fs;
+		fs.add_file(combine_path(libtorrent::filename(path), "data"), size);
+		create_torrent t(fs, cfg.piece_size);
+		error_code ec;
+		set_piece_hashes(t, parent_path(path), ec);
+		if (ec)
+		{
+			fprintf(stderr, "failed to hash \"%s\": %s\n", filename.c_str(), ec.message().c_str());
+			return 1;
+		}
+		bencode(std::back_inserter(buf), t.generate());
+		return 0;
+	}
+}
+
+void print_usage()
+{
+	fprintf(stderr, "usage: swarm_benchmark [options]\n\n"
+		"runs a seeding session and a number of simulated downloading\n"
+		"peers in the same process, over the loopback interface, and\n"
+		"prints the results as a JSON object.\n\n"
+		"options:\n"
+		"-c <num>     the number of simulated peers (default 20)\n"
+		"-p <size>    piece size in kiB (default 256)\n"
+		"-s <size>    size of the torrent in MiB (default 256)\n"
+		"-m <blocks>  disk cache size in 16 kiB blocks\n"
+		"             (default is the session default)\n"
+		"-q <num>     outstanding requests per peer (default 64)\n"
+		"-t <sec>     duration of the run (default 20)\n"
+		"-P <port>    the port the session listens on (default 48200)\n"
+		"-d <path>    directory to put the test data in\n"
+		"             (default swarm_benchmark_data)\n"
+		"-o <file>    write the results to <file> instead of stdout\n"
+		"-e           use encrypted connections (rc4)\n"
+		"-H           start from the high_performance_seed() settings\n");
+	exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+	swarm_config cfg;
+
+	++argv;
+	--argc;
+
+	while (argc > 0)
+	{
+		char const* optname = argv[0];
+		++argv;
+		--argc;
+
+		if (optname[0] != '-' || strlen(optname) != 2) print_usage();
+
+		// options with no arguments
+		switch (optname[1])
+		{
+			case 'e': cfg.encryption = true; continue;
+			case 'H': cfg.high_performance = true; continue;
+			case 'h': print_usage();
+		}
+
+		if (argc == 0)
+		{
+			fprintf(stderr, "missing argument for option: %s\n", optname);
+			print_usage();
+		}
+
+		char const* optarg = argv[0];
+		++argv;
+		--argc;
+
+		switch (optname[1])
+		{
+			case 'c': cfg.num_peers = atoi(optarg); break;
+			case 'p': cfg.piece_size = atoi(optarg) * 1024; break;
+			case 's': cfg.torrent_size = atoi(optarg); break;
+			case 'm': cfg.cache_size = atoi(optarg); break;
+			case 'q': cfg.queue_depth = atoi(optarg); break;
+			case 't': cfg.duration = atoi(optarg); break;
+			case 'P': cfg.port = atoi(optarg); break;
+			case 'd': cfg.data_path = optarg; break;
+			case 'o': cfg.output = optarg; break;
+			default:
+				fprintf(stderr, "unknown option: %s\n", optname);
+				print_usage();
+		}
+	}
+
+	if (cfg.num_peers <= 0 || cfg.torrent_size <= 0 || cfg.queue_depth <= 0
+		|| cfg.duration <= 0 || cfg.piece_size < block_size
+		|| (cfg.piece_size % block_size) != 0)
+	{
+		fprintf(stderr, "invalid arguments\n");
+		print_usage();
+	}
+
+#ifdef TORRENT_DISABLE_ENCRYPTION
+	if (cfg.encryption)
+	{
+		fprintf(stderr, "libtorrent was built without encryption support\n");
+		return 1;
+	}
+#endif
+
+	std::string torrent_buf;
+	if (create_data(cfg, torrent_buf) != 0) return 1;
+
+	error_code ec;
+	torrent_info ti(&torrent_buf[0], torrent_buf.size(), ec);
+	if (ec)
+	{
+		fprintf(stderr, "failed to load torrent: %s\n", ec.message().c_str());
+		return 1;
+	}
+
+	settings_pack pack;
+	if (cfg.high_performance) high_performance_seed(pack);
+	char iface[100];
+	snprintf(iface, sizeof(iface), "127.0.0.1:%d", cfg.port);
+	pack.set_str(settings_pack::listen_interfaces, iface);
+	pack.set_int(settings_pack::max_retry_port_bind, 100);
+	pack.set_int(settings_pack::alert_mask, alert::error_notification);
+	pack.set_bool(settings_pack::allow_multiple_connections_per_ip, true);
+	pack.set_int(settings_pack::connections_limit, cfg.num_peers + 10);
+	pack.set_int(settings_pack::unchoke_slots_limit, -1);
+	if (cfg.cache_size >= 0)
+		pack.set_int(settings_pack::cache_size, cfg.cache_size);
+	pack.set_int(settings_pack::in_enc_policy, cfg.encryption
+		? settings_pack::pe_forced : settings_pack::pe_enabled);
+	pack.set_int(settings_pack::allowed_enc_level, settings_pack::pe_rc4);
+
+	double const cpu_start = process_cpu_time();
+
+	session ses(pack, fingerprint("LT", LIBTORRENT_VERSION_MAJOR
+		, LIBTORRENT_VERSION_MINOR, 0, 0), 0);
+
+	add_torrent_params p;
+	p.ti = boost::make_shared<torrent_info>(ti);
+	p.save_path = parent_path(complete(cfg.data_path));
+	p.flags = add_torrent_params::flag_seed_mode;
+	torrent_handle h = ses.add_torrent(p, ec);
+	if (ec)
+	{
+		fprintf(stderr, "failed to add torrent: %s\n", ec.message().c_str());
+		return 1;
+	}
+
+	int const port = ses.listen_port();
+	if (port == 0)
+	{
+		fprintf(stderr, "session failed to listen\n");
+		return 1;
+	}
+
+	io_service ios;
+	ptime start;
+	ptime end;
+	thread peers(boost::bind(&run_peers, &ios, &cfg, &ti
+		, tcp::endpoint(address_v4::loopback(), port), &start, &end));
+	peers.join();
+
+	double const cpu_total = process_cpu_time() - cpu_start;
+	// the simulated peers run in this process too. Their CPU time is
+	// not attributed to the session
+	double const session_cpu = (std::max)(0.0, cpu_total - peer_cpu_time);
+	double const elapsed = total_microseconds(end - start) / 1000000.0;
+	double const gigabytes = total_payload / double(1024 * 1024 * 1024);
+
+	boost::uint32_t p50 = 0;
+	boost::uint32_t p99 = 0;
+	if (!request_latency.empty())
+	{
+		std::vector<boost::uint32_t>::iterator i = request_latency.begin()
+			+ request_latency.size() / 2;
+		std::nth_element(request_latency.begin(), i, request_latency.end());
+		p50 = *i;
+		i = request_latency.begin() + request_latency.size() * 99 / 100;
+		std::nth_element(request_latency.begin(), i, request_latency.end());
+		p99 = *i;
+	}
+
+	FILE* out = stdout;
+	if (cfg.output)
+	{
+		out = fopen(cfg.output, "w+");
+		if (out == 0)
+		{
+			fprintf(stderr, "failed to open \"%s\": %s\n", cfg.output, strerror(errno));
+			return 1;
+		}
+	}
+
+	fprintf(out, "{\n"
+		"\t\"version\": \"%s\",\n"
+		"\t\"peers\": %d,\n"
+		"\t\"failed_peers\": %d,\n"
+		"\t\"piece_size\": %d,\n"
+		"\t\"torrent_size\": %" PRId64 ",\n"
+		"\t\"cache_size\": %d,\n"
+		"\t\"queue_depth\": %d,\n"
+		"\t\"encryption\": %s,\n"
+		"\t\"duration\": %.3f,\n"
+		"\t\"payload_bytes\": %" PRId64 ",\n"
+		"\t\"requests\": %" PRId64 ",\n"
+		"\t\"throughput\": %.0f,\n"
+		"\t\"session_cpu_seconds\": %.3f,\n"
+		"\t\"peers_cpu_seconds\": %.3f,\n"
+		"\t\"cpu_seconds_per_gb\": %.3f,\n"
+		"\t\"request_latency_p50_us\": %u,\n"
+		"\t\"request_latency_p99_us\": %u,\n"
+		"\t\"peak_memory_kib\": %" PRId64 "\n"
+		"}\n"
+		, LIBTORRENT_VERSION
+		, cfg.num_peers
+		, num_failed_peers
+		, cfg.piece_size
+		, ti.total_size()
+		, cfg.cache_size
+		, cfg.queue_depth
+		, cfg.encryption ? "true" : "false"
+		, elapsed
+		, total_payload
+		, total_requests
+		, elapsed > 0.0 ? total_payload / elapsed : 0.0
+		, session_cpu
+		, peer_cpu_time
+		, gigabytes > 0.0 ? session_cpu / gigabytes : 0.0
+		, p50
+		, p99
+		, peak_memory());
+
+	if (out != stdout) fclose(out);
+	return 0;
+}
+
@@ -36,10 +36,13 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/config.hpp"
 #include "libtorrent/alert.hpp"
 #include "libtorrent/thread.hpp"
+#include "libtorrent/object_arena.hpp"
 
 #include <boost/function/function1.hpp>
 #include <boost/shared_ptr.hpp>
 #include <list>
+#include <vector>
+#include <deque>
 
 namespace libtorrent {
 
@@ -54,17 +57,52 @@ namespace libtorrent {
 			, boost::uint32_t alert_mask = alert::error_notification);
 		~alert_manager();
 
+		// copies the alert into the alert arena of the current generation.
+		// T must be the most derived type of the alert. When the static
+		// type isn't known, the non-template overload is used, which
+		// heap allocates a clone instead. If the client pops alerts with
+		// one of the interfaces that hand out owned alerts, the copy is
+		// heap allocated up-front, so it can be handed out as-is
+		template <class T>
+		void post_alert(T const& alert_)
+		{
+			TORRENT_ASSERT(alert_.type() == T::alert_type);
+			notify_extensions(&alert_);
+
+			mutex::scoped_lock lock(m_mutex);
+			if (!prepare_post(alert_, 0, lock)) return;
+			if (m_owned_alerts)
+				post_impl(new T(alert_), true, lock);
+			else
+				post_impl(m_generations[m_generation].arena.construct_copy(alert_), false, lock);
+		}
+
 		void post_alert(const alert& alert_);
 		void post_alert_ptr(alert* alert_);
 		bool pending() const;
+
+		// these return the queued alerts, owned by the caller. Once
+		// these are used, alerts are heap allocated when they're posted
+		// and handed out without another copy
 		std::auto_ptr<alert> get(int& num_resume);
 		void get_all(std::deque<alert*>* alerts, int& num_resume);
 
+		// returns pointers to the queued alerts without copying them. They
+		// are owned by the alert_manager and stay valid until the next call
+		// to this function or to get(). If ``alerts`` is reused between
+		// calls, this doesn't allocate any memory
+		void get_all(std::vector<alert*>* alerts, int& num_resume);
+
+		// the number of alerts held by the alert_manager, including the
+		// ones that have been handed out by get_all(std::vector*) and the
+		// ones popped by get() that haven't been reclaimed yet
+		int num_held_alerts() const;
+
 		template <class T>
 		bool should_post() const
 		{
 			mutex::scoped_lock lock(m_mutex);
-			if (m_alerts.size() >= m_queue_size_limit) return false;
+			if (queue_size() >= m_queue_size_limit) return false;
 			return (m_alert_mask & T::static_category) != 0;
 		}
 
@@ -95,9 +133,69 @@ namespace libtorrent {
 #endif
 
 	private:
-		void post_impl(std::auto_ptr<alert>& alert_, mutex::scoped_lock& l);
 
-		std::deque<alert*> m_alerts;
+		void notify_extensions(alert const* a);
+
+		// returns false if the alert should not be queued, either because
+		// it was handed to the dispatch function or because the queue is
+		// full. m_mutex must be held
+		// if ``owned`` is set, it's a heap allocated copy of ``a`` that
+		// is handed to the dispatch function instead of another clone
+		bool prepare_post(alert const& a, std::auto_ptr<alert>* owned
+			, mutex::scoped_lock& l);
+		void post_impl(alert* a, bool heap, mutex::scoped_lock& l);
+
+		// the number of alerts in the current generation that haven't
+		// been popped yet. m_mutex must be held
+		size_t queue_size() const
+		{ return m_generations[m_generation].alerts.size() - m_popped; }
+
+		// destructs all alerts in the given generation and frees up its
+		// arena for new alerts. m_mutex must be held
+		void clear_generation(int gen);
+
+		// takes the alert at index ``i`` of the current generation out of
+		// the alert_manager. Alerts that are heap allocated are released
+		// as-is, the ones in the arena are cloned. m_mutex must be held
+		alert* release_alert(size_t i);
+
+		// when alerts are popped one at a time by get(), and the queue
+		// is never drained completely, the popped alerts would pile
+		// up in the current generation. Once they make up more than
+		// half of it, the remaining alerts are moved to the other
+		// generation and this one is cleared. m_mutex must be held
+		void maybe_rotate();
+
+		// alerts are constructed into one of two generations. New alerts
+		// are posted to m_generations[m_generation]. get_all(std::vector*)
+		// hands that generation to the caller, flips m_generation and
+		// clears the other generation, i.e. the one handed out by the
+		// previous call. This way the client can read alerts without
+		// copying them while the network thread is posting new ones
+		struct generation_t
+		{
+			object_arena arena;
+			// the alerts, in the order they were posted
+			std::vector<alert*> alerts;
+			// for each entry in alerts, whether it's heap allocated
+			// (and deleted by clear_generation()) rather than constructed
+			// in the arena. Alerts that have been released to the client
+			// are set to 0 in alerts
+			std::vector<bool> heap;
+		};
+		generation_t m_generations[2];
+		int m_generation;
+
+		// the number of alerts at the front of the current generation
+		// that have already been popped, one at a time, by get()
+		size_t m_popped;
+
+		// set when the client pops alerts by get(), get_all(std::deque*)
+		// or a dispatch function, all of which take ownership of the
+		// alerts. While set, new alerts are heap allocated rather than
+		// constructed in the arena, to not have to clone them again
+		bool m_owned_alerts;
+
 		mutable mutex m_mutex;
 		condition_variable m_condition;
 		boost::uint32_t m_alert_mask;
@@ -42,6 +42,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/address.hpp"
 #include "libtorrent/stat.hpp"
 #include "libtorrent/rss.hpp" // for feed_handle
+#include "libtorrent/status_delta.hpp"
 
 namespace libtorrent
 {
@@ -1025,6 +1026,12 @@ namespace libtorrent
 			: torrent_alert(h)
 			, resume_data(rd)
 		{}
+
+		// internal
+		save_resume_data_alert(std::vector<char>& buf
+			, torrent_handle const& h)
+			: torrent_alert(h)
+		{ resume_buffer.swap(buf); }
 	
 		TORRENT_DEFINE_ALERT(save_resume_data_alert, 37);
 
@@ -1033,8 +1040,13 @@ namespace libtorrent
 		{ return torrent_alert::message() + " resume data generated"; }
 		virtual bool discardable() const { return false; }
 
-		// points to the resume data.
+		// points to the resume data. This is null if the resume data was
+		// requested with the torrent_handle::save_bencoded flag.
 		boost::shared_ptr<entry> resume_data;
+
+		// the bencoded resume data, if it was requested with the
+		// torrent_handle::save_bencoded flag. Otherwise empty.
+		std::vector<char> resume_buffer;
 	};
 
 	// This alert is generated instead of ``save_resume_data_alert`` if there was an error
@@ -1955,6 +1967,13 @@ namespace libtorrent
 		//
 		// For more information, see the session-statistics_ section.
 		std::vector<boost::uint64_t> values;
+
+		// the change of each metric since the previous session_stats_alert
+		// was posted (or since the session was started, for the first one),
+		// indexed the same way as ``values``. For gauges, this is how much
+		// the gauge moved, which may be negative. Dividing by the time
+		// between the two alerts' ``timestamp`` gives a rate.
+		std::vector<boost::int64_t> deltas;
 	};
 
 	// When a torrent changes its info-hash, this alert is posted. This only happens in very
@@ -2172,9 +2191,121 @@ namespace libtorrent
 		udp::endpoint ip;
 	};
 
+	// This alert is only posted when requested by the user, by calling
+	// session::post_torrent_deltas(). It is a compact alternative to
+	// state_update_alert. Instead of full torrent_status objects, it holds
+	// the fields the client subscribed to, for the torrents where any of
+	// those fields changed. Only the fields that changed are included. Use
+	// status_delta_reader to iterate over the records in ``buffer``.
+	struct TORRENT_EXPORT state_delta_alert : alert
+	{
+		state_delta_alert(): num_torrents(0) {}
+
+		TORRENT_DEFINE_ALERT(state_delta_alert, 79);
+
+		const static int static_category = alert::status_notification;
+		virtual std::string message() const;
+		virtual bool discardable() const { return false; }
+
+		// the records, one per torrent, in the format described by
+		// status_delta.hpp
+		std::vector<char> buffer;
+
+		// the number of records in ``buffer``
+		int num_torrents;
+	};
+
+	// This alert is posted when requested by the user, by calling
+	// session::post_latency_histograms(). It holds the latency histograms
+	// of disk jobs and peer requests, since the session started. The same
+	// numbers are available as counters in session_stats_alert, this alert
+	// is a convenience for clients that only care about latencies.
+	struct TORRENT_EXPORT latency_histogram_alert : alert
+	{
+		latency_histogram_alert(): timestamp(0) {}
+		TORRENT_DEFINE_ALERT(latency_histogram_alert, 80);
+
+		const static int static_category = alert::stats_notification;
+		virtual std::string message() const;
+		virtual bool discardable() const { return false; }
+
+		enum histogram_t
+		{
+			// the time it took to perform disk jobs, by kind
+			disk_read,
+			disk_write,
+			disk_hash,
+			disk_other,
+
+			// the time disk jobs waited before a disk thread picked them up
+			disk_queue,
+
+			// the time from receiving a request from a peer until the
+			// piece was put in the send buffer
+			peer_request,
+
+			num_histograms
+		};
+
+		// bucket ``i`` counts the samples that took less than 2^(i + 3)
+		// microseconds, and at least 2^(i + 2). The first bucket also
+		// counts everything faster, the last everything slower.
+		enum { num_buckets = 22 };
+
+		// returns an estimate of the latency at the percentile ``ppm`` (in
+		// parts per million) of ``histogram``, in microseconds. For
+		// instance, percentile(disk_read, 990000) is p99 of disk reads.
+		boost::int64_t percentile(int histogram, int ppm) const;
+
+		// the number of microseconds since the session was started, when
+		// the histograms were sampled
+		boost::uint64_t timestamp;
+
+		boost::uint64_t buckets[num_histograms][num_buckets];
+	};
+
+	// This alert is posted every settings_pack::top_torrents_interval
+	// seconds, when that is set. It lists the torrents that used the most
+	// network thread cpu time during the interval, and the torrents that
+	// have the most blocks in the disk cache. The cpu times are estimated
+	// by sampling, see settings_pack::cpu_sample_rate.
+	struct TORRENT_EXPORT top_torrents_alert : alert
+	{
+		top_torrents_alert(): interval(0) {}
+		TORRENT_DEFINE_ALERT(top_torrents_alert, 81);
+
+		const static int static_category = alert::stats_notification;
+		virtual std::string message() const;
+
+		struct torrent_usage
+		{
+			torrent_handle handle;
+
+			// the estimated number of microseconds of cpu time this torrent
+			// used during the interval
+			boost::int64_t cpu_time;
+
+			// the number of blocks this torrent has in the disk cache
+			int cached_blocks;
+		};
+
+		// at most settings_pack::top_torrents_count torrents, with the one
+		// that used the most cpu time first. Torrents that used no cpu time
+		// are not included
+		std::vector<torrent_usage> cpu;
+
+		// at most settings_pack::top_torrents_count torrents, with the one
+		// with the most blocks in the cache first. Torrents without any
+		// blocks in the cache are not included
+		std::vector<torrent_usage> cache;
+
+		// the number of seconds the cpu times were accumulated over
+		int interval;
+	};
+
 #undef TORRENT_DEFINE_ALERT
 
-	enum { num_alert_types = 79 };
+	enum { num_alert_types = 82 };
 }
 
 
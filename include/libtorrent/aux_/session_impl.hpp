@@ -46,6 +46,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/linked_list.hpp"
 #include "libtorrent/torrent_peer.hpp"
 #include "libtorrent/torrent_peer_allocator.hpp"
+#include "libtorrent/allocator.hpp" // for page_aligned_allocator
 #include "libtorrent/performance_counters.hpp" // for counters
 
 #ifdef _MSC_VER
@@ -114,6 +115,7 @@ namespace libtorrent
 	class lsd;
 	struct fingerprint;
 	class torrent;
+	struct status_snapshot_entry;
 	class alert;
 	struct cache_info;
 
@@ -424,13 +426,18 @@ namespace libtorrent
 			void refresh_torrent_status(std::vector<torrent_status>* ret
 				, boost::uint32_t flags) const;
 			void post_torrent_updates();
+			void post_torrent_deltas(boost::uint32_t fields);
 			void post_session_stats();
+			void post_latency_histograms();
+			void apply_torrent_operations(std::vector<torrent_operation> const* ops
+				, std::vector<error_code>* ret);
 
 			std::vector<torrent_handle> get_torrents() const;
 			
 			size_t set_alert_queue_size_limit(size_t queue_size_limit_);
 			std::auto_ptr<alert> pop_alert();
 			void pop_alerts(std::deque<alert*>* alerts);
+			void pop_alerts(std::vector<alert*>* alerts);
 			void set_alert_dispatch(boost::function<void(std::auto_ptr<alert>)> const&);
 			void post_alert(const alert& alert_);
 
@@ -554,6 +561,26 @@ namespace libtorrent
 
 			void deferred_submit_jobs();
 
+			int sample_cpu(int category);
+			void post_top_torrents();
+
+			// publishes a new status snapshot for the torrents whose state
+			// changed since the last one, or for all torrents if ``all`` is
+			// true
+			void publish_status_snapshots(bool all = false);
+			void invalidate_status_snapshot();
+
+			// these serve the corresponding session calls from the latest
+			// status snapshot. They may be called from any thread, and return
+			// false if there is no snapshot to use, or if it wasn't built with
+			// all of ``flags``
+			bool get_torrent_status_snapshot(std::vector<torrent_status>* ret
+				, boost::function<bool(torrent_status const&)> const& pred
+				, boost::uint32_t flags) const;
+			bool refresh_torrent_status_snapshot(std::vector<torrent_status>* ret
+				, boost::uint32_t flags) const;
+			bool get_torrents_snapshot(std::vector<torrent_handle>& ret) const;
+
 			char* allocate_buffer();
 			torrent_peer* allocate_peer_entry(int type);
 			void free_peer_entry(torrent_peer* p);
@@ -641,6 +668,7 @@ namespace libtorrent
 			void update_listen_interfaces();
 			void update_privileged_ports();
 			void update_auto_sequential();
+			void update_status_snapshots();
 
 			void update_upnp();
 			void update_natpmp();
@@ -673,6 +701,10 @@ namespace libtorrent
 
 			counters m_stats_counters;
 
+			// the counter values as of the last post_session_stats() call.
+			// The change since then is reported in session_stats_alert::deltas
+			boost::int64_t m_last_stats_counters[counters::num_counters];
+
 			// this is a pool allocator for torrent_peer objects
 			torrent_peer_allocator m_peer_allocator;
 
@@ -683,8 +715,12 @@ namespace libtorrent
 
 #ifndef TORRENT_DISABLE_POOL_ALLOCATOR
 			// this pool is used to allocate and recycle send
-			// buffers from.
-			boost::pool<> m_send_buffers;
+			// buffers from. The pool's blocks are page aligned, and
+			// since send_buffer_size_impl is a multiple of the cache
+			// line size, so is every buffer handed out from it. This
+			// keeps a send buffer chunk from ever sharing a cache line
+			// with another one
+			boost::pool<page_aligned_allocator> m_send_buffers;
 #endif
 
 			// this is where all active sockets are stored.
@@ -1117,6 +1153,28 @@ namespace libtorrent
 			// accumulated error
 			boost::uint16_t m_tick_residual;
 
+			// counts down the operations until the next one is timed, for
+			// the per-torrent cpu accounting, one per torrent::cpu_category_t.
+			// Operations of one category are often nested in the ones of
+			// another, with a shared countdown they would take turns using up
+			// the samples. See settings_pack::cpu_sample_rate
+			int m_cpu_sample_countdown[3];
+
+			// the number of seconds until the next top_torrents_alert is posted
+			int m_top_torrents_time_scaler;
+
+			// the number of seconds until the next status snapshot is
+			// published
+			int m_status_snapshot_time_scaler;
+
+			// the status of every torrent in the session, published by
+			// publish_status_snapshots(). It's read by other threads and must
+			// only be accessed with boost::atomic_load() and
+			// boost::atomic_store(). It's reset whenever a torrent is added or
+			// removed, so that it never holds a stale set of torrents
+			typedef std::vector<boost::shared_ptr<status_snapshot_entry const> > status_snapshot_t;
+			boost::shared_ptr<status_snapshot_t const> m_status_snapshot;
+
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
 			virtual boost::shared_ptr<logger> create_log(std::string const& name
 				, int instance, bool append = true);
@@ -179,6 +179,13 @@ namespace libtorrent { namespace aux
 
 		virtual void deferred_submit_jobs() = 0;
 
+		// returns the cpu sample rate if the next operation of ``category``
+		// (a torrent::cpu_category_t) should be timed for per-torrent cpu
+		// accounting, and 0 otherwise. The time of a timed operation is
+		// multiplied by the returned rate, to estimate the total time of
+		// all operations of that category
+		virtual int sample_cpu(int category) = 0;
+
 		virtual boost::uint16_t listen_port() const = 0;
 		virtual boost::uint16_t ssl_listen_port() const = 0;
 
@@ -259,6 +266,10 @@ namespace libtorrent { namespace aux
 			// torrents that want auto-scrape (only paused auto-managed ones)
 			torrent_want_scrape,
 
+			// torrents that have changed their states since the last status
+			// snapshot was published. See settings_pack::status_snapshot_interval
+			torrent_snapshot_updates,
+
 			// all torrents that have resume data to save
 //			torrent_want_save_resume,
 
@@ -77,10 +77,17 @@ struct TORRENT_EXTRA_EXPORT bandwidth_channel
 		return false;
 	}
 
-	// used as temporary storage while distributing
-	// bandwidth
+	// the sum of the priorities of all requests currently queued
+	// in the bandwidth_manager on this channel. This is maintained
+	// incrementally as requests are queued and dispatched, and is
+	// used to split distribute_quota proportionally
 	int tmp;
 
+	// the position of this channel in the bandwidth_manager's list
+	// of channels with queued requests, or -1 if it has none. Only
+	// those channels have their quota refilled on each tick
+	int active_index;
+
 	// this is the number of bytes to distribute this round
 	int distribute_quota;
 
@@ -34,6 +34,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_BANDWIDTH_MANAGER_HPP_INCLUDED
 
 #include <boost/shared_ptr.hpp>
+#include <vector>
+#include <deque>
+#include <map>
 
 #ifdef TORRENT_VERBOSE_BANDWIDTH_LIMIT
 #include <fstream>
@@ -82,11 +85,127 @@ struct TORRENT_EXTRA_EXPORT bandwidth_manager
 
 	void update_quotas(time_duration const& dt);
 
+	// the number of bandwidth channels that currently have
+	// requests queued on them
+	int num_active_channels() const { return int(m_channels.size()); }
+
+	// the number of distinct sets of bandwidth channels (i.e. of peer
+	// classes) that currently have requests queued on them
+	int num_active_groups() const { return int(m_active_groups.size()); }
+
 private:
 
-	// these are the consumers that want bandwidth
-	typedef std::vector<bw_request> queue_t;
-	queue_t m_queue;
+	// the credit of a group is kept in fractions of a byte per
+	// priority unit, this many bits of them
+	enum { credit_shift = 16 };
+
+	// the set of bandwidth channels a request is queued on, with the
+	// pointers sorted
+	struct group_key
+	{
+		bool operator<(group_key const& k) const;
+		bandwidth_channel* channel[bw_request::max_bandwidth_channels];
+		int num_channels;
+	};
+
+	// a reference to a request from one of the queues of its group. It's
+	// stale if the request's seq has changed since
+	struct request_ref
+	{
+		// for the satisfied heap, the group credit at which the request is
+		// satisfied
+		boost::int64_t credit;
+		int request;
+		boost::uint32_t seq;
+		bool operator<(request_ref const& r) const { return credit > r.credit; }
+	};
+
+	// the requests queued on the same set of bandwidth channels (in
+	// practice, from peers in the same peer classes). Within a group,
+	// every request gets the same share of the bandwidth per priority
+	// unit, so quota is distributed to the groups each tick rather than
+	// to the requests. A request is only visited once it's satisfied or
+	// has waited long enough to be dispatched with what it has
+	struct group_t
+	{
+		group_t();
+
+		group_key key;
+
+		// the sum of the priorities of the requests in this group. 0 means
+		// this group isn't in use
+		int priority;
+
+		// the bytes assigned to each priority unit of the requests in this
+		// group since it was created, in 1 / (1 << credit_shift) of a byte
+		boost::int64_t credit;
+
+		// the credit added in the last tick, or -1 if the group wasn't
+		// limited by any of its channels
+		boost::int64_t share;
+
+		// the position of this group in m_active_groups
+		int active_index;
+
+		// a min-heap of the requests, by the credit at which they're
+		// satisfied, and how many of its entries are stale
+		std::vector<request_ref> satisfied;
+		int num_stale;
+
+		// the requests in the order they were queued, which is also the
+		// order they expire in
+		std::deque<request_ref> expiry;
+	};
+
+	// the number of bytes assigned to the request so far. This is not
+	// capped at its request_size
+	boost::int64_t assigned(bw_request const& r) const;
+
+	// removes the request from the queue and its group and adds its peer
+	// and the bytes it's handed to ``tm``. Any quota assigned to it beyond
+	// that is returned to its channels
+	typedef std::vector<std::pair<boost::shared_ptr<bandwidth_socket>, int> > dispatch_queue_t;
+	void dispatch(int request, int amount, dispatch_queue_t& tm);
+
+	// dispatches the requests of the group that are satisfied or have
+	// expired. Returns false if that emptied the group, which is freed
+	bool update_group(int group, dispatch_queue_t& tm);
+
+	// subtracts the group's credit from the positions of all its requests,
+	// to keep the credit from overflowing
+	void rebase_group(group_t& g);
+
+	int find_group(group_key const& k);
+	void free_group(int group);
+
+	// adds or removes the priority of the request to the
+	// priority sum of each of its channels
+	void add_request_channels(bw_request const& bwr);
+	void remove_request_channels(bw_request const& bwr);
+
+	// these are the consumers that want bandwidth. Slots of dispatched
+	// requests are reused, those are listed in m_free_requests
+	std::vector<bw_request> m_requests;
+	std::vector<int> m_free_requests;
+	int m_num_queued;
+
+	// the groups, by index. Unused ones are listed in m_free_groups
+	std::vector<group_t> m_groups;
+	std::vector<int> m_free_groups;
+	std::vector<int> m_active_groups;
+	std::map<group_key, int> m_group_index;
+
+	// incremented every call to update_quotas()
+	int m_tick;
+
+	// the channels that have at least one request queued on them.
+	// This is the set of token buckets that are refilled every tick,
+	// so the cost of that is proportional to the number of rate
+	// limited peer classes and peers that are actually waiting, not
+	// the total number of channels. A channel is removed as soon as
+	// its last request is dispatched, since its owner may go away
+	// right after that
+	std::vector<bandwidth_channel*> m_channels;
 	// the number of bytes all the requests in queue are for
 	boost::int64_t m_queued_bytes;
 
@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_BANDWIDTH_QUEUE_ENTRY_HPP_INCLUDED
 
 #include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
 #include "libtorrent/bandwidth_limit.hpp"
 #include "libtorrent/bandwidth_socket.hpp"
 
@@ -47,20 +48,25 @@ struct TORRENT_EXTRA_EXPORT bw_request
 	boost::shared_ptr<bandwidth_socket> peer;
 	// 1 is normal prio
 	int priority;
-	// the number of bytes assigned to this request so far
-	int assigned;
-	// once assigned reaches this, we dispatch the request function
+	// once this many bytes are assigned to the request, we dispatch the
+	// request function
 	int request_size;
 
-	// the max number of rounds for this request to survive
-	// this ensures that requests gets responses at very low
-	// rate limits, when the requested size would take a long
-	// time to satisfy
-	int ttl;
-
-	// loops over the bandwidth channels and assigns bandwidth
-	// from the most limiting one
-	int assign_bandwidth();
+	// the bandwidth_manager group this request is queued in, and the group's
+	// credit when it was queued. The bytes assigned to the request so far
+	// are the credit the group has gained since, times the priority
+	int group;
+	boost::int64_t start;
+
+	// the tick in which the request is dispatched with whatever it has been
+	// assigned by then. This ensures that requests gets responses at very
+	// low rate limits, when the requested size would take a long time to
+	// satisfy
+	int expires;
+
+	// incremented every time the bandwidth_manager reuses this request's
+	// slot, to tell stale references to it apart
+	boost::uint32_t seq;
 
 	enum { max_bandwidth_channels = 10 };
 	// we don't actually support more than 10 channels per peer
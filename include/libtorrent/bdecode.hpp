@@ -0,0 +1,322 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_BDECODE_HPP
+#define TORRENT_BDECODE_HPP
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <boost/cstdint.hpp>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/assert.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/lazy_entry.hpp" // for bdecode_errors and pascal_string
+
+namespace libtorrent
+{
+
+namespace detail
+{
+	// internal
+	//
+	// a bdecoded structure is represented as a flat array of these tokens,
+	// one per item, in the order they appear in the buffer. Lists and
+	// dictionaries are followed by their items and an end_of_struct token.
+	// ``next_item`` is the relative index of the next sibling, which lets a
+	// container be skipped over without visiting its children.
+	struct bdecode_token
+	{
+		enum type_t
+		{ none, dict, list, string, integer, end_of_struct };
+
+		// the largest buffer offset a token can refer to
+		enum limits_t
+		{
+			max_offset = (1 << 29) - 1,
+			max_next_item = (1 << 29) - 1,
+			max_header = (1 << 3) - 1
+		};
+
+		bdecode_token(boost::uint32_t off, type_t t)
+			: offset(off)
+			, type(t)
+			, next_item(0)
+			, header(0)
+		{
+			TORRENT_ASSERT(off <= max_offset);
+		}
+
+		bdecode_token(boost::uint32_t off, boost::uint32_t next
+			, type_t t, boost::uint8_t header_size = 0)
+			: offset(off)
+			, type(t)
+			, next_item(next)
+			, header(t == string ? header_size - 2 : header_size)
+		{
+			TORRENT_ASSERT(off <= max_offset);
+			TORRENT_ASSERT(next <= max_next_item);
+			TORRENT_ASSERT(t != string || header_size >= 2);
+		}
+
+		// the offset of the first byte of the string payload, relative to
+		// ``offset``. Only valid for strings
+		int start_offset() const
+		{
+			TORRENT_ASSERT(type == string);
+			return header + 2;
+		}
+
+		// the byte offset into the buffer where this item starts
+		boost::uint32_t offset:29;
+
+		// one of type_t
+		boost::uint32_t type:3;
+
+		// the number of tokens to skip to get to the next item in the
+		// enclosing container. For end_of_struct tokens it's 0
+		boost::uint32_t next_item:29;
+
+		// for strings, the number of bytes of the length prefix and colon,
+		// minus 2. This limits string lengths to 8 decimal digits
+		boost::uint32_t header:3;
+	};
+}
+
+// ``bdecode_node`` is the node type produced by bdecode(). It is a
+// lightweight reference into the token array and the bencoded buffer it
+// was decoded from. It has the same navigation functions as lazy_entry,
+// but returns child nodes by value rather than by pointer. A node that
+// doesn't refer to anything (e.g. the result of a failed ``dict_find()``)
+// has the type ``none_t`` and converts to false.
+//
+// Only the root node, the one passed to bdecode(), owns the token array.
+// All other nodes are invalidated when the root is destroyed or reused.
+// All nodes are invalidated when the underlying buffer is freed.
+struct TORRENT_EXPORT bdecode_node
+{
+	TORRENT_EXPORT friend int bdecode(char const* start, char const* end
+		, bdecode_node& ret, error_code& ec, int* error_pos, int depth_limit
+		, int token_limit);
+
+	// creates a default constructed node, it will have the type ``none_t``.
+	bdecode_node();
+
+	// For owning nodes, the copy will create a copy of the tree, but the
+	// underlying buffer remains the same.
+	bdecode_node(bdecode_node const&);
+	bdecode_node& operator=(bdecode_node const&);
+
+	// the types of bdecoded nodes
+	enum type_t
+	{
+		// uninitialized or default constructed. This is also used
+		// to indicate that a node was not found in some cases.
+		none_t,
+		// a dictionary node. The ``dict_find_`` functions are valid.
+		dict_t,
+		// a list node. The ``list_`` functions are valid.
+		list_t,
+		// a string node, the ``string_`` functions are valid.
+		string_t,
+		// an integer node. The ``int_`` functions are valid.
+		int_t
+	};
+
+	// the type of this node. See type_t.
+	type_t type() const;
+
+	// returns true if type() != none_t.
+	operator bool() const { return type() != none_t; }
+
+	// return a non-owning reference to this node. This is useful to refer
+	// to the root node without copying it in assignments.
+	bdecode_node non_owning() const;
+
+	// returns the buffer and length of the section in the original bencoded
+	// buffer where this node is defined. For a dictionary for instance, this
+	// starts with ``d`` and ends with ``e``, and has all the content of the
+	// dictionary in between.
+	std::pair<char const*, int> data_section() const;
+
+	// functions with the ``list_`` prefix operate on lists. These functions
+	// are only valid if ``type()`` == ``list_t``. ``list_at()`` returns the
+	// item in the list at index ``i``. ``i`` may not be greater than or equal
+	// to the size of the list. ``list_size()`` returns the size of the list.
+	// Walking a list front to back with ``list_at()`` is linear, the last
+	// position looked up is cached.
+	bdecode_node list_at(int i) const;
+	std::string list_string_value_at(int i
+		, char const* default_val = "") const;
+	pascal_string list_pstr_at(int i) const;
+	boost::int64_t list_int_value_at(int i
+		, boost::int64_t default_val = 0) const;
+	int list_size() const;
+
+	// functions with the ``dict_`` prefix operates on dictionaries. They are
+	// only valid if ``type()`` == ``dict_t``. In case a key you're looking up
+	// contains a 0 byte, you cannot use the null-terminated string overloads,
+	// but have to use ``std::string`` instead. ``dict_find_list`` will return
+	// a valid ``bdecode_node`` if the key is found _and_ it is a list.
+	// Otherwise it will return a default-constructed bdecode_node.
+	// 
+	// Functions with the ``_value`` suffix return the value of the node
+	// directly, rather than the nodes. In case the node is not found, or it
+	// has a different type, a default value is returned (which can be
+	// specified).
+	std::pair<std::string, bdecode_node> dict_at(int i) const;
+	bdecode_node dict_find(std::string key) const;
+	bdecode_node dict_find(char const* key) const;
+	bdecode_node dict_find_dict(std::string key) const;
+	bdecode_node dict_find_dict(char const* key) const;
+	bdecode_node dict_find_list(std::string key) const;
+	bdecode_node dict_find_list(char const* key) const;
+	bdecode_node dict_find_string(char const* key) const;
+	bdecode_node dict_find_int(char const* key) const;
+	std::string dict_find_string_value(char const* key
+		, char const* default_value = "") const;
+	pascal_string dict_find_pstr(char const* key) const;
+	boost::int64_t dict_find_int_value(char const* key
+		, boost::int64_t default_val = 0) const;
+	int dict_size() const;
+
+	// this function is only valid if ``type()`` == ``int_t``. It returns the
+	// value of the integer.
+	boost::int64_t int_value() const;
+
+	// these functions are only valid if ``type()`` == ``string_t``. They
+	// return the string values. Note that ``string_ptr()`` is *not*
+	// null-terminated. ``string_length()`` returns the number of bytes in
+	// the string.
+	std::string string_value() const;
+	char const* string_ptr() const;
+	pascal_string string_pstr() const;
+	int string_length() const;
+
+	// resets the ``bdecoded_node`` to a default constructed state. If this
+	// is an owning node, the tree is freed and all child nodes are invalidated.
+	void clear();
+
+	// Swap contents.
+	void swap(bdecode_node& n);
+
+	// preallocate memory for the specified numbers of tokens. This is
+	// useful if you know approximately how many tokens are in the file
+	// you are about to parse. Doing so will save realloc operations
+	// while parsing. You should only call this on the root node, before
+	// passing it in to bdecode().
+	void reserve(int tokens);
+
+	// this buffer *MUST* be identical to the one originally parsed. This
+	// operation is only defined on owning root nodes, i.e. the one passed
+	// in to decode().
+	void switch_underlying_buffer(char const* buf);
+
+private:
+	bdecode_node(detail::bdecode_token const* tokens, char const* buf
+		, int len, int idx);
+
+	// if this is the root node, that owns all the tokens, they live in this
+	// vector. If this is a sub-node, this field is not used, instead the
+	// m_root_tokens pointer points to the root node's token.
+	std::vector<detail::bdecode_token> m_tokens;
+
+	// this points to the root nodes token vector
+	// for the root node, this points to its own m_tokens member
+	detail::bdecode_token const* m_root_tokens;
+
+	// this points to the original buffer that was parsed
+	char const* m_buffer;
+	int m_buffer_size;
+
+	// this is the index into m_root_tokens that this node refers to
+	// for the root node, it's 0. -1 means uninitialized.
+	int m_token_idx;
+
+	// this is a cache of the last element index looked up. This only applies
+	// to lists and dictionaries. If the next item to be looked up is at
+	// index m_last_index + 1, m_last_token is the token of the item at
+	// m_last_index, and it can be found by skipping one item
+	mutable int m_last_index;
+	mutable int m_last_token;
+
+	// the number of elements in this list or dict (computed on the first
+	// call to dict_size() or list_size())
+	mutable int m_size;
+};
+
+// print the bencoded structure in a human-readable format to a string
+// that's returned.
+TORRENT_EXPORT std::string print_entry(bdecode_node const& e
+	, bool single_line = false, int indent = 0);
+
+// This function decodes/parses bdecoded data (for example a .torrent file).
+// The data structure is returned in the ``ret`` argument. The buffer to parse
+// is specified by the ``start`` of the buffer as well as the ``end``, i.e. one
+// byte past the end. If the buffer fails to parse, the function returns a
+// non-zero value and fills in ``ec`` with the error code. The optional
+// argument ``error_pos``, if set to non-null, will be set to the byte offset
+// into the buffer where the parse failure occurred.
+//
+// ``depth_limit`` specifies the max number of nested lists or dictionaries
+// are allowed in the data structure. (This affects the stack usage of the
+// function, be careful not to set it too high).
+//
+// ``token_limit`` is the max number of tokens allowed to be parsed from the
+// buffer. This is simply a sanity check to not have unbounded memory usage.
+//
+// Unlike lazy_bdecode(), which allocates an array for every list and
+// dictionary, the whole structure is stored in a single token array owned by
+// ``ret``. Each token is 8 bytes. When a node is reused for decoding
+// another buffer, its token array is reused too, which makes the decode
+// free of allocations. The buffer may not be larger than 512 MiB, and
+// strings may not be longer than 99999999 bytes.
+//
+// The resulting ``bdecode_node`` is an *owning* node. That means it will
+// be holding the whole parsed tree. When iterating lists and dictionaries,
+// those ``bdecode_node`` objects will simply have references to the root or
+// owning ``bdecode_node``. If the root node is destructed, all other nodes
+// that refer to anything in that tree become invalid.
+//
+// However, the underlying buffer passed in as ``start`` and ``end`` is not
+// copied. All nodes refer to the buffer directly. If the buffer is freed,
+// all the nodes become invalid.
+TORRENT_EXPORT int bdecode(char const* start, char const* end, bdecode_node& ret
+	, error_code& ec, int* error_pos = 0, int depth_limit = 100
+	, int token_limit = 1000000);
+
+}
+
+#endif // TORRENT_BDECODE_HPP
+
@@ -0,0 +1,207 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_BENCODE_WRITER_HPP_INCLUDED
+#define TORRENT_BENCODE_WRITER_HPP_INCLUDED
+
+#include <vector>
+#include <string>
+#include <boost/cstdint.hpp>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/assert.hpp"
+
+namespace libtorrent
+{
+	class entry;
+
+	// bencode_writer encodes a structure directly into a buffer, one item at
+	// a time, without building an entry tree first. Containers are opened
+	// with begin_dict() or begin_list() and closed with end(). Inside a
+	// dictionary every value is preceded by a call to key().
+	//
+	// The encoded bytes are appended to the buffer passed to the
+	// constructor. The buffer is not cleared, and the writer keeps its
+	// internal bookkeeping between messages, so encoding a message with a
+	// reused buffer and writer does not allocate once they have grown to
+	// size.
+	//
+	// Dictionary keys may be written in any order. Bencoding requires them
+	// to be sorted, so when a dictionary whose keys were written out of
+	// order is closed, its items are reordered in place. Writing the keys
+	// in sorted order avoids that extra copy. Keys must be unique.
+	struct TORRENT_EXTRA_EXPORT bencode_writer
+	{
+		explicit bencode_writer(std::vector<char>& buf);
+
+		void begin_dict();
+		void begin_list();
+
+		// closes the innermost open dictionary or list
+		void end();
+
+		// writes a dictionary key. The next item written is its value
+		void key(char const* k);
+		void key(char const* k, int len);
+		void key(std::string const& k);
+
+		void integer(boost::int64_t val);
+		void string(char const* str);
+		void string(char const* str, int len);
+		void string(std::string const& str);
+
+		// appends a value that is already bencoded, such as an info
+		// dictionary
+		void raw(char const* buf, int len);
+
+		// bencodes ``e`` as the next value
+		void value(entry const& e);
+
+		// shortcuts for writing a key followed by its value
+		void int_item(char const* k, boost::int64_t val)
+		{ key(k); integer(val); }
+		void string_item(char const* k, std::string const& str)
+		{ key(k); string(str); }
+		void string_item(char const* k, char const* str, int len)
+		{ key(k); string(str, len); }
+
+		// appends a string header for a string of ``len`` bytes and returns
+		// a pointer to where its ``len`` bytes go. The pointer is only valid
+		// until the next call to the writer
+		char* alloc_string(int len);
+
+		// returns true if every dictionary and list has been closed
+		bool done() const { return m_stack.empty(); }
+
+		// the buffer the writer appends to
+		std::vector<char>& buffer() { return m_buf; }
+
+	private:
+
+		// called before every value, to keep track of dictionary state
+		void prepare_value();
+		void write_header(char type, boost::int64_t val, char delim);
+		void sort_dict(int first_item);
+
+		std::vector<char>& m_buf;
+
+		struct frame
+		{
+			// the index into m_items of this dictionary's first key. -1
+			// for lists
+			int first_item;
+			// true if the keys were written in sorted order so far
+			bool sorted;
+			// true if a key has been written but not its value
+			bool expect_value;
+		};
+
+		// the open containers, the innermost last
+		std::vector<frame> m_stack;
+
+		// the keys of the open dictionaries
+		struct dict_item
+		{
+			// the offset in m_buf where this item (the key) starts
+			int start;
+			// offset and length of the key string
+			int key;
+			int key_len;
+		};
+		std::vector<dict_item> m_items;
+
+		// used when sorting a dictionary
+		std::vector<char> m_scratch;
+		std::vector<int> m_order;
+	};
+
+	// entry_writer has the same interface as bencode_writer, but builds an
+	// entry tree instead of encoding it. This lets code that produces a
+	// structure be written once, as a template on the writer, and still
+	// produce an entry without encoding and decoding it. The first value
+	// written replaces ``e``.
+	struct TORRENT_EXTRA_EXPORT entry_writer
+	{
+		explicit entry_writer(entry& e);
+
+		void begin_dict();
+		void begin_list();
+		void end();
+
+		void key(char const* k);
+		void key(char const* k, int len);
+		void key(std::string const& k);
+
+		void integer(boost::int64_t val);
+		void string(char const* str);
+		void string(char const* str, int len);
+		void string(std::string const& str);
+
+		// decodes ``buf``, which must be a bencoded value
+		void raw(char const* buf, int len);
+
+		void value(entry const& e);
+
+		void int_item(char const* k, boost::int64_t val)
+		{ key(k); integer(val); }
+		void string_item(char const* k, std::string const& str)
+		{ key(k); string(str); }
+		void string_item(char const* k, char const* str, int len)
+		{ key(k); string(str, len); }
+
+		// the pointer is only valid until the next call to the writer
+		char* alloc_string(int len);
+
+		bool done() const { return m_started && m_stack.empty(); }
+
+	private:
+
+		// returns the entry the next value is written to
+		entry& next_value();
+
+		entry& m_root;
+
+		// the open containers, the innermost last
+		std::vector<entry*> m_stack;
+
+		// the key of the next value, in the innermost dictionary
+		std::string m_key;
+		bool m_expect_value;
+
+		// true once the root value has been written
+		bool m_started;
+	};
+}
+
+#endif // TORRENT_BENCODE_WRITER_HPP_INCLUDED
+
@@ -462,6 +462,12 @@ namespace libtorrent
 
 		int pinned_blocks() const { return m_pinned_blocks; }
 
+		// the number of times a read hit a piece in one of the ghost lists
+		int num_ghost_hits() const { return m_ghost_hits; }
+
+		// resizes the cache, and the ghost lists along with it
+		bool set_max_use(int max_use);
+
 #if TORRENT_USE_ASSERTS
 		void mark_deleted(file_storage const& fs);
 #endif
@@ -505,6 +511,13 @@ namespace libtorrent
 		// this is determined by being a fraction of the cache size
 		int m_ghost_size;
 
+		// the read_cache_line_size setting, used to size the ghost lists
+		int m_read_cache_line_size;
+
+		// the number of cache hits in the ghost lists, since the cache was
+		// created
+		int m_ghost_hits;
+
 		// the number of blocks in the cache
 		// that are in the read cache
 		boost::uint32_t m_read_cache_size;
@@ -291,9 +291,11 @@ namespace libtorrent
 
 public:
 
-		// these functions encrypt the send buffer if m_rc4_encrypted
+		// these functions queue the data for encryption if m_rc4_encrypted
 		// is true, otherwise it passes the call to the
-		// peer_connection functions of the same names
+		// peer_connection functions of the same names. The queued bytes are
+		// encrypted in one pass by setup_send(), right before they're
+		// handed to the socket
 		virtual void append_const_send_buffer(char const* buffer, int size
 			, chained_buffer::free_buffer_fun destructor = &nop
 			, void* userdata = NULL, block_cache_reference ref
@@ -307,8 +309,15 @@ public:
 			, void* userdata = NULL, block_cache_reference ref
 			= block_cache_reference(), bool encrypted = false);
 
+		virtual void setup_send();
+
 private:
 
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		// encrypts the last m_encrypt_pending bytes of the send buffer
+		void encrypt_pending_buffer();
+#endif
+
 		enum state_t
 		{
 #ifndef TORRENT_DISABLE_ENCRYPTION
@@ -423,6 +432,14 @@ private:
 		// used to disconnect peer if sync points are not found within
 		// the maximum number of bytes
 		int m_sync_bytes_read;
+
+		// the number of bytes at the end of the send buffer that are
+		// still plaintext and need to be encrypted before they're sent
+		int m_encrypt_pending;
+
+		// scratch space for the buffers passed to the encryption
+		// handler, kept around to avoid allocating it on every send
+		std::vector<asio::mutable_buffer> m_crypto_iovec;
 #endif
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
@@ -445,6 +462,11 @@ private:
 
 #if defined TORRENT_DEBUG || TORRENT_RELEASE_ASSERTS
 		bool m_in_constructor;		
+
+		// set when the payload of the piece message being received goes
+		// to the regular receive buffer rather than a disk buffer, because
+		// it had already been read from the socket along with the header
+		bool m_piece_in_recv_buffer;
 #endif
 
 	};
@@ -41,7 +41,6 @@ POSSIBILITY OF SUCH DAMAGE.
 #else
 #include <boost/asio/buffer.hpp>
 #endif
-#include <deque>
 #include <vector>
 #include <string.h> // for memcpy
 
@@ -55,7 +54,7 @@ namespace libtorrent
 #endif
 	struct TORRENT_EXTRA_EXPORT chained_buffer : private single_threaded
 	{
-		chained_buffer(): m_bytes(0), m_capacity(0)
+		chained_buffer(): m_first(0), m_num_buffers(0), m_bytes(0), m_capacity(0)
 		{
 			thread_started();
 #if TORRENT_USE_ASSERTS
@@ -102,17 +101,44 @@ namespace libtorrent
 		// enough room, returns 0
 		char* allocate_appendix(int s);
 
+		// returns the buffers covering the first ``to_send`` bytes. The
+		// number of buffers is capped at TORRENT_IOV_MAX, since that's all
+		// a single vectored write can send. In that case the buffers cover
+		// less than ``to_send`` bytes
 		std::vector<asio::const_buffer> const& build_iovec(int to_send);
 
+		// fills in ``vec`` with the buffers covering the last ``bytes`` bytes
+		// of the chain. This is used to mutate (encrypt) data in place after
+		// it has been appended. The buffers must not have been appended as
+		// const buffers
+		void build_mutable_iovec_tail(int bytes
+			, std::vector<asio::mutable_buffer>& vec);
+
 		void clear();
 
 		~chained_buffer();
 
 	private:
 
+		buffer_t& buffer_at(int i)
+		{
+			TORRENT_ASSERT(i >= 0 && i < m_num_buffers);
+			return m_vec[(m_first + i) & (m_vec.size() - 1)];
+		}
+
+		// makes room for at least one more buffer in the ring
+		void grow();
+
 		// this is the list of all the buffers we want to
-		// send
-		std::deque<buffer_t> m_vec;
+		// send. It's a ring buffer whose size is always a power
+		// of two. m_first is the index of the first buffer and
+		// m_num_buffers is the number of buffers in the chain.
+		// Unlike a deque, appending and popping buffers never
+		// allocate once the ring has grown to the peer's working
+		// set
+		std::vector<buffer_t> m_vec;
+		int m_first;
+		int m_num_buffers;
 
 		// this is the number of bytes in the send buf.
 		// this will always be equal to the sum of the
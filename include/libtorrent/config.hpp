@@ -110,6 +110,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #  define TORRENT_DEPRECATED __attribute__ ((deprecated))
 # endif
 
+// thread local storage for POD types
+#define TORRENT_THREAD_LOCAL __thread
+
 // ======= SUNPRO =========
 
 #elif defined __SUNPRO_CC
@@ -133,6 +136,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #define TORRENT_DEPRECATED_PREFIX __declspec(deprecated)
 
+#define TORRENT_THREAD_LOCAL __declspec(thread)
+
 #endif
 
 
@@ -94,6 +94,18 @@ namespace libtorrent
 
 		void set_settings(aux::session_settings const& sett);
 
+		// the maximum number of blocks in use, i.e. the cache size
+		int max_use() const
+		{
+			mutex::scoped_lock l(m_pool_mutex);
+			return m_max_use;
+		}
+
+		// changes the cache size, leaving the rest of the settings as they
+		// are. Returns false if the cache can't be resized, because it's
+		// mmapped
+		bool set_max_use(int max_use);
+
 		struct handler_t
 		{
 			char* buffer; // argument to the callback
@@ -145,12 +157,16 @@ namespace libtorrent
 	private:
 
 		void check_buffer_level(mutex::scoped_lock& l);
+		void set_max_use_impl(int max_use, mutex::scoped_lock& l);
 
 		mutable mutex m_pool_mutex;
 
 		int m_cache_buffer_chunk_size;
 		bool m_lock_disk_cache;
 
+		// the number of blocks between m_max_use and m_low_watermark
+		int m_watermark_margin;
+
 #if TORRENT_HAVE_MMAP
 		// the file descriptor of the cache mmap file
 		int m_cache_fd;
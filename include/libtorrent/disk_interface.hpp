@@ -103,6 +103,11 @@ namespace libtorrent
 		virtual void get_cache_info(cache_status* ret, bool no_pieces = true
 			, piece_manager const* storage = 0) const = 0;
 
+		// sets ``blocks[i]`` to the number of blocks ``storages[i]`` has in
+		// the cache, for ``num`` storages. Null storages have 0 blocks
+		virtual void cached_blocks(piece_manager const* const* storages
+			, int* blocks, int num) const = 0;
+
 		virtual file_pool& files() = 0;
 
 #if TORRENT_USE_ASSERTS
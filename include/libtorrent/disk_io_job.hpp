@@ -198,6 +198,10 @@ namespace libtorrent
 
 		enum { operation_failed = -1 };
 
+		// the time the job was issued. Used to measure how long jobs wait
+		// before a disk thread picks them up
+		ptime start_time;
+
 		// return value of operation
 		boost::int32_t ret;
 
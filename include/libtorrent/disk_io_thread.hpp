@@ -273,6 +273,18 @@ namespace libtorrent
 #endif
 	};
 	
+	// the policy of the adaptive cache size. Returns the new size of the
+	// cache, in blocks, given its current ``size``, its bounds, the number of
+	// ARC ghost list hits and block reads since it was last adjusted, and
+	// the physical and available RAM (0 if unknown). The cache shrinks by an
+	// eighth when available memory is below ``free_percent`` of the physical
+	// RAM, and otherwise grows by a quarter when at least 1% of the reads
+	// hit a ghost list.
+	TORRENT_EXTRA_EXPORT int adaptive_cache_target(int size, int min_size
+		, int max_size, int ghost_hits, boost::int64_t reads
+		, boost::uint64_t total_ram, boost::uint64_t available_ram
+		, int free_percent);
+
 	// this is a singleton consisting of the thread and a queue
 	// of disk io jobs
 	struct TORRENT_EXTRA_EXPORT disk_io_thread
@@ -361,8 +373,16 @@ namespace libtorrent
 		{ return m_disk_cache.exceeded_max_size(); }
 
 		void update_stats_counters(counters& c) const;
+
+		// grows or shrinks the cache, if adaptive_cache_size is enabled. This
+		// is called by the session once per second, and adjusts the size
+		// every 5 seconds, regardless of whether there's any disk activity
+		void update_cache_size();
+
 		void get_cache_info(cache_status* ret, bool no_pieces = true
 			, piece_manager const* storage = 0) const;
+		void cached_blocks(piece_manager const* const* storages
+			, int* blocks, int num) const;
 
 		// this submits all queued up jobs to the thread
 		void submit_jobs();
@@ -446,6 +466,13 @@ namespace libtorrent
 
 		void check_cache_level(mutex::scoped_lock& l, tailqueue& completed_jobs);
 
+		// applies adaptive_cache_target() to the cache. Must be called with
+		// the cache mutex held
+		void adjust_cache_size(mutex::scoped_lock& l);
+
+		// the upper bound of the adaptive cache size, in blocks
+		int max_cache_size() const;
+
 		void perform_job(disk_io_job* j, tailqueue& completed_jobs);
 
 		// this queues up another job to be submitted
@@ -522,6 +549,14 @@ namespace libtorrent
 		// the last time we expired write blocks from the cache
 		ptime m_last_cache_expiry;
 
+		// the last time the cache size was adjusted
+		ptime m_last_cache_adjust;
+
+		// the number of ghost list hits and the number of blocks read (from
+		// disk or from the cache) the last time adjust_cache_size() ran
+		int m_last_ghost_hits;
+		boost::int64_t m_last_cache_reads;
+
 		ptime m_last_file_check;
 
 		// LRU cache of open files
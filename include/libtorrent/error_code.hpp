@@ -384,6 +384,10 @@ namespace libtorrent
 			// specifying the flag to only save when there's anything new to save
 			// (torrent_handle::only_if_modified) and there wasn't anything changed.
 			resume_data_not_modified,
+			// the resume_store file doesn't have a valid header
+			invalid_resume_store,
+			// a record in the resume_store failed its checksum
+			resume_record_corrupt,
 
 
 
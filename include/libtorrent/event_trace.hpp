@@ -0,0 +1,139 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_EVENT_TRACE_HPP_INCLUDED
+#define TORRENT_EVENT_TRACE_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/error_code.hpp"
+
+#include <boost/cstdint.hpp>
+#include <string>
+
+namespace libtorrent
+{
+	// one event in the binary event trace. This is also the record format
+	// of the file written by dump_event_trace(), in host byte order
+	struct trace_event
+	{
+		enum type_t
+		{
+			// a disk job was handed to the disk thread. ``id`` is the job,
+			// ``arg0`` its action and ``arg1`` the piece
+			disk_job_submit,
+
+			// a disk thread started and finished performing a job. The
+			// arguments are the same as for disk_job_submit
+			disk_job_start,
+			disk_job_done,
+
+			// the completion handler of a job was called in the network
+			// thread. The arguments are the same as for disk_job_submit
+			disk_job_handler,
+
+			// we sent a block request to a peer, and received the block.
+			// ``id`` is the peer connection, ``arg0`` the piece and
+			// ``arg1`` the block index
+			block_request,
+			block_received,
+
+			// the peer choked or unchoked us. ``id`` is the peer connection
+			choked_by_peer,
+			unchoked_by_peer,
+
+			// we choked or unchoked the peer. ``id`` is the peer connection
+			choke_peer,
+			unchoke_peer,
+
+			// the congestion window of a uTP socket changed. ``id`` is the
+			// socket, ``arg0`` the congestion window and ``arg1`` the number
+			// of bytes in flight
+			utp_cwnd,
+
+			num_types
+		};
+
+		// nanoseconds, from the monotonic clock
+		boost::uint64_t timestamp;
+
+		// identifies the object the event is about
+		boost::uint64_t id;
+
+		boost::uint32_t arg0;
+		boost::uint32_t arg1;
+
+		// type_t
+		boost::uint16_t type;
+
+		// the index of the thread that recorded the event
+		boost::uint16_t thread;
+
+		boost::uint32_t reserved;
+	};
+
+	// appends an event to the calling thread's trace ring. Use the
+	// TORRENT_TRACE_EVENT macro instead of calling this directly, to have
+	// the calls compiled out when TORRENT_EVENT_TRACE is not defined
+	TORRENT_EXTRA_EXPORT void record_trace_event(int type, void const* id
+		, boost::uint32_t arg0, boost::uint32_t arg1);
+
+	// writes the contents of all threads' trace rings to ``filename``. The
+	// file starts with the 8 byte magic "LTTRACE2", followed by these 32 bit
+	// values in host byte order: 0x01020304, the size of a record, the
+	// number of threads that weren't traced and the number of disk job
+	// names. Then come the names of the disk_io_job actions, in order, each
+	// terminated by a null byte, followed by trace_event records. The
+	// records are grouped by thread and are in chronological order within
+	// each thread. The rings keep being written to while they're dumped, so
+	// this can be called on a live session. Use tools/parse_event_trace.py
+	// to convert the file to the Chrome trace JSON format.
+	//
+	// Each thread's ring is freed when the thread exits, so only events
+	// from live threads are included. At most 64 threads are traced at a
+	// time, events from any other thread are not recorded.
+	//
+	// If libtorrent was built without TORRENT_EVENT_TRACE, ``ec`` is set
+	// to operation_not_supported.
+	TORRENT_EXPORT void dump_event_trace(std::string const& filename
+		, error_code& ec);
+}
+
+#ifdef TORRENT_EVENT_TRACE
+#define TORRENT_TRACE_EVENT(type, id, arg0, arg1) \
+	::libtorrent::record_trace_event(::libtorrent::trace_event:: type \
+		, id, arg0, arg1)
+#else
+#define TORRENT_TRACE_EVENT(type, id, arg0, arg1) do {} while (false)
+#endif
+
+#endif // TORRENT_EVENT_TRACE_HPP_INCLUDED
+
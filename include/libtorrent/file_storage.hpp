@@ -37,11 +37,20 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <ctime>
 
+#include <boost/shared_array.hpp>
+#include <boost/cstdint.hpp>
+
 #include "libtorrent/size_type.hpp"
 #include "libtorrent/assert.hpp"
 #include "libtorrent/peer_request.hpp"
 #include "libtorrent/peer_id.hpp"
 
+#if TORRENT_HAS_BOOST_UNORDERED
+#include <boost/unordered_map.hpp>
+#else
+#include <map>
+#endif
+
 namespace libtorrent
 {
 	struct file;
@@ -181,7 +190,10 @@ namespace libtorrent
 		// name_is_owned, name is null terminated and owned by this object
 		// (i.e. it should be freed in the destructor). If
 		// the len is not name_is_owned, the name pointer doesn not belong
-		// to this object, and it's not null terminated
+		// to this object, and it's not null terminated. It either points
+		// into the torrent file or into the name pool of the file_storage
+		// this entry belongs to. Copying an entry does not copy a borrowed
+		// name.
 		boost::uint64_t name_len:12;
 		boost::uint64_t pad_file:1;
 		boost::uint64_t hidden_attribute:1;
@@ -197,8 +209,8 @@ namespace libtorrent
 
 		// the index into file_storage::m_paths. To get
 		// the full path to this file, concatenate the path
-		// from that array with the 'name' field in
-		// this struct
+		// of that directory (file_storage::path()) with the
+		// 'name' field in this struct
 		// values for path_index include:
 		// -1 means no path (i.e. single file torrent)
 		// -2, it means the filename
@@ -237,6 +249,10 @@ namespace libtorrent
 		file_storage();
 		// hidden
 		~file_storage() {}
+		// hidden
+		file_storage(file_storage const& f);
+		// hidden
+		file_storage& operator=(file_storage const& f);
 
 		// returns true if the piece length has been initialized
 		// on the file_storage. This is typically taken as a proxy
@@ -287,6 +303,13 @@ namespace libtorrent
 		void add_file(std::string const& p, size_type size, int flags = 0
 			, std::time_t mtime = 0, std::string const& s_p = "");
 
+		// this is a low-level function that adds a file whose name references
+		// a buffer that is not owned by the file_storage, like
+		// rename_file_borrow(). The file name is ``filename_len`` characters
+		// at ``filename``, the rest of the file is described by ``e``.
+		void add_file_borrow(char const* filename, int filename_len
+			, file_entry const& e, char const* filehash = 0);
+
 		// renames the file at ``index`` to ``new_filename``. Keep in mind
 		// that filenames are expected to be UTF-8 encoded.
 		void rename_file(int index, std::string const& new_filename);
@@ -320,6 +343,15 @@ namespace libtorrent
 		std::vector<file_slice> map_block(int piece, size_type offset
 			, int size) const;
 
+		// the same as the map_block() above, but instead of allocating a
+		// vector, at most ``num_slices`` file_slice objects are written to
+		// ``slices``. Returns the number of slices written. If the range
+		// overlaps more files than that, only the first part of it is mapped.
+		// The rest can be mapped by calling again with ``offset`` advanced
+		// by the sizes of the returned slices.
+		int map_block(int piece, size_type offset, int size
+			, file_slice* slices, int num_slices) const;
+
 		// returns a peer_request representing the piece index, byte offset
 		// and size the specified file range overlaps. This is the inverse
 		// mapping ove map_block().
@@ -371,12 +403,12 @@ namespace libtorrent
 		size_type total_size() const { return m_total_size; }
 
 		// set and get the number of pieces in the torrent
-		void set_num_pieces(int n) { m_num_pieces = n; }
+		void set_num_pieces(int n) { m_num_pieces = n; m_piece_index.clear(); }
 		int num_pieces() const { TORRENT_ASSERT(m_piece_length > 0); return m_num_pieces; }
 
 		// set and get the size of each piece in this torrent. This size is typically an even power
 		// of 2. It doesn't have to be though. It should be divisible by 16kiB however.
-		void set_piece_length(int l)  { m_piece_length = l; }
+		void set_piece_length(int l)  { m_piece_length = l; m_piece_index.clear(); }
 		int piece_length() const { TORRENT_ASSERT(m_piece_length > 0); return m_piece_length; }
 
 		// returns the piece size of ``index``. This will be the same as piece_length(), except
@@ -399,10 +431,15 @@ namespace libtorrent
 			swap(ti.m_mtime, m_mtime);
 			swap(ti.m_file_base, m_file_base);
 			swap(ti.m_paths, m_paths);
+			swap(ti.m_path_index, m_path_index);
 			swap(ti.m_name, m_name);
 			swap(ti.m_total_size, m_total_size);
 			swap(ti.m_num_pieces, m_num_pieces);
 			swap(ti.m_piece_length, m_piece_length);
+			swap(ti.m_name_pool, m_name_pool);
+			swap(ti.m_name_pool_next, m_name_pool_next);
+			swap(ti.m_name_pool_free, m_name_pool_free);
+			swap(ti.m_piece_index, m_piece_index);
 		}
 
 		// deallocates most of the memory used by this
@@ -478,7 +515,11 @@ namespace libtorrent
 			flag_symlink = 8
 		};
 
-		std::vector<std::string> const& paths() const { return m_paths; }
+		// the number of unique directories files are in, including their
+		// parent directories, and the path of each of them. The paths
+		// don't include the root directory name of multi-file torrents
+		int num_paths() const { return int(m_paths.size()); }
+		std::string path(int index) const;
 
 		// returns a bitmask of flags from file_flags_t that apply
 		// to file at ``index``.
@@ -496,6 +537,15 @@ namespace libtorrent
 		// returns the index of the file at the given offset in the torrent
 		int file_index_at_offset(size_type offset) const;
 
+		// builds a table of the first file each piece overlaps. Once built,
+		// file_index_at_offset() and map_block() only need to search the
+		// files within a single piece, rather than all files. Adding files
+		// or changing the piece size or number of pieces drops the table, so
+		// this should be called once the file list is final. It is only
+		// built for torrents with more than one file, and it costs 4 bytes
+		// per piece.
+		void build_piece_index();
+
 		// low-level function. returns a pointer to the internal storage for
 		// the filename. This string may not be null terinated!
 		// the ``file_name_len()`` function returns the length of the filename.
@@ -537,9 +587,28 @@ namespace libtorrent
 		// the number of pieces in the torrent
 		int m_num_pieces;
 
-		void update_path_index(internal_file_entry& e);
+		void update_path_index(internal_file_entry& e, std::string const& path
+			, bool set_name = true);
 		void reorder_file(int index, int dst);
 
+		// sets the name of ``e`` to a copy of the ``len`` characters at ``n``,
+		// allocated from the name pool
+		void set_file_name(internal_file_entry& e, char const* n, int len);
+		char const* allocate_name(char const* n, int len);
+
+		// makes the names borrowed by the file entries point into our own
+		// name pool. This is used after copying the file list from another
+		// file_storage
+		void copy_names();
+
+		// returns true if ``name`` points into the name pool
+		bool in_name_pool(char const* name) const;
+
+		// returns the index of the directory ``name`` (``len`` characters,
+		// a single path component) in the directory ``parent``, adding it
+		// if it's not there yet. ``parent`` is -1 for the top level
+		int intern_path(int parent, char const* name, int len);
+
 		// the list of files that this torrent consists of
 		std::vector<internal_file_entry> m_files;
 
@@ -567,12 +636,32 @@ namespace libtorrent
 		// offsets)
 		std::vector<size_type> m_file_base;
 
-		// all unique paths files have. The internal_file_entry::path_index
-		// points into this array. The paths don't include the root directory
-		// name for multi-file torrents. The m_name field need to be
-		// prepended to these paths, and the filename of a specific file
-		// entry appended, to form full file paths
-		std::vector<std::string> m_paths;
+		// all unique directories files are in, including their parent
+		// directories. The internal_file_entry::path_index points into this
+		// array. Directories are interned one path component at a time,
+		// each entry only holds its own name, allocated from the name pool,
+		// and the index of its parent (-1 at the top level). This way
+		// directories that share parents don't store them over and over.
+		// The paths don't include the root directory name for multi-file
+		// torrents. The m_name field need to be prepended to these paths,
+		// and the filename of a specific file entry appended, to form full
+		// file paths
+		struct path_entry
+		{
+			char const* name;
+			int len;
+			int parent;
+		};
+		std::vector<path_entry> m_paths;
+
+		// maps a hash of a path component and its parent to the entries in
+		// m_paths with that hash, see intern_path()
+#if TORRENT_HAS_BOOST_UNORDERED
+		typedef boost::unordered_multimap<boost::uint32_t, int> path_index_t;
+#else
+		typedef std::multimap<boost::uint32_t, int> path_index_t;
+#endif
+		path_index_t m_path_index;
 
 		// name of torrent. For multi-file torrents
 		// this is always the root directory
@@ -585,6 +674,29 @@ namespace libtorrent
 		// the torrent is unloaded
 		int m_num_files;
 
+		// for each piece, the index of the file its first byte belongs to.
+		// This is either empty or has exactly m_num_pieces entries. See
+		// build_piece_index()
+		std::vector<int> m_piece_index;
+
+		// the file names that aren't borrowed from the torrent file. They are
+		// allocated back-to-back (not null terminated) in a few large blocks,
+		// rather than one heap allocation per file. This makes a big
+		// difference for torrents with a large number of files, where the
+		// names are often shorter than the malloc overhead. Names are never
+		// freed individually, a renamed file leaves its old name behind in
+		// the pool until the file_storage is copied or unloaded
+		struct name_block
+		{
+			boost::shared_array<char> buf;
+			int size;
+		};
+		std::vector<name_block> m_name_pool;
+
+		// where the next name is allocated in the last block of the pool, and
+		// the number of bytes left in it
+		char* m_name_pool_next;
+		int m_name_pool_free;
 	};
 }
 
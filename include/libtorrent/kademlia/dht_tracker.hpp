@@ -137,6 +137,8 @@ namespace libtorrent { namespace dht
 		virtual bool has_quota();
 		virtual bool send_packet(libtorrent::entry& e, udp::endpoint const& addr
 			, int send_flags);
+		virtual bool send_packet(char const* buf, int size
+			, udp::endpoint const& addr, int send_flags);
 
 		counters& m_counters;
 		node_impl m_dht;
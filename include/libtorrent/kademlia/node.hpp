@@ -50,6 +50,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <libtorrent/assert.hpp>
 #include <libtorrent/thread.hpp>
 #include <libtorrent/bloom_filter.hpp>
+#include <libtorrent/bencode_writer.hpp>
 
 #include <boost/cstdint.hpp>
 #include <boost/ref.hpp>
@@ -188,6 +189,12 @@ struct udp_socket_interface
 {
 	virtual bool has_quota() = 0;
 	virtual bool send_packet(entry& e, udp::endpoint const& addr, int flags) = 0;
+
+	// sends a message that's already bencoded, including the "v" field.
+	// The default implementation decodes it and forwards it to the entry
+	// overload
+	virtual bool send_packet(char const* buf, int size, udp::endpoint const& addr
+		, int flags);
 };
 
 class TORRENT_EXTRA_EXPORT node_impl : boost::noncopyable
@@ -302,6 +309,7 @@ private:
 	std::set<traversal_algorithm*> m_running_requests;
 
 	void incoming_request(msg const& h, entry& e);
+	bool incoming_fast_request(msg const& m);
 
 	node_id m_id;
 
@@ -328,6 +336,11 @@ private:
 	alert_dispatcher* m_post_alert;
 	udp_socket_interface* m_sock;
 	counters& m_counters;
+
+	// the buffer replies to ping and find_node are encoded into. It's
+	// reused across messages
+	std::vector<char> m_reply_buf;
+	bencode_writer m_reply_writer;
 };
 
 
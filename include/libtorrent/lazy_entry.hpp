@@ -61,7 +61,11 @@ namespace libtorrent
 	// nested trees. However, in order to protect against potential attacks, the
 	// ``depth_limit`` and ``item_limit`` control how many levels deep the tree is
 	// allowed to get. With recursive parser, a few thousand levels would be enough
-	// to exhaust the threads stack and terminate the process. The ``item_limit``
+	// to exhaust the threads stack and terminate the process. The parser keeps
+	// its own stack of open lists and dictionaries, of ``depth_limit`` entries
+	// (but no more than the size of the buffer). Up to a depth of 1024 it's
+	// allocated on the thread's stack, beyond that on the heap, so any
+	// ``depth_limit`` is safe to pass. The ``item_limit``
 	// protects against very large structures, not necessarily deep. Each bencoded
 	// item in the structure causes the parser to allocate some amount of memory,
 	// this memory is constant regardless of how much data actually is stored in
@@ -421,6 +425,8 @@ namespace libtorrent
 			limit_exceeded,
 			// integer overflow
 			overflow,
+			// expected digit in bencoded integer
+			expected_digit,
 
 			// the number of error codes
 			error_code_max
@@ -0,0 +1,148 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_METADATA_BLOCK_PICKER_HPP_INCLUDED
+#define TORRENT_METADATA_BLOCK_PICKER_HPP_INCLUDED
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/time.hpp"
+
+namespace libtorrent
+{
+	// keeps track of the 16 kiB blocks of the metadata of a torrent that's
+	// being downloaded with ut_metadata, i.e. which ones we have, and which
+	// peer each outstanding one was requested from. It picks the block to
+	// request next from a peer.
+	//
+	// Peers are only referred to by a shared_ptr<void>, the block picker
+	// doesn't keep them alive.
+	struct TORRENT_EXTRA_EXPORT metadata_block_picker
+	{
+		// what the picker needs to know about the peer it picks a block for
+		struct peer_state
+		{
+			peer_state() : reserve(false), rtt(-1) {}
+
+			boost::shared_ptr<void> peer;
+
+			// the blocks currently requested from this peer. These won't be
+			// picked again
+			std::vector<int> requested;
+
+			// if true, the block picked is reserved for this peer for
+			// ``timeout``, during which it isn't picked for any other peer
+			// (other than as a speculative duplicate). This is set for peers
+			// that claim to have the metadata
+			bool reserve;
+			time_duration timeout;
+
+			// the round-trip time of this peer's requests, in milliseconds.
+			// -1 if it's not known yet
+			int rtt;
+		};
+
+		metadata_block_picker();
+
+		// sets the number of blocks, once the size of the metadata is known
+		void resize(int num_blocks);
+		int num_blocks() const { return int(m_blocks.size()); }
+
+		// returns the block to request from ``peer`` next, or -1 if there
+		// is none. The block requested the fewest times that isn't reserved
+		// for another peer is picked. If all blocks are reserved, the block
+		// that has been outstanding the longest may be picked again, if
+		// ``peer`` is expected to respond before that request times out.
+		// Every block is requested speculatively like that at most once
+		int pick(peer_state const& peer, ptime now);
+
+		// called when ``peer`` rejects the request for ``block``, or fails to
+		// respond to it. If the block was reserved for ``peer``, it's made
+		// available to other peers right away
+		void cancel(void const* peer, int block);
+
+		// marks ``block`` as received from ``peer``. Returns false if we
+		// already had it, i.e. it was received from another peer first
+		bool received(boost::shared_ptr<void> const& peer, int block);
+
+		bool have(int block) const;
+		bool have_all() const;
+
+		// the peers we received blocks from, once for every block. Peers
+		// that no longer exist are left out
+		void sources(std::vector<boost::shared_ptr<void> >& ret) const;
+
+		// forgets which blocks we have and have requested, but keeps the
+		// number of blocks. Used when the metadata fails the hash check
+		void reset();
+
+		// frees all blocks
+		void clear();
+
+	private:
+
+		int speculative_pick(peer_state const& peer, ptime now);
+
+		bool has_requested(peer_state const& peer, int block) const;
+
+		struct block
+		{
+			block();
+
+			// the number of times this block has been requested.
+			// std::numeric_limits<int>::max() means we have it
+			int num_requests;
+			ptime last_request;
+
+			// until this time the block is reserved for ``source``, and won't
+			// be requested from another peer (other than the one speculative
+			// request)
+			ptime timeout;
+
+			// the peer we're waiting for this block from. Once we have it,
+			// the peer we received it from
+			boost::weak_ptr<void> source;
+
+			// set when the block has been requested from a second peer
+			// while the first request was still outstanding
+			bool speculative;
+		};
+
+		std::vector<block> m_blocks;
+	};
+}
+
+#endif // TORRENT_METADATA_BLOCK_PICKER_HPP_INCLUDED
@@ -0,0 +1,114 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_METADATA_CACHE_HPP_INCLUDED
+#define TORRENT_METADATA_CACHE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/peer_id.hpp" // for sha1_hash
+
+namespace libtorrent
+{
+	class torrent_info;
+
+	// metadata_cache is a directory of torrent metadata, keyed by info-hash,
+	// that several sessions (in the same or in different processes) can
+	// load torrents from.
+	//
+	// Each torrent is stored as its bencoded info-dictionary in a file named
+	// after the hex encoded info-hash. When a torrent is loaded, the file is
+	// mapped into memory (where supported) and the torrent_info refers to
+	// the piece hashes and file names in the mapping rather than copying
+	// them to the heap. All processes mapping the same file share the same
+	// physical pages, so the bulk of the metadata is only held in memory
+	// once per host.
+	//
+	// The piece hashes in particular don't need to be resident at all. They
+	// are read from the file when a piece is verified, and torrents evict
+	// them again once they've been read in bulk, after loading and after
+	// checking the files. This keeps the memory use of seeds, which never
+	// verify pieces, independent of the number of pieces they're seeding.
+	//
+	// Files are never modified once they're in the cache. save() writes
+	// to a temporary file and renames it into place, and remove() unlinks
+	// the file, so a torrent that's already loaded keeps its mapping.
+	//
+	// The info-hash of a file is verified when it's loaded, so a corrupt
+	// file is rejected rather than yielding a torrent with the wrong
+	// metadata.
+	struct TORRENT_EXPORT metadata_cache
+	{
+		// the cache is stored in the directory ``dir``, which is created
+		// by the first save() if it doesn't exist.
+		metadata_cache(std::string const& dir);
+
+		// adds the metadata of ``ti`` to the cache. If it's already there,
+		// the cache is left untouched.
+		void save(torrent_info const& ti, error_code& ec);
+
+		// adds a bencoded info-dictionary to the cache, for instance one
+		// received via add_torrent_params::info or a metadata_received
+		// alert. The info-hash is calculated from the buffer.
+		void save(char const* info_section, int size, error_code& ec);
+
+		// returns true if there's metadata for ``ih`` in the cache
+		bool has(sha1_hash const& ih) const;
+
+		// loads the metadata for ``ih``. Returns an empty pointer, and sets
+		// ``ec``, if it's not in the cache or if it's invalid. The
+		// torrent_info can be passed to session::add_torrent() via
+		// add_torrent_params::ti.
+		boost::shared_ptr<torrent_info> load(sha1_hash const& ih
+			, error_code& ec) const;
+
+		// removes the metadata for ``ih`` from the cache. torrent_info
+		// objects already loaded from it are not affected.
+		void remove(sha1_hash const& ih, error_code& ec);
+
+		// returns the info-hashes of all the torrents in the cache
+		void torrents(std::vector<sha1_hash>& ret) const;
+
+		// the file the metadata for ``ih`` is stored in
+		std::string path(sha1_hash const& ih) const;
+
+	private:
+
+		std::string m_dir;
+	};
+}
+
+#endif // TORRENT_METADATA_CACHE_HPP_INCLUDED
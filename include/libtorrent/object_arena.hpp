@@ -0,0 +1,129 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_OBJECT_ARENA_HPP_INCLUDED
+#define TORRENT_OBJECT_ARENA_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <boost/type_traits/alignment_of.hpp>
+#include <vector>
+#include <new> // for placement new
+
+namespace libtorrent
+{
+	// a bump allocator that objects are copy-constructed into. All objects
+	// are destructed and the memory is reclaimed at once, by clear(). The
+	// chunks of memory are kept across calls to clear(), so once the arena
+	// has grown to its working set, constructing objects in it doesn't
+	// allocate. Objects are never moved, pointers to them stay valid until
+	// clear() is called.
+	struct TORRENT_EXTRA_EXPORT object_arena
+	{
+		object_arena(int chunk_size = 32 * 1024);
+		~object_arena();
+
+		// copy-constructs ``v`` into the arena and returns a pointer to the
+		// copy. T must be the dynamic type of ``v``, otherwise it would be
+		// sliced.
+		template <class T>
+		T* construct_copy(T const& v)
+		{
+			void* mem = allocate(sizeof(T), boost::alignment_of<T>::value);
+			T* ret = new (mem) T(v);
+			m_objects.push_back(object_t(ret, &destruct<T>));
+			return ret;
+		}
+
+		// takes ownership of a heap allocated object. It will be deleted
+		// by clear(), along with the objects constructed in the arena
+		template <class T>
+		void adopt(T* p)
+		{
+			TORRENT_ASSERT(p);
+			m_objects.push_back(object_t(p, &delete_object<T>));
+		}
+
+		// destructs all objects and makes the memory available
+		// for new ones
+		void clear();
+
+		// the number of objects currently held by the arena
+		int num_objects() const { return int(m_objects.size()); }
+
+		// the number of bytes allocated for chunks
+		int capacity() const;
+
+	private:
+
+		void* allocate(int size, int alignment);
+
+		template <class T>
+		static void destruct(void* p) { static_cast<T*>(p)->~T(); }
+
+		template <class T>
+		static void delete_object(void* p) { delete static_cast<T*>(p); }
+
+		struct object_t
+		{
+			object_t(void* p, void (*f)(void*)): ptr(p), destroy(f) {}
+			void* ptr;
+			void (*destroy)(void*);
+		};
+
+		struct chunk_t
+		{
+			char* buf;
+			int size;
+		};
+
+		// all objects in the arena, in the order they were added
+		std::vector<object_t> m_objects;
+
+		// the memory chunks objects are allocated from. Chunks before
+		// m_current are full, chunks after it are free.
+		std::vector<chunk_t> m_chunks;
+		int m_current;
+
+		// the number of bytes used in the current chunk
+		int m_used;
+
+		int m_chunk_size;
+
+		// not copyable
+		object_arena(object_arena const&);
+		object_arena& operator=(object_arena const&);
+	};
+}
+
+#endif
@@ -52,11 +52,22 @@ void TORRENT_EXTRA_EXPORT rc4_init(const unsigned char* in, unsigned long len, r
 unsigned long TORRENT_EXTRA_EXPORT rc4_encrypt(unsigned char *out, unsigned long outlen, rc4 *state);
 #endif
 
+#if defined TORRENT_ASIO_STANDALONE
+#include <asio/buffer.hpp>
+#else
+#include <boost/asio/buffer.hpp>
+#endif
+#include <vector>
+
 #include "libtorrent/peer_id.hpp" // For sha1_hash
 #include "libtorrent/assert.hpp"
 
 namespace libtorrent
 {
+#if BOOST_VERSION >= 103500
+	namespace asio = boost::asio;
+#endif
+
 	class TORRENT_EXTRA_EXPORT dh_key_exchange
 	{
 	public:
@@ -91,6 +102,13 @@ namespace libtorrent
 		virtual void set_outgoing_key(unsigned char const* key, int len) = 0;
 		virtual void encrypt(char* pos, int len) = 0;
 		virtual void decrypt(char* pos, int len) = 0;
+
+		// encrypts or decrypts all the buffers in ``iovec``, in order, as
+		// one contiguous stream. This lets a whole send window be processed
+		// in one pass rather than one call per message
+		virtual void encrypt(std::vector<asio::mutable_buffer> const& iovec) = 0;
+		virtual void decrypt(std::vector<asio::mutable_buffer> const& iovec) = 0;
+
 		virtual ~encryption_handler() {}
 	};
 
@@ -182,6 +200,26 @@ namespace libtorrent
 #endif
 		}
 
+		void encrypt(std::vector<asio::mutable_buffer> const& iovec)
+		{
+			if (!m_encrypt) return;
+			for (std::vector<asio::mutable_buffer>::const_iterator i = iovec.begin()
+				, end(iovec.end()); i != end; ++i)
+			{
+				encrypt(asio::buffer_cast<char*>(*i), int(asio::buffer_size(*i)));
+			}
+		}
+
+		void decrypt(std::vector<asio::mutable_buffer> const& iovec)
+		{
+			if (!m_decrypt) return;
+			for (std::vector<asio::mutable_buffer>::const_iterator i = iovec.begin()
+				, end(iovec.end()); i != end; ++i)
+			{
+				decrypt(asio::buffer_cast<char*>(*i), int(asio::buffer_size(*i)));
+			}
+		}
+
 	private:
 #ifdef TORRENT_USE_GCRYPT
 		gcry_cipher_hd_t m_rc4_incoming;
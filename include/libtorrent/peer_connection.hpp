@@ -835,6 +835,13 @@ namespace libtorrent
 		bool allocate_disk_receive_buffer(int disk_buffer_size);
 		char* release_disk_receive_buffer();
 		bool has_disk_receive_buffer() const { return m_disk_recv_buffer; }
+
+		// returns true if bytes past the current receive position have
+		// already been read from the socket into the regular receive
+		// buffer. When this is the case, the rest of the current message
+		// cannot be received into a disk buffer
+		bool has_buffered_receive_data() const
+		{ return m_recv_start + m_recv_pos < m_recv_end; }
 		void cut_receive_buffer(int size, int packet_size, int offset = 0);
 		void reset_recv_buffer(int packet_size);
 		void normalize_receive_buffer();
@@ -872,8 +879,11 @@ namespace libtorrent
 		void do_update_interest();
 		int preferred_caching() const;
 		void fill_send_buffer();
+		int bandwidth_delay_product(int channel) const;
+		void update_socket_buffers();
+		void restore_socket_buffers();
 		void on_disk_read_complete(disk_io_job const* j, peer_request r
-			, ptime issue_time);
+			, ptime issue_time, ptime request_time);
 		void on_disk_write_complete(disk_io_job const* j
 			, peer_request r, boost::shared_ptr<torrent> t);
 		void on_seed_mode_hashed(disk_io_job const* j);
@@ -892,6 +902,10 @@ namespace libtorrent
 		// to the disk thread yet
 		std::vector<peer_request> m_requests;
 
+		// the time each request in m_requests was received, in the
+		// same order. Used for the request latency histogram
+		std::vector<ptime> m_request_time;
+
 		// this peer's peer info struct. This may
 		// be 0, in case the connection is incoming
 		// and hasn't been added to a torrent yet.
@@ -1179,6 +1193,18 @@ namespace libtorrent
 
 		int m_disk_recv_buffer_size;
 
+		// the kernel socket buffer sizes we have last set on
+		// m_socket when auto_socket_buffers is enabled. 0 means
+		// we haven't touched them and the OS default is in effect
+		int m_send_socket_buffer;
+		int m_recv_socket_buffer;
+
+		// the sizes the kernel had picked for the buffers, the last time
+		// we asked. Once we have changed the buffers, these are the sizes
+		// restored if auto_socket_buffers is turned off again
+		int m_orig_send_socket_buffer;
+		int m_orig_recv_socket_buffer;
+
 		// the number of bytes we are currently reading
 		// from disk, that will be added to the send
 		// buffer as soon as they complete
@@ -35,8 +35,13 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <boost/cstdint.hpp>
 #include <boost/atomic.hpp>
+#include <algorithm> // for max
 #include "libtorrent/config.hpp"
 
+#if BOOST_ATOMIC_LLONG_LOCK_FREE != 2
+#include "libtorrent/thread.hpp"
+#endif
+
 namespace libtorrent
 {
 	struct TORRENT_EXTRA_EXPORT counters
@@ -185,6 +190,11 @@ namespace libtorrent
 			num_read_ops,
 			num_read_back,
 
+			// the adaptive disk cache sizing
+			num_arc_ghost_hits,
+			num_cache_size_grow,
+			num_cache_size_shrink,
+
 			disk_read_time,
 			disk_write_time,
 			disk_hash_time,
@@ -298,6 +308,160 @@ namespace libtorrent
 			socket_recv_size19,
 			socket_recv_size20,
 
+			// latency histograms. Each histogram has one counter per
+			// bucket. A counter ending in n counts samples that took less
+			// than 2^n microseconds, and at least 2^(n-1). The first bucket
+			// also counts everything faster and the last everything slower.
+			// The buckets are 8, 16, 32, 64, 128, 256, 512 us, 1, 2, 4, 8,
+			// 16, 32, 65, 131, 262, 524 ms, 1, 2, 4, 8, 16 s
+
+			// the time it took to perform read jobs
+			disk_read_latency3,
+			disk_read_latency4,
+			disk_read_latency5,
+			disk_read_latency6,
+			disk_read_latency7,
+			disk_read_latency8,
+			disk_read_latency9,
+			disk_read_latency10,
+			disk_read_latency11,
+			disk_read_latency12,
+			disk_read_latency13,
+			disk_read_latency14,
+			disk_read_latency15,
+			disk_read_latency16,
+			disk_read_latency17,
+			disk_read_latency18,
+			disk_read_latency19,
+			disk_read_latency20,
+			disk_read_latency21,
+			disk_read_latency22,
+			disk_read_latency23,
+			disk_read_latency24,
+
+			// the time it took to perform write jobs
+			disk_write_latency3,
+			disk_write_latency4,
+			disk_write_latency5,
+			disk_write_latency6,
+			disk_write_latency7,
+			disk_write_latency8,
+			disk_write_latency9,
+			disk_write_latency10,
+			disk_write_latency11,
+			disk_write_latency12,
+			disk_write_latency13,
+			disk_write_latency14,
+			disk_write_latency15,
+			disk_write_latency16,
+			disk_write_latency17,
+			disk_write_latency18,
+			disk_write_latency19,
+			disk_write_latency20,
+			disk_write_latency21,
+			disk_write_latency22,
+			disk_write_latency23,
+			disk_write_latency24,
+
+			// the time it took to perform hash jobs, including reading
+			// back blocks that weren't in the cache
+			disk_hash_latency3,
+			disk_hash_latency4,
+			disk_hash_latency5,
+			disk_hash_latency6,
+			disk_hash_latency7,
+			disk_hash_latency8,
+			disk_hash_latency9,
+			disk_hash_latency10,
+			disk_hash_latency11,
+			disk_hash_latency12,
+			disk_hash_latency13,
+			disk_hash_latency14,
+			disk_hash_latency15,
+			disk_hash_latency16,
+			disk_hash_latency17,
+			disk_hash_latency18,
+			disk_hash_latency19,
+			disk_hash_latency20,
+			disk_hash_latency21,
+			disk_hash_latency22,
+			disk_hash_latency23,
+			disk_hash_latency24,
+
+			// the time it took to perform all other disk jobs
+			disk_other_latency3,
+			disk_other_latency4,
+			disk_other_latency5,
+			disk_other_latency6,
+			disk_other_latency7,
+			disk_other_latency8,
+			disk_other_latency9,
+			disk_other_latency10,
+			disk_other_latency11,
+			disk_other_latency12,
+			disk_other_latency13,
+			disk_other_latency14,
+			disk_other_latency15,
+			disk_other_latency16,
+			disk_other_latency17,
+			disk_other_latency18,
+			disk_other_latency19,
+			disk_other_latency20,
+			disk_other_latency21,
+			disk_other_latency22,
+			disk_other_latency23,
+			disk_other_latency24,
+
+			// the time disk jobs spent queued (or blocked by a fence)
+			// before a disk thread picked them up
+			disk_queue_latency3,
+			disk_queue_latency4,
+			disk_queue_latency5,
+			disk_queue_latency6,
+			disk_queue_latency7,
+			disk_queue_latency8,
+			disk_queue_latency9,
+			disk_queue_latency10,
+			disk_queue_latency11,
+			disk_queue_latency12,
+			disk_queue_latency13,
+			disk_queue_latency14,
+			disk_queue_latency15,
+			disk_queue_latency16,
+			disk_queue_latency17,
+			disk_queue_latency18,
+			disk_queue_latency19,
+			disk_queue_latency20,
+			disk_queue_latency21,
+			disk_queue_latency22,
+			disk_queue_latency23,
+			disk_queue_latency24,
+
+			// the time from receiving a request from a peer until
+			// the piece was put in the send buffer
+			request_latency3,
+			request_latency4,
+			request_latency5,
+			request_latency6,
+			request_latency7,
+			request_latency8,
+			request_latency9,
+			request_latency10,
+			request_latency11,
+			request_latency12,
+			request_latency13,
+			request_latency14,
+			request_latency15,
+			request_latency16,
+			request_latency17,
+			request_latency18,
+			request_latency19,
+			request_latency20,
+			request_latency21,
+			request_latency22,
+			request_latency23,
+			request_latency24,
+
 			num_stats_counters
 		};
 
@@ -392,6 +556,7 @@ namespace libtorrent
 			arc_mfu_ghost_size,
 			arc_write_size,
 			arc_volatile_size,
+			cache_size_limit,
 
 			dht_nodes,
 			dht_node_cache,
@@ -412,30 +577,107 @@ namespace libtorrent
 			num_gauge_counters = num_counters - num_stats_counters
 		};
 
+		enum
+		{
+			// the exponent of the first latency histogram bucket
+			// and the number of buckets in each histogram
+			first_latency_bucket = 3,
+			num_latency_buckets = 22
+		};
+
+		// returns the offset of the bucket a latency sample falls in, from
+		// the first counter of a histogram
+		static int latency_bucket(boost::int64_t microseconds)
+		{
+			int n = 0;
+			while (n < first_latency_bucket + num_latency_buckets - 1
+				&& (microseconds >> n) > 0) ++n;
+			return (std::max)(n - first_latency_bucket, 0);
+		}
+
+		// records a latency sample in the histogram whose first bucket
+		// counter is ``histogram``, e.g. counters::disk_read_latency3
+		void add_latency_sample(int histogram, boost::int64_t microseconds)
+		{ inc_stats_counter(histogram + latency_bucket(microseconds)); }
+
 		counters();
 
 		counters(counters const&);
 		counters& operator=(counters const&);
 
-		// returns the new value
-		boost::int64_t inc_stats_counter(int c, boost::int64_t value = 1);
+		// increments (or decrements, for gauges) counter ``c``. This only
+		// touches the calling thread's shard of the counters, so threads
+		// incrementing counters don't contend on the same cache lines.
+		// Read the counter with operator[] if the new value is needed.
+		void inc_stats_counter(int c, boost::int64_t value = 1);
+
+		// returns the current value of counter ``i``, summed over all
+		// shards
 		boost::int64_t operator[](int i) const;
 
+		// copies the current value of every counter into ``values``, which
+		// must have room for num_counters elements. This is a lot cheaper
+		// than calling operator[] for each counter.
+		void snapshot(boost::int64_t* values) const;
+
+		// like snapshot(), but ``values`` is expected to hold the previous
+		// snapshot. It's updated to the current values and the difference
+		// for each counter is written to ``delta``. For gauges the
+		// difference is how much the gauge moved. This lets a poller
+		// compute rates without keeping a second copy.
+		void snapshot_delta(boost::int64_t* values, boost::int64_t* delta) const;
+
+		// sets the counter to ``value``. Increments made by other threads
+		// at the same time are either replaced by it or added to it, none
+		// are lost
 		void set_value(int c, boost::int64_t value);
 		void blend_stats_counter(int c, boost::int64_t value, int ratio);
 
 	private:
 
 		// TODO: some space could be saved here by making gauges 32 bits
-		// TODO: restore these to regular integers. Instead have one copy
-		// of the counters per thread and collect them at convenient
-		// synchronization points
 #if BOOST_ATOMIC_LLONG_LOCK_FREE == 2
-		boost::atomic<boost::int64_t> m_stats_counter[num_counters];
+
+		enum
+		{
+#ifdef TORRENT_THREAD_LOCAL
+			// the network thread and the disk threads each get their own
+			// shard, as long as there are fewer threads than this. Threads
+			// beyond that share shards, which is still correct since the
+			// shards are atomic
+			num_shards = 8,
+#else
+			num_shards = 1,
+#endif
+			cache_line_size = 64
+		};
+
+		// returns the shard for the calling thread
+		static int shard_index();
+
+		// the sum of all shards for counter ``c``
+		boost::int64_t shard_sum(int c) const;
+
+		// clears all shards for counter ``c`` and returns what they held
+		boost::int64_t fold_shards(int c);
+
+		// each thread increments counters in its own shard. The value of a
+		// counter is the base value plus the sum of all shards. The padding
+		// keeps counters of different shards on separate cache lines
+		struct shard_t
+		{
+			boost::atomic<boost::int64_t> counter[num_counters];
+			char padding[cache_line_size];
+		};
+		shard_t m_shards[num_shards];
+
+		// absolute values written by set_value() and blend_stats_counter()
+		// are stored here, with the shards cleared at the time
+		boost::atomic<boost::int64_t> m_base[num_counters];
 #else
 		// if the atomic type is't lock-free, use a single lock instead, for
 		// the whole array
-		mutex m_mutex;
+		mutable mutex m_mutex;
 		boost::int64_t m_stats_counter[num_counters];
 #endif
 	};
@@ -6,6 +6,10 @@
 namespace libtorrent
 {
 	boost::uint64_t total_physical_ram();
+
+	// returns the number of bytes of memory available to start new
+	// applications without swapping, or 0 if it's not known
+	boost::uint64_t available_physical_ram();
 }
 
 #endif // TORRENT_PLATFORM_UTIL_HPP
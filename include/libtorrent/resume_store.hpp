@@ -0,0 +1,192 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_RESUME_STORE_HPP_INCLUDED
+#define TORRENT_RESUME_STORE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/file.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/peer_id.hpp" // for sha1_hash
+
+namespace libtorrent
+{
+	struct save_resume_data_alert;
+
+	// resume_store keeps the resume data of all torrents in a session in a
+	// single file, as an alternative to one .fastresume file per torrent.
+	//
+	// The file is append-only. Saving the resume data for a torrent appends
+	// a record and supersedes any earlier record for the same info-hash, so
+	// a save only writes the torrents that are passed to it. Combined with
+	// the torrent_handle::only_if_modified flag, periodic saves only write
+	// the torrents whose state actually changed. A record that's identical
+	// to the one already stored isn't written at all.
+	//
+	// Every record has a checksummed header and a checksum of its payload.
+	// When the file is opened, it's mapped into memory (where supported) and
+	// only the record headers are scanned. A payload is verified the first
+	// time it's loaded. A partially written record at the end of the file,
+	// e.g. from a crash in the middle of a save, is discarded. A record
+	// whose header is corrupt is skipped, and the records after it are
+	// still loaded. Since the skipped record may have superseded (or
+	// removed) an earlier record of its torrent, the earlier one isn't
+	// used either when the info-hash in the corrupt header matches it. The
+	// torrent is removed from the store instead. See
+	// corrupt_records() and corrupt_torrents().
+	//
+	// Since superseded records are left in the file, it grows over time.
+	// Call compact() when garbage() becomes large relative to file_size().
+	//
+	// The payload of a record is the bencoded resume data, the same as
+	// add_torrent_params::resume_data expects. The cheapest way to produce
+	// it is to save resume data with the torrent_handle::save_bencoded flag.
+	//
+	// resume_store is not thread safe.
+	struct TORRENT_EXPORT resume_store : boost::noncopyable
+	{
+		resume_store();
+		~resume_store();
+
+		// opens the store at ``path``, creating it if it doesn't exist, and
+		// builds the index of the torrents in it.
+		void open(std::string const& path, error_code& ec);
+		void close();
+		bool is_open() const { return m_file.is_open(); }
+
+		// stores the resume data in ``buf`` for the torrent with info-hash
+		// ``ih``, replacing any previous resume data for it.
+		void save(sha1_hash const& ih, char const* buf, int size, error_code& ec);
+		void save(sha1_hash const& ih, std::vector<char> const& buf, error_code& ec);
+
+		// stores the resume data from a save_resume_data_alert. The resume
+		// data is taken from resume_buffer if it's set, otherwise
+		// resume_data is encoded.
+		void save(save_resume_data_alert const& a, error_code& ec);
+
+		// removes the resume data for the torrent with info-hash ``ih``,
+		// for instance when the torrent is removed from the session
+		void remove(sha1_hash const& ih, error_code& ec);
+
+		// copies the resume data for ``ih`` into ``buf``. Returns false if
+		// there is no resume data for the torrent, or if it couldn't be
+		// read, in which case ``ec`` is set. If the payload fails its
+		// checksum, ``ec`` is set to errors::resume_record_corrupt.
+		bool load(sha1_hash const& ih, std::vector<char>& buf, error_code& ec) const;
+
+		// returns the info-hashes of all the torrents in the store
+		void torrents(std::vector<sha1_hash>& ret) const;
+		int num_torrents() const { return int(m_index.size()); }
+
+		// the number of regions with corrupt record headers that were
+		// skipped when the store was opened. Each of them may have held the
+		// latest record of a torrent. The ones that could be attributed to a
+		// torrent are returned by corrupt_torrents(), and those torrents are
+		// removed from the store. If this is larger than the number of
+		// corrupt torrents, some torrents may have fallen back to an older
+		// record, or been removed and come back
+		int corrupt_records() const { return m_corrupt_records; }
+		void corrupt_torrents(std::vector<sha1_hash>& ret) const;
+
+		// rewrites the file with only the current record for each torrent,
+		// dropping the superseded ones. If the new file can't replace the
+		// old one, ``ec`` is set and the store stays open, with the old file.
+		void compact(error_code& ec);
+
+		// the size of the file and the number of bytes in it taken up by
+		// superseded records
+		boost::int64_t file_size() const { return m_end; }
+		boost::int64_t garbage() const { return m_end - m_live_bytes; }
+
+		// makes sure everything saved so far is written to the disk
+		void flush(error_code& ec);
+
+	private:
+
+		struct record
+		{
+			// the offset of the payload in the file
+			boost::int64_t offset;
+			int size;
+			boost::uint32_t crc;
+		};
+
+		void append(sha1_hash const& ih, int flags, char const* buf, int size
+			, boost::uint32_t crc, error_code& ec);
+		bool read(boost::int64_t offset, char* buf, int size, error_code& ec) const;
+		void scan(boost::int64_t file_size, error_code& ec);
+
+		// returns the offset of the first valid record header at or after
+		// ``offset``, or -1 if there is none
+		boost::int64_t find_record(boost::int64_t offset, boost::int64_t file_size
+			, error_code& ec) const;
+		void map_file(boost::int64_t size);
+		void unmap_file();
+
+		std::string m_path;
+		file m_file;
+
+		// the current record of every torrent in the store
+		std::map<sha1_hash, record> m_index;
+
+		// the torrents whose latest record has a corrupt header, see
+		// corrupt_torrents()
+		std::set<sha1_hash> m_corrupt;
+		int m_corrupt_records;
+
+		// the end of the last valid record. New records are appended here
+		boost::int64_t m_end;
+
+		// the number of bytes in the file that belong to current records,
+		// including the file header
+		boost::int64_t m_live_bytes;
+
+		// the file is mapped into memory when it's opened. Records are read
+		// from the mapping when they end before m_mapped_end, and with
+		// regular reads otherwise (i.e. records appended since the file was
+		// mapped)
+		char const* m_mapping;
+		boost::int64_t m_mapping_size;
+		boost::int64_t m_mapped_end;
+	};
+}
+
+#endif // TORRENT_RESUME_STORE_HPP_INCLUDED
+
@@ -138,6 +138,16 @@ namespace libtorrent
 	// values array returned by session_stats_alert.
 	TORRENT_EXPORT int find_metric_idx(char const* name);
 
+	// estimates a percentile of one of the latency histograms, in
+	// microseconds. ``buckets`` points to the first bucket of the histogram,
+	// for instance the value at find_metric_idx("disk.disk_read_latency3")
+	// in session_stats_alert::values. ``ppm`` is the percentile in parts
+	// per million, i.e. 500000 for the median and 999000 for p99.9. To get
+	// the latency over an interval rather than since the session started,
+	// pass the difference between two samples of the counters.
+	TORRENT_EXPORT boost::int64_t latency_percentile(boost::uint64_t const* buckets
+		, int ppm);
+
 	void TORRENT_EXPORT TORRENT_CFG();
 
 	namespace aux
@@ -356,6 +366,11 @@ namespace libtorrent
 		// 
 		// Any torrent_status object whose ``handle`` member is not referring to
 		// a valid torrent are ignored.
+		// 
+		// When settings_pack::status_snapshot_interval is set, and ``flags``
+		// are covered by settings_pack::status_snapshot_flags, both functions
+		// return the status published by the network thread at the last
+		// interval, and ``pred`` is called in the calling thread.
 		void get_torrent_status(std::vector<torrent_status>* ret
 			, boost::function<bool(torrent_status const&)> const& pred
 			, boost::uint32_t flags = 0) const;
@@ -370,6 +385,21 @@ namespace libtorrent
 		// included. This flag is on by default. See add_torrent_params.
 		void post_torrent_updates();
 
+		// This function instructs the session to post a state_delta_alert.
+		// It's a cheaper alternative to post_torrent_updates() for clients
+		// with a large number of torrents. ``fields`` is the set of
+		// status_delta fields the client is interested in, formed by or-ing
+		// together status_delta_mask() of each field. The alert includes a
+		// record for every torrent where any of those fields changed since it
+		// was last reported, with just the fields that changed. Fields that
+		// weren't part of the previous call's ``fields`` are always included.
+		// Bits that don't correspond to a field are ignored.
+		// No torrent_status objects are constructed.
+		// 
+		// This function and post_torrent_updates() consume the same set of
+		// updated torrents, a client should use one or the other.
+		void post_torrent_deltas(boost::uint32_t fields);
+
 		// This function will post a session_stats_alert object, containing a
 		// snapshot of the performance counters from the internals of libtorrent.
 		// To interpret these counters, query the session via
@@ -378,6 +408,20 @@ namespace libtorrent
 		// For more information, see the session-statistics_ section.
 		void post_session_stats();
 
+		// This function will post a latency_histogram_alert, containing
+		// the latency histograms of disk jobs and peer requests.
+		void post_latency_histograms();
+
+		// performs all operations in ``ops``, in order, in a single call into
+		// the network thread. This is a lot cheaper than calling the
+		// corresponding torrent_handle functions one at a time, when
+		// operating on many torrents. Returns one error_code per operation.
+		// It's set to invalid_torrent_handle if the operation's handle does
+		// not refer to a torrent in the session, and to invalid_argument if
+		// ``value`` is out of range for the operation.
+		std::vector<error_code> apply_torrent_operations(
+			std::vector<torrent_operation> const& ops);
+
 		// internal
 		io_service& get_io_service();
 
@@ -498,6 +542,15 @@ namespace libtorrent
 		// The signature of the function to pass in is::
 		// 
 		// 	void fun(sha1_hash const& info_hash, std::vector<char>& buf, error_code& ec);
+		// 
+		// When a load function is set, a torrent can be added with just its
+		// info-hash and resume data (without ``ti``), as long as the resume
+		// data was saved while the torrent had its metadata. Such torrents are
+		// added unloaded, and are not loaded (and their files not checked)
+		// until they are started. Adding a large number of queued torrents
+		// this way on startup is cheap. Note that pinned torrents are always
+		// loaded, and add_torrent_params::flag_pinned is part of the default
+		// flags. Clear it for the torrents to be added unloaded.
 		void set_load_function(user_load_function_t fun);
 
 		// returns session wide-statistics and status. For more information, see
@@ -1118,6 +1171,16 @@ namespace libtorrent
 		// Alternatively, you can pass in the same container the next time you
 		// call ``pop_alerts``.
 		// 
+		// The overload taking a ``std::vector<alert*>`` does not transfer
+		// ownership. The alerts are constructed in an arena owned by the
+		// session, and the returned pointers stay valid until the next call to
+		// ``pop_alerts()`` with a vector, at which point they are all freed at
+		// once. The caller must not delete them. This avoids a heap allocation
+		// and a copy per alert, and if the same vector is passed in every
+		// time, popping alerts doesn't allocate any memory. The ``std::deque``
+		// overload and ``pop_alert()`` return copies of the alerts, for
+		// compatibility.
+		// 
 		// ``wait_for_alert`` blocks until an alert is available, or for no more
 		// than ``max_wait`` time. If ``wait_for_alert`` returns because of the
 		// time-out, and no alerts are available, it returns 0. If at least one
@@ -1144,6 +1207,7 @@ namespace libtorrent
 		// posted, regardelss of the alert mask.
 		std::auto_ptr<alert> pop_alert();
 		void pop_alerts(std::deque<alert*>* alerts);
+		void pop_alerts(std::vector<alert*>* alerts);
 		alert const* wait_for_alert(time_duration max_wait);
 
 #ifndef TORRENT_NO_DEPRECATE
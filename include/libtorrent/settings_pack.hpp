@@ -625,6 +625,29 @@ namespace libtorrent
 			// is unlikely to matter anyway
 			auto_sequential,
 
+			// when true, the kernel send and receive buffers of each peer socket
+			// are sized from that peer's estimated bandwidth-delay product
+			// (its transfer rate times its round-trip time) instead of the fixed
+			// ``send_socket_buffer_size`` and ``recv_socket_buffer_size``. Those
+			// settings, if non-zero, become the upper bound of the automatic
+			// sizes. The send buffer watermark is raised to cover the estimated
+			// bandwidth-delay product as well. A socket is left alone as long
+			// as the operating system's own buffer autotuning already gives
+			// it enough room, since setting the size explicitly turns
+			// autotuning off. When this setting is disabled again, the
+			// buffers are set back to the fixed sizes (or the sizes the
+			// operating system had picked).
+			auto_socket_buffers,
+
+			// when true, the disk cache size is adjusted automatically between
+			// ``min_cache_size`` and ``max_cache_size``, starting at
+			// ``cache_size``. It grows when reads hit the ARC ghost lists (i.e.
+			// pieces that were evicted, but would have been cache hits in a
+			// larger cache) and shrinks when the system is low on free memory.
+			// See ``adaptive_cache_free_memory``. The mmap cache can't be
+			// resized, so this has no effect when ``mmap_cache`` is set.
+			adaptive_cache_size,
+
 			max_bool_setting_internal,
 			num_bool_settings = max_bool_setting_internal - bool_type_base
 		};
@@ -1460,6 +1483,51 @@ namespace libtorrent
 			// .. _i2p: http://www.i2p2.de
 			i2p_port,
 
+			// enables sampling based per-torrent cpu accounting. Ticks, piece
+			// picks and peer receive handlers are sampled independently. One in
+			// every ``cpu_sample_rate`` of each is timed, and the time is
+			// attributed to its torrent, scaled up by the sample rate. 0 disables the accounting. The estimates are
+			// reported in torrent_status and in top_torrents_alert.
+			cpu_sample_rate,
+
+			// the number of seconds between posting top_torrents_alert, with
+			// the ``top_torrents_count`` torrents that used the most cpu time
+			// and disk cache during the interval. 0 disables the alert.
+			top_torrents_interval,
+			top_torrents_count,
+
+			// when set, the network thread publishes a snapshot of the status
+			// of every torrent this often (in seconds). torrent_handle::status(),
+			// session::get_torrent_status(), session::refresh_torrent_status()
+			// and session::get_torrents() are then served from the latest
+			// snapshot, without waiting for the network thread, as long as the
+			// flags passed to them are covered by ``status_snapshot_flags``.
+			// Only torrents whose state changed since the last snapshot are
+			// updated, so the returned status may be up to this many seconds
+			// old, and timers of idle torrents may be older. 0 disables
+			// snapshots.
+			status_snapshot_interval,
+
+			// the torrent_handle::status_flags_t the status snapshots are built
+			// with. Asking for a status with flags outside of this set goes to
+			// the network thread. By default, all fields are included, so that
+			// the default flags of torrent_handle::status() are served from
+			// the snapshot. Leaving out the expensive ones, like ``query_pieces``
+			// and ``query_resource_usage``, makes publishing snapshots cheaper.
+			status_snapshot_flags,
+
+			// the bounds of the disk cache size, in 16 kiB blocks, when
+			// ``adaptive_cache_size`` is enabled. -1 for ``max_cache_size``
+			// means a quarter of the physical RAM.
+			min_cache_size,
+			max_cache_size,
+
+			// when ``adaptive_cache_size`` is enabled, the cache is shrunk
+			// whenever the system's available memory is below this percentage
+			// of the physical RAM. It's only supported on linux (where it's read
+			// from /proc/meminfo) and windows.
+			adaptive_cache_free_memory,
+
 			max_int_setting_internal,
 
 			num_int_settings = max_int_setting_internal - int_type_base
@@ -54,6 +54,25 @@ namespace libtorrent
 	TORRENT_EXPORT std::string endpoint_to_bytes(udp::endpoint const& ep);
 	TORRENT_EXTRA_EXPORT void hash_address(address const& ip, sha1_hash& h);
 
+	// returns the kernel's smoothed round-trip time estimate of the TCP
+	// connection, in milliseconds. If ``deviation`` is not null, it's set
+	// to the kernel's estimate of the RTT's variation. Returns -1 if the
+	// operating system doesn't provide an estimate. Unlike the RTT we
+	// measure ourselves, this is available for connections we only send
+	// data over
+	TORRENT_EXTRA_EXPORT int tcp_rtt(tcp::socket& s, int* deviation = 0);
+
+	// returns the number of bytes in flight on a connection transferring
+	// ``rate`` bytes per second with the given round-trip time (in
+	// milliseconds). RTTs below 20 ms are not trusted, and rounded up
+	TORRENT_EXTRA_EXPORT int bandwidth_delay_product(boost::int64_t rate, int rtt);
+
+	// returns the kernel socket buffer size to use for a connection with
+	// the given bandwidth-delay product. Twice the BDP lets the sender
+	// keep the pipe full while the receiver is still acknowledging the
+	// previous window. The result is clamped to [16 kiB, max_size]
+	TORRENT_EXTRA_EXPORT int socket_buffer_target(int bdp, int max_size);
+
 	namespace detail
 	{
 		template<class OutIt>
@@ -0,0 +1,170 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_STATUS_DELTA_HPP_INCLUDED
+#define TORRENT_STATUS_DELTA_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/peer_id.hpp" // for sha1_hash
+#include "libtorrent/assert.hpp"
+
+#include <boost/cstdint.hpp>
+#include <vector>
+
+namespace libtorrent
+{
+	// the fields that can be subscribed to via session::post_torrent_deltas().
+	// Each field is a 64 bit integer. The mask of fields to subscribe to is
+	// formed by or-ing together ``1 << field``, see status_delta_mask().
+	struct status_delta
+	{
+		enum field_t
+		{
+			// the torrent_status::state_t of the torrent
+			state,
+
+			// a bitmask of the flag_t bits below
+			flags,
+
+			// the same fields as in torrent_status
+			progress_ppm,
+			total_done,
+			total_wanted_done,
+			total_wanted,
+			total_download,
+			total_upload,
+			total_payload_download,
+			total_payload_upload,
+			all_time_download,
+			all_time_upload,
+			download_rate,
+			upload_rate,
+			download_payload_rate,
+			upload_payload_rate,
+			num_peers,
+			num_seeds,
+			num_complete,
+			num_incomplete,
+			num_connections,
+			num_uploads,
+			list_peers,
+			list_seeds,
+			queue_position,
+			num_pieces,
+			active_time,
+			finished_time,
+			seeding_time,
+
+			num_fields
+		};
+
+		// the bits of the ``flags`` field
+		enum flag_t
+		{
+			paused = 0x1,
+			auto_managed = 0x2,
+			is_seeding = 0x4,
+			is_finished = 0x8,
+			has_metadata = 0x10,
+			upload_mode = 0x20,
+			share_mode = 0x40,
+			super_seeding = 0x80,
+			sequential_download = 0x100,
+			has_error = 0x200,
+			need_save_resume = 0x400,
+			moving_storage = 0x800,
+			is_loaded = 0x1000
+		};
+	};
+
+	// returns the mask with the bit for ``field`` set
+	inline boost::uint32_t status_delta_mask(int field)
+	{
+		TORRENT_ASSERT(field >= 0 && field < status_delta::num_fields);
+		return boost::uint32_t(1) << field;
+	}
+
+	// appends one record to ``buf``. ``values`` is indexed by field, only
+	// the fields set in ``fields`` are read. The record is the info-hash,
+	// followed by the mask of fields, followed by the value of each field
+	// in the mask, in field order. All in host byte order.
+	TORRENT_EXTRA_EXPORT void append_status_delta(std::vector<char>& buf
+		, sha1_hash const& info_hash, boost::uint32_t fields
+		, boost::int64_t const* values);
+
+	// iterates over the records in the buffer of a state_delta_alert. The
+	// reader doesn't copy the buffer, it must stay alive for as long as the
+	// reader is used. Typical use::
+	//
+	//	status_delta_reader r(&a->buffer[0], a->buffer.size());
+	//	while (r.next())
+	//	{
+	//		torrent_entry& e = my_torrents[r.info_hash()];
+	//		if (r.has(status_delta::download_rate))
+	//			e.download_rate = r.value(status_delta::download_rate);
+	//	}
+	struct TORRENT_EXPORT status_delta_reader
+	{
+		status_delta_reader(char const* buf, int size);
+
+		// moves to the next record. Returns false when there are no more
+		// records, or if the buffer is malformed.
+		bool next();
+
+		// the info-hash of the torrent of the current record
+		sha1_hash const& info_hash() const { return m_info_hash; }
+
+		// the mask of fields present in the current record
+		boost::uint32_t fields() const { return m_fields; }
+
+		bool has(int field) const
+		{ return (m_fields & status_delta_mask(field)) != 0; }
+
+		// the value of ``field`` in the current record. Only valid
+		// if has(field) returns true
+		boost::int64_t value(int field) const
+		{
+			TORRENT_ASSERT(has(field));
+			return m_values[field];
+		}
+
+	private:
+		char const* m_cursor;
+		char const* m_end;
+		sha1_hash m_info_hash;
+		boost::uint32_t m_fields;
+		boost::int64_t m_values[status_delta::num_fields];
+	};
+}
+
+#endif // TORRENT_STATUS_DELTA_HPP_INCLUDED
+
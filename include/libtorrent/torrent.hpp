@@ -79,6 +79,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/vector_utils.hpp"
 #include "libtorrent/linked_list.hpp"
 #include "libtorrent/debug.hpp"
+#include "libtorrent/time.hpp"
 
 #if TORRENT_COMPLETE_TYPES_REQUIRED
 #include "libtorrent/peer_connection.hpp"
@@ -106,6 +107,7 @@ namespace libtorrent
 	struct storage_interface;
 	class bt_peer_connection;
 	struct listen_socket_t;
+	struct bencode_writer;
 
 
 	TORRENT_EXTRA_EXPORT void initialize_file_progress(
@@ -123,6 +125,24 @@ namespace libtorrent
 		lazy_entry entry;
 	};
 
+	// a torrent_status published by the network thread for other threads
+	// to read, see settings_pack::status_snapshot_interval. ``flags`` are
+	// the torrent_handle::status_flags_t it was built with
+	struct status_snapshot_entry
+	{
+		torrent_status status;
+		boost::uint32_t flags;
+	};
+
+	// returns true if ``st`` includes all the fields asked for by ``flags``
+	inline bool status_snapshot_covers(status_snapshot_entry const& st
+		, boost::uint32_t flags)
+	{
+		boost::uint32_t const all_flags
+			= (torrent_handle::query_resource_usage << 1) - 1;
+		return (flags & all_flags & ~st.flags) == 0;
+	}
+
 	struct time_critical_piece
 	{
 		// when this piece was first requested
@@ -407,6 +427,8 @@ namespace libtorrent
 		size_type bytes_left() const;
 		int block_bytes_wanted(piece_block const& p) const;
 		void bytes_done(torrent_status& st, bool accurate) const;
+		bool bytes_done(size_type& total_done, size_type& total_wanted_done
+			, size_type& total_wanted) const;
 		size_type quantized_bytes_done() const;
 
 		void sent_bytes(int bytes_payload, int bytes_protocol);
@@ -514,6 +536,63 @@ namespace libtorrent
 
 		void status(torrent_status* st, boost::uint32_t flags);
 
+		// appends a record of the status_delta fields in ``fields`` that
+		// changed since the last call, to ``buf``. Returns false if nothing
+		// changed, in which case nothing is appended
+		bool status_delta(std::vector<char>& buf, boost::uint32_t fields);
+
+		// the kinds of work the per-torrent cpu accounting distinguishes.
+		// Picking pieces is typically done while handling a peer message, so
+		// that time is counted in both cpu_picker and cpu_peer_messages
+		enum cpu_category_t
+		{
+			cpu_tick,
+			cpu_picker,
+			cpu_peer_messages,
+			num_cpu_categories
+		};
+
+		void add_cpu_time(int category, boost::int64_t us)
+		{
+			TORRENT_ASSERT(category >= 0 && category < num_cpu_categories);
+			m_cpu_time[category] += us;
+		}
+
+		// the estimated number of microseconds the network thread has spent
+		// on this torrent, in the given category
+		boost::int64_t cpu_time(int category) const
+		{
+			TORRENT_ASSERT(category >= 0 && category < num_cpu_categories);
+			return m_cpu_time[category];
+		}
+
+		// returns the estimated cpu time of all categories since the last
+		// call. Used for the top_torrents_alert
+		boost::int64_t cpu_time_since_report();
+
+		// replaces the status snapshot read by torrent_handle::status() with
+		// the current status, built with ``flags``. If those include
+		// query_resource_usage, ``cached_blocks`` is the number of blocks
+		// this torrent has in the disk cache, the session queries those for
+		// all torrents at once
+		void publish_status_snapshot(boost::uint32_t flags, int cached_blocks);
+		void clear_status_snapshot();
+
+		// returns the last published status snapshot, or an empty pointer if
+		// there isn't one. This may be called from any thread
+		boost::shared_ptr<status_snapshot_entry const> status_snapshot() const
+		{ return boost::atomic_load(&m_status_snapshot); }
+
+		// returns true if this torrent's state changed since its status
+		// snapshot was published
+		bool in_snapshot_update() const
+		{ return m_links[aux::session_interface::torrent_snapshot_updates].in_list(); }
+		void clear_in_snapshot_update()
+		{
+			TORRENT_ASSERT(in_snapshot_update());
+			m_links[aux::session_interface::torrent_snapshot_updates].clear();
+		}
+
 		// this torrent changed state, if the user is subscribing to
 		// it, add it to the m_state_updates list in session_impl
 		void state_updated();
@@ -899,6 +978,7 @@ namespace libtorrent
 		bool is_seed() const
 		{
 			if (!valid_metadata()) return false;
+			if (m_deferred_init) return m_deferred_seed;
 			if (m_have_all) return true;
 			if (m_picker && m_picker->num_passed() == m_picker->num_pieces()) return true;
 			return m_state == torrent_status::seeding;
@@ -909,6 +989,7 @@ namespace libtorrent
 		bool is_finished() const
 		{
 			if (is_seed()) return true;
+			if (m_deferred_init) return m_deferred_finished;
 
 			// this is slightly different from m_picker->is_finished()
 			// because any piece that has *passed* is considered here,
@@ -966,8 +1047,24 @@ namespace libtorrent
 		torrent_handle get_handle();
 
 		void write_resume_data(entry& rd) const;
+
+		// encodes the resume data as a dictionary with ``w``. The items of
+		// ``storage_rd`` (the storage's part of the resume data) are
+		// included, if it's not null
+		void write_resume_data(bencode_writer& w, entry const* storage_rd) const;
+
+		// posts the save_resume_data_alert, with the resume data encoded
+		// according to the save_resume_data() flags. ``storage_rd`` may be
+		// empty
+		void post_resume_data(boost::shared_ptr<entry> const& storage_rd);
 		void read_resume_data(lazy_entry const& rd);
 
+		// the part of read_resume_data() that doesn't need the metadata to
+		// be loaded. i.e. the stats, rate limits, paused and auto-managed
+		// state and the trackers. For torrents whose loading is deferred,
+		// these are read when they're added
+		void read_resume_settings(lazy_entry const& rd);
+
 		void seen_complete() { m_last_seen_complete = time(0); }
 		int time_since_complete() const { return int(time(0) - m_last_seen_complete); }
 		time_t last_seen_complete() const { return m_last_seen_complete; }
@@ -1101,6 +1198,21 @@ namespace libtorrent
 
 		void inc_stats_counter(int c, int value = 1);
 
+		// the implementation of both write_resume_data() overloads.
+		// ``Writer`` is either a bencode_writer or an entry_writer
+		template <class Writer>
+		void write_resume_data_impl(Writer& w, entry const* storage_rd) const;
+
+		// updates the fields of ``rd`` (the resume data this torrent was
+		// added with) that may change while the torrent isn't loaded. Those
+		// are the fields read by read_resume_settings()
+		void write_resume_settings(entry& rd) const;
+
+		// returns true if m_resume_data is resume data for this torrent. If
+		// it's for another torrent, or the wrong format, it's rejected (and
+		// m_resume_data is reset)
+		bool validate_resume_data();
+
 		// initialize the torrent_state structure passed to peer_list
 		// member functions. Don't forget to also call peers_erased()
 		// on the erased member after the peer_list call
@@ -1290,6 +1402,24 @@ namespace libtorrent
 
 		storage_constructor_type m_storage_constructor;
 
+		// the values of the status_delta fields last reported by
+		// status_delta(), and the mask of fields they were reported for.
+		// The vector is allocated the first time this torrent is included
+		// in a state_delta_alert
+		std::vector<boost::int64_t> m_delta_values;
+		boost::uint32_t m_delta_fields;
+
+		// the sampled cpu time spent on this torrent, in microseconds, per
+		// cpu_category_t. And the sum of them the last time it was reported
+		// in a top_torrents_alert
+		boost::int64_t m_cpu_time[num_cpu_categories];
+		boost::int64_t m_reported_cpu_time;
+
+		// the status published by publish_status_snapshot(). It's read by
+		// other threads, and must only be accessed with boost::atomic_load()
+		// and boost::atomic_store()
+		boost::shared_ptr<status_snapshot_entry const> m_status_snapshot;
+
 		// the posix time this torrent was added and when
 		// it was completed. If the torrent isn't yet
 		// completed, m_completed_time is 0
@@ -1663,6 +1793,21 @@ namespace libtorrent
 		// present
 		bool m_use_resume_save_path:1;
 
+		// this is set for torrents added from their resume data alone (with
+		// the metadata unloaded). init() is deferred until the torrent is
+		// loaded, which happens the first time it's started or needed
+		bool m_deferred_init:1;
+
+		// while init() is deferred, there's no piece picker. These are
+		// whether the resume data says the torrent is a seed and finished,
+		// and are what is_seed() and is_finished() return until it's loaded
+		bool m_deferred_seed:1;
+		bool m_deferred_finished:1;
+
+		// set once read_resume_settings() has been applied, to not apply it
+		// again (and overwrite changes made since) when the torrent is loaded
+		bool m_resume_settings_read:1;
+
 #if TORRENT_USE_ASSERTS
 	public:
 		// set to false until we've loaded resume data
@@ -1687,6 +1832,53 @@ namespace libtorrent
 		char const* m_purpose;
 	};
 
+	// times the scope it lives in, and attributes the time to the torrent's
+	// cpu accounting in ``category``, if the session picks this operation
+	// to be sampled. ``t`` may be null, in which case nothing is recorded
+	struct cpu_sample
+	{
+		cpu_sample(torrent* t, int category)
+			: m_rate(t ? t->session().sample_cpu(category) : 0)
+			, m_category(category)
+		{
+			if (m_rate == 0) return;
+			// hold a reference, in case the torrent is removed by the
+			// operation we're timing
+			m_torrent = t->shared_from_this();
+			m_start = time_now_hires();
+		}
+
+		// for callers that only hold a weak reference to the torrent. It's
+		// only locked if this operation is sampled
+		cpu_sample(boost::weak_ptr<torrent> const& t
+			, aux::session_interface& ses, int category)
+			: m_rate(ses.sample_cpu(category))
+			, m_category(category)
+		{
+			if (m_rate == 0) return;
+			m_torrent = t.lock();
+			if (!m_torrent)
+			{
+				m_rate = 0;
+				return;
+			}
+			m_start = time_now_hires();
+		}
+
+		~cpu_sample()
+		{
+			if (m_rate == 0) return;
+			m_torrent->add_cpu_time(m_category
+				, total_microseconds(time_now_hires() - m_start) * m_rate);
+		}
+
+	private:
+		boost::shared_ptr<torrent> m_torrent;
+		ptime m_start;
+		int m_rate;
+		int m_category;
+	};
+
 }
 
 #endif // TORRENT_TORRENT_HPP_INCLUDED
@@ -324,7 +324,11 @@ namespace libtorrent
 			query_name = 64,
 			// includes ``save_path``, the path to the directory the files of the
 			// torrent are saved to.
-			query_save_path = 128
+			query_save_path = 128,
+			// includes ``tick_time``, ``picker_time``, ``peer_message_time``
+			// and ``cached_blocks``. Counting the cached blocks requires
+			// locking the disk cache.
+			query_resource_usage = 256
 		};
 
 		// ``status()`` will return a structure with information about the status
@@ -337,6 +341,12 @@ namespace libtorrent
 		// 
 		// By default everything is included. The flags you can use to decide
 		// what to *include* are defined in the status_flags_t enum.
+		// 
+		// When settings_pack::status_snapshot_interval is set, and ``flags``
+		// are covered by settings_pack::status_snapshot_flags, the status is
+		// returned from the last snapshot, without waiting for the network
+		// thread. The default ``flags`` ask for every field, which is covered
+		// by the default ``status_snapshot_flags``.
 		torrent_status status(boost::uint32_t flags = 0xffffffff) const;
 
 		// ``get_download_queue()`` takes a non-const reference to a vector which
@@ -615,6 +625,13 @@ namespace libtorrent
 			// saving, a save_resume_data_failed_alert is posted with the error
 			// resume_data_not_modified.
 			only_if_modified = 4,
+
+			// the resume data is delivered already bencoded, in
+			// save_resume_data_alert::resume_buffer, instead of as an entry.
+			// This is cheaper since the resume data is encoded directly
+			// without building an entry tree first. The buffer can be
+			// written to disk as-is.
+			save_bencoded = 8,
 		};
 
 		// ``save_resume_data()`` generates fast-resume data and returns it as an
@@ -1255,6 +1272,41 @@ namespace libtorrent
 
 	};
 
+	// one operation on a torrent, as passed to
+	// session::apply_torrent_operations(). Each operation corresponds to
+	// the torrent_handle member function of the same name, taking ``value``
+	// as its argument, where it takes one.
+	struct TORRENT_EXPORT torrent_operation
+	{
+		enum op_t
+		{
+			// ``value`` is the flags to pause(), i.e. graceful_pause
+			pause,
+			resume,
+			// ``value`` is non-zero to make the torrent auto managed
+			auto_managed,
+			set_priority,
+			set_upload_limit,
+			set_download_limit,
+			set_max_uploads,
+			set_max_connections,
+			// ``value`` is the number of seconds to wait before announcing
+			force_reannounce,
+			force_recheck,
+			queue_position_up,
+			queue_position_down,
+			// ``value`` is non-zero to enable upload mode
+			set_upload_mode
+		};
+
+		torrent_operation(torrent_handle const& h, op_t o, int v = 0)
+			: handle(h), op(o), value(v) {}
+
+		torrent_handle handle;
+		op_t op;
+		int value;
+	};
+
 	// holds a snapshot of the status of a torrent, as queried by
 	// torrent_handle::status().
 	struct TORRENT_EXPORT torrent_status
@@ -1415,6 +1467,21 @@ namespace libtorrent
 		size_type all_time_upload;
 		size_type all_time_download;
 
+		// estimates of the number of microseconds the network thread has
+		// spent on this torrent since it was loaded, in its second tick, in
+		// the piece picker and handling messages from its peers. These are
+		// only updated when settings_pack::cpu_sample_rate is set. Picking
+		// pieces is mostly done while handling peer messages, so
+		// ``picker_time`` is typically included in ``peer_message_time``
+		// too.
+		boost::int64_t tick_time;
+		boost::int64_t picker_time;
+		boost::int64_t peer_message_time;
+
+		// the number of blocks this torrent has in the disk cache. See
+		// ``block_size``.
+		int cached_blocks;
+
 		// the posix-time when this torrent was added. i.e. what ``time(NULL)``
 		// returned at the time.
 		time_t added_time;
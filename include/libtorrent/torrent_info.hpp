@@ -309,6 +309,17 @@ namespace libtorrent
 	{
 	public:
 
+		// flags for the constructors
+		enum flags_t
+		{
+			// the info section passed to the constructor taking a
+			// shared_array is a memory mapped file. The piece hashes are then
+			// read from the file by the operating system when they're used,
+			// rather than all being resident. See prefetch_piece_hashes() and
+			// evict_piece_hashes()
+			mapped_info_section = 1
+		};
+
 		// The constructor that takes an info-hash  will initialize the info-hash
 		// to the given value, but leave all other fields empty. This is used
 		// internally when downloading torrents without the metadata. The
@@ -339,7 +350,15 @@ namespace libtorrent
 		// an error occurs. These overloads are not available when building
 		// without exception support.
 		// 
-		// The ``flags`` argument is currently unused.
+		// The version that takes a shared_array expects a bencoded
+		// info-dictionary (not a whole .torrent file) and, rather than copying
+		// it, keeps a reference to the buffer for as long as the torrent_info
+		// lives. The piece hashes and file names point into it, so it must
+		// not be modified. This is what metadata_cache uses to back torrents
+		// by a memory mapped file.
+		//
+		// The only flag is mapped_info_section, which applies to the
+		// shared_array overload.
 #ifndef BOOST_NO_EXCEPTIONS
 		torrent_info(lazy_entry const& torrent_file, int flags = 0);
 		torrent_info(char const* buffer, int size, int flags = 0);
@@ -359,6 +378,8 @@ namespace libtorrent
 		torrent_info(lazy_entry const& torrent_file, error_code& ec, int flags = 0);
 		torrent_info(char const* buffer, int size, error_code& ec, int flags = 0);
 		torrent_info(std::string const& filename, error_code& ec, int flags = 0);
+		torrent_info(boost::shared_array<char> info_section, int size
+			, error_code& ec, int flags = 0);
 #ifndef TORRENT_NO_DEPRECATE
 #if TORRENT_USE_WSTRING
 		// all wstring APIs are deprecated since 0.16.11
@@ -543,6 +564,14 @@ namespace libtorrent
 		void load(char const* buffer, int size, error_code& ec);
 		void unload();
 
+		// internal
+		// puts this object in the unloaded state, with just the name, piece
+		// length and total size known. This is used to register a torrent from
+		// its resume data alone, and load the metadata the first time it's
+		// needed
+		void set_unloaded_metadata(std::string const& name, int piece_length
+			, size_type total_size);
+
 #ifndef TORRENT_NO_DEPRECATE
 // ------- start deprecation -------
 // these functions will be removed in a future version
@@ -603,6 +632,16 @@ namespace libtorrent
 
 		bool is_loaded() const { return m_piece_hashes || !m_merkle_tree.empty(); }
 
+		// when the info section is memory mapped (see mapped_info_section),
+		// ``prefetch_piece_hashes()`` asks the operating system to start
+		// reading the hashes of the ``num`` pieces starting at ``piece``
+		// into memory, ahead of them being needed to verify those pieces.
+		// ``evict_piece_hashes()`` drops all piece hashes from this process'
+		// memory. They're read back from the file the next time they're used.
+		// Both do nothing for torrents whose info section isn't mapped.
+		void prefetch_piece_hashes(int piece, int num) const;
+		void evict_piece_hashes() const;
+
 		// ``merkle_tree()`` returns a reference to the merkle tree for this torrent, if any.
 		// 
 		// ``set_merkle_tree()`` moves the passed in merkle tree into the torrent_info object.
@@ -776,6 +815,10 @@ namespace libtorrent
 		// features are disabled for this torrent (unless the
 		// settings allows mixing i2p peers with regular peers)
 		bool m_i2p:1;
+
+		// this is true if m_info_section is a memory mapped file, in which
+		// case the pages holding the piece hashes can be evicted
+		bool m_mapped_info_section:1;
 	};
 
 }
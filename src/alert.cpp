@@ -42,6 +42,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/escape_string.hpp"
 #include "libtorrent/extensions.hpp"
 #include "libtorrent/torrent.hpp"
+#include "libtorrent/session.hpp" // for latency_percentile
 #include <boost/bind.hpp>
 
 namespace libtorrent {
@@ -711,5 +712,46 @@ namespace libtorrent {
 		return msg;
 	}
 
+	boost::int64_t latency_histogram_alert::percentile(int histogram, int ppm) const
+	{
+		TORRENT_ASSERT(histogram >= 0 && histogram < num_histograms);
+		return latency_percentile(buckets[histogram], ppm);
+	}
+
+	std::string latency_histogram_alert::message() const
+	{
+		static char const* names[] =
+		{ "disk read", "disk write", "disk hash", "disk other", "disk queue"
+			, "peer request" };
+
+		char msg[600];
+		int len = snprintf(msg, sizeof(msg), "latency (us p50/p99/p999):");
+		for (int i = 0; i < num_histograms && len < int(sizeof(msg)); ++i)
+		{
+			len += snprintf(msg + len, sizeof(msg) - len, " %s: %d/%d/%d"
+				, names[i], int(percentile(i, 500000)), int(percentile(i, 990000))
+				, int(percentile(i, 999000)));
+		}
+		return msg;
+	}
+
+	std::string state_delta_alert::message() const
+	{
+		char msg[600];
+		snprintf(msg, sizeof(msg), "state deltas for %d torrents (%d bytes)"
+			, num_torrents, int(buffer.size()));
+		return msg;
+	}
+
+	std::string top_torrents_alert::message() const
+	{
+		char msg[600];
+		snprintf(msg, sizeof(msg), "top torrents over %d seconds: %d by cpu "
+			"(max %d ms) %d by cache (max %d blocks)", interval, int(cpu.size())
+			, cpu.empty() ? 0 : int(cpu[0].cpu_time / 1000)
+			, int(cache.size()), cache.empty() ? 0 : cache[0].cached_blocks);
+		return msg;
+	}
+
 } // namespace libtorrent
 
@@ -42,22 +42,26 @@ namespace libtorrent
 {
 
 	alert_manager::alert_manager(int queue_limit, boost::uint32_t alert_mask)
-		: m_alert_mask(alert_mask)
+		: m_generation(0)
+		, m_popped(0)
+		, m_owned_alerts(false)
+		, m_alert_mask(alert_mask)
 		, m_queue_size_limit(queue_limit)
 		, m_num_queued_resume(0)
 	{}
 
 	alert_manager::~alert_manager()
 	{
-		while (!m_alerts.empty())
+		std::vector<alert*> const& alerts = m_generations[m_generation].alerts;
+		for (size_t i = m_popped; i < alerts.size(); ++i)
 		{
-			TORRENT_ASSERT(alert_cast<save_resume_data_alert>(m_alerts.front()) == 0
+			TORRENT_ASSERT(alert_cast<save_resume_data_alert>(alerts[i]) == 0
 				&& "shutting down session with remaining resume data alerts in the alert queue. "
 				"You proabably wany to make sure you always wait for all resume data "
 				"alerts before shutting down");
-			delete m_alerts.front();
-			m_alerts.pop_front();
 		}
+		clear_generation(0);
+		clear_generation(1);
 	}
 
 	int alert_manager::num_queued_resume() const
@@ -70,11 +74,12 @@ namespace libtorrent
 	{
 		mutex::scoped_lock lock(m_mutex);
 
-		if (!m_alerts.empty()) return m_alerts.front();
+		std::vector<alert*> const& alerts = m_generations[m_generation].alerts;
+		if (queue_size() > 0) return alerts[m_popped];
 		
 		// this call can be interrupted prematurely by other signals
 		m_condition.wait_for(lock, max_wait);
-		if (!m_alerts.empty()) return m_alerts.front();
+		if (queue_size() > 0) return alerts[m_popped];
 
 		return NULL;
 	}
@@ -84,9 +89,13 @@ namespace libtorrent
 		mutex::scoped_lock lock(m_mutex);
 
 		m_dispatch = fun;
+		if (fun) m_owned_alerts = true;
 
+		// the dispatch function takes ownership of the alerts
 		std::deque<alert*> alerts;
-		m_alerts.swap(alerts);
+		for (size_t i = m_popped; i < m_generations[m_generation].alerts.size(); ++i)
+			alerts.push_back(release_alert(i));
+		clear_generation(m_generation);
 		lock.unlock();
 
 		while (!alerts.empty())
@@ -105,63 +114,119 @@ namespace libtorrent
 		dispatcher(*alert_);
 	}
 
-	void alert_manager::post_alert_ptr(alert* alert_)
+	void alert_manager::notify_extensions(alert const* a)
 	{
-		std::auto_ptr<alert> a(alert_);
-
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		for (ses_extension_list_t::iterator i = m_ses_extensions.begin()
 			, end(m_ses_extensions.end()); i != end; ++i)
 		{
 			TORRENT_TRY {
-				(*i)->on_alert(alert_);
+				(*i)->on_alert(a);
 			} TORRENT_CATCH(std::exception&) {}
 		}
 #endif
+	}
+
+	void alert_manager::post_alert_ptr(alert* alert_)
+	{
+		std::auto_ptr<alert> a(alert_);
+
+		notify_extensions(alert_);
 
 		mutex::scoped_lock lock(m_mutex);
-		post_impl(a, lock);
+		if (!prepare_post(*alert_, &a, lock)) return;
+		post_impl(a.release(), true, lock);
 	}
 
 	void alert_manager::post_alert(const alert& alert_)
 	{
-		std::auto_ptr<alert> a(alert_.clone());
-
-#ifndef TORRENT_DISABLE_EXTENSIONS
-		for (ses_extension_list_t::iterator i = m_ses_extensions.begin()
-			, end(m_ses_extensions.end()); i != end; ++i)
-		{
-			TORRENT_TRY {
-				(*i)->on_alert(&alert_);
-			} TORRENT_CATCH(std::exception&) {}
-		}
-#endif
+		notify_extensions(&alert_);
 
 		mutex::scoped_lock lock(m_mutex);
-		post_impl(a, lock);
+		if (!prepare_post(alert_, 0, lock)) return;
+		post_impl(alert_.clone().release(), true, lock);
 	}
-		
-	void alert_manager::post_impl(std::auto_ptr<alert>& alert_
+
+	bool alert_manager::prepare_post(alert const& a, std::auto_ptr<alert>* owned
 		, mutex::scoped_lock& /* l */)
 	{
-
-		if (alert_cast<save_resume_data_failed_alert>(alert_.get())
-			|| alert_cast<save_resume_data_alert>(alert_.get()))
+		if (alert_cast<save_resume_data_failed_alert>(&a)
+			|| alert_cast<save_resume_data_alert>(&a))
 			++m_num_queued_resume;
 
 		if (m_dispatch)
 		{
-			TORRENT_ASSERT(m_alerts.empty());
+			TORRENT_ASSERT(queue_size() == 0);
 			TORRENT_TRY {
-				m_dispatch(alert_);
+				m_dispatch(owned ? *owned : a.clone());
 			} TORRENT_CATCH(std::exception&) {}
+			return false;
+		}
+
+		return queue_size() < m_queue_size_limit || !a.discardable();
+	}
+
+	void alert_manager::post_impl(alert* a, bool heap, mutex::scoped_lock& /* l */)
+	{
+		generation_t& g = m_generations[m_generation];
+		g.alerts.push_back(a);
+		g.heap.push_back(heap);
+		if (queue_size() == 1)
+			m_condition.notify_all();
+	}
+
+	void alert_manager::clear_generation(int gen)
+	{
+		generation_t& g = m_generations[gen];
+		for (size_t i = 0; i < g.alerts.size(); ++i)
+		{
+			if (g.heap[i]) delete g.alerts[i];
+		}
+		g.alerts.clear();
+		g.heap.clear();
+		g.arena.clear();
+		if (gen == m_generation) m_popped = 0;
+	}
+
+	alert* alert_manager::release_alert(size_t i)
+	{
+		generation_t& g = m_generations[m_generation];
+		TORRENT_ASSERT(i < g.alerts.size());
+		TORRENT_ASSERT(g.alerts[i]);
+		alert* ret = g.alerts[i];
+		if (g.heap[i])
+		{
+			g.alerts[i] = 0;
+			g.heap[i] = false;
+			return ret;
 		}
-		else if (m_alerts.size() < m_queue_size_limit || !alert_->discardable())
+		return ret->clone().release();
+	}
+
+	void alert_manager::maybe_rotate()
+	{
+		if (m_popped < 64 || m_popped < queue_size()) return;
+
+		// the other generation holds the alerts handed out by the last
+		// call to get_all(std::vector*)
+		int const next = 1 - m_generation;
+		clear_generation(next);
+
+		generation_t& g = m_generations[next];
+		for (size_t i = m_popped; i < m_generations[m_generation].alerts.size(); ++i)
 		{
-			m_alerts.push_back(alert_.release());
-			if (m_alerts.size() == 1)
-				m_condition.notify_all();
+			g.alerts.push_back(release_alert(i));
+			g.heap.push_back(true);
 		}
+		clear_generation(m_generation);
+		m_generation = next;
+		m_popped = 0;
+	}
+
+	int alert_manager::num_held_alerts() const
+	{
+		mutex::scoped_lock lock(m_mutex);
+		return int(m_generations[0].alerts.size() + m_generations[1].alerts.size());
 	}
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
@@ -175,16 +240,17 @@ namespace libtorrent
 	{
 		mutex::scoped_lock lock(m_mutex);
 		
-		if (m_alerts.empty())
+		if (queue_size() == 0)
 			return std::auto_ptr<alert>(0);
 
-		TORRENT_ASSERT(m_num_queued_resume <= int(m_alerts.size()));
+		TORRENT_ASSERT(m_num_queued_resume <= int(queue_size()));
 
-		alert* result = m_alerts.front();
-		m_alerts.pop_front();
+		m_owned_alerts = true;
 
-		if (alert_cast<save_resume_data_failed_alert>(result)
-				|| alert_cast<save_resume_data_alert>(result))
+		alert* front = m_generations[m_generation].alerts[m_popped];
+
+		if (alert_cast<save_resume_data_failed_alert>(front)
+				|| alert_cast<save_resume_data_alert>(front))
 		{
 			--m_num_queued_resume;
 			num_resume = 1;
@@ -193,24 +259,53 @@ namespace libtorrent
 		{
 			num_resume = 0;
 		}
-		return std::auto_ptr<alert>(result);
+
+		std::auto_ptr<alert> ret(release_alert(m_popped));
+		++m_popped;
+
+		// once all alerts have been popped, reclaim the arena. Otherwise
+		// it would keep growing for clients that only pop one at a time
+		if (queue_size() == 0) clear_generation(m_generation);
+		else maybe_rotate();
+		return ret;
 	}
 
 	void alert_manager::get_all(std::deque<alert*>* alerts, int& num_resume)
 	{
 		mutex::scoped_lock lock(m_mutex);
-		TORRENT_ASSERT(m_num_queued_resume <= int(m_alerts.size()));
+		TORRENT_ASSERT(m_num_queued_resume <= int(queue_size()));
+		num_resume = m_num_queued_resume;
+		m_num_queued_resume = 0;
+		m_owned_alerts = true;
+		if (queue_size() == 0) return;
+
+		for (size_t i = m_popped; i < m_generations[m_generation].alerts.size(); ++i)
+			alerts->push_back(release_alert(i));
+		clear_generation(m_generation);
+	}
+
+	void alert_manager::get_all(std::vector<alert*>* alerts, int& num_resume)
+	{
+		mutex::scoped_lock lock(m_mutex);
+		TORRENT_ASSERT(m_num_queued_resume <= int(queue_size()));
 		num_resume = m_num_queued_resume;
 		m_num_queued_resume = 0;
-		if (m_alerts.empty()) return;
-		m_alerts.swap(*alerts);
+		m_owned_alerts = false;
+
+		std::vector<alert*> const& queued = m_generations[m_generation].alerts;
+		alerts->assign(queued.begin() + m_popped, queued.end());
+
+		// the other generation holds the alerts returned by the previous
+		// call. The client is done with those now
+		m_generation = 1 - m_generation;
+		clear_generation(m_generation);
 	}
 
 	bool alert_manager::pending() const
 	{
 		mutex::scoped_lock lock(m_mutex);
 		
-		return !m_alerts.empty();
+		return queue_size() > 0;
 	}
 
 	size_t alert_manager::set_alert_queue_size_limit(size_t queue_size_limit_)
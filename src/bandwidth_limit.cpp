@@ -37,6 +37,7 @@ namespace libtorrent
 {
 	bandwidth_channel::bandwidth_channel()
 		: tmp(0)
+		, active_index(-1)
 		, distribute_quota(0)
 		, m_quota_left(0)
 		, m_limit(0)
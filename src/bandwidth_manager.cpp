@@ -33,15 +33,49 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/bandwidth_manager.hpp"
 #include "libtorrent/time.hpp"
 
+#include <algorithm>
+#include <functional>
+#include <climits>
+
+#if TORRENT_USE_INVARIANT_CHECKS
+#include <map>
+#endif
+
 namespace libtorrent
 {
+	namespace
+	{
+		// the number of ticks a request waits, at most, before it's
+		// dispatched with whatever bandwidth it has been assigned
+		int const request_ttl = 20;
+	}
+
+	bool bandwidth_manager::group_key::operator<(group_key const& k) const
+	{
+		if (num_channels != k.num_channels) return num_channels < k.num_channels;
+		return std::lexicographical_compare(channel, channel + num_channels
+			, k.channel, k.channel + k.num_channels
+			, std::less<bandwidth_channel*>());
+	}
+
+	bandwidth_manager::group_t::group_t()
+		: priority(0)
+		, credit(0)
+		, share(0)
+		, active_index(-1)
+		, num_stale(0)
+	{
+		key.num_channels = 0;
+	}
 
 	bandwidth_manager::bandwidth_manager(int channel
 #ifdef TORRENT_VERBOSE_BANDWIDTH_LIMIT
 		, bool log
 #endif		
 		)
-		: m_queued_bytes(0)
+		: m_num_queued(0)
+		, m_tick(0)
+		, m_queued_bytes(0)
 		, m_channel(channel)
 		, m_abort(false)
 	{
@@ -56,23 +90,154 @@ namespace libtorrent
 	{
 		m_abort = true;
 
-		queue_t tm;
-		tm.swap(m_queue);
+		dispatch_queue_t tm;
+		for (int i = 0; i < int(m_requests.size()); ++i)
+		{
+			bw_request const& r = m_requests[i];
+			if (!r.peer) continue;
+			tm.push_back(std::make_pair(r.peer
+				, int((std::min)(assigned(r), boost::int64_t(r.request_size)))));
+		}
+
+		for (std::vector<bandwidth_channel*>::iterator i = m_channels.begin()
+			, end(m_channels.end()); i != end; ++i)
+		{
+			(*i)->tmp = 0;
+			(*i)->active_index = -1;
+		}
+		m_channels.clear();
+		m_requests.clear();
+		m_free_requests.clear();
+		m_groups.clear();
+		m_free_groups.clear();
+		m_active_groups.clear();
+		m_group_index.clear();
+		m_num_queued = 0;
 		m_queued_bytes = 0;
 
 		while (!tm.empty())
 		{
-			bw_request& bwr = tm.back();
-			bwr.peer->assign_bandwidth(m_channel, bwr.assigned);
+			tm.back().first->assign_bandwidth(m_channel, tm.back().second);
 			tm.pop_back();
 		}
 	}
 
+	void bandwidth_manager::add_request_channels(bw_request const& bwr)
+	{
+		for (int j = 0; j < bw_request::max_bandwidth_channels && bwr.channel[j]; ++j)
+		{
+			bandwidth_channel* bwc = bwr.channel[j];
+			int const idx = bwc->active_index;
+			if (idx < 0 || idx >= int(m_channels.size())
+				|| m_channels[idx] != bwc)
+			{
+				// this channel doesn't have any requests queued with us.
+				// Any state left in it belongs to a bandwidth_manager
+				// that was destructed without being closed
+				bwc->tmp = 0;
+				bwc->active_index = int(m_channels.size());
+				m_channels.push_back(bwc);
+			}
+			TORRENT_ASSERT(INT_MAX - bwc->tmp > bwr.priority);
+			bwc->tmp += bwr.priority;
+		}
+	}
+
+	void bandwidth_manager::remove_request_channels(bw_request const& bwr)
+	{
+		for (int j = 0; j < bw_request::max_bandwidth_channels && bwr.channel[j]; ++j)
+		{
+			bandwidth_channel* bwc = bwr.channel[j];
+			TORRENT_ASSERT(bwc->tmp >= bwr.priority);
+			TORRENT_ASSERT(bwc->active_index >= 0);
+			bwc->tmp -= bwr.priority;
+			if (bwc->tmp > 0) continue;
+
+			// this was the last request on this channel. Swap it
+			// with the last entry in the list to remove it in O(1)
+			int const idx = bwc->active_index;
+			TORRENT_ASSERT(m_channels[idx] == bwc);
+			m_channels[idx] = m_channels.back();
+			m_channels[idx]->active_index = idx;
+			m_channels.pop_back();
+			bwc->active_index = -1;
+		}
+	}
+
+	int bandwidth_manager::find_group(group_key const& k)
+	{
+		std::map<group_key, int>::iterator i = m_group_index.find(k);
+		if (i != m_group_index.end()) return i->second;
+
+		int idx;
+		if (m_free_groups.empty())
+		{
+			idx = int(m_groups.size());
+			m_groups.push_back(group_t());
+		}
+		else
+		{
+			idx = m_free_groups.back();
+			m_free_groups.pop_back();
+		}
+
+		group_t& g = m_groups[idx];
+		g.key = k;
+		g.active_index = int(m_active_groups.size());
+		m_active_groups.push_back(idx);
+		m_group_index.insert(std::make_pair(k, idx));
+		return idx;
+	}
+
+	void bandwidth_manager::free_group(int group)
+	{
+		group_t& g = m_groups[group];
+		TORRENT_ASSERT(g.priority == 0);
+		TORRENT_ASSERT(m_active_groups[g.active_index] == group);
+
+		m_group_index.erase(g.key);
+
+		// swap it with the last active group, to remove it in O(1)
+		int const idx = g.active_index;
+		m_active_groups[idx] = m_active_groups.back();
+		m_groups[m_active_groups[idx]].active_index = idx;
+		m_active_groups.pop_back();
+
+		// any requests still referenced by the group have been dispatched
+		g = group_t();
+		m_free_groups.push_back(group);
+	}
+
+	boost::int64_t bandwidth_manager::assigned(bw_request const& r) const
+	{
+		group_t const& g = m_groups[r.group];
+		TORRENT_ASSERT(g.credit >= r.start);
+		return ((g.credit - r.start) * r.priority) >> credit_shift;
+	}
+
+	void bandwidth_manager::rebase_group(group_t& g)
+	{
+		boost::int64_t const base = g.credit;
+		for (std::deque<request_ref>::iterator i = g.expiry.begin()
+			, end(g.expiry.end()); i != end; ++i)
+		{
+			bw_request& r = m_requests[i->request];
+			if (r.seq != i->seq) continue;
+			r.start -= base;
+		}
+		for (std::vector<request_ref>::iterator i = g.satisfied.begin()
+			, end(g.satisfied.end()); i != end; ++i)
+		{
+			i->credit -= base;
+		}
+		g.credit = 0;
+	}
+
 #if TORRENT_USE_ASSERTS
 	bool bandwidth_manager::is_queued(bandwidth_socket const* peer) const
 	{
-		for (queue_t::const_iterator i = m_queue.begin()
-			, end(m_queue.end()); i != end; ++i)
+		for (std::vector<bw_request>::const_iterator i = m_requests.begin()
+			, end(m_requests.end()); i != end; ++i)
 		{
 			if (i->peer.get() == peer) return true;
 		}
@@ -82,7 +247,7 @@ namespace libtorrent
 
 	int bandwidth_manager::queue_size() const
 	{
-		return m_queue.size();
+		return m_num_queued;
 	}
 
 	boost::int64_t bandwidth_manager::queued_bytes() const
@@ -115,18 +280,66 @@ namespace libtorrent
 			return blk;
 		}
 
-		int k = 0;
-		bw_request bwr(peer, blk, priority);
-		for (int i = 0; i < num_channels; ++i)
+		// channels without a limit don't hold the request back, and
+		// leaving them out lets peers with an unlimited channel of their
+		// own share a group with the other peers of their classes
+		group_key k;
+		k.num_channels = 0;
+		for (int i = 0; i < num_channels
+			&& k.num_channels < bw_request::max_bandwidth_channels; ++i)
 		{
+			if (chan[i]->throttle() == 0) continue;
 			if (chan[i]->need_queueing(blk))
-				bwr.channel[k++] = chan[i];
+				k.channel[k.num_channels++] = chan[i];
 		}
 
-		if (k == 0) return blk;
+		if (k.num_channels == 0) return blk;
 
+		std::sort(k.channel, k.channel + k.num_channels
+			, std::less<bandwidth_channel*>());
+
+		int const group = find_group(k);
+
+		int idx;
+		if (m_free_requests.empty())
+		{
+			idx = int(m_requests.size());
+			m_requests.push_back(bw_request(peer, blk, priority));
+		}
+		else
+		{
+			idx = m_free_requests.back();
+			m_free_requests.pop_back();
+			bw_request& r = m_requests[idx];
+			boost::uint32_t const seq = r.seq;
+			r = bw_request(peer, blk, priority);
+			r.seq = seq;
+		}
+
+		group_t& g = m_groups[group];
+		if (g.credit > (boost::int64_t(1) << 60)) rebase_group(g);
+
+		bw_request& r = m_requests[idx];
+		std::copy(k.channel, k.channel + k.num_channels, r.channel);
+		r.group = group;
+		r.start = g.credit;
+		r.expires = m_tick + request_ttl;
+
+		request_ref ref;
+		ref.request = idx;
+		ref.seq = r.seq;
+		ref.credit = r.start + ((boost::int64_t(blk) << credit_shift)
+			+ priority - 1) / priority;
+		g.satisfied.push_back(ref);
+		std::push_heap(g.satisfied.begin(), g.satisfied.end());
+		g.expiry.push_back(ref);
+
+		TORRENT_ASSERT(INT_MAX - g.priority > priority);
+		g.priority += priority;
+		add_request_channels(r);
+
+		++m_num_queued;
 		m_queued_bytes += blk;
-		m_queue.push_back(bwr);
 		return 0;
 	}
 
@@ -134,100 +347,215 @@ namespace libtorrent
 	void bandwidth_manager::check_invariant() const
 	{
 		boost::int64_t queued = 0;
-		for (queue_t::const_iterator i = m_queue.begin()
-			, end(m_queue.end()); i != end; ++i)
+		int num_queued = 0;
+		std::map<bandwidth_channel const*, int> prio;
+		std::map<int, int> group_prio;
+		for (std::vector<bw_request>::const_iterator i = m_requests.begin()
+			, end(m_requests.end()); i != end; ++i)
 		{
-			queued += i->request_size - i->assigned;
+			if (!i->peer) continue;
+			++num_queued;
+			queued += i->request_size;
+			group_prio[i->group] += i->priority;
+			TORRENT_ASSERT(m_groups[i->group].credit >= i->start);
+			for (int j = 0; j < bw_request::max_bandwidth_channels && i->channel[j]; ++j)
+				prio[i->channel[j]] += i->priority;
 		}
 		TORRENT_ASSERT(queued == m_queued_bytes);
+		TORRENT_ASSERT(num_queued == m_num_queued);
+		TORRENT_ASSERT(num_queued + int(m_free_requests.size()) == int(m_requests.size()));
+
+		TORRENT_ASSERT(prio.size() == m_channels.size());
+		for (int i = 0; i < int(m_channels.size()); ++i)
+		{
+			bandwidth_channel const* bwc = m_channels[i];
+			TORRENT_ASSERT(bwc->active_index == i);
+			TORRENT_ASSERT(prio[bwc] == bwc->tmp);
+		}
+
+		TORRENT_ASSERT(group_prio.size() == m_active_groups.size());
+		TORRENT_ASSERT(m_group_index.size() == m_active_groups.size());
+		for (int i = 0; i < int(m_active_groups.size()); ++i)
+		{
+			group_t const& g = m_groups[m_active_groups[i]];
+			TORRENT_ASSERT(g.active_index == i);
+			TORRENT_ASSERT(g.priority > 0);
+			TORRENT_ASSERT(group_prio[m_active_groups[i]] == g.priority);
+		}
 	}
 #endif
 
-	void bandwidth_manager::update_quotas(time_duration const& dt)
+	void bandwidth_manager::dispatch(int request, int amount, dispatch_queue_t& tm)
 	{
-		if (m_abort) return;
-		if (m_queue.empty()) return;
+		bw_request& r = m_requests[request];
+		group_t& g = m_groups[r.group];
 
-		INVARIANT_CHECK;
+		// peers that are disconnecting don't get anything
+		if (r.peer->is_disconnecting()) amount = 0;
 
-		boost::int64_t dt_milliseconds = total_milliseconds(dt);
-		if (dt_milliseconds > 3000) dt_milliseconds = 3000;
+		// return the part of the quota the request got, but doesn't use, to
+		// all the bandwidth channels it belongs to
+		boost::int64_t const extra = assigned(r) - amount;
+		if (extra > 0)
+		{
+			int const ret = int((std::min)(extra, boost::int64_t(INT_MAX)));
+			for (int j = 0; j < bw_request::max_bandwidth_channels && r.channel[j]; ++j)
+				r.channel[j]->return_quota(ret);
+		}
 
-		// for each bandwidth channel, call update_quota(dt)
+		m_queued_bytes -= r.request_size;
+		--m_num_queued;
+		remove_request_channels(r);
+		g.priority -= r.priority;
 
-		std::vector<bandwidth_channel*> channels;
+		tm.push_back(std::make_pair(r.peer, amount));
+		r.peer.reset();
+		++r.seq;
+		m_free_requests.push_back(request);
+	}
 
-		queue_t tm;
+	bool bandwidth_manager::update_group(int group, dispatch_queue_t& tm)
+	{
+		group_t& g = m_groups[group];
 
-		for (queue_t::iterator i = m_queue.begin();
-			i != m_queue.end();)
+		if (g.share < 0)
 		{
-			if (i->peer->is_disconnecting())
+			// none of this group's channels are limited anymore. Every
+			// request is satisfied
+			for (std::deque<request_ref>::iterator i = g.expiry.begin()
+				, end(g.expiry.end()); i != end; ++i)
 			{
-				m_queued_bytes -= i->request_size - i->assigned;
-
-				// return all assigned quota to all the
-				// bandwidth channels this peer belongs to
-				for (int j = 0; j < bw_request::max_bandwidth_channels && i->channel[j]; ++j)
-				{
-					bandwidth_channel* bwc = i->channel[j];
-					bwc->return_quota(i->assigned);
-				}
-
-				i->assigned = 0;
-				tm.push_back(*i);
-				i = m_queue.erase(i);
-				continue;
+				bw_request const& r = m_requests[i->request];
+				if (r.seq != i->seq) continue;
+				dispatch(i->request, r.request_size, tm);
 			}
-			for (int j = 0; j < bw_request::max_bandwidth_channels && i->channel[j]; ++j)
+			TORRENT_ASSERT(g.priority == 0);
+			free_group(group);
+			return false;
+		}
+
+		// the requests that have been assigned all they asked for
+		while (!g.satisfied.empty() && g.satisfied.front().credit <= g.credit)
+		{
+			request_ref const ref = g.satisfied.front();
+			std::pop_heap(g.satisfied.begin(), g.satisfied.end());
+			g.satisfied.pop_back();
+			bw_request const& r = m_requests[ref.request];
+			if (r.seq != ref.seq)
 			{
-				bandwidth_channel* bwc = i->channel[j];
-				bwc->tmp = 0;
+				--g.num_stale;
+				continue;
 			}
-			++i;
+			dispatch(ref.request, r.request_size, tm);
 		}
 
-		for (queue_t::iterator i = m_queue.begin()
-			, end(m_queue.end()); i != end; ++i)
+		// the requests that have waited long enough get what they have so
+		// far, unless that's nothing. Requests queued after one that hasn't
+		// been assigned anything haven't been assigned anything either
+		while (!g.expiry.empty())
 		{
-			for (int j = 0; j < bw_request::max_bandwidth_channels && i->channel[j]; ++j)
+			request_ref const& ref = g.expiry.front();
+			bw_request const& r = m_requests[ref.request];
+			if (r.seq != ref.seq)
 			{
-				bandwidth_channel* bwc = i->channel[j];
-				if (bwc->tmp == 0) channels.push_back(bwc);
-				TORRENT_ASSERT(INT_MAX - bwc->tmp > i->priority);
-				bwc->tmp += i->priority;
+				g.expiry.pop_front();
+				continue;
 			}
+			if (r.expires > m_tick) break;
+			boost::int64_t const a = assigned(r);
+			if (a == 0) break;
+			TORRENT_ASSERT(a < r.request_size);
+			int const request = ref.request;
+			g.expiry.pop_front();
+			dispatch(request, int(a), tm);
+			// its entry in the satisfied heap is stale now
+			++g.num_stale;
 		}
 
-		for (std::vector<bandwidth_channel*>::iterator i = channels.begin()
-			, end(channels.end()); i != end; ++i)
+		if (g.priority == 0)
 		{
-			(*i)->update_quota(int(dt_milliseconds));
+			free_group(group);
+			return false;
 		}
 
-		for (queue_t::iterator i = m_queue.begin();
-			i != m_queue.end();)
+		// don't let the stale entries of expired requests build up in the
+		// heap. Rebuilding it is linear, but only happens once the heap
+		// has grown to twice the number of requests
+		if (g.num_stale > int(g.satisfied.size()) / 2)
 		{
-			int a = i->assign_bandwidth();
-			if (i->assigned == i->request_size
-				|| (i->ttl <= 0 && i->assigned > 0))
+			std::vector<request_ref>::iterator out = g.satisfied.begin();
+			for (std::vector<request_ref>::iterator i = g.satisfied.begin()
+				, end(g.satisfied.end()); i != end; ++i)
 			{
-				a += i->request_size - i->assigned;
-				TORRENT_ASSERT(i->assigned <= i->request_size);
-				tm.push_back(*i);
-				i = m_queue.erase(i);
+				if (m_requests[i->request].seq != i->seq) continue;
+				*out++ = *i;
 			}
-			else
+			g.satisfied.erase(out, g.satisfied.end());
+			std::make_heap(g.satisfied.begin(), g.satisfied.end());
+			g.num_stale = 0;
+		}
+		return true;
+	}
+
+	void bandwidth_manager::update_quotas(time_duration const& dt)
+	{
+		if (m_abort) return;
+		if (m_num_queued == 0) return;
+
+		INVARIANT_CHECK;
+
+		boost::int64_t dt_milliseconds = total_milliseconds(dt);
+		if (dt_milliseconds > 3000) dt_milliseconds = 3000;
+
+		++m_tick;
+
+		// the priority sums (tmp) of the channels are kept up to date as
+		// requests come and go, so all that's left is to refill the token
+		// buckets of the channels that have requests waiting on them
+		for (std::vector<bandwidth_channel*>::iterator i = m_channels.begin()
+			, end(m_channels.end()); i != end; ++i)
+		{
+			(*i)->update_quota(int(dt_milliseconds));
+		}
+
+		// every priority unit queued on a channel gets the same share of
+		// its quota, and a group gets the share of its most limiting
+		// channel. The priority sums must stay fixed while distributing
+		// the quota, for every group to get its proportional share, so
+		// requests are only dispatched once every group has its share
+		for (std::vector<int>::iterator i = m_active_groups.begin()
+			, end(m_active_groups.end()); i != end; ++i)
+		{
+			group_t& g = m_groups[*i];
+			boost::int64_t share = -1;
+			for (int j = 0; j < g.key.num_channels; ++j)
 			{
-				++i;
+				bandwidth_channel const* bwc = g.key.channel[j];
+				if (bwc->throttle() == 0) continue;
+				TORRENT_ASSERT(bwc->tmp > 0);
+				boost::int64_t const s = (boost::int64_t(bwc->distribute_quota)
+					<< credit_shift) / bwc->tmp;
+				if (share < 0 || s < share) share = s;
 			}
-			m_queued_bytes -= a;
+			g.share = share;
+			if (share <= 0) continue;
+
+			g.credit += share;
+			int const used = int((share * g.priority) >> credit_shift);
+			for (int j = 0; j < g.key.num_channels; ++j)
+				g.key.channel[j]->use_quota(used);
+		}
+
+		dispatch_queue_t tm;
+		for (int i = 0; i < int(m_active_groups.size());)
+		{
+			// if the group is freed, the last group takes its place
+			if (update_group(m_active_groups[i], tm)) ++i;
 		}
 
 		while (!tm.empty())
 		{
-			bw_request& bwr = tm.back();
-			bwr.peer->assign_bandwidth(m_channel, bwr.assigned);
+			tm.back().first->assign_bandwidth(m_channel, tm.back().second);
 			tm.pop_back();
 		}
 	}
@@ -41,34 +41,14 @@ namespace libtorrent
 		, int blk, int prio)
 		: peer(pe)
 		, priority(prio)
-		, assigned(0)
 		, request_size(blk)
-		, ttl(20)
+		, group(-1)
+		, start(0)
+		, expires(0)
+		, seq(0)
 	{
 		TORRENT_ASSERT(priority > 0);
 		std::memset(channel, 0, sizeof(channel));
 	}
-
-	int bw_request::assign_bandwidth()
-	{
-		TORRENT_ASSERT(assigned < request_size);
-		int quota = request_size - assigned;
-		TORRENT_ASSERT(quota >= 0);
-		--ttl;
-		if (quota == 0) return quota;
-
-		for (int j = 0; j < 5 && channel[j]; ++j)
-		{
-			if (channel[j]->throttle() == 0) continue;
-			if (channel[j]->tmp == 0) continue;
-			quota = (std::min)(int(boost::int64_t(channel[j]->distribute_quota)
-				* priority / channel[j]->tmp), quota);
-		}
-		assigned += quota;
-		for (int j = 0; j < 5 && channel[j]; ++j)
-			channel[j]->use_quota(quota);
-		TORRENT_ASSERT(assigned <= request_size);
-		return quota;
-	}
 }
 
@@ -0,0 +1,368 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/bencode_writer.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/entry.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace libtorrent
+{
+	namespace
+	{
+		int compare_keys(char const* lhs, int lhs_len, char const* rhs, int rhs_len)
+		{
+			int const ret = std::memcmp(lhs, rhs, (std::min)(lhs_len, rhs_len));
+			if (ret != 0) return ret;
+			return lhs_len - rhs_len;
+		}
+
+		// orders the items of a dictionary, by index, by key. The keys are
+		// read from the copy of the dictionary in ``buf``, which starts at
+		// offset ``base`` in the output buffer
+		template <class Item>
+		struct item_order
+		{
+			item_order(Item const* items, char const* buf, int base)
+				: m_items(items), m_buf(buf), m_base(base) {}
+
+			bool operator()(int lhs, int rhs) const
+			{
+				Item const& l = m_items[lhs];
+				Item const& r = m_items[rhs];
+				return compare_keys(m_buf + l.key - m_base, l.key_len
+					, m_buf + r.key - m_base, r.key_len) < 0;
+			}
+
+			Item const* m_items;
+			char const* m_buf;
+			int m_base;
+		};
+	}
+
+	bencode_writer::bencode_writer(std::vector<char>& buf)
+		: m_buf(buf)
+	{}
+
+	void bencode_writer::prepare_value()
+	{
+		if (m_stack.empty()) return;
+		frame& top = m_stack.back();
+		if (top.first_item < 0) return;
+
+		// every value in a dictionary must be preceded by a key
+		TORRENT_ASSERT(top.expect_value);
+		top.expect_value = false;
+	}
+
+	void bencode_writer::write_header(char type, boost::int64_t val, char delim)
+	{
+		char buf[24];
+		if (type) m_buf.push_back(type);
+		char const* str = detail::integer_to_str(buf, sizeof(buf), val);
+		char const* str_end = buf + sizeof(buf) - 1;
+		m_buf.insert(m_buf.end(), str, str_end);
+		m_buf.push_back(delim);
+	}
+
+	void bencode_writer::begin_dict()
+	{
+		prepare_value();
+		m_buf.push_back('d');
+		frame f;
+		f.first_item = int(m_items.size());
+		f.sorted = true;
+		f.expect_value = false;
+		m_stack.push_back(f);
+	}
+
+	void bencode_writer::begin_list()
+	{
+		prepare_value();
+		m_buf.push_back('l');
+		frame f;
+		f.first_item = -1;
+		f.sorted = true;
+		f.expect_value = false;
+		m_stack.push_back(f);
+	}
+
+	void bencode_writer::end()
+	{
+		TORRENT_ASSERT(!m_stack.empty());
+		if (m_stack.empty()) return;
+
+		frame const f = m_stack.back();
+		m_stack.pop_back();
+
+		if (f.first_item >= 0)
+		{
+			// a key without a value
+			TORRENT_ASSERT(!f.expect_value);
+			if (!f.sorted) sort_dict(f.first_item);
+			m_items.resize(f.first_item);
+		}
+		m_buf.push_back('e');
+	}
+
+	void bencode_writer::sort_dict(int first_item)
+	{
+		int const num_items = int(m_items.size()) - first_item;
+		TORRENT_ASSERT(num_items > 1);
+		dict_item const* items = &m_items[first_item];
+
+		// copy the body of the dictionary out of the way and copy the items
+		// back in key order. Each item extends until the start of the next
+		// one, the last one until the end of the buffer
+		int const base = items[0].start;
+		int const end = int(m_buf.size());
+		m_scratch.assign(m_buf.begin() + base, m_buf.end());
+
+		m_order.resize(num_items);
+		for (int i = 0; i < num_items; ++i) m_order[i] = i;
+
+		item_order<dict_item> const cmp(items, &m_scratch[0], base);
+		std::sort(m_order.begin(), m_order.end(), cmp);
+
+		char* out = &m_buf[base];
+		for (int i = 0; i < num_items; ++i)
+		{
+			int const idx = m_order[i];
+			int const start = items[idx].start;
+			int const stop = idx + 1 < num_items ? items[idx + 1].start : end;
+			std::memcpy(out, &m_scratch[start - base], stop - start);
+			out += stop - start;
+
+			// keys must be unique
+			TORRENT_ASSERT(i == 0 || cmp(m_order[i-1], idx));
+		}
+		TORRENT_ASSERT(out == &m_buf[0] + end);
+	}
+
+	void bencode_writer::key(char const* k)
+	{
+		key(k, int(std::strlen(k)));
+	}
+
+	void bencode_writer::key(std::string const& k)
+	{
+		key(k.c_str(), int(k.size()));
+	}
+
+	void bencode_writer::key(char const* k, int len)
+	{
+		TORRENT_ASSERT(!m_stack.empty());
+		frame& top = m_stack.back();
+		// keys are only valid in dictionaries, and not where a value is
+		// expected
+		TORRENT_ASSERT(top.first_item >= 0);
+		TORRENT_ASSERT(!top.expect_value);
+
+		dict_item item;
+		item.start = int(m_buf.size());
+		write_header(0, len, ':');
+		item.key = int(m_buf.size());
+		item.key_len = len;
+		m_buf.insert(m_buf.end(), k, k + len);
+
+		if (int(m_items.size()) > top.first_item && top.sorted)
+		{
+			dict_item const& prev = m_items.back();
+			int const cmp = compare_keys(&m_buf[prev.key], prev.key_len
+				, &m_buf[item.key], item.key_len);
+			TORRENT_ASSERT(cmp != 0);
+			if (cmp > 0) top.sorted = false;
+		}
+
+		m_items.push_back(item);
+		top.expect_value = true;
+	}
+
+	void bencode_writer::integer(boost::int64_t val)
+	{
+		prepare_value();
+		write_header('i', val, 'e');
+	}
+
+	void bencode_writer::string(char const* str)
+	{
+		string(str, int(std::strlen(str)));
+	}
+
+	void bencode_writer::string(std::string const& str)
+	{
+		string(str.c_str(), int(str.size()));
+	}
+
+	void bencode_writer::string(char const* str, int len)
+	{
+		prepare_value();
+		write_header(0, len, ':');
+		m_buf.insert(m_buf.end(), str, str + len);
+	}
+
+	char* bencode_writer::alloc_string(int len)
+	{
+		prepare_value();
+		write_header(0, len, ':');
+		int const pos = int(m_buf.size());
+		m_buf.resize(pos + len);
+		return &m_buf[0] + pos;
+	}
+
+	void bencode_writer::raw(char const* buf, int len)
+	{
+		prepare_value();
+		m_buf.insert(m_buf.end(), buf, buf + len);
+	}
+
+	void bencode_writer::value(entry const& e)
+	{
+		prepare_value();
+		bencode(std::back_inserter(m_buf), e);
+	}
+
+	entry_writer::entry_writer(entry& e)
+		: m_root(e)
+		, m_expect_value(false)
+		, m_started(false)
+	{}
+
+	entry& entry_writer::next_value()
+	{
+		if (m_stack.empty())
+		{
+			// only one value can be written at the top level
+			TORRENT_ASSERT(!m_started);
+			m_started = true;
+			return m_root;
+		}
+
+		entry& top = *m_stack.back();
+		if (top.type() == entry::list_t)
+		{
+			top.list().push_back(entry());
+			return top.list().back();
+		}
+
+		// every value in a dictionary must be preceded by a key
+		TORRENT_ASSERT(m_expect_value);
+		m_expect_value = false;
+		return top[m_key];
+	}
+
+	void entry_writer::begin_dict()
+	{
+		entry& e = next_value();
+		e = entry(entry::dictionary_t);
+		m_stack.push_back(&e);
+	}
+
+	void entry_writer::begin_list()
+	{
+		entry& e = next_value();
+		e = entry(entry::list_t);
+		m_stack.push_back(&e);
+	}
+
+	void entry_writer::end()
+	{
+		TORRENT_ASSERT(!m_stack.empty());
+		// a key without a value
+		TORRENT_ASSERT(!m_expect_value);
+		if (m_stack.empty()) return;
+		m_stack.pop_back();
+	}
+
+	void entry_writer::key(char const* k)
+	{
+		key(k, int(std::strlen(k)));
+	}
+
+	void entry_writer::key(std::string const& k)
+	{
+		key(k.c_str(), int(k.size()));
+	}
+
+	void entry_writer::key(char const* k, int len)
+	{
+		TORRENT_ASSERT(!m_stack.empty());
+		TORRENT_ASSERT(m_stack.back()->type() == entry::dictionary_t);
+		TORRENT_ASSERT(!m_expect_value);
+		m_key.assign(k, len);
+		// keys must be unique
+		TORRENT_ASSERT(m_stack.back()->find_key(m_key) == 0);
+		m_expect_value = true;
+	}
+
+	void entry_writer::integer(boost::int64_t val)
+	{
+		next_value() = entry(entry::integer_type(val));
+	}
+
+	void entry_writer::string(char const* str)
+	{
+		next_value() = entry(entry::string_type(str));
+	}
+
+	void entry_writer::string(std::string const& str)
+	{
+		next_value() = entry(str);
+	}
+
+	void entry_writer::string(char const* str, int len)
+	{
+		next_value() = entry(entry::string_type(str, len));
+	}
+
+	char* entry_writer::alloc_string(int len)
+	{
+		entry& e = next_value();
+		e = entry(entry::string_type(len, '\0'));
+		return len > 0 ? &e.string()[0] : 0;
+	}
+
+	void entry_writer::raw(char const* buf, int len)
+	{
+		next_value() = bdecode(buf, buf + len);
+	}
+
+	void entry_writer::value(entry const& e)
+	{
+		next_value() = e;
+	}
+}
+
@@ -270,6 +270,8 @@ block_cache::block_cache(int block_size, io_service& ios
 	: disk_buffer_pool(block_size, ios, trigger_trim, alert_disp)
 	, m_last_cache_op(cache_miss)
 	, m_ghost_size(8)
+	, m_read_cache_line_size(32)
+	, m_ghost_hits(0)
 	, m_read_cache_size(0)
 	, m_write_cache_size(0)
 	, m_send_buffer_blocks(0)
@@ -385,11 +387,13 @@ void block_cache::cache_hit(cached_piece_entry* p, void* requester, bool volatil
 	if (p->cache_state == cached_piece_entry::read_lru1_ghost)
 	{
 		m_last_cache_op = ghost_hit_lru1;
+		++m_ghost_hits;
 		p->storage->add_piece(p);
 	}
 	else if (p->cache_state == cached_piece_entry::read_lru2_ghost)
 	{
 		m_last_cache_op = ghost_hit_lru2;
+		++m_ghost_hits;
 		p->storage->add_piece(p);
 	}
 
@@ -1465,6 +1469,7 @@ void block_cache::update_stats_counters(counters& c) const
 	c.set_value(counters::arc_mfu_ghost_size, m_lru[cached_piece_entry::read_lru2_ghost].size());
 	c.set_value(counters::arc_write_size, m_lru[cached_piece_entry::write_lru].size());
 	c.set_value(counters::arc_volatile_size, m_lru[cached_piece_entry::volatile_read_lru].size());
+	c.set_value(counters::cache_size_limit, max_use());
 }
 
 #ifndef TORRENT_NO_DEPRECATE
@@ -1491,11 +1496,19 @@ void block_cache::set_settings(aux::session_settings const& sett)
 	// assumption is that there are about 128 blocks per piece,
 	// and there are two ghost lists, so divide by 2.
 
+	m_read_cache_line_size = (std::max)(sett.get_int(settings_pack::read_cache_line_size), 4);
 	m_ghost_size = (std::max)(8, sett.get_int(settings_pack::cache_size)
-		/ (std::max)(sett.get_int(settings_pack::read_cache_line_size), 4) / 2);
+		/ m_read_cache_line_size / 2);
 	disk_buffer_pool::set_settings(sett);
 }
 
+bool block_cache::set_max_use(int max_use)
+{
+	if (!disk_buffer_pool::set_max_use(max_use)) return false;
+	m_ghost_size = (std::max)(8, max_use / m_read_cache_line_size / 2);
+	return true;
+}
+
 #if TORRENT_USE_INVARIANT_CHECKS
 void block_cache::check_invariant() const
 {
@@ -111,6 +111,7 @@ namespace libtorrent
 		, m_our_peer_id(pid)
 #ifndef TORRENT_DISABLE_ENCRYPTION
 		, m_sync_bytes_read(0)
+		, m_encrypt_pending(0)
 #endif
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		, m_upload_only_id(0)
@@ -122,6 +123,7 @@ namespace libtorrent
 #endif
 #if defined TORRENT_DEBUG || TORRENT_RELEASE_ASSERTS
 		, m_in_constructor(true)
+		, m_piece_in_recv_buffer(false)
 #endif
 	{
 #ifdef TORRENT_VERBOSE_LOGGING
@@ -711,21 +713,12 @@ namespace libtorrent
 		, block_cache_reference ref, bool encrypted)
 	{
 		TORRENT_ASSERT(encrypted == false);
-#ifndef TORRENT_DISABLE_ENCRYPTION
-		if (m_rc4_encrypted)
-			m_enc_handler->encrypt(buffer, size);
-#endif
 		peer_connection::append_send_buffer(buffer, size, destructor
 			, userdata, ref, true);
-	}
-
 #ifndef TORRENT_DISABLE_ENCRYPTION
-	void encrypt(char* buf, int len, void* userdata)
-	{
-		rc4_handler* rc4 = (rc4_handler*)userdata;
-		rc4->encrypt(buf, len);
-	}
+		if (m_rc4_encrypted) m_encrypt_pending += size;
 #endif
+	}
 
 	void bt_peer_connection::send_buffer(char const* buf, int size, int flags
 			, void (*f)(char*, int, void*), void* ud)
@@ -734,19 +727,55 @@ namespace libtorrent
 		TORRENT_ASSERT(ud == 0);
 		TORRENT_ASSERT(buf);
 		TORRENT_ASSERT(size > 0);
-		
-		void* userdata = 0;
-		void (*fun)(char*, int, void*) = 0;
+
 #ifndef TORRENT_DISABLE_ENCRYPTION
-		if (m_encrypted && m_rc4_encrypted)
+		// the data is encrypted in place in the send buffer later, see
+		// encrypt_pending_buffer(). send_buffer() may call setup_send(),
+		// so the bytes must be accounted for before it's called
+		if (m_encrypted && m_rc4_encrypted) m_encrypt_pending += size;
+#endif
+
+		peer_connection::send_buffer(buf, size, flags);
+
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		// if we failed to allocate a send buffer, the connection was closed
+		// and only part of the message (if any) made it into the send buffer.
+		// Nothing more will be written to the socket, so forget about it.
+		// Leaving it counted would have encrypt_pending_buffer() encrypt bytes
+		// that were already encrypted
+		if (is_disconnecting()) m_encrypt_pending = 0;
+#endif
+	}
+
+	void bt_peer_connection::setup_send()
+	{
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		encrypt_pending_buffer();
+#endif
+		peer_connection::setup_send();
+	}
+
+#ifndef TORRENT_DISABLE_ENCRYPTION
+	void bt_peer_connection::encrypt_pending_buffer()
+	{
+		if (m_encrypt_pending == 0) return;
+		if (is_disconnecting())
 		{
-			fun = encrypt;
-			userdata = m_enc_handler.get();
+			m_encrypt_pending = 0;
+			return;
 		}
-#endif
-		
-		peer_connection::send_buffer(buf, size, flags, fun, userdata);
+		TORRENT_ASSERT(m_enc_handler.get());
+		TORRENT_ASSERT(m_rc4_encrypted);
+
+		// the send buffer may have been cleared when disconnecting
+		int const pending = (std::min)(m_encrypt_pending, send_buffer_size());
+		m_encrypt_pending = 0;
+		if (pending == 0) return;
+
+		m_send_buffer.build_mutable_iovec_tail(pending, m_crypto_iovec);
+		m_enc_handler->encrypt(m_crypto_iovec);
 	}
+#endif
 
 	void bt_peer_connection::write_handshake(bool plain_handshake)
 	{
@@ -1158,7 +1187,10 @@ namespace libtorrent
 				}
 
 				TORRENT_ASSERT(!has_disk_receive_buffer());
-				if (!m_settings.get_bool(settings_pack::contiguous_recv_buffer))
+#if TORRENT_USE_ASSERTS
+				m_piece_in_recv_buffer = has_buffered_receive_data();
+#endif
+				if (!has_buffered_receive_data())
 				{
 					if (!allocate_disk_receive_buffer(packet_size() - 13 - list_size))
 					{
@@ -1166,6 +1198,8 @@ namespace libtorrent
 						return;
 					}
 				}
+				TORRENT_ASSERT(has_buffered_receive_data() || has_disk_receive_buffer()
+					|| packet_size() == 13 + list_size);
 			}
 		}
 		else
@@ -1180,7 +1214,13 @@ namespace libtorrent
 					return;
 				}
 
-				if (!m_settings.get_bool(settings_pack::contiguous_recv_buffer))
+				// unless the payload has already been read into the regular
+				// receive buffer, receive it straight into a disk buffer,
+				// to save copying it
+#if TORRENT_USE_ASSERTS
+				m_piece_in_recv_buffer = has_buffered_receive_data();
+#endif
+				if (!has_buffered_receive_data())
 				{
 					if (!allocate_disk_receive_buffer(packet_size() - 9))
 					{
@@ -1190,7 +1230,7 @@ namespace libtorrent
 				}
 			}
 		}
-		TORRENT_ASSERT(m_settings.get_bool(settings_pack::contiguous_recv_buffer) || has_disk_receive_buffer() || packet_size() == 9);
+		TORRENT_ASSERT(m_piece_in_recv_buffer || has_disk_receive_buffer() || packet_size() == 9);
 		// classify the received data as protocol chatter
 		// or data payload for the statistics
 		int piece_bytes = 0;
@@ -1256,7 +1296,7 @@ namespace libtorrent
 			if (is_disconnecting()) return;
 		}
 
-		TORRENT_ASSERT(m_settings.get_bool(settings_pack::contiguous_recv_buffer) || has_disk_receive_buffer() || packet_size() == header_size);
+		TORRENT_ASSERT(m_piece_in_recv_buffer || has_disk_receive_buffer() || packet_size() == header_size);
 
 		incoming_piece_fragment(piece_bytes);
 		if (!packet_finished()) return;
@@ -2541,8 +2581,19 @@ namespace libtorrent
 		if (m_rc4_encrypted && m_encrypted)
 		{
 			std::pair<buffer::interval, buffer::interval> wr_buf = wr_recv_buffers(bytes_transferred);
-			m_enc_handler->decrypt(wr_buf.first.begin, wr_buf.first.left());
-			if (wr_buf.second.left()) m_enc_handler->decrypt(wr_buf.second.begin, wr_buf.second.left());
+			if (wr_buf.second.left())
+			{
+				// the payload straddles the receive buffer and the disk
+				// buffer. Decrypt both in one pass
+				m_crypto_iovec.clear();
+				m_crypto_iovec.push_back(asio::mutable_buffer(wr_buf.first.begin, wr_buf.first.left()));
+				m_crypto_iovec.push_back(asio::mutable_buffer(wr_buf.second.begin, wr_buf.second.left()));
+				m_enc_handler->decrypt(m_crypto_iovec);
+			}
+			else
+			{
+				m_enc_handler->decrypt(wr_buf.first.begin, wr_buf.first.left());
+			}
 		}
 #endif
 
@@ -33,15 +33,17 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/chained_buffer.hpp"
 #include "libtorrent/assert.hpp"
 
+#include <algorithm> // for std::min
+
 namespace libtorrent
 {
 	void chained_buffer::pop_front(int bytes_to_pop)
 	{
 		TORRENT_ASSERT(is_single_thread());
 		TORRENT_ASSERT(bytes_to_pop <= m_bytes);
-		while (bytes_to_pop > 0 && !m_vec.empty())
+		while (bytes_to_pop > 0 && m_num_buffers > 0)
 		{
-			buffer_t& b = m_vec.front();
+			buffer_t& b = buffer_at(0);
 			if (b.used_size > bytes_to_pop)
 			{
 				b.start += bytes_to_pop;
@@ -60,17 +62,30 @@ namespace libtorrent
 			TORRENT_ASSERT(m_bytes >= 0);
 			TORRENT_ASSERT(m_capacity >= 0);
 			TORRENT_ASSERT(m_bytes <= m_capacity);
-			m_vec.pop_front();
+			m_first = (m_first + 1) & (m_vec.size() - 1);
+			--m_num_buffers;
 		}
 	}
 
+	void chained_buffer::grow()
+	{
+		int const new_size = m_vec.empty() ? 8 : int(m_vec.size()) * 2;
+		std::vector<buffer_t> new_vec(new_size);
+		for (int i = 0; i < m_num_buffers; ++i)
+			new_vec[i] = buffer_at(i);
+		m_vec.swap(new_vec);
+		m_first = 0;
+	}
+
 	void chained_buffer::append_buffer(char* buffer, int s, int used_size
 		, free_buffer_fun destructor, void* userdata
 		, block_cache_reference ref)
 	{
 		TORRENT_ASSERT(is_single_thread());
 		TORRENT_ASSERT(s >= used_size);
-		buffer_t b;
+		if (m_num_buffers == int(m_vec.size())) grow();
+		++m_num_buffers;
+		buffer_t& b = buffer_at(m_num_buffers - 1);
 		b.buf = buffer;
 		b.size = s;
 		b.start = buffer;
@@ -78,7 +93,6 @@ namespace libtorrent
 		b.free_fun = destructor;
 		b.userdata = userdata;
 		b.ref = ref;
-		m_vec.push_back(b);
 
 		m_bytes += used_size;
 		m_capacity += s;
@@ -90,8 +104,8 @@ namespace libtorrent
 	int chained_buffer::space_in_last_buffer()
 	{
 		TORRENT_ASSERT(is_single_thread());
-		if (m_vec.empty()) return 0;
-		buffer_t& b = m_vec.back();
+		if (m_num_buffers == 0) return 0;
+		buffer_t& b = buffer_at(m_num_buffers - 1);
 		return b.size - b.used_size - (b.start - b.buf);
 	}
 
@@ -113,8 +127,8 @@ namespace libtorrent
 	char* chained_buffer::allocate_appendix(int s)
 	{
 		TORRENT_ASSERT(is_single_thread());
-		if (m_vec.empty()) return 0;
-		buffer_t& b = m_vec.back();
+		if (m_num_buffers == 0) return 0;
+		buffer_t& b = buffer_at(m_num_buffers - 1);
 		char* insert = b.start + b.used_size;
 		if (insert + s > b.buf + b.size) return 0;
 		b.used_size += s;
@@ -128,32 +142,63 @@ namespace libtorrent
 		TORRENT_ASSERT(is_single_thread());
 		m_tmp_vec.clear();
 
-		for (std::deque<buffer_t>::iterator i = m_vec.begin()
-			, end(m_vec.end()); to_send > 0 && i != end; ++i)
+		int const num_bufs = (std::min)(m_num_buffers, int(TORRENT_IOV_MAX));
+		for (int i = 0; to_send > 0 && i < num_bufs; ++i)
 		{
-			if (i->used_size > to_send)
+			buffer_t const& b = buffer_at(i);
+			if (b.used_size > to_send)
 			{
 				TORRENT_ASSERT(to_send > 0);
-				m_tmp_vec.push_back(asio::const_buffer(i->start, to_send));
+				m_tmp_vec.push_back(asio::const_buffer(b.start, to_send));
 				break;
 			}
-			TORRENT_ASSERT(i->used_size > 0);
-			m_tmp_vec.push_back(asio::const_buffer(i->start, i->used_size));
-			to_send -= i->used_size;
+			TORRENT_ASSERT(b.used_size > 0);
+			m_tmp_vec.push_back(asio::const_buffer(b.start, b.used_size));
+			to_send -= b.used_size;
 		}
 		return m_tmp_vec;
 	}
 
+	void chained_buffer::build_mutable_iovec_tail(int bytes
+		, std::vector<asio::mutable_buffer>& vec)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		TORRENT_ASSERT(bytes >= 0);
+		TORRENT_ASSERT(bytes <= m_bytes);
+		vec.clear();
+		if (bytes == 0) return;
+
+		// walk backwards to find the buffer the tail starts in
+		int i = m_num_buffers - 1;
+		int left = bytes;
+		while (buffer_at(i).used_size < left)
+		{
+			left -= buffer_at(i).used_size;
+			--i;
+			TORRENT_ASSERT(i >= 0);
+		}
+
+		buffer_t const& first = buffer_at(i);
+		vec.push_back(asio::mutable_buffer(first.start + first.used_size - left, left));
+		for (++i; i < m_num_buffers; ++i)
+		{
+			buffer_t const& b = buffer_at(i);
+			if (b.used_size == 0) continue;
+			vec.push_back(asio::mutable_buffer(b.start, b.used_size));
+		}
+	}
+
 	void chained_buffer::clear()
 	{
-		for (std::deque<buffer_t>::iterator i = m_vec.begin()
-			, end(m_vec.end()); i != end; ++i)
+		for (int i = 0; i < m_num_buffers; ++i)
 		{
-			i->free_fun(i->buf, i->userdata, i->ref);
+			buffer_t& b = buffer_at(i);
+			b.free_fun(b.buf, b.userdata, b.ref);
 		}
 		m_bytes = 0;
 		m_capacity = 0;
-		m_vec.clear();
+		m_first = 0;
+		m_num_buffers = 0;
 	}
 
 	chained_buffer::~chained_buffer()
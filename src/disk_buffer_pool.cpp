@@ -110,6 +110,7 @@ namespace libtorrent
 		, m_ios(ios)
 		, m_cache_buffer_chunk_size(0)
 		, m_lock_disk_cache(false)
+		, m_watermark_margin(16)
 #if TORRENT_HAVE_MMAP
 		, m_cache_fd(-1)
 		, m_cache_pool(0)
@@ -460,6 +461,33 @@ namespace libtorrent
 		return ret;
 	}
 
+	bool disk_buffer_pool::set_max_use(int max_use)
+	{
+		mutex::scoped_lock l(m_pool_mutex);
+
+#if TORRENT_HAVE_MMAP
+		// the mmapped cache is allocated up-front, it can't be resized
+		if (m_cache_pool) return false;
+#endif
+
+		set_max_use_impl(max_use, l);
+		return true;
+	}
+
+	void disk_buffer_pool::set_max_use_impl(int max_use, mutex::scoped_lock& l)
+	{
+		TORRENT_ASSERT(l.locked());
+
+		m_max_use = max_use;
+		m_low_watermark = m_max_use - m_watermark_margin;
+		if (m_low_watermark < 0) m_low_watermark = 0;
+		if (m_in_use >= m_max_use && !m_exceeded_max_size)
+		{
+			m_exceeded_max_size = true;
+			m_trigger_cache_trim();
+		}
+	}
+
 	void disk_buffer_pool::set_settings(aux::session_settings const& sett)
 	{
 		mutex::scoped_lock l(m_pool_mutex);
@@ -493,20 +521,11 @@ namespace libtorrent
 			if (cache_size < 0)
 			{
 				boost::uint64_t phys_ram = physical_ram();
-				if (phys_ram == 0) m_max_use = 1024;
-				else m_max_use = phys_ram / 8 / m_block_size;
-			}
-			else
-			{
-				m_max_use = cache_size;
-			}
-			m_low_watermark = m_max_use - (std::max)(16, sett.get_int(settings_pack::max_queued_disk_bytes) / 0x4000);
-			if (m_low_watermark < 0) m_low_watermark = 0;
-			if (m_in_use >= m_max_use && !m_exceeded_max_size)
-			{
-				m_exceeded_max_size = true;
-				m_trigger_cache_trim();
+				if (phys_ram == 0) cache_size = 1024;
+				else cache_size = phys_ram / 8 / m_block_size;
 			}
+			m_watermark_margin = (std::max)(16, sett.get_int(settings_pack::max_queued_disk_bytes) / 0x4000);
+			set_max_use_impl(cache_size, l);
 		}
 
 #if TORRENT_USE_ASSERTS
@@ -42,6 +42,7 @@ namespace libtorrent
 		, buffer(0)
 		, piece(0)
 		, action(read)
+		, start_time(time_now_hires())
 		, ret(0)
 		, flags(0)
 #if defined TORRENT_DEBUG || TORRENT_RELEASE_ASSERTS
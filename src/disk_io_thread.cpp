@@ -42,6 +42,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <boost/bind.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <set>
+#include <limits.h> // for INT_MAX
 #include <vector>
 
 #include "libtorrent/time.hpp"
@@ -51,6 +52,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/alert_dispatcher.hpp"
 #include "libtorrent/uncork_interface.hpp"
 #include "libtorrent/performance_counters.hpp"
+#include "libtorrent/event_trace.hpp"
+#include "libtorrent/platform_util.hpp" // for total_physical_ram
 
 #include "libtorrent/debug.hpp"
 
@@ -170,6 +173,9 @@ namespace libtorrent
 		, m_num_running_threads(0)
 		, m_userdata(userdata)
 		, m_last_cache_expiry(min_time())
+		, m_last_cache_adjust(min_time())
+		, m_last_ghost_hits(0)
+		, m_last_cache_reads(0)
 		, m_last_file_check(time_now_hires())
 		, m_file_pool(40)
 		, m_disk_cache(block_size, ios, boost::bind(&disk_io_thread::trigger_cache_trim, this), alert_disp)
@@ -300,8 +306,98 @@ namespace libtorrent
 	{
 		TORRENT_ASSERT(m_magic == 0x1337);
 		mutex::scoped_lock l(m_cache_mutex);
+		bool const was_adaptive = m_settings.get_bool(settings_pack::adaptive_cache_size);
+		int const cache_size = m_disk_cache.max_use();
 		apply_pack(pack, m_settings);
 		m_disk_cache.set_settings(m_settings);
+
+		// don't let changes to unrelated settings reset the cache size the
+		// adaptive sizing has arrived at
+		if (was_adaptive && m_settings.get_bool(settings_pack::adaptive_cache_size))
+		{
+			int const min_size = m_settings.get_int(settings_pack::min_cache_size);
+			int const max_size = max_cache_size();
+			m_disk_cache.set_max_use((std::max)(min_size
+				, (std::min)(cache_size, max_size)));
+		}
+	}
+
+	int disk_io_thread::max_cache_size() const
+	{
+		int ret = m_settings.get_int(settings_pack::max_cache_size);
+		if (ret >= 0) return (std::max)(ret, m_settings.get_int(settings_pack::min_cache_size));
+
+		// default to a quarter of the physical memory
+		boost::uint64_t const phys_ram = total_physical_ram();
+		if (phys_ram == 0) ret = 1024;
+		else ret = int((std::min)(phys_ram / 4 / m_disk_cache.block_size()
+			, boost::uint64_t(INT_MAX)));
+		return (std::max)(ret, m_settings.get_int(settings_pack::min_cache_size));
+	}
+
+	int adaptive_cache_target(int size, int min_size, int max_size
+		, int ghost_hits, boost::int64_t reads, boost::uint64_t total_ram
+		, boost::uint64_t available_ram, int free_percent)
+	{
+		int target = size;
+
+		if (total_ram > 0 && available_ram > 0
+			&& available_ram * 100 < total_ram * boost::uint64_t((std::max)(0, free_percent)))
+		{
+			// the system is running low on memory. Give some of it back,
+			// regardless of how useful the cache is
+			target = size - size / 8;
+		}
+		else if (ghost_hits > 0 && boost::int64_t(ghost_hits) * 100 >= reads)
+		{
+			// at least 1% of the reads were for pieces that were evicted from
+			// the cache, but would still have been in it, had it been larger
+			target = size + (std::max)(size / 4, 16);
+		}
+
+		return (std::max)((std::max)(min_size, 0), (std::min)(target, max_size));
+	}
+
+	void disk_io_thread::update_cache_size()
+	{
+		TORRENT_ASSERT(m_magic == 0x1337);
+		mutex::scoped_lock l(m_cache_mutex);
+		ptime const now = time_now();
+		if (now < m_last_cache_adjust + seconds(5)) return;
+		m_last_cache_adjust = now;
+		adjust_cache_size(l);
+	}
+
+	void disk_io_thread::adjust_cache_size(mutex::scoped_lock& l)
+	{
+		TORRENT_ASSERT(l.locked());
+
+		int const ghost_hits = m_disk_cache.num_ghost_hits() - m_last_ghost_hits;
+		m_last_ghost_hits += ghost_hits;
+		if (ghost_hits > 0)
+			m_stats_counters.inc_stats_counter(counters::num_arc_ghost_hits, ghost_hits);
+
+		boost::int64_t const total_reads = m_stats_counters[counters::num_blocks_read]
+			+ m_stats_counters[counters::num_blocks_cache_hits];
+		boost::int64_t const reads = total_reads - m_last_cache_reads;
+		m_last_cache_reads = total_reads;
+
+		if (!m_settings.get_bool(settings_pack::adaptive_cache_size)) return;
+
+		int const size = m_disk_cache.max_use();
+		int const target = adaptive_cache_target(size
+			, m_settings.get_int(settings_pack::min_cache_size)
+			, max_cache_size(), ghost_hits, reads
+			, total_physical_ram(), available_physical_ram()
+			, m_settings.get_int(settings_pack::adaptive_cache_free_memory));
+		if (target == size) return;
+		if (!m_disk_cache.set_max_use(target)) return;
+
+		DLOG("adjust_cache_size: %d -> %d (ghost hits: %d reads: %d)\n"
+			, size, target, ghost_hits, int(reads));
+
+		m_stats_counters.inc_stats_counter(target > size
+			? counters::num_cache_size_grow : counters::num_cache_size_shrink);
 	}
 
 	// flush all blocks that are below p->hash.offset, since we've
@@ -1058,7 +1154,9 @@ namespace libtorrent
 		"rename_file",
 		"stop_torrent",
 		"cache_piece",
+#ifndef TORRENT_NO_DEPRECATE
 		"finalize_file",
+#endif
 		"flush_piece",
 		"flush_hashed",
 		"flush_storage",
@@ -1082,6 +1180,19 @@ namespace libtorrent
 
 #endif
 
+	// returns the first counter of the latency histogram jobs of this
+	// kind are recorded in
+	int job_latency_histogram(int action)
+	{
+		switch (action)
+		{
+			case disk_io_job::read: return counters::disk_read_latency3;
+			case disk_io_job::write: return counters::disk_write_latency3;
+			case disk_io_job::hash: return counters::disk_hash_latency3;
+			default: return counters::disk_other_latency3;
+		}
+	}
+
 	// evict and/or flush blocks if we're exceeding the cache size
 	// or used to exceed it and haven't dropped below the low watermark yet
 	// the low watermark is dynamic, based on the number of peers waiting
@@ -1138,6 +1249,7 @@ namespace libtorrent
 
 		ptime start_time = time_now_hires();
 
+		TORRENT_TRACE_EVENT(disk_job_start, j, j->action, j->piece);
 		m_stats_counters.inc_stats_counter(counters::num_running_disk_jobs, 1);
 
 		// call disk function
@@ -1147,6 +1259,7 @@ namespace libtorrent
 		TORRENT_ASSERT(ret != -1 || (j->error.ec && j->error.operation != 0));
 
 		m_stats_counters.inc_stats_counter(counters::num_running_disk_jobs, -1);
+		TORRENT_TRACE_EVENT(disk_job_done, j, j->action, j->piece);
 
 		if (ret == retry_job)
 		{
@@ -1168,6 +1281,12 @@ namespace libtorrent
 			return;
 		}
 
+		ptime const done_time = time_now_hires();
+		m_stats_counters.add_latency_sample(counters::disk_queue_latency3
+			, total_microseconds(start_time - j->start_time));
+		m_stats_counters.add_latency_sample(job_latency_histogram(j->action)
+			, total_microseconds(done_time - start_time));
+
 #if TORRENT_USE_ASSERT
 		// TODO: it should clear the hash state even when there's an error, right?
 		if (j->action == disk_io_job::hash && !j->error.ec)
@@ -1187,8 +1306,7 @@ namespace libtorrent
 
 		j->ret = ret;
 
-		ptime now = time_now_hires();
-		m_job_time.add_sample(total_microseconds(now - start_time));
+		m_job_time.add_sample(total_microseconds(done_time - start_time));
 		completed_jobs.push_back(j);
 	}
 
@@ -2798,6 +2916,26 @@ namespace libtorrent
 		m_disk_cache.update_stats_counters(c);
 	}
 
+	void disk_io_thread::cached_blocks(piece_manager const* const* storages
+		, int* blocks, int num) const
+	{
+		mutex::scoped_lock l(m_cache_mutex);
+
+		for (int i = 0; i < num; ++i)
+		{
+			blocks[i] = 0;
+			if (storages[i] == 0) continue;
+
+			boost::unordered_set<cached_piece_entry*> const& pieces
+				= storages[i]->cached_pieces();
+			for (boost::unordered_set<cached_piece_entry*>::const_iterator p
+				= pieces.begin(), end(pieces.end()); p != end; ++p)
+			{
+				blocks[i] += (*p)->num_blocks;
+			}
+		}
+	}
+
 	void disk_io_thread::get_cache_info(cache_status* ret, bool no_pieces
 		, piece_manager const* storage) const
 	{
@@ -3128,6 +3266,8 @@ namespace libtorrent
 			return;
 		}
 
+		TORRENT_TRACE_EVENT(disk_job_submit, j, j->action, j->piece);
+
 		DLOG("add_job: %s (outstanding: %d)\n"
 			, job_action_name[j->action]
 			, j->storage ? j->storage->num_outstanding_jobs() : 0);
@@ -3522,6 +3662,7 @@ namespace libtorrent
 #if TORRENT_USE_ASSERTS
 			j->callback_called = true;
 #endif
+			TORRENT_TRACE_EVENT(disk_job_handler, j, j->action, j->piece);
 			if (j->callback) j->callback(j);
 			to_delete.push_back(j);
 			j = next;
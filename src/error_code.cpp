@@ -205,8 +205,8 @@ namespace libtorrent
 			"invalid piece index in slot list",
 			"pieces needs to be reordered",
 			"fastresume not modified since last save",
-			"",
-			"",
+			"invalid resume store file",
+			"resume store record failed checksum",
 			"",
 			"",
 			"",
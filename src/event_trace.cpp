@@ -0,0 +1,278 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/event_trace.hpp"
+#include "libtorrent/time.hpp" // for the chrono headers
+#include "libtorrent/assert.hpp"
+#include "libtorrent/socket.hpp" // for asio::error
+
+#ifdef TORRENT_EVENT_TRACE
+#include "libtorrent/thread.hpp"
+#include "libtorrent/disk_io_job.hpp"
+#include <boost/atomic.hpp>
+#include <vector>
+
+#if defined TORRENT_WINDOWS || defined TORRENT_CYGWIN
+#include <windows.h> // for FlsAlloc
+#else
+#include <pthread.h>
+#endif
+#endif
+
+#include <cstdio>
+#include <cstring> // for memcpy
+#include <algorithm> // for min
+#include <cerrno>
+
+#if defined TORRENT_EVENT_TRACE && !defined TORRENT_THREAD_LOCAL
+#error TORRENT_EVENT_TRACE requires thread local storage
+#endif
+
+namespace libtorrent
+{
+#ifdef TORRENT_EVENT_TRACE
+	// defined in disk_io_thread.cpp
+	extern const char* job_action_name[];
+
+	namespace
+	{
+		enum
+		{
+			// the number of events each thread's ring holds before it
+			// wraps around. Must be a power of two
+			ring_size = 1 << 15,
+
+			// the max number of threads recording events at the same time.
+			// Threads beyond this don't record anything, they're counted in
+			// g_dropped_threads instead
+			max_rings = 64
+		};
+
+		// a ring is only ever written to by the thread owning it. ``head``
+		// is the total number of events recorded so far
+		struct trace_ring
+		{
+			trace_ring(int idx): index(idx) { head = 0; }
+			boost::atomic<boost::uint64_t> head;
+			int index;
+			trace_event events[ring_size];
+		};
+
+		// the rings of all live threads. A ring is removed and freed when
+		// its thread exits, so slots are reused. Dumping holds the mutex
+		// while reading a ring, to keep it alive
+		mutex g_rings_mutex;
+		trace_ring* g_rings[max_rings];
+
+		// the number of threads that have recorded events, used to assign
+		// thread indices. Indices are not reused
+		boost::atomic<int> g_num_threads(0);
+
+		// the number of threads that found all rings taken
+		boost::atomic<int> g_dropped_threads(0);
+
+		TORRENT_THREAD_LOCAL trace_ring* g_thread_ring = 0;
+		TORRENT_THREAD_LOCAL bool g_thread_dropped = false;
+
+		// called in the exiting thread
+		void free_ring(void* p)
+		{
+			trace_ring* r = static_cast<trace_ring*>(p);
+			if (r == 0) return;
+			g_thread_ring = 0;
+			g_thread_dropped = true;
+			{
+				mutex::scoped_lock l(g_rings_mutex);
+				for (int i = 0; i < max_rings; ++i)
+				{
+					if (g_rings[i] != r) continue;
+					g_rings[i] = 0;
+					break;
+				}
+			}
+			delete r;
+		}
+
+		// a thread local slot with a destructor, to free the ring when its
+		// thread exits. TORRENT_THREAD_LOCAL only supports POD types
+#if defined TORRENT_WINDOWS || defined TORRENT_CYGWIN
+		void WINAPI fls_free_ring(void* p) { free_ring(p); }
+
+		struct ring_key_t
+		{
+			ring_key_t(): key(FlsAlloc(&fls_free_ring)) {}
+			void set(trace_ring* r)
+			{ if (key != FLS_OUT_OF_INDEXES) FlsSetValue(key, r); }
+			DWORD key;
+		};
+#else
+		struct ring_key_t
+		{
+			ring_key_t(): valid(pthread_key_create(&key, &free_ring) == 0) {}
+			void set(trace_ring* r) { if (valid) pthread_setspecific(key, r); }
+			pthread_key_t key;
+			bool valid;
+		};
+#endif
+		ring_key_t g_ring_key;
+
+		trace_ring* thread_ring()
+		{
+			trace_ring* r = g_thread_ring;
+			if (r != 0 || g_thread_dropped) return r;
+
+			r = new trace_ring(g_num_threads.fetch_add(1));
+			{
+				mutex::scoped_lock l(g_rings_mutex);
+				int i = 0;
+				while (i < max_rings && g_rings[i] != 0) ++i;
+				if (i < max_rings) g_rings[i] = r;
+				else
+				{
+					delete r;
+					r = 0;
+				}
+			}
+			if (r == 0)
+			{
+				g_thread_dropped = true;
+				g_dropped_threads.fetch_add(1);
+				return 0;
+			}
+			g_ring_key.set(r);
+			g_thread_ring = r;
+			return r;
+		}
+
+		boost::uint64_t trace_clock()
+		{
+#if defined BOOST_ASIO_HAS_STD_CHRONO
+			using namespace std::chrono;
+#else
+			using namespace boost::chrono;
+#endif
+			return duration_cast<nanoseconds>(
+				steady_clock::now().time_since_epoch()).count();
+		}
+	}
+
+	void record_trace_event(int type, void const* id
+		, boost::uint32_t arg0, boost::uint32_t arg1)
+	{
+		TORRENT_ASSERT(type >= 0 && type < trace_event::num_types);
+
+		trace_ring* r = thread_ring();
+		if (r == 0) return;
+		boost::uint64_t const h = r->head.load(boost::memory_order_relaxed);
+		trace_event& e = r->events[h & (ring_size - 1)];
+		e.timestamp = trace_clock();
+		e.id = boost::uint64_t(reinterpret_cast<boost::uintptr_t>(id));
+		e.arg0 = arg0;
+		e.arg1 = arg1;
+		e.type = type;
+		e.thread = r->index;
+		e.reserved = 0;
+		r->head.store(h + 1, boost::memory_order_release);
+	}
+
+	void dump_event_trace(std::string const& filename, error_code& ec)
+	{
+		FILE* f = fopen(filename.c_str(), "wb");
+		if (f == 0)
+		{
+			ec.assign(errno, generic_category());
+			return;
+		}
+
+		char header[24] = "LTTRACE2";
+		boost::uint32_t const byte_order = 0x01020304;
+		boost::uint32_t const record_size = sizeof(trace_event);
+		boost::uint32_t const dropped = g_dropped_threads.load();
+		boost::uint32_t const num_names = disk_io_job::num_job_ids;
+		memcpy(header + 8, &byte_order, 4);
+		memcpy(header + 12, &record_size, 4);
+		memcpy(header + 16, &dropped, 4);
+		memcpy(header + 20, &num_names, 4);
+		bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+
+		// the names of the disk job actions, which depend on the build
+		// configuration
+		for (int i = 0; i < int(num_names) && ok; ++i)
+			ok = fwrite(job_action_name[i], strlen(job_action_name[i]) + 1, 1, f) == 1;
+
+		std::vector<trace_event> events;
+		for (int i = 0; i < max_rings && ok; ++i)
+		{
+			events.clear();
+			{
+				mutex::scoped_lock l(g_rings_mutex);
+				trace_ring const* r = g_rings[i];
+				if (r == 0) continue;
+
+				boost::uint64_t const start = r->head.load(boost::memory_order_acquire);
+				boost::uint64_t const first = start > ring_size ? start - ring_size : 0;
+				for (boost::uint64_t k = first; k < start; ++k)
+					events.push_back(r->events[k & (ring_size - 1)]);
+
+				// the owning thread kept recording while we were copying. Any
+				// slot it has advanced into may have been overwritten
+				// half-way, so skip those. The fence keeps the reads of the
+				// events from being moved past the read of head
+				boost::atomic_thread_fence(boost::memory_order_acquire);
+				boost::uint64_t const end = r->head.load(boost::memory_order_relaxed);
+				int skip = 0;
+				if (end - first >= ring_size)
+					skip = (std::min)(int(end - first - ring_size + 1), int(events.size()));
+				events.erase(events.begin(), events.begin() + skip);
+			}
+
+			if (!events.empty())
+			{
+				ok = fwrite(&events[0], sizeof(trace_event)
+					, events.size(), f) == events.size();
+			}
+		}
+
+		if (!ok) ec.assign(errno, generic_category());
+		fclose(f);
+	}
+#else
+	void record_trace_event(int, void const*, boost::uint32_t, boost::uint32_t)
+	{}
+
+	void dump_event_trace(std::string const&, error_code& ec)
+	{
+		ec = asio::error::operation_not_supported;
+	}
+#endif
+}
+
@@ -36,17 +36,162 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/utf8.hpp"
 #include <boost/bind.hpp>
 #include <cstdio>
+#include <cstring>
 #include <algorithm>
 
 namespace libtorrent
 {
+	namespace
+	{
+#if defined TORRENT_WINDOWS || defined TORRENT_OS2
+		char const path_separator = '\\';
+#else
+		char const path_separator = '/';
+#endif
+
+		bool is_separator(char c)
+		{
+#ifdef TORRENT_WINDOWS
+			if (c == '\\') return true;
+#endif
+			return c == '/';
+		}
+
+		// FNV-1a of the path component, seeded with its parent
+		boost::uint32_t path_hash(int parent, char const* name, int len)
+		{
+			boost::uint32_t h = 2166136261u ^ boost::uint32_t(parent);
+			for (int i = 0; i < len; ++i)
+			{
+				h ^= boost::uint8_t(name[i]);
+				h *= 16777619u;
+			}
+			return h;
+		}
+	}
+
 	file_storage::file_storage()
 		: m_piece_length(0)
 		, m_num_pieces(0)
 		, m_total_size(0)
 		, m_num_files(0)
+		, m_name_pool_next(0)
+		, m_name_pool_free(0)
 	{}
 
+	file_storage::file_storage(file_storage const& f)
+		: m_piece_length(f.m_piece_length)
+		, m_num_pieces(f.m_num_pieces)
+		, m_files(f.m_files)
+		, m_file_hashes(f.m_file_hashes)
+		, m_symlinks(f.m_symlinks)
+		, m_mtime(f.m_mtime)
+		, m_file_base(f.m_file_base)
+		, m_paths(f.m_paths)
+		, m_path_index(f.m_path_index)
+		, m_name(f.m_name)
+		, m_total_size(f.m_total_size)
+		, m_num_files(f.m_num_files)
+		, m_piece_index(f.m_piece_index)
+		, m_name_pool_next(0)
+		, m_name_pool_free(0)
+	{
+		copy_names();
+	}
+
+	file_storage& file_storage::operator=(file_storage const& f)
+	{
+		if (this == &f) return *this;
+		file_storage tmp(f);
+		swap(tmp);
+		return *this;
+	}
+
+	void file_storage::copy_names()
+	{
+		// the borrowed names and the directory names still point into the
+		// file_storage (or torrent file) the entries were copied from. Copy
+		// all of them into a single block of our own
+		m_name_pool.clear();
+		m_name_pool_next = 0;
+		m_name_pool_free = 0;
+
+		int size = 0;
+		for (std::vector<internal_file_entry>::const_iterator i = m_files.begin()
+			, end(m_files.end()); i != end; ++i)
+		{
+			if (i->name_len == internal_file_entry::name_is_owned) continue;
+			size += i->name_len;
+		}
+		for (std::vector<path_entry>::const_iterator i = m_paths.begin()
+			, end(m_paths.end()); i != end; ++i)
+			size += i->len;
+
+		if (size > 0)
+		{
+			name_block b;
+			b.buf.reset(new char[size]);
+			b.size = size;
+			m_name_pool.push_back(b);
+			m_name_pool_next = b.buf.get();
+			m_name_pool_free = size;
+		}
+
+		for (std::vector<internal_file_entry>::iterator i = m_files.begin()
+			, end(m_files.end()); i != end; ++i)
+		{
+			if (i->name_len == internal_file_entry::name_is_owned) continue;
+			i->name = allocate_name(i->name, i->name_len);
+		}
+		for (std::vector<path_entry>::iterator i = m_paths.begin()
+			, end(m_paths.end()); i != end; ++i)
+			i->name = allocate_name(i->name, i->len);
+	}
+
+	char const* file_storage::allocate_name(char const* n, int len)
+	{
+		TORRENT_ASSERT(len >= 0);
+		if (len > m_name_pool_free || m_name_pool_next == 0)
+		{
+			// the blocks grow with the number of names, so that torrents with
+			// few files only allocate a small block, and torrents with many
+			// files don't need too many blocks
+			name_block b;
+			b.size = (std::max)(len, 256 << (std::min)(int(m_name_pool.size()), 12));
+			b.buf.reset(new char[b.size]);
+			m_name_pool.push_back(b);
+			m_name_pool_next = b.buf.get();
+			m_name_pool_free = b.size;
+		}
+		char* ret = m_name_pool_next;
+		std::memcpy(ret, n, len);
+		m_name_pool_next += len;
+		m_name_pool_free -= len;
+		return ret;
+	}
+
+	bool file_storage::in_name_pool(char const* name) const
+	{
+		for (std::vector<name_block>::const_iterator i = m_name_pool.begin()
+			, end(m_name_pool.end()); i != end; ++i)
+		{
+			if (name >= i->buf.get() && name <= i->buf.get() + i->size) return true;
+		}
+		return false;
+	}
+
+	void file_storage::set_file_name(internal_file_entry& e, char const* n, int len)
+	{
+		if (len >= internal_file_entry::name_is_owned)
+		{
+			// this name is too long for the length field. Keep it as a null
+			// terminated string of its own
+			e.set_name(std::string(n, len).c_str());
+			return;
+		}
+		e.set_name(allocate_name(n, len), true, len);
+	}
+
 	void file_storage::reserve(int num_files)
 	{
 		m_files.reserve(num_files);
@@ -68,43 +213,49 @@ namespace libtorrent
 			return piece_length();
 	}
 
-	void file_storage::update_path_index(internal_file_entry& e)
+	void file_storage::update_path_index(internal_file_entry& e
+		, std::string const& path, bool set_name)
 	{
-		std::string fn = e.filename();
-		if (is_complete(fn))
+		if (is_complete(path))
 		{
+			if (set_name) set_file_name(e, path.c_str(), int(path.size()));
 			e.path_index = -2;
 			return;
 		}
+
 		// sorry about this messy string handling, but I did
 		// profile it, and it was expensive
-		char const* leaf = filename_cstr(fn.c_str());
+		char const* leaf = filename_cstr(path.c_str());
 		char const* branch_path = "";
-		if (leaf > fn.c_str())
+		int branch_len = 0;
+		if (leaf > path.c_str())
 		{
 			// split the string into the leaf filename
 			// and the branch path
-			branch_path = fn.c_str();
-			((char*)leaf)[-1] = 0;
+			branch_path = path.c_str();
+			branch_len = int(leaf - path.c_str()) - 1;
 		}
-		if (branch_path[0] == 0)
+		if (set_name) set_file_name(e, leaf, int(path.size() - (leaf - path.c_str())));
+
+		if (branch_len == 0)
 		{
 			e.path_index = -1;
 			return;
 		}
 
-		int branch_len = strlen(branch_path);
-		if (branch_len >= m_name.size()
+		if (branch_len >= int(m_name.size())
 			&& std::memcmp(branch_path, m_name.c_str(), m_name.size()) == 0
-			&& (branch_len == m_name.size()
+			&& (branch_len == int(m_name.size())
 #ifdef TORRENT_WINDOWS
 				|| branch_path[m_name.size()] == '\\'
 #endif
 				|| branch_path[m_name.size()] == '/'
 			))
 		{
-			branch_path += m_name.size()
-				+ (m_name.size() == branch_len?0:1);
+			int const skip = int(m_name.size())
+				+ (int(m_name.size()) == branch_len ? 0 : 1);
+			branch_path += skip;
+			branch_len -= skip;
 			e.no_root_dir = false;
 		}
 		else
@@ -112,22 +263,68 @@ namespace libtorrent
 			e.no_root_dir = true;
 		}
 
-		// do we already have this path in the path list?
-		std::vector<std::string>::reverse_iterator p
-			= std::find(m_paths.rbegin(), m_paths.rend(), branch_path);
+		// look up the directory one path component at a time, adding the
+		// ones we don't have yet
+		int parent = -1;
+		char const* end = branch_path + branch_len;
+		while (branch_path < end)
+		{
+			char const* sep = branch_path;
+			while (sep < end && !is_separator(*sep)) ++sep;
+			if (sep > branch_path)
+				parent = intern_path(parent, branch_path, int(sep - branch_path));
+			branch_path = sep + 1;
+		}
+
+		// the file is in the root directory of the torrent. That's an
+		// (empty) path of its own, to tell it apart from single file
+		// torrents
+		if (parent == -1) parent = intern_path(-1, "", 0);
+		e.path_index = parent;
+	}
 
-		if (p == m_paths.rend())
+	int file_storage::intern_path(int parent, char const* name, int len)
+	{
+		TORRENT_ASSERT(parent >= -1 && parent < int(m_paths.size()));
+		boost::uint32_t const h = path_hash(parent, name, len);
+		std::pair<path_index_t::iterator, path_index_t::iterator> range
+			= m_path_index.equal_range(h);
+		for (; range.first != range.second; ++range.first)
 		{
-			// no, we don't. add it
-			e.path_index = m_paths.size();
-			m_paths.push_back(branch_path);
+			path_entry const& p = m_paths[range.first->second];
+			if (p.parent != parent || p.len != len) continue;
+			if (std::memcmp(p.name, name, len) != 0) continue;
+			return range.first->second;
 		}
-		else
+
+		path_entry p;
+		p.name = allocate_name(name, len);
+		p.len = len;
+		p.parent = parent;
+		int const ret = int(m_paths.size());
+		m_paths.push_back(p);
+		m_path_index.insert(std::make_pair(h, ret));
+		return ret;
+	}
+
+	std::string file_storage::path(int index) const
+	{
+		TORRENT_ASSERT_PRECOND(index >= 0 && index < int(m_paths.size()));
+
+		// walk up to the top level to find the length of the path, then
+		// fill it in from the end
+		int size = -1;
+		for (int i = index; i >= 0; i = m_paths[i].parent)
+			size += m_paths[i].len + 1;
+
+		std::string ret(size, path_separator);
+		for (int i = index; i >= 0; i = m_paths[i].parent)
 		{
-			// yes we do. use it
-			e.path_index = p.base() - m_paths.begin() - 1;
+			size -= m_paths[i].len;
+			std::memcpy(&ret[size], m_paths[i].name, m_paths[i].len);
+			--size;
 		}
-		e.set_name(leaf);
+		return ret;
 	}
 
 	file_entry::file_entry(): offset(0), size(0), file_base(0)
@@ -156,11 +353,15 @@ namespace libtorrent
 		, name(0)
 		, path_index(fe.path_index)
 	{
-		set_name(fe.filename().c_str());
+		// borrowed names are not copied, they remain valid for as long as
+		// the buffer they point into
+		if (fe.name_len == name_is_owned) set_name(fe.name);
+		else name = fe.name;
 	}
 
 	internal_file_entry& internal_file_entry::operator=(internal_file_entry const& fe)
 	{
+		if (this == &fe) return *this;
 		offset = fe.offset;
 		size = fe.size;
 		path_index = fe.path_index;
@@ -170,7 +371,8 @@ namespace libtorrent
 		executable_attribute = fe.executable_attribute;
 		symlink_attribute = fe.symlink_attribute;
 		no_root_dir = fe.no_root_dir;
-		set_name(fe.filename().c_str());
+		if (fe.name_len == name_is_owned) set_name(fe.name);
+		else set_name(fe.name, true, fe.name_len);
 		return *this;
 	}
 
@@ -225,8 +427,7 @@ namespace libtorrent
 		TORRENT_ASSERT_PRECOND(index >= 0 && index < int(m_files.size()));
 		std::string utf8;
 		wchar_utf8(new_filename, utf8);
-		m_files[index].set_name(utf8.c_str());
-		update_path_index(m_files[index]);
+		update_path_index(m_files[index], utf8);
 	}
 
 	void file_storage::add_file(std::wstring const& file, size_type size, int flags
@@ -247,8 +448,7 @@ namespace libtorrent
 	void file_storage::rename_file(int index, std::string const& new_filename)
 	{
 		TORRENT_ASSERT_PRECOND(index >= 0 && index < int(m_files.size()));
-		m_files[index].set_name(new_filename.c_str());
-		update_path_index(m_files[index]);
+		update_path_index(m_files[index], new_filename);
 	}
 
 	void file_storage::rename_file_borrow(int index, char const* new_filename, int len)
@@ -294,14 +494,46 @@ namespace libtorrent
 		target.offset = offset;
 		TORRENT_ASSERT(!compare_file_offset(target, m_files.front()));
 
+		std::vector<internal_file_entry>::const_iterator begin = m_files.begin();
+		std::vector<internal_file_entry>::const_iterator end = m_files.end();
+
+		if (!m_piece_index.empty())
+		{
+			// the file we're looking for is somewhere between the first file
+			// of this piece and the first file of the next piece
+			int const piece = int(offset / m_piece_length);
+			TORRENT_ASSERT(piece < int(m_piece_index.size()));
+			begin += m_piece_index[piece];
+			if (piece + 1 < int(m_piece_index.size()))
+				end = m_files.begin() + m_piece_index[piece + 1] + 1;
+		}
+
 		std::vector<internal_file_entry>::const_iterator file_iter = std::upper_bound(
-			m_files.begin(), m_files.end(), target, compare_file_offset);
+			begin, end, target, compare_file_offset);
 
-		TORRENT_ASSERT(file_iter != m_files.begin());
+		TORRENT_ASSERT(file_iter != begin);
 		--file_iter;
 		return file_iter - m_files.begin();
 	}
 
+	void file_storage::build_piece_index()
+	{
+		std::vector<int>().swap(m_piece_index);
+		if (m_files.size() < 2 || m_num_pieces <= 0 || m_piece_length <= 0)
+			return;
+
+		m_piece_index.resize(m_num_pieces);
+		int file = 0;
+		int const last_file = int(m_files.size()) - 1;
+		for (int i = 0; i < m_num_pieces; ++i)
+		{
+			size_type const piece_start = size_type(i) * m_piece_length;
+			while (file < last_file && m_files[file + 1].offset <= piece_start)
+				++file;
+			m_piece_index[i] = file;
+		}
+	}
+
 	char const* file_storage::file_name_ptr(int index) const
 	{
 		return m_files[index].name;
@@ -320,34 +552,51 @@ namespace libtorrent
 		TORRENT_ASSERT_PRECOND(num_files() > 0);
 		std::vector<file_slice> ret;
 
-		if (m_files.empty()) return ret;
+		file_slice slices[16];
+		while (size > 0)
+		{
+			int const num = map_block(piece, offset, size, slices
+				, sizeof(slices) / sizeof(slices[0]));
+			if (num == 0) break;
+			for (int i = 0; i < num; ++i)
+			{
+				ret.push_back(slices[i]);
+				offset += slices[i].size;
+				size -= int(slices[i].size);
+			}
+		}
+		return ret;
+	}
 
-		// find the file iterator and file offset
-		internal_file_entry target;
-		target.offset = piece * (size_type)m_piece_length + offset;
-		TORRENT_ASSERT_PRECOND(size_type(target.offset + size) <= m_total_size);
-		TORRENT_ASSERT(!compare_file_offset(target, m_files.front()));
+	int file_storage::map_block(int piece, size_type offset, int size
+		, file_slice* slices, int num_slices) const
+	{
+		TORRENT_ASSERT_PRECOND(num_files() > 0);
+		TORRENT_ASSERT_PRECOND(num_slices > 0);
 
-		std::vector<internal_file_entry>::const_iterator file_iter = std::upper_bound(
-			m_files.begin(), m_files.end(), target, compare_file_offset);
+		if (m_files.empty()) return 0;
 
-		TORRENT_ASSERT(file_iter != m_files.begin());
-		--file_iter;
+		size_type const torrent_offset = piece * (size_type)m_piece_length + offset;
+		TORRENT_ASSERT_PRECOND(size_type(torrent_offset + size) <= m_total_size);
 
-		size_type file_offset = target.offset - file_iter->offset;
-		for (; size > 0; file_offset -= file_iter->size, ++file_iter)
+		int file_index = file_index_at_offset(torrent_offset);
+		size_type file_offset = torrent_offset - m_files[file_index].offset;
+		int ret = 0;
+		for (; size > 0 && ret < num_slices; file_offset -= m_files[file_index].size
+			, ++file_index)
 		{
-			TORRENT_ASSERT(file_iter != m_files.end());
-			if (file_offset < size_type(file_iter->size))
+			TORRENT_ASSERT(file_index < int(m_files.size()));
+			internal_file_entry const& fe = m_files[file_index];
+			if (file_offset < size_type(fe.size))
 			{
-				file_slice f;
-				f.file_index = file_iter - m_files.begin();
-				f.offset = file_offset + file_base(f.file_index);
-				f.size = (std::min)(boost::uint64_t(file_iter->size) - file_offset, boost::uint64_t(size));
+				file_slice& f = slices[ret];
+				f.file_index = file_index;
+				f.offset = file_offset + file_base(file_index);
+				f.size = (std::min)(boost::uint64_t(fe.size) - file_offset, boost::uint64_t(size));
 				TORRENT_ASSERT(f.size <= size);
 				size -= int(f.size);
 				file_offset += f.size;
-				ret.push_back(f);
+				++ret;
 			}
 			
 			TORRENT_ASSERT(size >= 0);
@@ -432,9 +681,9 @@ namespace libtorrent
 		}
 		TORRENT_ASSERT_PRECOND(m_name == split_path(file).c_str());
 		m_files.push_back(internal_file_entry());
+		m_piece_index.clear();
 		++m_num_files;
 		internal_file_entry& e = m_files.back();
-		e.set_name(file.c_str());
 		e.size = size;
 		e.offset = m_total_size;
 		e.pad_file = (flags & pad_file) != 0;
@@ -455,11 +704,17 @@ namespace libtorrent
 			m_mtime[m_files.size() - 1] = mtime;
 		}
 		
-		update_path_index(e);
+		update_path_index(e, file);
 		m_total_size += size;
 	}
 
 	void file_storage::add_file(file_entry const& ent, char const* filehash)
+	{
+		add_file_borrow(NULL, 0, ent, filehash);
+	}
+
+	void file_storage::add_file_borrow(char const* filename, int filename_len
+		, file_entry const& ent, char const* filehash)
 	{
 		TORRENT_ASSERT_PRECOND(ent.size >= 0);
 		if (!has_parent_path(ent.path))
@@ -476,11 +731,16 @@ namespace libtorrent
 			if (m_files.empty())
 				m_name = split_path(ent.path).c_str();
 		}
-		internal_file_entry ife(ent);
 		int file_index = m_files.size();
-		m_files.push_back(ife);
+		m_files.push_back(internal_file_entry());
+		m_piece_index.clear();
 		++m_num_files;
 		internal_file_entry& e = m_files.back();
+		e.size = ent.size;
+		e.pad_file = ent.pad_file;
+		e.hidden_attribute = ent.hidden_attribute;
+		e.executable_attribute = ent.executable_attribute;
+		e.symlink_attribute = ent.symlink_attribute;
 		e.offset = m_total_size;
 		m_total_size += e.size;
 		if (filehash)
@@ -499,7 +759,8 @@ namespace libtorrent
 			m_mtime[m_files.size() - 1] = ent.mtime;
 		}
 		if (ent.file_base) set_file_base(file_index, ent.file_base);
-		update_path_index(e);
+		update_path_index(e, ent.path, filename == NULL);
+		if (filename) e.set_name(filename, true, filename_len);
 	}
 
 	sha1_hash file_storage::hash(int index) const
@@ -548,12 +809,12 @@ namespace libtorrent
 
 		if (fe.no_root_dir)
 			return combine_path(save_path
-				, combine_path(m_paths[fe.path_index]
+				, combine_path(path(fe.path_index)
 				, fe.filename()));
 
 		return combine_path(save_path
 			, combine_path(m_name
-			, combine_path(m_paths[fe.path_index]
+			, combine_path(path(fe.path_index)
 			, fe.filename())));
 	}
 
@@ -697,6 +958,7 @@ namespace libtorrent
 
 	void file_storage::optimize(int pad_file_limit, int alignment)
 	{
+		m_piece_index.clear();
 		if (alignment == -1)
 			alignment = m_piece_length;
 
@@ -784,7 +1046,7 @@ namespace libtorrent
 				char name[30];
 				snprintf(name, sizeof(name), ".____padding_file/%d", padding_file);
 				std::string path = combine_path(m_name, name);
-				e.set_name(path.c_str());
+				set_file_name(e, path.c_str(), int(path.size()));
 				e.pad_file = true;
 				off += pad_size;
 				++padding_file;
@@ -811,7 +1073,12 @@ namespace libtorrent
 		std::vector<std::string>().swap(m_symlinks);
 		std::vector<time_t>().swap(m_mtime);
 		std::vector<size_type>().swap(m_file_base);
-		std::vector<std::string>().swap(m_paths);
+		std::vector<path_entry>().swap(m_paths);
+		path_index_t().swap(m_path_index);
+		std::vector<name_block>().swap(m_name_pool);
+		std::vector<int>().swap(m_piece_index);
+		m_name_pool_next = 0;
+		m_name_pool_free = 0;
 	}
 }
 
@@ -658,17 +658,24 @@ namespace libtorrent { namespace dht
 
 		m_send_buf.clear();
 		bencode(std::back_inserter(m_send_buf), e);
+		return send_packet(&m_send_buf[0], int(m_send_buf.size()), addr, send_flags);
+	}
+
+	bool dht_tracker::send_packet(char const* buf, int size
+		, udp::endpoint const& addr, int send_flags)
+	{
 		error_code ec;
 
 #ifdef TORRENT_DHT_VERBOSE_LOGGING
 		std::stringstream log_line;
 		lazy_entry print;
-		int ret = lazy_bdecode(&m_send_buf[0], &m_send_buf[0] + m_send_buf.size(), print, ec);
+		int ret = lazy_bdecode(buf, buf + size, print, ec);
 		TORRENT_ASSERT(ret == 0);
 		log_line << print_entry(print, true);
+		std::string const y = print.dict_find_string_value("y");
 #endif
 
-		if (m_sock.send(addr, &m_send_buf[0], (int)m_send_buf.size(), ec, send_flags))
+		if (m_sock.send(addr, buf, size, ec, send_flags))
 		{
 			if (ec)
 			{
@@ -680,14 +687,14 @@ namespace libtorrent { namespace dht
 			}
 
 			// account for IP and UDP overhead
-			m_sent_bytes += m_send_buf.size() + (addr.address().is_v6() ? 48 : 28);
+			m_sent_bytes += size + (addr.address().is_v6() ? 48 : 28);
 
-			m_counters.inc_stats_counter(counters::dht_bytes_out, m_send_buf.size());
+			m_counters.inc_stats_counter(counters::dht_bytes_out, size);
 			m_counters.inc_stats_counter(counters::dht_messages_out);
 #ifdef TORRENT_DHT_VERBOSE_LOGGING
-			m_total_out_bytes += m_send_buf.size();
+			m_total_out_bytes += size;
 		
-			if (e["y"].string() == "r")
+			if (y == "r")
 			{
 /*
 				// This doesn't work. r is a dictionary with return
@@ -701,13 +708,13 @@ namespace libtorrent { namespace dht
 				if (cmd_idx >= 0)
 				{
 					++m_replies_sent[cmd_idx];
-					m_replies_bytes_sent[cmd_idx] += int(m_send_buf.size());
+					m_replies_bytes_sent[cmd_idx] += size;
 				}
 */
 			}
-			else if (e["y"].string() == "q")
+			else if (y == "q")
 			{
-				m_queries_out_bytes += m_send_buf.size();
+				m_queries_out_bytes += size;
 			}
 			TORRENT_LOG(dht_tracker) << "==> " << addr << " " << log_line.str();
 #endif
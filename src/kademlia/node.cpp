@@ -36,6 +36,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/io.hpp"
 #include "libtorrent/bencode.hpp"
+#include "libtorrent/bencode_writer.hpp"
+#include "libtorrent/version.hpp"
 #include "libtorrent/hasher.hpp"
 #include "libtorrent/alert_types.hpp"
 #include "libtorrent/alert.hpp"
@@ -111,6 +113,7 @@ node_impl::node_impl(alert_dispatcher* alert_disp
 	, m_post_alert(alert_disp)
 	, m_sock(sock)
 	, m_counters(cnt)
+	, m_reply_writer(m_reply_buf)
 {
 	m_secret[0] = random();
 	m_secret[1] = random();
@@ -279,6 +282,8 @@ void node_impl::incoming(msg const& m)
 		case 'q':
 		{
 			TORRENT_ASSERT(m.message.dict_find_string_value("y") == "q");
+			if (incoming_fast_request(m)) break;
+
 			entry e;
 			incoming_request(m, e);
 			m_sock->send_packet(e, m.addr, 0);
@@ -770,6 +775,112 @@ struct immutable_item_comparator
 	node_id const& m_our_id;
 };
 
+bool udp_socket_interface::send_packet(char const* buf, int size
+	, udp::endpoint const& addr, int flags)
+{
+	entry e = bdecode(buf, buf + size);
+	return send_packet(e, addr, flags);
+}
+
+// ping and find_node make up the bulk of the incoming queries. Their
+// responses are encoded straight into m_reply_buf, without building an
+// entry. Returns false if the query should be handled by
+// incoming_request() instead, including when it's invalid, in which case
+// that responds with the appropriate error.
+bool node_impl::incoming_fast_request(msg const& m)
+{
+	lazy_entry const* q = m.message.dict_find_string("q");
+	if (q == 0) return false;
+
+	bool const ping = q->string_length() == 4
+		&& std::memcmp(q->string_ptr(), "ping", 4) == 0;
+	bool const find_node = q->string_length() == 9
+		&& std::memcmp(q->string_ptr(), "find_node", 9) == 0;
+	if (!ping && !find_node) return false;
+
+	if (!m_sock->has_quota()) return false;
+
+	key_desc_t top_desc[] = {
+		{"t", lazy_entry::string_t, 0, key_desc_t::optional},
+		{"ro", lazy_entry::int_t, 0, key_desc_t::optional},
+		{"a", lazy_entry::dict_t, 0, key_desc_t::parse_children},
+			{"id", lazy_entry::string_t, 20, 0},
+			{"target", lazy_entry::string_t, 20, key_desc_t::optional
+				| key_desc_t::last_child},
+	};
+
+	lazy_entry const* top_level[5];
+	char error_string[200];
+	if (!verify_message(&m.message, top_desc, top_level, 5, error_string, sizeof(error_string)))
+		return false;
+
+	if (find_node && top_level[4] == 0) return false;
+
+	node_id id(top_level[3]->string_ptr());
+	if (m_settings.enforce_node_id && !verify_id(id, m.addr.address()))
+		return false;
+
+	bool read_only = top_level[1] && top_level[1]->int_value() != 0;
+	if (!read_only)
+		m_table.heard_about(id, m.addr);
+
+	bencode_writer& w = m_reply_writer;
+	m_reply_buf.clear();
+	w.begin_dict();
+
+	char ip[18];
+	char* ptr = ip;
+	write_endpoint(m.addr, ptr);
+	w.string_item("ip", ip, int(ptr - ip));
+
+	w.key("r");
+	w.begin_dict();
+	w.string_item("id", (char const*)m_id.begin(), 20);
+	if (find_node)
+	{
+		m_counters.inc_stats_counter(counters::dht_find_node_in);
+		sha1_hash target(top_level[4]->string_ptr());
+
+		nodes_t n;
+		m_table.find_node(target, n, 0);
+
+		int num_nodes = 0;
+		for (nodes_t::const_iterator i = n.begin(), end(n.end()); i != end; ++i)
+			if (i->addr().is_v4()) ++num_nodes;
+
+		w.key("nodes");
+		ptr = w.alloc_string(num_nodes * 26);
+		for (nodes_t::const_iterator i = n.begin(), end(n.end()); i != end; ++i)
+		{
+			if (!i->addr().is_v4()) continue;
+			ptr = std::copy(i->id.begin(), i->id.end(), ptr);
+			write_endpoint(udp::endpoint(i->addr(), i->port()), ptr);
+		}
+	}
+	else
+	{
+		m_counters.inc_stats_counter(counters::dht_ping_in);
+	}
+	// mirror back the other node's external port
+	w.int_item("p", m.addr.port());
+	w.end();
+
+	if (top_level[0])
+		w.string_item("t", top_level[0]->string_ptr(), top_level[0]->string_length());
+	else
+		w.string_item("t", "", 0);
+
+	static char const version_str[] = {'L', 'T'
+		, LIBTORRENT_VERSION_MAJOR, LIBTORRENT_VERSION_MINOR};
+	w.string_item("v", version_str, 4);
+	w.string_item("y", "r", 1);
+	w.end();
+	TORRENT_ASSERT(w.done());
+
+	m_sock->send_packet(&m_reply_buf[0], int(m_reply_buf.size()), m.addr, 0);
+	return true;
+}
+
 // build response
 void node_impl::incoming_request(msg const& m, entry& e)
 {
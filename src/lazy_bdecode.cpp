@@ -32,7 +32,10 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/config.hpp"
 #include "libtorrent/lazy_entry.hpp"
+#include "libtorrent/alloca.hpp"
 #include <cstring>
+#include <vector>
+#include <algorithm> // for max
 
 namespace
 {
@@ -47,25 +50,26 @@ namespace libtorrent
 	namespace
 	{
 		int fail(int* error_pos
-			, std::vector<lazy_entry*>& stack
+			, lazy_entry* const* stack
+			, int sp
 			, char const* start
 			, char const* orig_start)
 		{
-			while (!stack.empty()) {
-				lazy_entry* top = stack.back();
+			while (sp > 0) {
+				lazy_entry* top = stack[sp-1];
 				if (top->type() == lazy_entry::dict_t || top->type() == lazy_entry::list_t)
 				{
 					top->pop();
 					break;
 				}
-				stack.pop_back();
+				--sp;
 			}
 			if (error_pos) *error_pos = start - orig_start;
 			return -1;
 		}
 	}
 
-#define TORRENT_FAIL_BDECODE(code) do { ec = make_error_code(code); return fail(error_pos, stack, start, orig_start); } while (false)
+#define TORRENT_FAIL_BDECODE(code) do { ec = make_error_code(code); return fail(error_pos, stack, sp, start, orig_start); } while (false)
 
 	namespace { bool numeric(char c) { return c >= '0' && c <= '9'; } }
 
@@ -119,6 +123,10 @@ namespace libtorrent
 	}
 #endif
 
+	// the deepest parse stack that's allocated on the (call) stack. Deeper
+	// ones go on the heap. This covers the default depth_limit
+	int const max_alloca_depth = 1024;
+
 	// return 0 = success
 	int lazy_bdecode(char const* start, char const* end, lazy_entry& ret
 		, error_code& ec, int* error_pos, int depth_limit, int item_limit)
@@ -127,16 +135,37 @@ namespace libtorrent
 		ret.clear();
 		if (start == end) return 0;
 
-		std::vector<lazy_entry*> stack;
+		// this is the stack of open lists and dictionaries. At most one
+		// entry is pushed per iteration, and we fail as soon as it's
+		// deeper than depth_limit, so it never holds more than
+		// depth_limit + 1 entries. Every entry also takes at least one byte
+		// of input, so it can't be deeper than the buffer is long either.
+		// Keeping it on the stack saves an allocation per decoded message,
+		// but a large depth_limit would overflow it, so only shallow stacks
+		// are allocated there
+		int const max_depth = int((std::min)(boost::int64_t((std::max)(depth_limit, 0))
+			, boost::int64_t(end - start))) + 2;
+		std::vector<lazy_entry*> heap_stack;
+		lazy_entry** stack;
+		if (max_depth <= max_alloca_depth)
+		{
+			stack = TORRENT_ALLOCA(lazy_entry*, max_depth);
+		}
+		else
+		{
+			heap_stack.resize(max_depth);
+			stack = &heap_stack[0];
+		}
+		int sp = 0;
 
-		stack.push_back(&ret);
+		stack[sp++] = &ret;
 		while (start <= end)
 		{
-			if (stack.empty()) break; // done!
+			if (sp == 0) break; // done!
 
-			lazy_entry* top = stack.back();
+			lazy_entry* top = stack[sp-1];
 
-			if (int(stack.size()) > depth_limit) TORRENT_FAIL_BDECODE(bdecode_errors::depth_exceeded);
+			if (sp > depth_limit) TORRENT_FAIL_BDECODE(bdecode_errors::depth_exceeded);
 			if (start >= end) TORRENT_FAIL_BDECODE(bdecode_errors::unexpected_eof);
 			char t = *start;
 			++start;
@@ -149,7 +178,7 @@ namespace libtorrent
 					if (t == 'e')
 					{
 						top->set_end(start);
-						stack.pop_back();
+						--sp;
 						continue;
 					}
 					if (!numeric(t)) TORRENT_FAIL_BDECODE(bdecode_errors::expected_string);
@@ -171,7 +200,7 @@ namespace libtorrent
 					if (ent == 0) TORRENT_FAIL_BDECODE(boost::system::errc::not_enough_memory);
 					start += len;
 					if (start >= end) TORRENT_FAIL_BDECODE(bdecode_errors::unexpected_eof);
-					stack.push_back(ent);
+					stack[sp++] = ent;
 					t = *start;
 					++start;
 					break;
@@ -181,12 +210,12 @@ namespace libtorrent
 					if (t == 'e')
 					{
 						top->set_end(start);
-						stack.pop_back();
+						--sp;
 						continue;
 					}
 					lazy_entry* ent = top->list_append();
 					if (ent == 0) TORRENT_FAIL_BDECODE(boost::system::errc::not_enough_memory);
-					stack.push_back(ent);
+					stack[sp++] = ent;
 					break;
 				}
 				default: break;
@@ -195,7 +224,7 @@ namespace libtorrent
 			--item_limit;
 			if (item_limit <= 0) TORRENT_FAIL_BDECODE(bdecode_errors::limit_exceeded);
 
-			top = stack.back();
+			top = stack[sp-1];
 			switch (t)
 			{
 				case 'd':
@@ -212,7 +241,7 @@ namespace libtorrent
 					if (start == end) TORRENT_FAIL_BDECODE(bdecode_errors::unexpected_eof);
 					TORRENT_ASSERT(*start == 'e');
 					++start;
-					stack.pop_back();
+					--sp;
 					continue;
 				}
 				default:
@@ -232,7 +261,7 @@ namespace libtorrent
 
 					++start;
 					top->construct_string(start, int(len));
-					stack.pop_back();
+					--sp;
 					start += len;
 					continue;
 				}
@@ -697,6 +726,7 @@ namespace libtorrent
 			"bencoded nesting depth exceeded",
 			"bencoded item count limit exceeded",
 			"integer overflow",
+			"expected digit in bencoded integer",
 		};
 		if (ev < 0 || ev >= int(sizeof(msgs)/sizeof(msgs[0])))
 			return "Unknown error";
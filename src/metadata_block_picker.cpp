@@ -0,0 +1,192 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/metadata_block_picker.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace libtorrent
+{
+	namespace
+	{
+		int const have_block = (std::numeric_limits<int>::max)();
+	}
+
+	metadata_block_picker::block::block()
+		: num_requests(0)
+		, last_request(min_time())
+		, timeout(min_time())
+		, speculative(false)
+	{}
+
+	metadata_block_picker::metadata_block_picker() {}
+
+	void metadata_block_picker::resize(int num_blocks)
+	{
+		m_blocks.resize(num_blocks);
+	}
+
+	bool metadata_block_picker::has_requested(peer_state const& peer
+		, int block) const
+	{
+		return std::find(peer.requested.begin(), peer.requested.end(), block)
+			!= peer.requested.end();
+	}
+
+	int metadata_block_picker::pick(peer_state const& peer, ptime now)
+	{
+		// pick the block requested the fewest number of times, of the
+		// ones we don't have and aren't waiting for
+		int ret = -1;
+		for (int i = 0; i < int(m_blocks.size()); ++i)
+		{
+			block const& b = m_blocks[i];
+			if (b.num_requests == have_block) continue;
+			if (b.timeout > now) continue;
+			if (has_requested(peer, i)) continue;
+			if (ret == -1 || b.num_requests < m_blocks[ret].num_requests)
+				ret = i;
+		}
+
+		if (ret == -1) return speculative_pick(peer, now);
+
+		block& b = m_blocks[ret];
+		++b.num_requests;
+		b.last_request = now;
+		b.speculative = false;
+		b.source = peer.peer;
+
+		// only reserve the block for peers that have metadata. This is to
+		// prevent peers with no metadata from starving out the ones that
+		// do
+		if (peer.reserve) b.timeout = now + peer.timeout;
+
+		return ret;
+	}
+
+	// the time to receive the metadata is the time until the last block
+	// arrives. Once every block has been requested, a slow peer holding
+	// one of the last blocks would hold up the whole torrent until its
+	// request times out. Instead we ask a peer we expect to respond
+	// before then for the same block, and use whichever response arrives
+	// first.
+	int metadata_block_picker::speculative_pick(peer_state const& peer
+		, ptime now)
+	{
+		// we only make speculative requests to peers we know the
+		// round-trip time of
+		if (!peer.reserve || peer.rtt < 0) return -1;
+
+		ptime const expected = now + milliseconds(peer.rtt);
+		int ret = -1;
+		for (int i = 0; i < int(m_blocks.size()); ++i)
+		{
+			block const& b = m_blocks[i];
+			if (b.num_requests == have_block) continue;
+			if (b.speculative) continue;
+			if (expected >= b.timeout) continue;
+			if (has_requested(peer, i)) continue;
+
+			// prefer the block we've been waiting for the longest
+			if (ret == -1 || b.last_request < m_blocks[ret].last_request)
+				ret = i;
+		}
+
+		if (ret == -1) return -1;
+
+		block& b = m_blocks[ret];
+		++b.num_requests;
+		b.speculative = true;
+		return ret;
+	}
+
+	void metadata_block_picker::cancel(void const* peer, int block)
+	{
+		if (block < 0 || block >= int(m_blocks.size())) return;
+		metadata_block_picker::block& b = m_blocks[block];
+		if (b.num_requests == have_block) return;
+		if (b.source.lock().get() != peer) return;
+		b.timeout = min_time();
+	}
+
+	bool metadata_block_picker::received(boost::shared_ptr<void> const& peer
+		, int block)
+	{
+		TORRENT_ASSERT(block >= 0 && block < int(m_blocks.size()));
+		metadata_block_picker::block& b = m_blocks[block];
+		if (b.num_requests == have_block) return false;
+		b.num_requests = have_block;
+		b.source = peer;
+		return true;
+	}
+
+	bool metadata_block_picker::have(int block) const
+	{
+		TORRENT_ASSERT(block >= 0 && block < int(m_blocks.size()));
+		return m_blocks[block].num_requests == have_block;
+	}
+
+	bool metadata_block_picker::have_all() const
+	{
+		for (std::vector<block>::const_iterator i = m_blocks.begin()
+			, end(m_blocks.end()); i != end; ++i)
+			if (i->num_requests != have_block) return false;
+		return true;
+	}
+
+	void metadata_block_picker::sources(std::vector<boost::shared_ptr<void> >& ret) const
+	{
+		ret.clear();
+		for (std::vector<block>::const_iterator i = m_blocks.begin()
+			, end(m_blocks.end()); i != end; ++i)
+		{
+			if (i->num_requests != have_block) continue;
+			boost::shared_ptr<void> p = i->source.lock();
+			if (p) ret.push_back(p);
+		}
+	}
+
+	void metadata_block_picker::reset()
+	{
+		int const num_blocks = int(m_blocks.size());
+		m_blocks.clear();
+		m_blocks.resize(num_blocks);
+	}
+
+	void metadata_block_picker::clear()
+	{
+		std::vector<block>().swap(m_blocks);
+	}
+}
@@ -0,0 +1,211 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/metadata_cache.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/file.hpp"
+#include "libtorrent/escape_string.hpp" // for to_hex
+#include "libtorrent/random.hpp"
+
+#include <boost/shared_array.hpp>
+#include <cstring>
+#include <cstdio>
+#include <climits>
+
+#if TORRENT_HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+namespace libtorrent
+{
+	namespace
+	{
+		char const file_extension[] = ".info";
+
+#if TORRENT_HAVE_MMAP
+		// the deleter of an info section that's a mapping of a cache file
+		struct unmap_buffer
+		{
+			unmap_buffer(int s): size(s) {}
+			void operator()(char* p) const { munmap(p, size); }
+			int size;
+		};
+#endif
+	}
+
+	metadata_cache::metadata_cache(std::string const& dir)
+		: m_dir(dir)
+	{}
+
+	std::string metadata_cache::path(sha1_hash const& ih) const
+	{
+		return combine_path(m_dir, to_hex(ih.to_string()) + file_extension);
+	}
+
+	bool metadata_cache::has(sha1_hash const& ih) const
+	{
+		return exists(path(ih));
+	}
+
+	void metadata_cache::save(torrent_info const& ti, error_code& ec)
+	{
+		if (!ti.is_loaded() || ti.metadata_size() == 0)
+		{
+			ec = errors::no_metadata;
+			return;
+		}
+		save(ti.metadata().get(), ti.metadata_size(), ec);
+	}
+
+	void metadata_cache::save(char const* info_section, int size, error_code& ec)
+	{
+		TORRENT_ASSERT(size > 0);
+		sha1_hash const ih = hasher(info_section, size).final();
+		std::string const target = path(ih);
+		if (exists(target)) return;
+
+		if (!exists(m_dir))
+		{
+			create_directories(m_dir, ec);
+			if (ec) return;
+		}
+
+		// write the file under a name no other process uses and move it in
+		// place once it's complete. That way the cache never contains a
+		// partially written file, and a file that someone has mapped is
+		// never modified
+		char suffix[20];
+		snprintf(suffix, sizeof(suffix), ".%08x.tmp", random());
+		std::string const tmp = target + suffix;
+
+		{
+			file f;
+			if (!f.open(tmp, file::write_only, ec)) return;
+			file::iovec_t b = { const_cast<char*>(info_section), size_t(size) };
+			size_type const written = f.writev(0, &b, 1, ec);
+			if (!ec && written != size) ec = errors::file_too_short;
+		}
+
+		if (!ec) rename(tmp, target, ec);
+		if (ec)
+		{
+			error_code ignore;
+			libtorrent::remove(tmp, ignore);
+		}
+	}
+
+	boost::shared_ptr<torrent_info> metadata_cache::load(sha1_hash const& ih
+		, error_code& ec) const
+	{
+		boost::shared_ptr<torrent_info> ret;
+
+		file f;
+		if (!f.open(path(ih), file::read_only, ec)) return ret;
+		size_type const size = f.get_size(ec);
+		if (ec) return ret;
+		if (size <= 0 || size > INT_MAX)
+		{
+			ec = errors::torrent_invalid_length;
+			return ret;
+		}
+
+		boost::shared_array<char> buf;
+		int flags = 0;
+#if TORRENT_HAVE_MMAP
+		// files are never modified once they're in the cache, so the pages
+		// of a private read-only mapping are shared with every other process
+		// that has the same file mapped
+		void* p = mmap(0, size, PROT_READ, MAP_PRIVATE, f.native_handle(), 0);
+		if (p != MAP_FAILED)
+		{
+			buf.reset(static_cast<char*>(p), unmap_buffer(int(size)));
+			flags |= torrent_info::mapped_info_section;
+		}
+#endif
+
+		if (!buf)
+		{
+			buf.reset(new char[size]);
+			file::iovec_t b = { buf.get(), size_t(size) };
+			size_type const read = f.readv(0, &b, 1, ec);
+			if (ec) return ret;
+			if (read != size)
+			{
+				ec = errors::file_too_short;
+				return ret;
+			}
+		}
+
+		ret.reset(new torrent_info(buf, int(size), ec, flags));
+		if (ec)
+		{
+			ret.reset();
+			return ret;
+		}
+
+		if (ret->info_hash() != ih)
+		{
+			ec = errors::mismatching_info_hash;
+			ret.reset();
+			return ret;
+		}
+
+		// calculating the info-hash read all the piece hashes. They aren't
+		// needed again until pieces are verified
+		ret->evict_piece_hashes();
+		return ret;
+	}
+
+	void metadata_cache::remove(sha1_hash const& ih, error_code& ec)
+	{
+		libtorrent::remove(path(ih), ec);
+	}
+
+	void metadata_cache::torrents(std::vector<sha1_hash>& ret) const
+	{
+		ret.clear();
+		error_code ec;
+		for (directory i(m_dir, ec); !ec && !i.done(); i.next(ec))
+		{
+			std::string const name = i.file();
+			if (name.size() != 40 + sizeof(file_extension) - 1
+				|| name.compare(40, std::string::npos, file_extension) != 0)
+				continue;
+
+			sha1_hash ih;
+			if (!from_hex(name.c_str(), 40, (char*)&ih[0])) continue;
+			ret.push_back(ih);
+		}
+	}
+}
+
@@ -0,0 +1,108 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/object_arena.hpp"
+
+#include <algorithm> // for std::max
+
+namespace libtorrent
+{
+	object_arena::object_arena(int chunk_size)
+		: m_current(0)
+		, m_used(0)
+		, m_chunk_size(chunk_size)
+	{
+		TORRENT_ASSERT(chunk_size > 0);
+	}
+
+	object_arena::~object_arena()
+	{
+		clear();
+		for (std::vector<chunk_t>::iterator i = m_chunks.begin()
+			, end(m_chunks.end()); i != end; ++i)
+			delete[] i->buf;
+	}
+
+	void object_arena::clear()
+	{
+		// destruct in reverse order of construction, just like objects
+		// on the stack
+		for (std::vector<object_t>::reverse_iterator i = m_objects.rbegin()
+			, end(m_objects.rend()); i != end; ++i)
+			i->destroy(i->ptr);
+		m_objects.clear();
+		m_current = 0;
+		m_used = 0;
+	}
+
+	int object_arena::capacity() const
+	{
+		int ret = 0;
+		for (std::vector<chunk_t>::const_iterator i = m_chunks.begin()
+			, end(m_chunks.end()); i != end; ++i)
+			ret += i->size;
+		return ret;
+	}
+
+	void* object_arena::allocate(int size, int alignment)
+	{
+		TORRENT_ASSERT(size > 0);
+		TORRENT_ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+		for (;;)
+		{
+			if (m_current < int(m_chunks.size()))
+			{
+				chunk_t& c = m_chunks[m_current];
+				// new[] returns memory aligned for any type, so aligning
+				// the offset is enough
+				int const offset = (m_used + alignment - 1) & ~(alignment - 1);
+				if (offset + size <= c.size)
+				{
+					m_used = offset + size;
+					return c.buf + offset;
+				}
+				// this chunk is full, move on to the next one
+				++m_current;
+				m_used = 0;
+				continue;
+			}
+
+			// we're out of chunks. Objects larger than a chunk get
+			// a chunk of their own
+			chunk_t c;
+			c.size = (std::max)(m_chunk_size, size);
+			c.buf = new char[c.size];
+			m_chunks.push_back(c);
+		}
+	}
+}
@@ -345,7 +345,8 @@ void rc4_init(const unsigned char* in, unsigned long len, rc4 *state)
 
 unsigned long rc4_encrypt(unsigned char *out, unsigned long outlen, rc4 *state)
 {
-	unsigned char x, y, *s, tmp;
+	unsigned int x, y, tx, ty;
+	unsigned char *s;
 	unsigned long n;
 
 	TORRENT_ASSERT(out != 0);
@@ -355,13 +356,34 @@ unsigned long rc4_encrypt(unsigned char *out, unsigned long outlen, rc4 *state)
 	x = state->x;
 	y = state->y;
 	s = state->buf;
-	while (outlen--) {
-		x = (x + 1) & 255;
-		y = (y + s[x]) & 255;
-		tmp = s[x]; s[x] = s[y]; s[y] = tmp;
-		tmp = (s[x] + s[y]) & 255;
-		*out++ ^= s[tmp];
+
+	// keep the two swapped state bytes in registers instead of
+	// re-loading them from the table after the swap, and unroll
+	// the loop to let the compiler interleave the table lookups
+#define TORRENT_RC4_STEP(i) \
+	x = (x + 1) & 255; \
+	tx = s[x]; \
+	y = (y + tx) & 255; \
+	ty = s[y]; \
+	s[x] = (unsigned char)ty; \
+	s[y] = (unsigned char)tx; \
+	out[i] ^= s[(tx + ty) & 255];
+
+	while (outlen >= 4) {
+		TORRENT_RC4_STEP(0)
+		TORRENT_RC4_STEP(1)
+		TORRENT_RC4_STEP(2)
+		TORRENT_RC4_STEP(3)
+		out += 4;
+		outlen -= 4;
 	}
+	while (outlen > 0) {
+		TORRENT_RC4_STEP(0)
+		++out;
+		--outlen;
+	}
+#undef TORRENT_RC4_STEP
+
 	state->x = x;
 	state->y = y;
 	return n;
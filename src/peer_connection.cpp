@@ -65,6 +65,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/bandwidth_manager.hpp"
 #include "libtorrent/request_blocks.hpp" // for request_a_block
 #include "libtorrent/performance_counters.hpp" // for counters
+#include "libtorrent/event_trace.hpp"
 #include "libtorrent/alert_manager.hpp" // for alert_manageralert_manager
 #include "libtorrent/ip_filter.hpp"
 #include "libtorrent/kademlia/node_id.hpp"
@@ -89,6 +90,12 @@ namespace libtorrent
 	{
 		// the limits of the download queue size
 		min_request_queue = 2,
+
+		// the largest regular receive buffer we keep around once all
+		// messages in it have been handled. This fits one block worth
+		// of message, which is the most we ever need to receive into
+		// it when the payload goes to a disk buffer
+		max_idle_receive_buffer = 16 * 1024 + 16
 	};
 
 	int round_up8(int v)
@@ -175,6 +182,10 @@ namespace libtorrent
 		, m_queued_time_critical(0)
 		, m_recv_end(0)
 		, m_disk_recv_buffer_size(0)
+		, m_send_socket_buffer(0)
+		, m_recv_socket_buffer(0)
+		, m_orig_send_socket_buffer(0)
+		, m_orig_recv_socket_buffer(0)
 		, m_reading_bytes(0)
 		, m_picker_options(0)
 		, m_num_invalid_requests(0)
@@ -1372,6 +1383,8 @@ namespace libtorrent
 		TORRENT_ASSERT(is_single_thread());
 		INVARIANT_CHECK;
 
+		TORRENT_TRACE_EVENT(choked_by_peer, this, 0, 0);
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		for (extension_list_t::iterator i = m_extensions.begin()
 			, end(m_extensions.end()); i != end; ++i)
@@ -1588,6 +1601,8 @@ namespace libtorrent
 		TORRENT_ASSERT(is_single_thread());
 		INVARIANT_CHECK;
 
+		TORRENT_TRACE_EVENT(unchoked_by_peer, this, 0, 0);
+
 		boost::shared_ptr<torrent> t = m_torrent.lock();
 		TORRENT_ASSERT(t);
 
@@ -2372,6 +2387,7 @@ namespace libtorrent
 				m_counters.inc_stats_counter(counters::num_peers_up_requests);
 
 			m_requests.push_back(r);
+			m_request_time.push_back(time_now_hires());
 #ifdef TORRENT_REQUEST_LOGGING
 			FILE* log = m_ses.get_request_log();
 			if (log)
@@ -2392,6 +2408,7 @@ namespace libtorrent
 			peer_request const& r = *i;
 			if (r.piece != index) continue;
 			write_reject_request(r);
+			m_request_time.erase(m_request_time.begin() + (i - m_requests.begin()));
 			i = m_requests.erase(i);
 
 			if (m_requests.empty())
@@ -2585,6 +2602,8 @@ namespace libtorrent
 		// we're not receiving any block right now
 		m_receiving_block = piece_block::invalid;
 
+		TORRENT_TRACE_EVENT(block_received, this, p.piece, p.start / t->block_size());
+
 #ifdef TORRENT_CORRUPT_DATA
 		// corrupt all pieces from certain peers
 		if (m_remote.address().is_v4()
@@ -2775,8 +2794,8 @@ namespace libtorrent
 			, boost::bind(&peer_connection::on_disk_write_complete
 			, self(), _1, p, t));
 
-		boost::uint64_t write_queue_size = m_counters.inc_stats_counter(
-			counters::queued_write_bytes, p.length);
+		m_counters.inc_stats_counter(counters::queued_write_bytes, p.length);
+		boost::uint64_t write_queue_size = m_counters[counters::queued_write_bytes];
 		m_outstanding_writing_bytes += p.length;
 
 		boost::uint64_t max_queue_size = m_settings.get_int(
@@ -3004,6 +3023,7 @@ namespace libtorrent
 		if (i != m_requests.end())
 		{
 			m_counters.inc_stats_counter(counters::cancelled_piece_requests);
+			m_request_time.erase(m_request_time.begin() + (i - m_requests.begin()));
 			m_requests.erase(i);
 
 			if (m_requests.empty())
@@ -3567,6 +3587,7 @@ namespace libtorrent
 		peer_log("==> CHOKE");
 #endif
 		write_choke();
+		TORRENT_TRACE_EVENT(choke_peer, this, 0, 0);
 		m_counters.inc_stats_counter(counters::num_peers_up_unchoked_all, -1);
 		if (!ignore_unchoke_slots())
 			m_counters.inc_stats_counter(counters::num_peers_up_unchoked, -1);
@@ -3593,6 +3614,7 @@ namespace libtorrent
 				, r.piece , r.start , r.length);
 #endif
 			write_reject_request(r);
+			m_request_time.erase(m_request_time.begin() + (i - m_requests.begin()));
 			i = m_requests.erase(i);
 
 			if (m_requests.empty())
@@ -3630,6 +3652,7 @@ namespace libtorrent
 
 		m_last_unchoke = time_now();
 		write_unchoke();
+		TORRENT_TRACE_EVENT(unchoke_peer, this, 0, 0);
 		m_counters.inc_stats_counter(counters::num_peers_up_unchoked_all);
 		if (!ignore_unchoke_slots())
 			m_counters.inc_stats_counter(counters::num_peers_up_unchoked);
@@ -3867,6 +3890,7 @@ namespace libtorrent
 				write_request(r);
 				m_last_request = time_now();
 			}
+			TORRENT_TRACE_EVENT(block_request, this, r.piece, r.start / t->block_size());
 
 #ifdef TORRENT_VERBOSE_LOGGING
 			peer_log("==> REQUEST      [ piece: %d | s: %x | l: %x | ds: %d B/s | "
@@ -4783,6 +4807,8 @@ namespace libtorrent
 		}
 		if (is_disconnecting()) return;
 
+		update_socket_buffers();
+
 		if (!t->ready_for_connections()) return;
 
 		update_desired_queue_size();
@@ -4951,6 +4977,158 @@ namespace libtorrent
 		return line_size;
 	}
 
+	// returns the estimated number of bytes in flight on the given
+	// channel, i.e. the current transfer rate times the round-trip time.
+	// The RTT is padded with its deviation, since a buffer sized for the
+	// mean would drain whenever the latency spikes
+	int peer_connection::bandwidth_delay_product(int channel) const
+	{
+		boost::int64_t rate = channel == upload_channel
+			? m_statistics.upload_rate() : m_statistics.download_rate();
+
+		// we only sample m_rtt for piece requests we send, so it's never
+		// updated for peers we only upload to. Prefer the kernel's
+		// estimate, which covers both directions
+		int deviation = 0;
+		int rtt = -1;
+		tcp::socket* s = m_socket->get<stream_socket>();
+#ifdef TORRENT_USE_OPENSSL
+		if (s == 0 && m_socket->get<ssl_stream<stream_socket> >())
+			s = &m_socket->get<ssl_stream<stream_socket> >()->next_layer();
+#endif
+		if (s) rtt = tcp_rtt(*s, &deviation);
+		if (rtt < 0)
+		{
+			rtt = m_rtt.mean();
+			deviation = m_rtt.avg_deviation();
+		}
+		return libtorrent::bandwidth_delay_product(rate, rtt + deviation);
+	}
+
+	void peer_connection::update_socket_buffers()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		if (!m_settings.get_bool(settings_pack::auto_socket_buffers))
+		{
+			restore_socket_buffers();
+			return;
+		}
+		if (!m_socket->is_open()) return;
+
+		// uTP has its own send and receive windows, the socket options
+		// don't do anything for it
+		if (is_utp(*m_socket)) return;
+
+		enum
+		{
+			// the upper bound when the user hasn't configured one
+			default_max_socket_buffer = 4 * 1024 * 1024
+		};
+
+		int const limits[] = {
+			m_settings.get_int(settings_pack::send_socket_buffer_size),
+			m_settings.get_int(settings_pack::recv_socket_buffer_size)
+		};
+		int* const current[] = { &m_send_socket_buffer, &m_recv_socket_buffer };
+		int* const original[] = { &m_orig_send_socket_buffer, &m_orig_recv_socket_buffer };
+
+		for (int channel = 0; channel < num_channels; ++channel)
+		{
+			int const max_size = limits[channel] > 0
+				? limits[channel] : int(default_max_socket_buffer);
+
+			int const target = socket_buffer_target(
+				bandwidth_delay_product(channel), max_size);
+
+			int const cur = *current[channel];
+			if (cur == 0)
+			{
+				// setting the buffer size explicitly disables the kernel's
+				// own buffer autotuning for this socket. As long as it has
+				// already given us enough room, leave it in charge. The
+				// kernel's size is cached, and only queried again once the
+				// target outgrows it
+				if (*original[channel] >= target) continue;
+
+				error_code ec;
+				int kernel_size = 0;
+				if (channel == upload_channel)
+				{
+					stream_socket::send_buffer_size opt;
+					m_socket->get_option(opt, ec);
+					kernel_size = opt.value();
+				}
+				else
+				{
+					stream_socket::receive_buffer_size opt;
+					m_socket->get_option(opt, ec);
+					kernel_size = opt.value();
+				}
+				if (ec) continue;
+#if defined TORRENT_LINUX
+				// linux reports twice the size, to account for its own
+				// bookkeeping overhead
+				kernel_size /= 2;
+#endif
+				*original[channel] = kernel_size;
+				if (kernel_size >= target) continue;
+			}
+			// only resize when we're off by more than 25%, to avoid issuing
+			// a setsockopt() for every fluctuation in the rate
+			else if (target > cur - cur / 4 && target < cur + cur / 4)
+			{
+				continue;
+			}
+
+			error_code ec;
+			if (channel == upload_channel)
+				m_socket->set_option(stream_socket::send_buffer_size(target), ec);
+			else
+				m_socket->set_option(stream_socket::receive_buffer_size(target), ec);
+			if (ec) continue;
+
+#if defined TORRENT_VERBOSE_LOGGING
+			peer_log("*** SOCKET_BUFFER [ %s: %d -> %d rtt: %d ]"
+				, channel == upload_channel ? "send" : "recv"
+				, cur, target, m_rtt.mean());
+#endif
+			*current[channel] = target;
+		}
+	}
+
+	// undo update_socket_buffers(), once auto_socket_buffers is disabled.
+	// The buffers go back to the configured fixed size, or the size the
+	// kernel picked before we touched them. Once set, the kernel won't
+	// resume autotuning them though
+	void peer_connection::restore_socket_buffers()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		if (m_send_socket_buffer == 0 && m_recv_socket_buffer == 0) return;
+
+		int const limits[] = {
+			m_settings.get_int(settings_pack::send_socket_buffer_size),
+			m_settings.get_int(settings_pack::recv_socket_buffer_size)
+		};
+		int* const current[] = { &m_send_socket_buffer, &m_recv_socket_buffer };
+		int* const original[] = { &m_orig_send_socket_buffer, &m_orig_recv_socket_buffer };
+
+		for (int channel = 0; channel < num_channels; ++channel)
+		{
+			if (*current[channel] == 0) continue;
+			int const size = limits[channel] > 0
+				? limits[channel] : *original[channel];
+			*current[channel] = 0;
+			*original[channel] = 0;
+			if (size <= 0 || !m_socket->is_open()) continue;
+
+			error_code ec;
+			if (channel == upload_channel)
+				m_socket->set_option(stream_socket::send_buffer_size(size), ec);
+			else
+				m_socket->set_option(stream_socket::receive_buffer_size(size), ec);
+		}
+	}
+
 	void peer_connection::fill_send_buffer()
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -4970,6 +5148,15 @@ namespace libtorrent
 		int buffer_size_watermark = int(upload_rate
 			* m_settings.get_int(settings_pack::send_buffer_watermark_factor) / 100);
 
+		// with auto-tuned socket buffers, make sure we queue up enough
+		// to fill the path to this peer. Peers far away need a deeper
+		// pipeline than the rate alone suggests
+		if (m_settings.get_bool(settings_pack::auto_socket_buffers))
+		{
+			int const bdp = bandwidth_delay_product(upload_channel) * 2;
+			if (bdp > buffer_size_watermark) buffer_size_watermark = bdp;
+		}
+
 		if (buffer_size_watermark < m_settings.get_int(settings_pack::send_buffer_low_watermark))
 		{
 			buffer_size_watermark = m_settings.get_int(settings_pack::send_buffer_low_watermark);
@@ -5023,6 +5210,7 @@ namespace libtorrent
 				// verified this piece (r.piece)
 				if (!t->need_loaded()) return;
 				t->inc_refcount("async_seed_hash");
+				t->torrent_file().prefetch_piece_hashes(r.piece, 1);
 				m_disk_thread.async_hash(&t->storage(), r.piece, 0
 					, boost::bind(&peer_connection::on_seed_mode_hashed, self(), _1)
 					, this);
@@ -5060,9 +5248,10 @@ namespace libtorrent
 				t->inc_refcount("async_read");
 				m_disk_thread.async_read(&t->storage(), r
 					, boost::bind(&peer_connection::on_disk_read_complete
-					, self(), _1, r, time_now_hires()), this);
+					, self(), _1, r, time_now_hires(), m_request_time[i]), this);
 			}
 			m_requests.erase(m_requests.begin() + i);
+			m_request_time.erase(m_request_time.begin() + i);
 
 			if (m_requests.empty())
 				m_counters.inc_stats_counter(counters::num_peers_up_requests, -1);
@@ -5130,7 +5319,7 @@ namespace libtorrent
 	}
 
 	void peer_connection::on_disk_read_complete(disk_io_job const* j
-		, peer_request r, ptime issue_time)
+		, peer_request r, ptime issue_time, ptime request_time)
 	{
 		TORRENT_ASSERT(is_single_thread());
 		// return value:
@@ -5221,6 +5410,9 @@ namespace libtorrent
 			t->add_suggest_piece(r.piece);
 		}
 		write_piece(r, buffer);
+
+		m_counters.add_latency_sample(counters::request_latency3
+			, total_microseconds(time_now_hires() - request_time));
 	}
 
 	void peer_connection::assign_bandwidth(int channel, int amount)
@@ -5578,9 +5770,11 @@ namespace libtorrent
 		int num_bufs = 0;
 		// only apply the contiguous receive buffer when we don't have any
 		// outstanding requests. When we're likely to receive pieces, we'll
-		// save more time from avoiding copying data from the socket
-		if ((m_settings.get_bool(settings_pack::contiguous_recv_buffer)
-			|| m_download_queue.empty()) && !m_disk_recv_buffer)
+		// save more time from avoiding copying data from the socket. In that
+		// case we read the message header first, and the payload straight
+		// into a disk buffer (see bt_peer_connection::on_piece)
+		if (m_settings.get_bool(settings_pack::contiguous_recv_buffer)
+			&& m_download_queue.empty() && !m_disk_recv_buffer)
 		{
 			if (s == read_sync)
 			{
@@ -6005,6 +6199,11 @@ namespace libtorrent
 
 		INVARIANT_CHECK;
 
+		// attribute the time spent handling this peer's messages to its
+		// torrent, for the per-torrent cpu accounting. The torrent is only
+		// locked when this call is sampled
+		cpu_sample sample(m_torrent, m_ses, torrent::cpu_peer_messages);
+
 		int bytes_in_loop = bytes_transferred;
 
 		if (error)
@@ -6086,9 +6285,15 @@ namespace libtorrent
 
 			TORRENT_ASSERT(m_packet_size > 0);
 
-			if (m_peer_choked
-				&& m_recv_pos == 0
-				&& (m_recv_buffer.capacity() - m_packet_size) > 128)
+			// shrink the receive buffer back down once it's empty, if we
+			// don't expect to receive any more piece data, or if it has
+			// grown from reading a large burst of messages at once. Piece
+			// payloads are received into disk buffers, so there's no need
+			// to keep a large regular receive buffer around for idle peers
+			if (m_recv_pos == 0
+				&& (m_recv_buffer.capacity() - m_packet_size) > 128
+				&& (m_peer_choked
+					|| int(m_recv_buffer.capacity()) > max_idle_receive_buffer))
 			{
 				// round up to an even 8 bytes since that's the RC4 blocksize
 				buffer(round_up8(m_packet_size)).swap(m_recv_buffer);
@@ -6450,6 +6655,7 @@ namespace libtorrent
 		TORRENT_ASSERT(m_queued_time_critical <= int(m_request_queue.size()));
 		TORRENT_ASSERT(m_recv_end >= m_recv_start);
 		TORRENT_ASSERT(m_accept_fast.size() == m_accept_fast_piece_cnt.size());
+		TORRENT_ASSERT(m_requests.size() == m_request_time.size());
 
 		TORRENT_ASSERT(bool(m_disk_recv_buffer) == (m_disk_recv_buffer_size > 0));
 
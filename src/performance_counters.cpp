@@ -41,12 +41,59 @@ POSSIBILITY OF SUCH DAMAGE.
 namespace libtorrent {
 
 
+#if BOOST_ATOMIC_LLONG_LOCK_FREE == 2
+	namespace {
+
+	boost::atomic<int> g_next_shard(0);
+
+#ifdef TORRENT_THREAD_LOCAL
+	// the shard of the current thread, plus one. 0 means the thread hasn't
+	// been assigned one yet
+	TORRENT_THREAD_LOCAL int g_thread_shard = 0;
+#endif
+
+	}
+
+	int counters::shard_index()
+	{
+#ifdef TORRENT_THREAD_LOCAL
+		if (g_thread_shard == 0)
+		{
+			g_thread_shard = g_next_shard.fetch_add(1
+				, boost::memory_order_relaxed) % num_shards + 1;
+		}
+		return g_thread_shard - 1;
+#else
+		return 0;
+#endif
+	}
+
+	boost::int64_t counters::shard_sum(int c) const
+	{
+		boost::int64_t ret = 0;
+		for (int s = 0; s < num_shards; ++s)
+			ret += m_shards[s].counter[c].load(boost::memory_order_relaxed);
+		return ret;
+	}
+
+	boost::int64_t counters::fold_shards(int c)
+	{
+		boost::int64_t ret = 0;
+		for (int s = 0; s < num_shards; ++s)
+			ret += m_shards[s].counter[c].exchange(0, boost::memory_order_relaxed);
+		return ret;
+	}
+#endif
+
 	counters::counters()
 	{
 #if BOOST_ATOMIC_LLONG_LOCK_FREE == 2
-		for (int i = 0; i < sizeof(m_stats_counter)
-			/ sizeof(m_stats_counter[0]); ++i)
-			m_stats_counter[i].store(0, boost::memory_order_relaxed);
+		for (int i = 0; i < num_counters; ++i)
+		{
+			m_base[i].store(0, boost::memory_order_relaxed);
+			for (int s = 0; s < num_shards; ++s)
+				m_shards[s].counter[i].store(0, boost::memory_order_relaxed);
+		}
 #else
 		memset(m_stats_counter, 0, sizeof(m_stats_counter));
 #endif
@@ -55,11 +102,14 @@ namespace libtorrent {
 	counters::counters(counters const& c)
 	{
 #if BOOST_ATOMIC_LLONG_LOCK_FREE == 2
-		for (int i = 0; i < sizeof(m_stats_counter)
-			/ sizeof(m_stats_counter[0]); ++i)
-			m_stats_counter[i].store(
-				c.m_stats_counter[i].load(boost::memory_order_relaxed)
-					, boost::memory_order_relaxed);
+		boost::int64_t values[num_counters];
+		c.snapshot(values);
+		for (int i = 0; i < num_counters; ++i)
+		{
+			m_base[i].store(values[i], boost::memory_order_relaxed);
+			for (int s = 0; s < num_shards; ++s)
+				m_shards[s].counter[i].store(0, boost::memory_order_relaxed);
+		}
 #else
 		mutex::scoped_lock l(c.m_mutex);
 		memcpy(m_stats_counter, c.m_stats_counter, sizeof(m_stats_counter));
@@ -68,15 +118,19 @@ namespace libtorrent {
 
 	counters& counters::operator=(counters const& c)
 	{
+		if (&c == this) return *this;
 #if BOOST_ATOMIC_LLONG_LOCK_FREE == 2
-		for (int i = 0; i < sizeof(m_stats_counter)
-			/ sizeof(m_stats_counter[0]); ++i)
-			m_stats_counter[i].store(
-				c.m_stats_counter[i].load(boost::memory_order_relaxed)
-					, boost::memory_order_relaxed);
+		boost::int64_t values[num_counters];
+		c.snapshot(values);
+		for (int i = 0; i < num_counters; ++i)
+		{
+			m_base[i].store(values[i], boost::memory_order_relaxed);
+			for (int s = 0; s < num_shards; ++s)
+				m_shards[s].counter[i].store(0, boost::memory_order_relaxed);
+		}
 #else
 		mutex::scoped_lock l(m_mutex);
-		mutex::scoped_lock l(c.m_mutex);
+		mutex::scoped_lock l2(c.m_mutex);
 		memcpy(m_stats_counter, c.m_stats_counter, sizeof(m_stats_counter));
 #endif
 		return *this;
@@ -86,21 +140,57 @@ namespace libtorrent {
 	{
 		TORRENT_ASSERT(i >= 0);
 		TORRENT_ASSERT(i < num_counters);
+
+#if BOOST_ATOMIC_LLONG_LOCK_FREE == 2
+		return m_base[i].load(boost::memory_order_relaxed) + shard_sum(i);
+#else
+		mutex::scoped_lock l(m_mutex);
 #ifdef TORRENT_USE_VALGRIND
 		VALGRIND_CHECK_VALUE_IS_DEFINED(m_stats_counter[i]);
 #endif
+		return m_stats_counter[i];
+#endif
+	}
 
+	void counters::snapshot(boost::int64_t* values) const
+	{
 #if BOOST_ATOMIC_LLONG_LOCK_FREE == 2
-		return m_stats_counter[i].load(boost::memory_order_relaxed);
+		for (int i = 0; i < num_counters; ++i)
+			values[i] = m_base[i].load(boost::memory_order_relaxed);
+		// sum the shards one at a time, to read memory sequentially
+		for (int s = 0; s < num_shards; ++s)
+		{
+			boost::atomic<boost::int64_t> const* shard = m_shards[s].counter;
+			for (int i = 0; i < num_counters; ++i)
+				values[i] += shard[i].load(boost::memory_order_relaxed);
+		}
+#if TORRENT_USE_ASSERTS
+		// a gauge may be incremented on one shard and decremented on
+		// another, so while other threads update it, its sum may be
+		// momentarily negative. Only the monotonic counters can be checked
+		for (int i = 0; i < num_stats_counters; ++i)
+			TORRENT_ASSERT(values[i] >= 0);
+#endif
 #else
 		mutex::scoped_lock l(m_mutex);
-		return m_stats_counter[i];
+		memcpy(values, m_stats_counter, sizeof(m_stats_counter));
 #endif
 	}
 
+	void counters::snapshot_delta(boost::int64_t* values, boost::int64_t* delta) const
+	{
+		boost::int64_t current[num_counters];
+		snapshot(current);
+		for (int i = 0; i < num_counters; ++i)
+		{
+			delta[i] = current[i] - values[i];
+			values[i] = current[i];
+		}
+	}
+
 	// the argument specifies which counter to
 	// increment or decrement
-	boost::int64_t counters::inc_stats_counter(int c, boost::int64_t value)
+	void counters::inc_stats_counter(int c, boost::int64_t value)
 	{
 		// if c >= num_stats_counters, it means it's not
 		// a monotonically increasing counter, but a gauge
@@ -110,13 +200,13 @@ namespace libtorrent {
 		TORRENT_ASSERT(c < num_counters);
 
 #if BOOST_ATOMIC_LLONG_LOCK_FREE == 2
-		boost::int64_t pv = m_stats_counter[c].fetch_add(value, boost::memory_order_relaxed);
-		TORRENT_ASSERT(pv + value >= 0);
-		return pv + value;
+		// counters going negative are caught in snapshot(). Summing all
+		// shards here would touch every other thread's cache lines
+		m_shards[shard_index()].counter[c].fetch_add(value, boost::memory_order_relaxed);
 #else
 		mutex::scoped_lock l(m_mutex);
 		TORRENT_ASSERT(m_stats_counter[c] + value >= 0);
-		return m_stats_counter[c] += value;
+		m_stats_counter[c] += value;
 #endif
 	}
 
@@ -132,14 +222,14 @@ namespace libtorrent {
 		TORRENT_ASSERT(num_stats_counters);
 
 #if BOOST_ATOMIC_LLONG_LOCK_FREE == 2
-		boost::int64_t current = m_stats_counter[c].load(boost::memory_order_relaxed);
-		boost::int64_t new_value = (current * (100-ratio) + value * ratio) / 100;
-
-		while (!m_stats_counter[c].compare_exchange_weak(current, new_value
-			, boost::memory_order_relaxed))
-		{
-			new_value = (current * (100-ratio) + value * ratio) / 100;
-		}
+		// blended counters are only blended by a single thread, which is
+		// also the only one writing their base value. Moving the shards into
+		// the base with exchange() keeps increments made on other threads
+		// in the meantime, they're added on top of the blended value
+		boost::int64_t const current = m_base[c].load(boost::memory_order_relaxed)
+			+ fold_shards(c);
+		boost::int64_t const new_value = (current * (100-ratio) + value * ratio) / 100;
+		m_base[c].store(new_value, boost::memory_order_relaxed);
 #else
 		mutex::scoped_lock l(m_mutex);
 		boost::int64_t current = m_stats_counter[c];
@@ -153,7 +243,11 @@ namespace libtorrent {
 		TORRENT_ASSERT(c < num_counters);
 
 #if BOOST_ATOMIC_LLONG_LOCK_FREE == 2
-		m_stats_counter[c].store(value);
+		// the shards hold whatever has been added with inc_stats_counter()
+		// so far, which ``value`` replaces. Increments made on other threads
+		// after their shard has been cleared are added on top of it
+		fold_shards(c);
+		m_base[c].store(value, boost::memory_order_relaxed);
 #else
 		mutex::scoped_lock l(m_mutex);
 
@@ -166,4 +260,3 @@ namespace libtorrent {
 	}
 
 }
-
@@ -46,6 +46,11 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <windows.h>
 #endif
 
+#if defined TORRENT_LINUX
+#include <stdio.h>
+#include <string.h>
+#endif
+
 namespace libtorrent
 {
 
@@ -96,5 +101,45 @@ namespace libtorrent
 #endif
 		return ret;
 	}
-}
 
+	boost::uint64_t available_physical_ram()
+	{
+		boost::uint64_t ret = 0;
+
+#if defined TORRENT_WINDOWS
+		MEMORYSTATUSEX ms;
+		ms.dwLength = sizeof(MEMORYSTATUSEX);
+		if (GlobalMemoryStatusEx(&ms))
+			ret = ms.ullAvailPhys;
+#elif defined TORRENT_LINUX
+		FILE* f = fopen("/proc/meminfo", "r");
+		if (f == 0) return 0;
+
+		// MemAvailable is only reported by linux 3.14 and later. On older
+		// kernels, estimate it from the free memory and the page cache
+		boost::uint64_t available = 0;
+		boost::uint64_t free_mem = 0;
+		boost::uint64_t buffers = 0;
+		boost::uint64_t cached = 0;
+		bool has_available = false;
+
+		char line[200];
+		while (fgets(line, sizeof(line), f))
+		{
+			unsigned long long kb = 0;
+			if (sscanf(line, "MemAvailable: %llu", &kb) == 1)
+			{
+				available = kb;
+				has_available = true;
+			}
+			else if (sscanf(line, "MemFree: %llu", &kb) == 1) free_mem = kb;
+			else if (sscanf(line, "Buffers: %llu", &kb) == 1) buffers = kb;
+			else if (sscanf(line, "Cached: %llu", &kb) == 1) cached = kb;
+		}
+		fclose(f);
+
+		ret = (has_available ? available : free_mem + buffers + cached) * 1024;
+#endif
+		return ret;
+	}
+}
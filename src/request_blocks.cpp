@@ -75,6 +75,8 @@ namespace libtorrent
 		// initialized after we have the metadata
 		if (!t.are_files_checked()) return false;
 
+		cpu_sample sample(&t, torrent::cpu_picker);
+
 		TORRENT_ASSERT(c.peer_info_struct() != 0 || c.type() != peer_connection::bittorrent_connection);
 
 		bool time_critical_mode = t.num_time_critical_pieces() > 0;
@@ -0,0 +1,547 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/resume_store.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/io.hpp"
+
+#include <boost/crc.hpp>
+#include <algorithm>
+#include <cstring>
+
+#if TORRENT_HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#ifndef TORRENT_WINDOWS
+#include <unistd.h> // for fsync
+#endif
+
+namespace libtorrent
+{
+	namespace
+	{
+		// the file starts with a magic number and a version
+		char const file_magic[4] = {'L', 'T', 'R', 'S'};
+		int const file_version = 1;
+		int const file_header_size = 8;
+
+		// each record has this header, followed by the payload:
+		//   uint32 payload size
+		//   uint32 flags
+		//   uint32 crc32c of the payload
+		//   uint32 crc32c of the other fields of the header
+		//   20 bytes info-hash
+		int const record_header_size = 36;
+
+		enum record_flags
+		{
+			// the torrent was removed from the store. There's no payload
+			record_removed = 1
+		};
+
+		boost::uint32_t checksum(char const* buf, int size)
+		{
+			boost::crc_optimal<32, 0x1EDC6F41, 0xFFFFFFFF, 0xFFFFFFFF, true, true> crc;
+			crc.process_bytes(buf, size);
+			return crc.checksum();
+		}
+
+		boost::uint32_t header_checksum(char const* hdr)
+		{
+			boost::crc_optimal<32, 0x1EDC6F41, 0xFFFFFFFF, 0xFFFFFFFF, true, true> crc;
+			crc.process_bytes(hdr, 12);
+			crc.process_bytes(hdr + 16, record_header_size - 16);
+			return crc.checksum();
+		}
+	}
+
+	resume_store::resume_store()
+		: m_end(0)
+		, m_live_bytes(0)
+		, m_corrupt_records(0)
+		, m_mapping(0)
+		, m_mapping_size(0)
+		, m_mapped_end(0)
+	{}
+
+	resume_store::~resume_store()
+	{
+		close();
+	}
+
+	void resume_store::open(std::string const& path, error_code& ec)
+	{
+		close();
+		m_path = path;
+		if (!m_file.open(path, file::read_write, ec)) return;
+
+		boost::int64_t const size = m_file.get_size(ec);
+		if (ec)
+		{
+			close();
+			return;
+		}
+
+		if (size == 0)
+		{
+			// this is a new store, write the file header
+			char hdr[file_header_size];
+			char* ptr = hdr;
+			std::memcpy(ptr, file_magic, 4);
+			ptr += 4;
+			detail::write_uint32(file_version, ptr);
+
+			file::iovec_t b = { hdr, file_header_size };
+			m_file.writev(0, &b, 1, ec);
+			if (ec)
+			{
+				close();
+				return;
+			}
+			m_end = file_header_size;
+			m_live_bytes = file_header_size;
+			return;
+		}
+
+		map_file(size);
+		scan(size, ec);
+		if (ec)
+		{
+			close();
+			return;
+		}
+
+		// if the last record was only partially written (or there's nothing
+		// but garbage after the last valid record), cut it off. The next
+		// record is written in its place
+		if (m_end < size)
+		{
+			m_file.set_size(m_end, ec);
+			if (m_mapped_end > m_end) m_mapped_end = m_end;
+			if (ec)
+			{
+				close();
+				return;
+			}
+		}
+
+		// the torrents whose latest record was corrupt are removed for good.
+		// Otherwise their older records would be used again once the corrupt
+		// record is gone, e.g. cut off with the end of the file above
+		for (std::set<sha1_hash>::const_iterator i = m_corrupt.begin()
+			, end(m_corrupt.end()); i != end; ++i)
+		{
+			append(*i, record_removed, 0, 0, checksum(0, 0), ec);
+			if (ec)
+			{
+				close();
+				return;
+			}
+		}
+	}
+
+	void resume_store::close()
+	{
+		unmap_file();
+		m_file.close();
+		m_index.clear();
+		m_corrupt.clear();
+		m_corrupt_records = 0;
+		m_end = 0;
+		m_live_bytes = 0;
+	}
+
+	void resume_store::scan(boost::int64_t const size, error_code& ec)
+	{
+		char hdr[record_header_size];
+		if (size < file_header_size
+			|| !read(0, hdr, file_header_size, ec)
+			|| std::memcmp(hdr, file_magic, 4) != 0)
+		{
+			if (!ec) ec = errors::invalid_resume_store;
+			return;
+		}
+
+		char const* ptr = hdr + 4;
+		if (detail::read_uint32(ptr) != file_version)
+		{
+			ec = errors::invalid_resume_store;
+			return;
+		}
+
+		m_end = file_header_size;
+		m_live_bytes = file_header_size;
+
+		// only the headers are read here. The payloads are verified when
+		// they're loaded
+		while (m_end + record_header_size <= size)
+		{
+			if (!read(m_end, hdr, record_header_size, ec)) return;
+
+			ptr = hdr;
+			boost::uint32_t const payload_size = detail::read_uint32(ptr);
+			int const flags = detail::read_uint32(ptr);
+			boost::uint32_t const crc = detail::read_uint32(ptr);
+			boost::uint32_t const hdr_crc = detail::read_uint32(ptr);
+
+			if (hdr_crc != header_checksum(hdr))
+			{
+				++m_corrupt_records;
+
+				// if the info-hash is intact, this was the latest record of
+				// a torrent we know. It may have been removed, or its resume
+				// data changed, so its previous record can't be used either
+				sha1_hash const ih(hdr + 16);
+				std::map<sha1_hash, record>::iterator i = m_index.find(ih);
+				if (i != m_index.end())
+				{
+					m_live_bytes -= record_header_size + i->second.size;
+					m_index.erase(i);
+					m_corrupt.insert(ih);
+				}
+
+				// the header is corrupt, so its size can't be trusted either.
+				// Skip ahead to the next valid header, if there is one. The
+				// skipped bytes count as garbage. If there isn't one, this is
+				// where the valid records end
+				boost::int64_t const next = find_record(m_end + 1, size, ec);
+				if (ec) return;
+				if (next < 0) break;
+				m_end = next;
+				continue;
+			}
+
+			// a record that runs past the end of the file can only be the
+			// result of being interrupted while appending it, so it's the
+			// end of the valid records
+			boost::int64_t const record_end = m_end + record_header_size + payload_size;
+			if (record_end > size) break;
+
+			sha1_hash const ih(ptr);
+			m_corrupt.erase(ih);
+			std::map<sha1_hash, record>::iterator i = m_index.find(ih);
+			if (i != m_index.end())
+			{
+				// this record supersedes the previous one
+				m_live_bytes -= record_header_size + i->second.size;
+				if (flags & record_removed) m_index.erase(i);
+			}
+
+			if ((flags & record_removed) == 0)
+			{
+				record& r = m_index[ih];
+				r.offset = m_end + record_header_size;
+				r.size = payload_size;
+				r.crc = crc;
+				m_live_bytes += record_end - m_end;
+			}
+			m_end = record_end;
+		}
+	}
+
+	boost::int64_t resume_store::find_record(boost::int64_t offset
+		, boost::int64_t const size, error_code& ec) const
+	{
+		// the file is read in chunks that overlap by one header, so that
+		// every offset is checked with a whole header in the buffer
+		std::vector<char> buf;
+		while (offset + record_header_size <= size)
+		{
+			int const len = int((std::min)(boost::int64_t(64 * 1024)
+				, size - offset));
+			buf.resize(len);
+			if (!read(offset, &buf[0], len, ec)) return -1;
+
+			for (int i = 0; i + record_header_size <= len; ++i)
+			{
+				char const* hdr = &buf[i];
+				char const* ptr = hdr;
+				boost::uint32_t const payload_size = detail::read_uint32(ptr);
+				ptr = hdr + 12;
+				boost::uint32_t const hdr_crc = detail::read_uint32(ptr);
+				if (hdr_crc != header_checksum(hdr)) continue;
+				if (offset + i + record_header_size + payload_size > size) continue;
+				return offset + i;
+			}
+			offset += len - record_header_size + 1;
+		}
+		return -1;
+	}
+
+	bool resume_store::read(boost::int64_t offset, char* buf, int size
+		, error_code& ec) const
+	{
+		if (offset + size <= m_mapped_end)
+		{
+			std::memcpy(buf, m_mapping + offset, size);
+			return true;
+		}
+
+		file::iovec_t b = { buf, size_t(size) };
+		file& f = const_cast<file&>(m_file);
+		size_type const ret = f.readv(offset, &b, 1, ec);
+		if (ec) return false;
+		if (ret != size)
+		{
+			ec = errors::file_too_short;
+			return false;
+		}
+		return true;
+	}
+
+	void resume_store::append(sha1_hash const& ih, int flags, char const* buf
+		, int size, boost::uint32_t crc, error_code& ec)
+	{
+		char hdr[record_header_size];
+		char* ptr = hdr;
+		detail::write_uint32(size, ptr);
+		detail::write_uint32(flags, ptr);
+		detail::write_uint32(crc, ptr);
+		// the header checksum goes here, it's filled in below
+		ptr += 4;
+		std::memcpy(ptr, ih.begin(), 20);
+		ptr = hdr + 12;
+		detail::write_uint32(header_checksum(hdr), ptr);
+
+		file::iovec_t b[2] = {
+			{ hdr, size_t(record_header_size) },
+			{ const_cast<char*>(buf), size_t(size) } };
+		size_type const ret = m_file.writev(m_end, b, size > 0 ? 2 : 1, ec);
+		if (ec) return;
+		if (ret != record_header_size + size)
+		{
+			ec = errors::file_too_short;
+			return;
+		}
+		m_end += record_header_size + size;
+	}
+
+	void resume_store::save(sha1_hash const& ih, std::vector<char> const& buf
+		, error_code& ec)
+	{
+		save(ih, buf.empty() ? 0 : &buf[0], int(buf.size()), ec);
+	}
+
+	void resume_store::save(save_resume_data_alert const& a, error_code& ec)
+	{
+		sha1_hash const ih = a.handle.info_hash();
+		if (!a.resume_buffer.empty() || !a.resume_data)
+		{
+			save(ih, a.resume_buffer, ec);
+			return;
+		}
+
+		std::vector<char> buf;
+		bencode(std::back_inserter(buf), *a.resume_data);
+		save(ih, buf, ec);
+	}
+
+	void resume_store::save(sha1_hash const& ih, char const* buf, int size
+		, error_code& ec)
+	{
+		TORRENT_ASSERT(is_open());
+		boost::uint32_t const crc = checksum(buf, size);
+
+		std::map<sha1_hash, record>::iterator i = m_index.find(ih);
+		if (i != m_index.end() && i->second.size == size && i->second.crc == crc)
+		{
+			// if the resume data hasn't changed since it was last saved,
+			// there's no need to write it again
+			record const& r = i->second;
+			if (r.offset + size <= m_mapped_end)
+			{
+				if (std::memcmp(m_mapping + r.offset, buf, size) == 0) return;
+			}
+			else
+			{
+				std::vector<char> old(size);
+				if (size == 0 || (read(r.offset, &old[0], size, ec)
+					&& std::memcmp(&old[0], buf, size) == 0))
+					return;
+				if (ec) return;
+			}
+		}
+
+		boost::int64_t const offset = m_end + record_header_size;
+		append(ih, 0, buf, size, crc, ec);
+		if (ec) return;
+
+		if (i != m_index.end())
+			m_live_bytes -= record_header_size + i->second.size;
+		else
+			i = m_index.insert(std::make_pair(ih, record())).first;
+
+		i->second.offset = offset;
+		i->second.size = size;
+		i->second.crc = crc;
+		m_live_bytes += record_header_size + size;
+	}
+
+	void resume_store::remove(sha1_hash const& ih, error_code& ec)
+	{
+		TORRENT_ASSERT(is_open());
+		std::map<sha1_hash, record>::iterator i = m_index.find(ih);
+		if (i == m_index.end()) return;
+
+		append(ih, record_removed, 0, 0, checksum(0, 0), ec);
+		if (ec) return;
+
+		m_live_bytes -= record_header_size + i->second.size;
+		m_index.erase(i);
+	}
+
+	bool resume_store::load(sha1_hash const& ih, std::vector<char>& buf
+		, error_code& ec) const
+	{
+		std::map<sha1_hash, record>::const_iterator i = m_index.find(ih);
+		if (i == m_index.end()) return false;
+
+		record const& r = i->second;
+		buf.resize(r.size);
+		if (r.size > 0 && !read(r.offset, &buf[0], r.size, ec))
+		{
+			buf.clear();
+			return false;
+		}
+
+		if (checksum(buf.empty() ? 0 : &buf[0], r.size) != r.crc)
+		{
+			buf.clear();
+			ec = errors::resume_record_corrupt;
+			return false;
+		}
+		return true;
+	}
+
+	void resume_store::torrents(std::vector<sha1_hash>& ret) const
+	{
+		ret.clear();
+		ret.reserve(m_index.size());
+		for (std::map<sha1_hash, record>::const_iterator i = m_index.begin()
+			, end(m_index.end()); i != end; ++i)
+			ret.push_back(i->first);
+	}
+
+	void resume_store::corrupt_torrents(std::vector<sha1_hash>& ret) const
+	{
+		ret.assign(m_corrupt.begin(), m_corrupt.end());
+	}
+
+	void resume_store::compact(error_code& ec)
+	{
+		TORRENT_ASSERT(is_open());
+		if (garbage() == 0) return;
+
+		// write the current records to a new file and replace the store
+		// with it once it's complete. If we're interrupted, the old file
+		// is still intact
+		std::string const tmp_path = m_path + ".tmp";
+		{
+			resume_store tmp;
+			libtorrent::remove(tmp_path, ec);
+			ec.clear();
+			tmp.open(tmp_path, ec);
+			if (ec) return;
+
+			std::vector<char> buf;
+			for (std::map<sha1_hash, record>::const_iterator i = m_index.begin()
+				, end(m_index.end()); i != end; ++i)
+			{
+				// a corrupt record is dropped rather than carried over
+				if (!load(i->first, buf, ec))
+				{
+					if (ec != error_code(errors::resume_record_corrupt)) return;
+					ec.clear();
+					continue;
+				}
+				tmp.save(i->first, buf, ec);
+				if (ec) return;
+			}
+			tmp.flush(ec);
+			if (ec) return;
+		}
+
+		// the store is closed before it's replaced, since an open file can't
+		// be replaced on windows. If that fails, the original file is still
+		// intact, and is opened again
+		std::string const path = m_path;
+		close();
+		libtorrent::rename(tmp_path, path, ec);
+		if (ec)
+		{
+			error_code ignore;
+			open(path, ignore);
+			libtorrent::remove(tmp_path, ignore);
+			return;
+		}
+		open(path, ec);
+	}
+
+	void resume_store::flush(error_code& ec)
+	{
+		TORRENT_ASSERT(is_open());
+#ifdef TORRENT_WINDOWS
+		if (FlushFileBuffers(m_file.native_handle()) == 0)
+			ec.assign(GetLastError(), boost::system::get_system_category());
+#else
+		if (fsync(m_file.native_handle()) != 0)
+			ec.assign(errno, boost::system::generic_category());
+#endif
+	}
+
+	void resume_store::map_file(boost::int64_t size)
+	{
+		unmap_file();
+#if TORRENT_HAVE_MMAP
+		void* p = mmap(0, size, PROT_READ, MAP_SHARED, m_file.native_handle(), 0);
+		if (p == MAP_FAILED) return;
+		m_mapping = static_cast<char const*>(p);
+		m_mapping_size = size;
+		m_mapped_end = size;
+#endif
+	}
+
+	void resume_store::unmap_file()
+	{
+#if TORRENT_HAVE_MMAP
+		if (m_mapping)
+			munmap(const_cast<char*>(m_mapping), m_mapping_size);
+#endif
+		m_mapping = 0;
+		m_mapping_size = 0;
+		m_mapped_end = 0;
+	}
+}
+
@@ -568,12 +568,14 @@ namespace libtorrent
 		, boost::function<bool(torrent_status const&)> const& pred
 		, boost::uint32_t flags) const
 	{
+		if (m_impl->get_torrent_status_snapshot(ret, pred, flags)) return;
 		TORRENT_SYNC_CALL3(get_torrent_status, ret, boost::ref(pred), flags);
 	}
 
 	void session::refresh_torrent_status(std::vector<torrent_status>* ret
 		, boost::uint32_t flags) const
 	{
+		if (m_impl->refresh_torrent_status_snapshot(ret, flags)) return;
 		TORRENT_SYNC_CALL2(refresh_torrent_status, ret, flags);
 	}
 
@@ -582,6 +584,11 @@ namespace libtorrent
 		TORRENT_ASYNC_CALL(post_torrent_updates);
 	}
 
+	void session::post_torrent_deltas(boost::uint32_t fields)
+	{
+		TORRENT_ASYNC_CALL1(post_torrent_deltas, fields);
+	}
+
 	std::vector<stats_metric> session_stats_metrics()
 	{
 		std::vector<stats_metric> ret;
@@ -596,8 +603,24 @@ namespace libtorrent
 		TORRENT_ASYNC_CALL(post_session_stats);
 	}
 
+	void session::post_latency_histograms()
+	{
+		TORRENT_ASYNC_CALL(post_latency_histograms);
+	}
+
+	std::vector<error_code> session::apply_torrent_operations(
+		std::vector<torrent_operation> const& ops)
+	{
+		std::vector<error_code> ret;
+		if (ops.empty()) return ret;
+		TORRENT_SYNC_CALL2(apply_torrent_operations, &ops, &ret);
+		return ret;
+	}
+
 	std::vector<torrent_handle> session::get_torrents() const
 	{
+		std::vector<torrent_handle> ret;
+		if (m_impl->get_torrents_snapshot(ret)) return ret;
 		return TORRENT_SYNC_CALL_RET(std::vector<torrent_handle>, get_torrents);
 	}
 	
@@ -1139,6 +1162,11 @@ namespace libtorrent
 		m_impl->pop_alerts(alerts);
 	}
 
+	void session::pop_alerts(std::vector<alert*>* alerts)
+	{
+		m_impl->pop_alerts(alerts);
+	}
+
 	alert const* session::wait_for_alert(time_duration max_wait)
 	{
 		return m_impl->wait_for_alert(max_wait);
@@ -415,6 +415,8 @@ namespace aux {
 		, m_host_resolver(m_io_service)
 		, m_download_connect_attempts(0)
 		, m_tick_residual(0)
+		, m_top_torrents_time_scaler(0)
+		, m_status_snapshot_time_scaler(0)
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
 		, m_logpath(".")
 #endif
@@ -456,6 +458,11 @@ namespace aux {
 		}
 #endif
 
+		memset(m_last_stats_counters, 0, sizeof(m_last_stats_counters));
+		TORRENT_ASSERT(sizeof(m_cpu_sample_countdown) / sizeof(m_cpu_sample_countdown[0])
+			== torrent::num_cpu_categories);
+		memset(m_cpu_sample_countdown, 0, sizeof(m_cpu_sample_countdown));
+
 		error_code ec;
 		m_listen_interface = tcp::endpoint(address_v4::any(), 0);
 		TORRENT_ASSERT_VAL(!ec, ec);
@@ -1056,6 +1063,7 @@ namespace aux {
 			i->second->abort();
 		}
 		m_torrents.clear();
+		invalidate_status_snapshot();
 
 #if defined(TORRENT_VERBOSE_LOGGING) || defined(TORRENT_LOGGING)
 		session_log(" aborting all tracker requests");
@@ -1461,6 +1469,16 @@ namespace aux {
 		m_io_service.post(boost::bind(&session_impl::submit_disk_jobs, this));
 	}
 
+	int session_impl::sample_cpu(int category)
+	{
+		TORRENT_ASSERT(category >= 0 && category < torrent::num_cpu_categories);
+		int const rate = m_settings.get_int(settings_pack::cpu_sample_rate);
+		if (rate <= 0) return 0;
+		if (--m_cpu_sample_countdown[category] > 0) return 0;
+		m_cpu_sample_countdown[category] = rate;
+		return rate;
+	}
+
 	void session_impl::submit_disk_jobs()
 	{
 		TORRENT_ASSERT(m_deferred_submit_disk_jobs);
@@ -2071,6 +2089,33 @@ retry:
 			, boost::bind(&session_impl::on_socks_accept, this, m_socks_listen_socket, _1));
 	}
 
+	void session_impl::update_status_snapshots()
+	{
+		if (m_settings.get_int(settings_pack::status_snapshot_interval) > 0)
+		{
+			// publish one right away, and then every interval
+			m_status_snapshot_time_scaler = m_settings.get_int(
+				settings_pack::status_snapshot_interval);
+			publish_status_snapshots(true);
+			return;
+		}
+
+		invalidate_status_snapshot();
+		for (torrent_map::iterator i = m_torrents.begin()
+			, end(m_torrents.end()); i != end; ++i)
+		{
+			i->second->clear_status_snapshot();
+		}
+
+		std::vector<torrent*>& updates = m_torrent_lists[torrent_snapshot_updates];
+		for (std::vector<torrent*>::iterator i = updates.begin()
+			, end(updates.end()); i != end; ++i)
+		{
+			(*i)->clear_in_snapshot_update();
+		}
+		updates.clear();
+	}
+
 	void session_impl::update_i2p_bridge()
 	{
 		// we need this socket to be open before we
@@ -2590,6 +2635,10 @@ retry:
 
 	void session_impl::setup_socket_buffers(socket_type& s)
 	{
+		// with auto_socket_buffers, the peer_connection sizes the buffers
+		// itself once it has rate and RTT estimates, and the configured
+		// sizes are only upper bounds
+		if (m_settings.get_bool(settings_pack::auto_socket_buffers)) return;
 		error_code ec;
 		set_socket_buffer_size(s, m_settings, ec);
 	}
@@ -2890,6 +2939,8 @@ retry:
 		// don't do any of the following while we're shutting down
 		if (m_abort) return;
 
+		m_disk_thread.update_cache_size();
+
 		// --------------------------------------------------------------
 		// RSS feeds
 		// --------------------------------------------------------------
@@ -3000,6 +3051,25 @@ retry:
 			if (!t.want_tick()) --i;
 		}
 
+		// --------------------------------------------------------------
+		// report the torrents using the most resources
+		// --------------------------------------------------------------
+		if (m_settings.get_int(settings_pack::top_torrents_interval) > 0
+			&& --m_top_torrents_time_scaler <= 0)
+		{
+			m_top_torrents_time_scaler = m_settings.get_int(
+				settings_pack::top_torrents_interval);
+			post_top_torrents();
+		}
+
+		if (m_settings.get_int(settings_pack::status_snapshot_interval) > 0
+			&& --m_status_snapshot_time_scaler <= 0)
+		{
+			m_status_snapshot_time_scaler = m_settings.get_int(
+				settings_pack::status_snapshot_interval);
+			publish_status_snapshots();
+		}
+
 #ifndef TORRENT_DISABLE_DHT
 		int dht_down = 0;
 		int dht_up = 0;
@@ -3551,7 +3621,10 @@ retry:
 					continue;
 				}
 
-				TORRENT_ASSERT(t->m_resume_data_loaded || !t->valid_metadata());
+				// torrents added unloaded don't read their resume data until
+				// they're started
+				TORRENT_ASSERT(t->m_resume_data_loaded || !t->valid_metadata()
+					|| !t->is_loaded());
 				// this torrent is auto managed, add it to
 				// the list (depending on if it's a seed or not)
 				if (t->is_finished())
@@ -4116,6 +4189,7 @@ retry:
 	{
 		m_torrents.insert(std::make_pair(ih, t));
 		if (!uuid.empty()) m_uuids.insert(std::make_pair(uuid, t));
+		invalidate_status_snapshot();
 
 		TORRENT_ASSERT(m_torrents.size() >= m_torrent_lru.size());
 	}
@@ -4307,6 +4381,132 @@ retry:
 		}
 	}
 
+	void session_impl::publish_status_snapshots(bool all)
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		boost::uint32_t const flags = m_settings.get_int(
+			settings_pack::status_snapshot_flags);
+
+		// only the torrents whose state changed since the last snapshot,
+		// and the ones that don't have one yet, need a new status. The
+		// others keep their previous one
+		std::vector<torrent*> torrents;
+		std::vector<piece_manager const*> storages;
+		boost::shared_ptr<status_snapshot_t> snapshot(new status_snapshot_t);
+		snapshot->reserve(m_torrents.size());
+		for (torrent_map::const_iterator i = m_torrents.begin()
+			, end(m_torrents.end()); i != end; ++i)
+		{
+			torrent& t = *i->second;
+			if (t.is_aborted()) continue;
+			if (all || t.in_snapshot_update() || !t.status_snapshot())
+			{
+				torrents.push_back(&t);
+				storages.push_back(t.has_storage() ? &t.storage() : 0);
+			}
+		}
+
+		// count the cached blocks of all torrents while holding the cache
+		// mutex once, rather than once per torrent
+		std::vector<int> blocks(torrents.size());
+		if (!torrents.empty() && (flags & torrent_handle::query_resource_usage))
+			m_disk_thread.cached_blocks(&storages[0], &blocks[0], int(storages.size()));
+
+		for (int i = 0; i < int(torrents.size()); ++i)
+			torrents[i]->publish_status_snapshot(flags, blocks[i]);
+
+		std::vector<torrent*>& updates = m_torrent_lists[torrent_snapshot_updates];
+		for (std::vector<torrent*>::iterator i = updates.begin()
+			, end(updates.end()); i != end; ++i)
+		{
+			(*i)->clear_in_snapshot_update();
+		}
+		updates.clear();
+
+		for (torrent_map::const_iterator i = m_torrents.begin()
+			, end(m_torrents.end()); i != end; ++i)
+		{
+			if (i->second->is_aborted()) continue;
+			snapshot->push_back(i->second->status_snapshot());
+		}
+		boost::atomic_store(&m_status_snapshot
+			, boost::shared_ptr<status_snapshot_t const>(snapshot));
+	}
+
+	void session_impl::invalidate_status_snapshot()
+	{
+		boost::atomic_store(&m_status_snapshot
+			, boost::shared_ptr<status_snapshot_t const>());
+	}
+
+	bool session_impl::get_torrent_status_snapshot(std::vector<torrent_status>* ret
+		, boost::function<bool(torrent_status const&)> const& pred
+		, boost::uint32_t flags) const
+	{
+		boost::shared_ptr<status_snapshot_t const> snapshot
+			= boost::atomic_load(&m_status_snapshot);
+		if (!snapshot) return false;
+
+		for (status_snapshot_t::const_iterator i = snapshot->begin()
+			, end(snapshot->end()); i != end; ++i)
+		{
+			if (!status_snapshot_covers(**i, flags)) return false;
+		}
+
+		for (status_snapshot_t::const_iterator i = snapshot->begin()
+			, end(snapshot->end()); i != end; ++i)
+		{
+			if (!pred((*i)->status)) continue;
+			ret->push_back((*i)->status);
+		}
+		return true;
+	}
+
+	bool session_impl::refresh_torrent_status_snapshot(
+		std::vector<torrent_status>* ret, boost::uint32_t flags) const
+	{
+		if (!boost::atomic_load(&m_status_snapshot)) return false;
+
+		std::vector<boost::shared_ptr<status_snapshot_entry const> > st;
+		st.reserve(ret->size());
+		for (std::vector<torrent_status>::iterator i
+			= ret->begin(), end(ret->end()); i != end; ++i)
+		{
+			boost::shared_ptr<torrent> t = i->handle.m_torrent.lock();
+			st.push_back(t ? t->status_snapshot()
+				: boost::shared_ptr<status_snapshot_entry const>());
+			if (!t) continue;
+			// this torrent was added after the snapshot was published (and
+			// the snapshot was reset after that), or the snapshot doesn't have
+			// the fields that were asked for. Let the caller fall back to
+			// asking the network thread
+			if (!st.back() || !status_snapshot_covers(*st.back(), flags))
+				return false;
+		}
+
+		for (int i = 0; i < int(ret->size()); ++i)
+		{
+			if (st[i]) (*ret)[i] = st[i]->status;
+		}
+		return true;
+	}
+
+	bool session_impl::get_torrents_snapshot(std::vector<torrent_handle>& ret) const
+	{
+		boost::shared_ptr<status_snapshot_t const> snapshot
+			= boost::atomic_load(&m_status_snapshot);
+		if (!snapshot) return false;
+
+		ret.reserve(snapshot->size());
+		for (status_snapshot_t::const_iterator i = snapshot->begin()
+			, end(snapshot->end()); i != end; ++i)
+		{
+			ret.push_back((*i)->status.handle);
+		}
+		return true;
+	}
+
 	void session_impl::refresh_torrent_status(std::vector<torrent_status>* ret
 		, boost::uint32_t flags) const
 	{
@@ -4354,6 +4554,41 @@ retry:
 		}
 		state_updates.clear();
 
+#if TORRENT_USE_ASSERTS
+		m_posting_torrent_updates = false;
+#endif
+
+		m_alerts.post_alert_ptr(alert.release());
+	}
+
+	void session_impl::post_torrent_deltas(boost::uint32_t fields)
+	{
+		INVARIANT_CHECK;
+
+		TORRENT_ASSERT(is_single_thread());
+
+		// bits that don't correspond to a field are ignored
+		fields &= (boost::uint32_t(1) << status_delta::num_fields) - 1;
+
+		std::auto_ptr<state_delta_alert> alert(new state_delta_alert());
+		std::vector<torrent*>& state_updates
+			= m_torrent_lists[aux::session_impl::torrent_state_updates];
+
+#if TORRENT_USE_ASSERTS
+		m_posting_torrent_updates = true;
+#endif
+
+		for (std::vector<torrent*>::iterator i = state_updates.begin()
+			, end(state_updates.end()); i != end; ++i)
+		{
+			torrent* t = *i;
+			TORRENT_ASSERT(t->m_links[aux::session_impl::torrent_state_updates].in_list());
+			if (t->status_delta(alert->buffer, fields))
+				++alert->num_torrents;
+			t->clear_in_state_update();
+		}
+		state_updates.clear();
+
 #if TORRENT_USE_ASSERTS
 		m_posting_torrent_updates = false;
 #endif
@@ -4396,14 +4631,197 @@ retry:
 		m_stats_counters.set_value(counters::limiter_down_bytes
 			, m_download_rate.queued_bytes());
 
-		for (int i = 0; i < counters::num_counters; ++i)
-			values[i] = m_stats_counters[i];
+		// the counters are sharded per thread. Sum them all up in one pass,
+		// along with the change since the last call
+		boost::int64_t delta[counters::num_counters];
+		m_stats_counters.snapshot_delta(m_last_stats_counters, delta);
+		std::copy(m_last_stats_counters, m_last_stats_counters
+			+ counters::num_counters, values.begin());
+		alert->deltas.assign(delta, delta + counters::num_counters);
 
 		alert->timestamp = total_microseconds(time_now_hires() - m_created);
 
 		m_alerts.post_alert_ptr(alert.release());
 	}
 
+	void session_impl::post_latency_histograms()
+	{
+		// the histograms are laid out back to back in the counters, in the
+		// same order as in the alert
+		TORRENT_ASSERT(counters::request_latency3 == counters::disk_read_latency3
+			+ latency_histogram_alert::peer_request * counters::num_latency_buckets);
+		TORRENT_ASSERT(counters::num_latency_buckets
+			== latency_histogram_alert::num_buckets);
+
+		latency_histogram_alert alert;
+		for (int h = 0; h < latency_histogram_alert::num_histograms; ++h)
+		{
+			int const first = counters::disk_read_latency3
+				+ h * counters::num_latency_buckets;
+			for (int i = 0; i < latency_histogram_alert::num_buckets; ++i)
+				alert.buckets[h][i] = m_stats_counters[first + i];
+		}
+		alert.timestamp = total_microseconds(time_now_hires() - m_created);
+
+		m_alerts.post_alert(alert);
+	}
+
+	namespace
+	{
+		struct torrent_usage_entry
+		{
+			torrent* t;
+			boost::int64_t cpu_time;
+			int cached_blocks;
+		};
+
+		bool more_cpu_time(torrent_usage_entry const& lhs
+			, torrent_usage_entry const& rhs)
+		{ return lhs.cpu_time > rhs.cpu_time; }
+
+		bool more_cached_blocks(torrent_usage_entry const& lhs
+			, torrent_usage_entry const& rhs)
+		{ return lhs.cached_blocks > rhs.cached_blocks; }
+
+		top_torrents_alert::torrent_usage make_usage(torrent_usage_entry const& e)
+		{
+			top_torrents_alert::torrent_usage ret;
+			ret.handle = e.t->get_handle();
+			ret.cpu_time = e.cpu_time;
+			ret.cached_blocks = e.cached_blocks;
+			return ret;
+		}
+	}
+
+	void session_impl::post_top_torrents()
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		std::vector<torrent_usage_entry> usage;
+		std::vector<piece_manager const*> storages;
+		usage.reserve(m_torrents.size());
+		storages.reserve(m_torrents.size());
+
+		// the cpu time is counted from the last time we were here, whether
+		// anyone was listening for the alert or not
+		for (torrent_map::iterator i = m_torrents.begin()
+			, end(m_torrents.end()); i != end; ++i)
+		{
+			torrent& t = *i->second;
+			torrent_usage_entry e;
+			e.t = &t;
+			e.cpu_time = t.cpu_time_since_report();
+			e.cached_blocks = 0;
+			usage.push_back(e);
+			storages.push_back(t.has_storage() ? &t.storage() : 0);
+		}
+
+		if (!m_alerts.should_post<top_torrents_alert>()) return;
+		if (usage.empty()) return;
+
+		std::vector<int> blocks(storages.size());
+		m_disk_thread.cached_blocks(&storages[0], &blocks[0], int(storages.size()));
+		for (int i = 0; i < int(usage.size()); ++i)
+			usage[i].cached_blocks = blocks[i];
+
+		int const count = (std::min)(int(usage.size())
+			, (std::max)(0, m_settings.get_int(settings_pack::top_torrents_count)));
+
+		top_torrents_alert alert;
+		alert.interval = m_settings.get_int(settings_pack::top_torrents_interval);
+
+		std::partial_sort(usage.begin(), usage.begin() + count, usage.end()
+			, &more_cpu_time);
+		for (int i = 0; i < count && usage[i].cpu_time > 0; ++i)
+			alert.cpu.push_back(make_usage(usage[i]));
+
+		std::partial_sort(usage.begin(), usage.begin() + count, usage.end()
+			, &more_cached_blocks);
+		for (int i = 0; i < count && usage[i].cached_blocks > 0; ++i)
+			alert.cache.push_back(make_usage(usage[i]));
+
+		m_alerts.post_alert(alert);
+	}
+
+	void session_impl::apply_torrent_operations(
+		std::vector<torrent_operation> const* ops, std::vector<error_code>* ret)
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		ret->resize(ops->size());
+		for (int i = 0; i < int(ops->size()); ++i)
+		{
+			torrent_operation const& op = (*ops)[i];
+			boost::shared_ptr<torrent> t = op.handle.m_torrent.lock();
+			if (!t || t->is_aborted())
+			{
+				(*ret)[i] = errors::invalid_torrent_handle;
+				continue;
+			}
+
+			switch (op.op)
+			{
+				case torrent_operation::pause:
+					t->pause(op.value & torrent_handle::graceful_pause);
+					break;
+				case torrent_operation::resume:
+					t->resume();
+					break;
+				case torrent_operation::auto_managed:
+					t->auto_managed(op.value != 0);
+					break;
+				case torrent_operation::set_priority:
+					if (op.value < 0 || op.value > 255)
+						(*ret)[i] = asio::error::invalid_argument;
+					else
+						t->set_priority(op.value);
+					break;
+				case torrent_operation::set_upload_limit:
+					if (op.value < -1)
+						(*ret)[i] = asio::error::invalid_argument;
+					else
+						t->set_upload_limit(op.value);
+					break;
+				case torrent_operation::set_download_limit:
+					if (op.value < -1)
+						(*ret)[i] = asio::error::invalid_argument;
+					else
+						t->set_download_limit(op.value);
+					break;
+				case torrent_operation::set_max_uploads:
+					if (op.value < 2 && op.value != -1)
+						(*ret)[i] = asio::error::invalid_argument;
+					else
+						t->set_max_uploads(op.value, true);
+					break;
+				case torrent_operation::set_max_connections:
+					if (op.value < 2 && op.value != -1)
+						(*ret)[i] = asio::error::invalid_argument;
+					else
+						t->set_max_connections(op.value, true);
+					break;
+				case torrent_operation::force_reannounce:
+					t->force_tracker_request(time_now() + seconds(op.value), -1);
+					break;
+				case torrent_operation::force_recheck:
+					t->force_recheck();
+					break;
+				case torrent_operation::queue_position_up:
+					t->queue_up();
+					break;
+				case torrent_operation::queue_position_down:
+					t->queue_down();
+					break;
+				case torrent_operation::set_upload_mode:
+					t->set_upload_mode(op.value != 0);
+					break;
+				default:
+					(*ret)[i] = asio::error::operation_not_supported;
+					break;
+			}
+		}
+	}
+
 	std::vector<torrent_handle> session_impl::get_torrents() const
 	{
 		std::vector<torrent_handle> ret;
@@ -4606,6 +5024,27 @@ retry:
 				}
 #endif
 			}
+			else if (tmp.type() == lazy_entry::dict_t
+				&& m_user_load_torrent
+				&& (params.flags & add_torrent_params::flag_pinned) == 0
+				&& params.url.empty()
+				&& !params.info_hash.is_all_zeros()
+				&& tmp.dict_find_string_value("info-hash") == params.info_hash.to_string()
+				&& tmp.dict_find_int_value("piece_length") > 0
+				&& tmp.dict_find_int_value("total_size") > 0)
+			{
+				// there's no metadata in the resume data, but there's a summary
+				// of it. That's enough to add the torrent unloaded, and have the
+				// load function provide the metadata once the torrent is started.
+				// This makes adding a large number of torrents on startup cheap
+#if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING
+				session_log("adding torrent unloaded, from resume data");
+#endif
+				params.ti = boost::make_shared<torrent_info>(params.info_hash);
+				params.ti->set_unloaded_metadata(tmp.dict_find_string_value("name")
+					, int(tmp.dict_find_int_value("piece_length"))
+					, tmp.dict_find_int_value("total_size"));
+			}
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
 			else
 			{
@@ -4689,6 +5128,7 @@ retry:
 #endif // TORRENT_HAS_BOOST_UNORDERED
 
 		m_torrents.insert(std::make_pair(*ih, torrent_ptr));
+		invalidate_status_snapshot();
 
 		TORRENT_ASSERT(m_torrents.size() >= m_torrent_lru.size());
 
@@ -4701,7 +5141,9 @@ retry:
 		m_obfuscated_torrents.insert(std::make_pair(h.final(), torrent_ptr));
 #endif
 
-		if (torrent_ptr->is_pinned() == false)
+		// torrents added unloaded enter the LRU when they are first loaded
+		if (torrent_ptr->is_pinned() == false
+			&& (torrent_ptr->is_loaded() || !torrent_ptr->valid_metadata()))
 		{
 			evict_torrents_except(torrent_ptr.get());
 			bump_torrent(torrent_ptr.get());
@@ -4901,6 +5343,7 @@ retry:
 			++m_next_lsd_torrent;
 
 		m_torrents.erase(i);
+		invalidate_status_snapshot();
 
 		TORRENT_ASSERT(m_torrents.size() >= m_torrent_lru.size());
 
@@ -6167,6 +6610,18 @@ retry:
 			, this, num_resume));
 	}
 
+	// this function is called on the user's thread
+	// not the network thread
+	void session_impl::pop_alerts(std::vector<alert*>* alerts)
+	{
+		int num_resume = 0;
+		m_alerts.get_all(alerts, num_resume);
+		// we can only issue more resume data jobs from
+		// the network thread
+		m_io_service.post(boost::bind(&session_impl::async_resume_dispatched
+			, this, num_resume));
+	}
+
 	alert const* session_impl::wait_for_alert(time_duration max_wait)
 	{
 		return m_alerts.wait_for_alert(max_wait);
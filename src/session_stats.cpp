@@ -342,6 +342,9 @@ namespace libtorrent
 		METRIC(disk, arc_write_size)
 		METRIC(disk, arc_volatile_size)
 
+		// the current size limit of the disk cache, in blocks
+		METRIC(disk, cache_size_limit)
+
 		// the number of blocks written and read from disk in total. A block is
 		// 16 kiB.
 		METRIC(disk, num_blocks_written)
@@ -362,6 +365,13 @@ namespace libtorrent
 		// hash a piece (when verifying against the piece hash)
 		METRIC(disk, num_read_back)
 
+		// the number of reads that hit a piece in one of the ARC ghost lists,
+		// and the number of times the adaptive cache sizing grew or shrunk the
+		// cache. See settings_pack::adaptive_cache_size
+		METRIC(disk, num_arc_ghost_hits)
+		METRIC(disk, num_cache_size_grow)
+		METRIC(disk, num_cache_size_shrink)
+
 		// cumulative time spent in various disk jobs, as well
 		// as total for all disk jobs. Measured in microseconds
 		METRIC(disk, disk_read_time)
@@ -504,6 +514,142 @@ namespace libtorrent
 		METRIC(sock_bufs, socket_recv_size19)
 		METRIC(sock_bufs, socket_recv_size20)
 
+		// latency histograms, with one counter per log2 bucket. The number
+		// at the end of the name is n, where the bucket counts samples that
+		// took less than 2^n microseconds. See latency_percentile()
+		METRIC(disk, disk_read_latency3)
+		METRIC(disk, disk_read_latency4)
+		METRIC(disk, disk_read_latency5)
+		METRIC(disk, disk_read_latency6)
+		METRIC(disk, disk_read_latency7)
+		METRIC(disk, disk_read_latency8)
+		METRIC(disk, disk_read_latency9)
+		METRIC(disk, disk_read_latency10)
+		METRIC(disk, disk_read_latency11)
+		METRIC(disk, disk_read_latency12)
+		METRIC(disk, disk_read_latency13)
+		METRIC(disk, disk_read_latency14)
+		METRIC(disk, disk_read_latency15)
+		METRIC(disk, disk_read_latency16)
+		METRIC(disk, disk_read_latency17)
+		METRIC(disk, disk_read_latency18)
+		METRIC(disk, disk_read_latency19)
+		METRIC(disk, disk_read_latency20)
+		METRIC(disk, disk_read_latency21)
+		METRIC(disk, disk_read_latency22)
+		METRIC(disk, disk_read_latency23)
+		METRIC(disk, disk_read_latency24)
+		METRIC(disk, disk_write_latency3)
+		METRIC(disk, disk_write_latency4)
+		METRIC(disk, disk_write_latency5)
+		METRIC(disk, disk_write_latency6)
+		METRIC(disk, disk_write_latency7)
+		METRIC(disk, disk_write_latency8)
+		METRIC(disk, disk_write_latency9)
+		METRIC(disk, disk_write_latency10)
+		METRIC(disk, disk_write_latency11)
+		METRIC(disk, disk_write_latency12)
+		METRIC(disk, disk_write_latency13)
+		METRIC(disk, disk_write_latency14)
+		METRIC(disk, disk_write_latency15)
+		METRIC(disk, disk_write_latency16)
+		METRIC(disk, disk_write_latency17)
+		METRIC(disk, disk_write_latency18)
+		METRIC(disk, disk_write_latency19)
+		METRIC(disk, disk_write_latency20)
+		METRIC(disk, disk_write_latency21)
+		METRIC(disk, disk_write_latency22)
+		METRIC(disk, disk_write_latency23)
+		METRIC(disk, disk_write_latency24)
+		METRIC(disk, disk_hash_latency3)
+		METRIC(disk, disk_hash_latency4)
+		METRIC(disk, disk_hash_latency5)
+		METRIC(disk, disk_hash_latency6)
+		METRIC(disk, disk_hash_latency7)
+		METRIC(disk, disk_hash_latency8)
+		METRIC(disk, disk_hash_latency9)
+		METRIC(disk, disk_hash_latency10)
+		METRIC(disk, disk_hash_latency11)
+		METRIC(disk, disk_hash_latency12)
+		METRIC(disk, disk_hash_latency13)
+		METRIC(disk, disk_hash_latency14)
+		METRIC(disk, disk_hash_latency15)
+		METRIC(disk, disk_hash_latency16)
+		METRIC(disk, disk_hash_latency17)
+		METRIC(disk, disk_hash_latency18)
+		METRIC(disk, disk_hash_latency19)
+		METRIC(disk, disk_hash_latency20)
+		METRIC(disk, disk_hash_latency21)
+		METRIC(disk, disk_hash_latency22)
+		METRIC(disk, disk_hash_latency23)
+		METRIC(disk, disk_hash_latency24)
+		METRIC(disk, disk_other_latency3)
+		METRIC(disk, disk_other_latency4)
+		METRIC(disk, disk_other_latency5)
+		METRIC(disk, disk_other_latency6)
+		METRIC(disk, disk_other_latency7)
+		METRIC(disk, disk_other_latency8)
+		METRIC(disk, disk_other_latency9)
+		METRIC(disk, disk_other_latency10)
+		METRIC(disk, disk_other_latency11)
+		METRIC(disk, disk_other_latency12)
+		METRIC(disk, disk_other_latency13)
+		METRIC(disk, disk_other_latency14)
+		METRIC(disk, disk_other_latency15)
+		METRIC(disk, disk_other_latency16)
+		METRIC(disk, disk_other_latency17)
+		METRIC(disk, disk_other_latency18)
+		METRIC(disk, disk_other_latency19)
+		METRIC(disk, disk_other_latency20)
+		METRIC(disk, disk_other_latency21)
+		METRIC(disk, disk_other_latency22)
+		METRIC(disk, disk_other_latency23)
+		METRIC(disk, disk_other_latency24)
+		METRIC(disk, disk_queue_latency3)
+		METRIC(disk, disk_queue_latency4)
+		METRIC(disk, disk_queue_latency5)
+		METRIC(disk, disk_queue_latency6)
+		METRIC(disk, disk_queue_latency7)
+		METRIC(disk, disk_queue_latency8)
+		METRIC(disk, disk_queue_latency9)
+		METRIC(disk, disk_queue_latency10)
+		METRIC(disk, disk_queue_latency11)
+		METRIC(disk, disk_queue_latency12)
+		METRIC(disk, disk_queue_latency13)
+		METRIC(disk, disk_queue_latency14)
+		METRIC(disk, disk_queue_latency15)
+		METRIC(disk, disk_queue_latency16)
+		METRIC(disk, disk_queue_latency17)
+		METRIC(disk, disk_queue_latency18)
+		METRIC(disk, disk_queue_latency19)
+		METRIC(disk, disk_queue_latency20)
+		METRIC(disk, disk_queue_latency21)
+		METRIC(disk, disk_queue_latency22)
+		METRIC(disk, disk_queue_latency23)
+		METRIC(disk, disk_queue_latency24)
+		METRIC(peer, request_latency3)
+		METRIC(peer, request_latency4)
+		METRIC(peer, request_latency5)
+		METRIC(peer, request_latency6)
+		METRIC(peer, request_latency7)
+		METRIC(peer, request_latency8)
+		METRIC(peer, request_latency9)
+		METRIC(peer, request_latency10)
+		METRIC(peer, request_latency11)
+		METRIC(peer, request_latency12)
+		METRIC(peer, request_latency13)
+		METRIC(peer, request_latency14)
+		METRIC(peer, request_latency15)
+		METRIC(peer, request_latency16)
+		METRIC(peer, request_latency17)
+		METRIC(peer, request_latency18)
+		METRIC(peer, request_latency19)
+		METRIC(peer, request_latency20)
+		METRIC(peer, request_latency21)
+		METRIC(peer, request_latency22)
+		METRIC(peer, request_latency23)
+		METRIC(peer, request_latency24)
+
 		// ... more
 	};
 #undef METRIC
@@ -521,6 +667,40 @@ namespace libtorrent
 		}
 	}
 
+	boost::int64_t latency_percentile(boost::uint64_t const* buckets, int ppm)
+	{
+		TORRENT_ASSERT(ppm >= 0 && ppm <= 1000000);
+
+		boost::uint64_t total = 0;
+		for (int i = 0; i < counters::num_latency_buckets; ++i)
+			total += buckets[i];
+		if (total == 0) return 0;
+
+		// the 1-based rank of the sample at the percentile, rounded up
+		boost::uint64_t rank = total / 1000000 * ppm
+			+ ((total % 1000000) * ppm + 999999) / 1000000;
+		if (rank == 0) rank = 1;
+
+		boost::uint64_t seen = 0;
+		for (int i = 0; i < counters::num_latency_buckets; ++i)
+		{
+			if (seen + buckets[i] < rank)
+			{
+				seen += buckets[i];
+				continue;
+			}
+
+			// assume the samples are evenly spread across the bucket
+			int const exp = counters::first_latency_bucket + i;
+			boost::int64_t const lower = i == 0 ? 0 : boost::int64_t(1) << (exp - 1);
+			boost::int64_t const upper = boost::int64_t(1) << exp;
+			return lower + (upper - lower) * boost::int64_t(rank - seen)
+				/ boost::int64_t(buckets[i]);
+		}
+		TORRENT_ASSERT(false);
+		return 0;
+	}
+
 	int find_metric_idx(char const* name)
 	{
 		stats_metric_impl const* end = metrics + sizeof(metrics)/sizeof(metrics[0]);
@@ -201,6 +201,8 @@ namespace libtorrent
 		SET_NOPREV(proxy_hostnames, true, 0),
 		SET_NOPREV(proxy_peer_connections, true, 0),
 		SET_NOPREV(auto_sequential, true, &session_impl::update_auto_sequential),
+		SET_NOPREV(auto_socket_buffers, false, 0),
+		SET_NOPREV(adaptive_cache_size, false, 0),
 	};
 
 	int_setting_entry_t int_settings[settings_pack::num_int_settings] =
@@ -334,7 +336,16 @@ namespace libtorrent
 		SET(inactive_up_rate, 2048, 0),
 		SET_NOPREV(proxy_type, settings_pack::none, &session_impl::update_proxy),
 		SET_NOPREV(proxy_port, 0, &session_impl::update_proxy),
-		SET_NOPREV(i2p_port, 0, &session_impl::update_i2p_bridge)
+		SET_NOPREV(i2p_port, 0, &session_impl::update_i2p_bridge),
+		SET_NOPREV(cpu_sample_rate, 0, 0),
+		SET_NOPREV(top_torrents_interval, 0, 0),
+		SET_NOPREV(top_torrents_count, 10, 0),
+		SET_NOPREV(status_snapshot_interval, 0, &session_impl::update_status_snapshots),
+		SET_NOPREV(status_snapshot_flags, (torrent_handle::query_resource_usage << 1) - 1
+			, &session_impl::update_status_snapshots),
+		SET_NOPREV(min_cache_size, 256, 0),
+		SET_NOPREV(max_cache_size, -1, 0),
+		SET_NOPREV(adaptive_cache_free_memory, 10, 0)
 	};
 
 #undef SET
@@ -40,6 +40,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/io.hpp" // for write_uint16
 #include "libtorrent/hasher.hpp" // for hasher
 
+#include <algorithm> // for min/max
+#include <limits>
+
+#if defined TORRENT_LINUX
+#include <netinet/in.h>
+#include <netinet/tcp.h> // for TCP_INFO
+#endif
+
 namespace libtorrent
 {
 
@@ -152,5 +160,40 @@ namespace libtorrent
 		}
 	}
 
+	int tcp_rtt(tcp::socket& s, int* deviation)
+	{
+#if defined TORRENT_LINUX && defined TCP_INFO
+		tcp_info info;
+		socklen_t len = sizeof(info);
+		if (getsockopt(s.native_handle(), IPPROTO_TCP, TCP_INFO, &info, &len) != 0
+			|| len < socklen_t(sizeof(info)))
+			return -1;
+		// the kernel reports these in microseconds. Before the first ACK
+		// there is no estimate
+		if (info.tcpi_rtt == 0) return -1;
+		if (deviation) *deviation = int(info.tcpi_rttvar / 1000);
+		return int(info.tcpi_rtt / 1000);
+#else
+		(void)s;
+		(void)deviation;
+		return -1;
+#endif
+	}
+
+	int bandwidth_delay_product(boost::int64_t rate, int rtt)
+	{
+		if (rtt < 20) rtt = 20;
+		return int((std::min)(rate * rtt / 1000
+			, boost::int64_t((std::numeric_limits<int>::max)())));
+	}
+
+	int socket_buffer_target(int bdp, int max_size)
+	{
+		int const min_size = 16 * 1024;
+		boost::int64_t target = (std::min)(boost::int64_t(bdp) * 2
+			, boost::int64_t(max_size));
+		if (target < min_size) target = (std::min)(min_size, max_size);
+		return int(target);
+	}
 }
 
@@ -0,0 +1,104 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/status_delta.hpp"
+
+#include <cstring> // for memcpy
+
+namespace libtorrent
+{
+	namespace
+	{
+		int const header_size = 20 + sizeof(boost::uint32_t);
+
+		int popcount(boost::uint32_t v)
+		{
+			int ret = 0;
+			for (; v != 0; v &= v - 1) ++ret;
+			return ret;
+		}
+	}
+
+	void append_status_delta(std::vector<char>& buf
+		, sha1_hash const& info_hash, boost::uint32_t fields
+		, boost::int64_t const* values)
+	{
+		TORRENT_ASSERT((fields >> status_delta::num_fields) == 0);
+
+		int pos = buf.size();
+		buf.resize(pos + header_size + popcount(fields) * sizeof(boost::int64_t));
+		char* ptr = &buf[pos];
+		std::memcpy(ptr, &info_hash[0], 20);
+		ptr += 20;
+		std::memcpy(ptr, &fields, sizeof(fields));
+		ptr += sizeof(fields);
+		for (int i = 0; i < status_delta::num_fields; ++i)
+		{
+			if ((fields & status_delta_mask(i)) == 0) continue;
+			std::memcpy(ptr, &values[i], sizeof(boost::int64_t));
+			ptr += sizeof(boost::int64_t);
+		}
+		TORRENT_ASSERT(ptr == &buf[0] + buf.size());
+	}
+
+	status_delta_reader::status_delta_reader(char const* buf, int size)
+		: m_cursor(buf)
+		, m_end(buf + size)
+		, m_fields(0)
+	{
+		TORRENT_ASSERT(size >= 0);
+	}
+
+	bool status_delta_reader::next()
+	{
+		m_fields = 0;
+		if (m_end - m_cursor < header_size) return false;
+
+		boost::uint32_t fields;
+		std::memcpy(&fields, m_cursor + 20, sizeof(fields));
+		if ((fields >> status_delta::num_fields) != 0) return false;
+		int const values_size = popcount(fields) * sizeof(boost::int64_t);
+		if (m_end - m_cursor - header_size < values_size) return false;
+
+		m_info_hash.assign(m_cursor);
+		m_cursor += header_size;
+		for (int i = 0; i < status_delta::num_fields; ++i)
+		{
+			if ((fields & status_delta_mask(i)) == 0) continue;
+			std::memcpy(&m_values[i], m_cursor, sizeof(boost::int64_t));
+			m_cursor += sizeof(boost::int64_t);
+		}
+		m_fields = fields;
+		return true;
+	}
+}
+
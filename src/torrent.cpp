@@ -54,6 +54,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/tracker_manager.hpp"
 #include "libtorrent/parse_url.hpp"
 #include "libtorrent/bencode.hpp"
+#include "libtorrent/bencode_writer.hpp"
 #include "libtorrent/hasher.hpp"
 #include "libtorrent/entry.hpp"
 #include "libtorrent/peer.hpp"
@@ -85,6 +86,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/alert_manager.hpp" // for alert_manageralert_manager
 #include "libtorrent/resolver_interface.hpp"
 #include "libtorrent/alloca.hpp"
+#include "libtorrent/status_delta.hpp"
 
 #ifdef TORRENT_USE_OPENSSL
 #include "libtorrent/ssl_stream.hpp"
@@ -160,6 +162,8 @@ namespace libtorrent
 		, m_source_feed_url(p.source_feed_url)
 		, m_stats_counters(ses.stats_counters())
 		, m_storage_constructor(p.storage)
+		, m_delta_fields(0)
+		, m_reported_cpu_time(0)
 		, m_added_time(time(0))
 		, m_completed_time(0)
 		, m_last_seen_complete(0)
@@ -236,11 +240,15 @@ namespace libtorrent
 		, m_last_scrape(INT16_MIN)
 		, m_progress_ppm(0)
 		, m_use_resume_save_path(p.flags & add_torrent_params::flag_use_resume_save_path)
+		, m_deferred_init(false)
+		, m_deferred_seed(false)
+		, m_deferred_finished(false)
+		, m_resume_settings_read(false)
 	{
 		if (m_pinned)
 			inc_stats_counter(counters::num_pinned_torrents);
 
-		inc_stats_counter(counters::num_loaded_torrents);
+		memset(m_cpu_time, 0, sizeof(m_cpu_time));
 
 		// if there is resume data already, we don't need to trigger the initial save
 		// resume data
@@ -281,6 +289,11 @@ namespace libtorrent
 		if (!m_torrent_file)
 			m_torrent_file = (p.ti ? p.ti : boost::make_shared<torrent_info>(info_hash));
 
+		// torrents added from their resume data alone start out unloaded,
+		// they are counted once their metadata is loaded
+		if (!m_torrent_file->is_valid() || m_torrent_file->is_loaded())
+			inc_stats_counter(counters::num_loaded_torrents);
+
 		// add web seeds from add_torrent_params
 		for (std::vector<std::string>::const_iterator i = p.url_seeds.begin()
 			, end(p.url_seeds.end()); i != end; ++i)
@@ -764,6 +777,56 @@ namespace libtorrent
 			// we need to download the .torrent file from m_url
 			start_download_url();
 		}
+		else if (m_torrent_file->is_valid() && !m_torrent_file->is_loaded())
+		{
+			// this torrent was added from its resume data, without its
+			// metadata. Don't load it (and check its files) until it's started.
+			// Most torrents in a large session are queued, and won't need to
+			// be loaded at all until their turn comes
+			m_deferred_init = true;
+			bool const valid_resume = validate_resume_data();
+
+			// the auto manager queues seeds and downloads separately, so
+			// carry over whether the torrent is finished from the resume data
+			lazy_entry const* pieces = valid_resume
+				? m_resume_data->entry.dict_find_string("pieces") : 0;
+			int const num_pieces = m_torrent_file->num_pieces();
+			if (pieces && pieces->string_length() == num_pieces)
+			{
+				char const* have = pieces->string_ptr();
+				lazy_entry const* prio = m_resume_data->entry.dict_find_string("piece_priority");
+				if (prio && prio->string_length() != num_pieces) prio = 0;
+
+				bool seed = true;
+				bool finished = true;
+				for (int i = 0; i < num_pieces; ++i)
+				{
+					if (have[i] & 1) continue;
+					seed = false;
+					// pieces we don't want don't count. The piece priorities
+					// include the file priorities
+					if (prio && prio->string_ptr()[i] == 0) continue;
+					finished = false;
+					break;
+				}
+				m_deferred_seed = seed;
+				m_deferred_finished = finished;
+				update_gauge();
+			}
+
+			// the paused and auto-managed state, the limits and the trackers
+			// don't need the metadata. Apply them now, rather than when the
+			// torrent is loaded, to have it queued (or started) according to
+			// its resume data, and to not overwrite changes made to the
+			// torrent in the meantime once it is loaded
+			if (valid_resume)
+			{
+				read_resume_settings(m_resume_data->entry);
+				m_need_save_resume_data = false;
+			}
+
+			if (!is_paused()) need_loaded();
+		}
 		else if (m_torrent_file->is_valid())
 		{
 			init();
@@ -777,6 +840,38 @@ namespace libtorrent
 		}
 	}
 
+	bool torrent::validate_resume_data()
+	{
+		if (!m_resume_data || m_resume_data->entry.type() != lazy_entry::dict_t)
+			return false;
+
+		int ev = 0;
+		if (m_resume_data->entry.dict_find_string_value("file-format") != "libtorrent resume file")
+			ev = errors::invalid_file_tag;
+
+		std::string info_hash = m_resume_data->entry.dict_find_string_value("info-hash");
+		if (!ev && info_hash.empty())
+			ev = errors::missing_info_hash;
+
+		if (!ev && sha1_hash(info_hash) != m_torrent_file->info_hash())
+			ev = errors::mismatching_info_hash;
+
+		if (!ev) return true;
+
+		if (m_ses.alerts().should_post<fastresume_rejected_alert>())
+		{
+			error_code ec = error_code(ev, get_libtorrent_category());
+			m_ses.alerts().post_alert(fastresume_rejected_alert(get_handle(), ec, "", 0));
+		}
+
+#if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
+		debug_log("fastresume data rejected: %s"
+			, error_code(ev, get_libtorrent_category()).message().c_str());
+#endif
+		m_resume_data.reset();
+		return false;
+	}
+
 	void torrent::start_download_url()
 	{
 		TORRENT_ASSERT(!m_url.empty());
@@ -1723,38 +1818,8 @@ namespace libtorrent
 			return;
 		}
 
-		if (m_resume_data && m_resume_data->entry.type() == lazy_entry::dict_t)
-		{
-			int ev = 0;
-			if (m_resume_data->entry.dict_find_string_value("file-format") != "libtorrent resume file")
-				ev = errors::invalid_file_tag;
-	
-			std::string info_hash = m_resume_data->entry.dict_find_string_value("info-hash");
-			if (!ev && info_hash.empty())
-				ev = errors::missing_info_hash;
-
-			if (!ev && sha1_hash(info_hash) != m_torrent_file->info_hash())
-				ev = errors::mismatching_info_hash;
-
-			if (ev && m_ses.alerts().should_post<fastresume_rejected_alert>())
-			{
-				error_code ec = error_code(ev, get_libtorrent_category());
-				m_ses.alerts().post_alert(fastresume_rejected_alert(get_handle(), ec, "", 0));
-			}
-
-			if (ev)
-			{
-#if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
-				debug_log("fastresume data rejected: %s"
-					, error_code(ev, get_libtorrent_category()).message().c_str());
-#endif
-				m_resume_data.reset();
-			}
-			else
-			{
-				read_resume_data(m_resume_data->entry);
-			}
-		}
+		if (validate_resume_data())
+			read_resume_data(m_resume_data->entry);
 	
 #if TORRENT_USE_ASSERTS
 		m_resume_data_loaded = true;
@@ -1977,6 +2042,8 @@ namespace libtorrent
 	{
 		error_code ec;
 		m_torrent_file->load(&buffer[0], buffer.size(), ec);
+		if (!ec && m_torrent_file->info_hash() != m_info_hash)
+			ec = errors::mismatching_info_hash;
 		if (ec)
 		{
 			set_error(ec, error_file_metadata);
@@ -2005,6 +2072,17 @@ namespace libtorrent
 
 		inc_stats_counter(counters::num_loaded_torrents);
 
+		if (m_deferred_init)
+		{
+			// this is the first time this torrent is loaded. init() reads the
+			// resume data, constructs the storage and checks the files
+			// is_seed() no longer reflects the resume data
+			m_deferred_init = false;
+			update_gauge();
+			init();
+			return !has_error();
+		}
+
 		construct_storage();
 
 		return true;
@@ -2483,6 +2561,7 @@ namespace libtorrent
 		for (int i = 0; i < num_outstanding; ++i)
 		{
 			inc_refcount("start_checking");
+			m_torrent_file->prefetch_piece_hashes(m_checking_piece, 1);
 			m_ses.disk_thread().async_hash(m_storage.get(), m_checking_piece++
 				, disk_io_job::sequential_access | disk_io_job::volatile_read
 				, boost::bind(&torrent::on_piece_hashed
@@ -2633,6 +2712,7 @@ namespace libtorrent
 			}
 
 			inc_refcount("start_checking");
+			m_torrent_file->prefetch_piece_hashes(m_checking_piece, 1);
 			m_ses.disk_thread().async_hash(m_storage.get(), m_checking_piece++
 				, disk_io_job::sequential_access | disk_io_job::volatile_read
 				, boost::bind(&torrent::on_piece_hashed
@@ -3558,35 +3638,45 @@ namespace libtorrent
 		int offset = p.block_index * block_size();
 		if (m_padding == 0) return (std::min)(piece_size - offset, int(block_size()));
 
-		std::vector<file_slice> files = fs.map_block(
-			p.piece_index, offset, (std::min)(piece_size - offset, int(block_size())));
+		int const block = (std::min)(piece_size - offset, int(block_size()));
+		int left = block;
 		int ret = 0;
-		for (std::vector<file_slice>::iterator i = files.begin()
-			, end(files.end()); i != end; ++i)
+		file_slice files[8];
+		while (left > 0)
 		{
-			if (fs.pad_file_at(i->file_index)) continue;
-			ret += i->size;
+			int const num = fs.map_block(p.piece_index, offset, left
+				, files, sizeof(files) / sizeof(files[0]));
+			TORRENT_ASSERT(num > 0);
+			if (num == 0) break;
+			for (int i = 0; i < num; ++i)
+			{
+				if (!fs.pad_file_at(files[i].file_index)) ret += int(files[i].size);
+				offset += int(files[i].size);
+				left -= int(files[i].size);
+			}
 		}
-		TORRENT_ASSERT(ret <= (std::min)(piece_size - offset, int(block_size())));
+		TORRENT_ASSERT(ret <= block);
 		return ret;
 	}
 
 	// fills in total_wanted, total_wanted_done and total_done
-	void torrent::bytes_done(torrent_status& st, bool accurate) const
+	// the cheap part of bytes_done(), that doesn't need the torrent to be
+	// loaded. Returns false if the counters are exact and there's nothing
+	// left for the accurate pass to refine
+	bool torrent::bytes_done(size_type& total_done, size_type& total_wanted_done
+		, size_type& total_wanted) const
 	{
-		INVARIANT_CHECK;
+		total_done = 0;
+		total_wanted_done = 0;
+		total_wanted = m_torrent_file->total_size();
 
-		st.total_done = 0;
-		st.total_wanted_done = 0;
-		st.total_wanted = m_torrent_file->total_size();
-
-		TORRENT_ASSERT(st.total_wanted >= m_padding);
-		TORRENT_ASSERT(st.total_wanted >= 0);
+		TORRENT_ASSERT(total_wanted >= m_padding);
+		TORRENT_ASSERT(total_wanted >= 0);
 
 		if (!valid_metadata() || m_torrent_file->num_pieces() == 0)
-			return;
+			return false;
 
-		TORRENT_ASSERT(st.total_wanted >= size_type(m_torrent_file->piece_length())
+		TORRENT_ASSERT(total_wanted >= size_type(m_torrent_file->piece_length())
 			* (m_torrent_file->num_pieces() - 1));
 
 		const int last_piece = m_torrent_file->num_pieces() - 1;
@@ -3596,25 +3686,25 @@ namespace libtorrent
 		// and m_seed_mode will be false
 		if (m_seed_mode || is_seed())
 		{
-			st.total_done = m_torrent_file->total_size() - m_padding;
-			st.total_wanted_done = st.total_done;
-			st.total_wanted = st.total_done;
-			return;
+			total_done = m_torrent_file->total_size() - m_padding;
+			total_wanted_done = total_done;
+			total_wanted = total_done;
+			return false;
 		}
 		else if (!has_picker())
 		{
-			st.total_done = 0;
-			st.total_wanted_done = 0;
-			st.total_wanted = m_torrent_file->total_size() - m_padding;
-			return;
+			total_done = 0;
+			total_wanted_done = 0;
+			total_wanted = m_torrent_file->total_size() - m_padding;
+			return false;
 		}
 
 		TORRENT_ASSERT(num_have() >= m_picker->num_have_filtered());
-		st.total_wanted_done = size_type(num_passed() - m_picker->num_have_filtered())
+		total_wanted_done = size_type(num_passed() - m_picker->num_have_filtered())
 			* piece_size;
-		TORRENT_ASSERT(st.total_wanted_done >= 0);
+		TORRENT_ASSERT(total_wanted_done >= 0);
 		
-		st.total_done = size_type(num_passed()) * piece_size;
+		total_done = size_type(num_passed()) * piece_size;
 		// if num_passed() == num_pieces(), we should be a seed, and taken the
 		// branch above
 		TORRENT_ASSERT(num_passed() <= m_torrent_file->num_pieces());
@@ -3624,31 +3714,44 @@ namespace libtorrent
 		int last_piece_index = m_torrent_file->num_pieces() - 1;
 		if (m_picker->piece_priority(last_piece_index) == 0)
 		{
-			st.total_wanted -= m_torrent_file->piece_size(last_piece_index);
-			TORRENT_ASSERT(st.total_wanted >= 0);
+			total_wanted -= m_torrent_file->piece_size(last_piece_index);
+			TORRENT_ASSERT(total_wanted >= 0);
 			--num_filtered_pieces;
 		}
-		st.total_wanted -= size_type(num_filtered_pieces) * piece_size;
-		TORRENT_ASSERT(st.total_wanted >= 0);
+		total_wanted -= size_type(num_filtered_pieces) * piece_size;
+		TORRENT_ASSERT(total_wanted >= 0);
 	
 		// if we have the last piece, we have to correct
 		// the amount we have, since the first calculation
 		// assumed all pieces were of equal size
 		if (m_picker->has_piece_passed(last_piece))
 		{
-			TORRENT_ASSERT(st.total_done >= piece_size);
+			TORRENT_ASSERT(total_done >= piece_size);
 			int corr = m_torrent_file->piece_size(last_piece)
 				- piece_size;
 			TORRENT_ASSERT(corr <= 0);
 			TORRENT_ASSERT(corr > -piece_size);
-			st.total_done += corr;
+			total_done += corr;
 			if (m_picker->piece_priority(last_piece) != 0)
 			{
-				TORRENT_ASSERT(st.total_wanted_done >= piece_size);
-				st.total_wanted_done += corr;
+				TORRENT_ASSERT(total_wanted_done >= piece_size);
+				total_wanted_done += corr;
 			}
 		}
-		TORRENT_ASSERT(st.total_wanted >= st.total_wanted_done);
+		TORRENT_ASSERT(total_wanted >= total_wanted_done);
+
+		return true;
+	}
+
+	void torrent::bytes_done(torrent_status& st, bool accurate) const
+	{
+		INVARIANT_CHECK;
+
+		if (!bytes_done(st.total_done, st.total_wanted_done, st.total_wanted))
+			return;
+
+		const int last_piece = m_torrent_file->num_pieces() - 1;
+		const int piece_size = m_torrent_file->piece_length();
 
 		// this is expensive, we might not want to do it all the time
 		if (!accurate) return;
@@ -4658,6 +4761,7 @@ namespace libtorrent
 		if (m_abort) return;
 
 		m_abort = true;
+		clear_status_snapshot();
 		update_want_peers();
 		update_want_tick();
 		update_gauge();
@@ -4805,13 +4909,29 @@ namespace libtorrent
 
 		m_need_save_resume_data = false;
 		m_last_saved_resume = m_ses.session_time();
-		write_resume_data(*((entry*)j->buffer));
-		alerts().post_alert(save_resume_data_alert(boost::shared_ptr<entry>((entry*)j->buffer)
-			, get_handle()));
+		boost::shared_ptr<entry> rd((entry*)j->buffer);
 		const_cast<disk_io_job*>(j)->buffer = 0;
+		post_resume_data(rd);
 		state_updated();
 	}
 
+	void torrent::post_resume_data(boost::shared_ptr<entry> const& storage_rd)
+	{
+		if (m_save_resume_flags & torrent_handle::save_bencoded)
+		{
+			// encode the resume data straight into the buffer handed to the
+			// client, without building an entry tree
+			std::vector<char> buf;
+			bencode_writer w(buf);
+			write_resume_data(w, storage_rd.get());
+			alerts().post_alert(save_resume_data_alert(buf, get_handle()));
+			return;
+		}
+
+		write_resume_data(*storage_rd);
+		alerts().post_alert(save_resume_data_alert(storage_rd, get_handle()));
+	}
+
 	void torrent::on_file_renamed(disk_io_job const* j)
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -6501,6 +6621,120 @@ namespace libtorrent
 
 	void torrent::read_resume_data(lazy_entry const& rd)
 	{
+		// if the settings were read when the torrent was added, they may have
+		// been changed since. Leave them (and whether the resume data needs
+		// saving) alone
+		bool const settings_read = m_resume_settings_read;
+		bool const need_save_resume_data = m_need_save_resume_data;
+		if (!settings_read) read_resume_settings(rd);
+
+		if (m_seed_mode)
+			m_verified.resize(m_torrent_file->num_pieces(), false);
+
+		// TODO: make this more generic to not just work if files have been
+		// renamed, but also if they have been merged into a single file for instance
+		// maybe use the same format as .torrent files and reuse some code from torrent_info
+		// The mapped_files needs to be read both in the network thread
+		// and in the disk thread, since they both have their own mapped files structures
+		// which are kept in sync
+		lazy_entry const* mapped_files = rd.dict_find_list("mapped_files");
+		if (mapped_files && mapped_files->list_size() == m_torrent_file->num_files())
+		{
+			for (int i = 0; i < m_torrent_file->num_files(); ++i)
+			{
+				std::string new_filename = mapped_files->list_string_value_at(i);
+				if (new_filename.empty()) continue;
+				m_torrent_file->rename_file(i, new_filename);
+			}
+		}
+		
+		if (!m_seed_mode && !m_override_resume_data)
+		{
+			lazy_entry const* file_priority = rd.dict_find_list("file_priority");
+			if (file_priority && file_priority->list_size()
+				== m_torrent_file->num_files())
+			{
+				int num_files = m_torrent_file->num_files();
+				m_file_priority.resize(num_files);
+				for (int i = 0; i < num_files; ++i)
+					m_file_priority[i] = file_priority->list_int_value_at(i, 1);
+				// unallocated slots are assumed to be priority 1, so cut off any
+				// trailing ones
+				int end_range = num_files - 1;
+				for (; end_range >= 0; --end_range) if (m_file_priority[end_range] != 1) break;
+				m_file_priority.resize(end_range + 1);
+         
+				// initialize pad files to priority 0
+				file_storage const& fs = m_torrent_file->files();
+				for (int i = 0; i < (std::min)(fs.num_files(), end_range + 1); ++i)
+				{
+					if (!fs.pad_file_at(i)) continue;
+					m_file_priority[i] = 0;
+				}
+			}
+
+			update_piece_priorities();
+		}
+
+		lazy_entry const* url_list = rd.dict_find_list("url-list");
+		if (url_list)
+		{
+			for (int i = 0; i < url_list->list_size(); ++i)
+			{
+				std::string url = url_list->list_string_value_at(i);
+				if (url.empty()) continue;
+				if (m_torrent_file->num_files() > 1 && url[url.size()-1] != '/') url += '/';
+				add_web_seed(url, web_seed_entry::url_seed);
+			}
+		}
+
+		lazy_entry const* httpseeds = rd.dict_find_list("httpseeds");
+		if (httpseeds)
+		{
+			for (int i = 0; i < httpseeds->list_size(); ++i)
+			{
+				std::string url = httpseeds->list_string_value_at(i);
+				if (url.empty()) continue;
+				add_web_seed(url, web_seed_entry::http_seed);
+			}
+		}
+
+		if (m_torrent_file->is_merkle_torrent())
+		{
+			lazy_entry const* mt = rd.dict_find_string("merkle tree");
+			if (mt)
+			{
+				std::vector<sha1_hash> tree;
+				tree.resize(m_torrent_file->merkle_tree().size());
+				std::memcpy(&tree[0], mt->string_ptr()
+					, (std::min)(mt->string_length(), int(tree.size()) * 20));
+				if (mt->string_length() < int(tree.size()) * 20)
+					std::memset(&tree[0] + mt->string_length() / 20, 0
+						, tree.size() - mt->string_length() / 20);
+				m_torrent_file->set_merkle_tree(tree);
+			}
+			else
+			{
+				// TODO: 0 if this is a merkle torrent and we can't
+				// restore the tree, we need to wipe all the
+				// bits in the have array, but not necessarily
+				// we might want to do a full check to see if we have
+				// all the pieces. This is low priority since almost
+				// no one uses merkle torrents
+				TORRENT_ASSERT(false);
+			}
+		}
+
+		// updating some of the torrent state may have set need_save_resume_data.
+		// clear it here since we've just restored the resume data we already
+		// have. Nothing has changed from that state yet.
+		m_need_save_resume_data = settings_read ? need_save_resume_data : false;
+	}
+
+	void torrent::read_resume_settings(lazy_entry const& rd)
+	{
+		m_resume_settings_read = true;
+
 		m_total_uploaded = rd.dict_find_int_value("total_uploaded");
 		m_total_downloaded = rd.dict_find_int_value("total_downloaded");
 		m_active_time = rd.dict_find_int_value("active_time");
@@ -6536,30 +6770,8 @@ namespace libtorrent
 
 			int sequential_ = rd.dict_find_int_value("sequential_download", -1);
 			if (sequential_ != -1) set_sequential_download(sequential_);
-
-			int paused_ = rd.dict_find_int_value("paused", -1);
-			if (paused_ != -1)
-			{
-				set_allow_peers(!paused_);
-				m_announce_to_dht = !paused_;
-				m_announce_to_trackers = !paused_;
-				m_announce_to_lsd = !paused_;
-
-				update_gauge();
-				update_want_peers();
-				update_want_scrape();
-			}
-			int dht_ = rd.dict_find_int_value("announce_to_dht", -1);
-			if (dht_ != -1) m_announce_to_dht = dht_;
-			int lsd_ = rd.dict_find_int_value("announce_to_lsd", -1);
-			if (lsd_ != -1) m_announce_to_lsd = lsd_;
-			int track_ = rd.dict_find_int_value("announce_to_trackers", -1);
-			if (track_ != -1) m_announce_to_trackers = track_;
 		}
 
-		if (m_seed_mode)
-			m_verified.resize(m_torrent_file->num_pieces(), false);
-
 		int now = m_ses.session_time();
 		int tmp = rd.dict_find_int_value("last_scrape", -1);
 		m_last_scrape = tmp == -1 ? INT16_MIN : now - tmp;
@@ -6586,56 +6798,11 @@ namespace libtorrent
 			m_ses.insert_uuid_torrent(m_uuid.empty() ? m_url : m_uuid, me);
 		}
 
-		// TODO: make this more generic to not just work if files have been
-		// renamed, but also if they have been merged into a single file for instance
-		// maybe use the same format as .torrent files and reuse some code from torrent_info
-		// The mapped_files needs to be read both in the network thread
-		// and in the disk thread, since they both have their own mapped files structures
-		// which are kept in sync
-		lazy_entry const* mapped_files = rd.dict_find_list("mapped_files");
-		if (mapped_files && mapped_files->list_size() == m_torrent_file->num_files())
-		{
-			for (int i = 0; i < m_torrent_file->num_files(); ++i)
-			{
-				std::string new_filename = mapped_files->list_string_value_at(i);
-				if (new_filename.empty()) continue;
-				m_torrent_file->rename_file(i, new_filename);
-			}
-		}
-		
 		m_added_time = rd.dict_find_int_value("added_time", m_added_time);
 		m_completed_time = rd.dict_find_int_value("completed_time", m_completed_time);
 		if (m_completed_time != 0 && m_completed_time < m_added_time)
 			m_completed_time = m_added_time;
 
-		if (!m_seed_mode && !m_override_resume_data)
-		{
-			lazy_entry const* file_priority = rd.dict_find_list("file_priority");
-			if (file_priority && file_priority->list_size()
-				== m_torrent_file->num_files())
-			{
-				int num_files = m_torrent_file->num_files();
-				m_file_priority.resize(num_files);
-				for (int i = 0; i < num_files; ++i)
-					m_file_priority[i] = file_priority->list_int_value_at(i, 1);
-				// unallocated slots are assumed to be priority 1, so cut off any
-				// trailing ones
-				int end_range = num_files - 1;
-				for (; end_range >= 0; --end_range) if (m_file_priority[end_range] != 1) break;
-				m_file_priority.resize(end_range + 1);
-         
-				// initialize pad files to priority 0
-				file_storage const& fs = m_torrent_file->files();
-				for (int i = 0; i < (std::min)(fs.num_files(), end_range + 1); ++i)
-				{
-					if (!fs.pad_file_at(i)) continue;
-					m_file_priority[i] = 0;
-				}
-			}
-
-			update_piece_priorities();
-		}
-
 		lazy_entry const* trackers = rd.dict_find_list("trackers");
 		if (trackers)
 		{
@@ -6665,59 +6832,29 @@ namespace libtorrent
 				prioritize_udp_trackers();
 		}
 
-		lazy_entry const* url_list = rd.dict_find_list("url-list");
-		if (url_list)
-		{
-			for (int i = 0; i < url_list->list_size(); ++i)
-			{
-				std::string url = url_list->list_string_value_at(i);
-				if (url.empty()) continue;
-				if (m_torrent_file->num_files() > 1 && url[url.size()-1] != '/') url += '/';
-				add_web_seed(url, web_seed_entry::url_seed);
-			}
-		}
-
-		lazy_entry const* httpseeds = rd.dict_find_list("httpseeds");
-		if (httpseeds)
+		// this goes last, since resuming a torrent whose loading is deferred
+		// loads it
+		if (!m_override_resume_data)
 		{
-			for (int i = 0; i < httpseeds->list_size(); ++i)
+			int paused_ = rd.dict_find_int_value("paused", -1);
+			if (paused_ != -1)
 			{
-				std::string url = httpseeds->list_string_value_at(i);
-				if (url.empty()) continue;
-				add_web_seed(url, web_seed_entry::http_seed);
-			}
-		}
+				set_allow_peers(!paused_);
+				m_announce_to_dht = !paused_;
+				m_announce_to_trackers = !paused_;
+				m_announce_to_lsd = !paused_;
 
-		if (m_torrent_file->is_merkle_torrent())
-		{
-			lazy_entry const* mt = rd.dict_find_string("merkle tree");
-			if (mt)
-			{
-				std::vector<sha1_hash> tree;
-				tree.resize(m_torrent_file->merkle_tree().size());
-				std::memcpy(&tree[0], mt->string_ptr()
-					, (std::min)(mt->string_length(), int(tree.size()) * 20));
-				if (mt->string_length() < int(tree.size()) * 20)
-					std::memset(&tree[0] + mt->string_length() / 20, 0
-						, tree.size() - mt->string_length() / 20);
-				m_torrent_file->set_merkle_tree(tree);
-			}
-			else
-			{
-				// TODO: 0 if this is a merkle torrent and we can't
-				// restore the tree, we need to wipe all the
-				// bits in the have array, but not necessarily
-				// we might want to do a full check to see if we have
-				// all the pieces. This is low priority since almost
-				// no one uses merkle torrents
-				TORRENT_ASSERT(false);
+				update_gauge();
+				update_want_peers();
+				update_want_scrape();
 			}
+			int dht_ = rd.dict_find_int_value("announce_to_dht", -1);
+			if (dht_ != -1) m_announce_to_dht = dht_;
+			int lsd_ = rd.dict_find_int_value("announce_to_lsd", -1);
+			if (lsd_ != -1) m_announce_to_lsd = lsd_;
+			int track_ = rd.dict_find_int_value("announce_to_trackers", -1);
+			if (track_ != -1) m_announce_to_trackers = track_;
 		}
-
-		// updating some of the torrent state may have set need_save_resume_data.
-		// clear it here since we've just restored the resume data we already
-		// have. Nothing has changed from that state yet.
-		m_need_save_resume_data = false;
 	}
 
 	boost::shared_ptr<const torrent_info> torrent::get_torrent_copy()
@@ -6728,62 +6865,87 @@ namespace libtorrent
 		return m_torrent_file;
 	}
 	
-	void torrent::write_resume_data(entry& ret) const
+	template <class Writer>
+	void torrent::write_resume_data_impl(Writer& w, entry const* storage_rd) const
 	{
 		using namespace libtorrent::detail; // for write_*_endpoint()
-		ret["file-format"] = "libtorrent resume file";
-		ret["file-version"] = 1;
-		ret["libtorrent-version"] = LIBTORRENT_VERSION;
+		w.begin_dict();
+
+		// the fields written by the storage. They must not collide with
+		// any of the fields written below
+		if (storage_rd && storage_rd->type() == entry::dictionary_t)
+		{
+			entry::dictionary_type const& d = storage_rd->dict();
+			for (entry::dictionary_type::const_iterator i = d.begin()
+				, end(d.end()); i != end; ++i)
+			{
+				w.key(i->first);
+				w.value(i->second);
+			}
+		}
 
-		ret["total_uploaded"] = m_total_uploaded;
-		ret["total_downloaded"] = m_total_downloaded;
+		w.string_item("file-format", "libtorrent resume file");
+		w.int_item("file-version", 1);
+		w.string_item("libtorrent-version", LIBTORRENT_VERSION);
 
-		ret["active_time"] = active_time();
-		ret["finished_time"] = finished_time();
-		ret["seeding_time"] = seeding_time();
-		ret["last_seen_complete"] = m_last_seen_complete;
+		w.int_item("total_uploaded", m_total_uploaded);
+		w.int_item("total_downloaded", m_total_downloaded);
 
-		ret["num_complete"] = m_complete;
-		ret["num_incomplete"] = m_incomplete;
-		ret["num_downloaded"] = m_downloaded;
+		w.int_item("active_time", active_time());
+		w.int_item("finished_time", finished_time());
+		w.int_item("seeding_time", seeding_time());
+		w.int_item("last_seen_complete", m_last_seen_complete);
 
-		ret["sequential_download"] = m_sequential_download;
+		w.int_item("num_complete", m_complete);
+		w.int_item("num_incomplete", m_incomplete);
+		w.int_item("num_downloaded", m_downloaded);
 
-		ret["seed_mode"] = m_seed_mode;
-		ret["super_seeding"] = m_super_seeding;
+		w.int_item("sequential_download", m_sequential_download);
 
-		ret["added_time"] = m_added_time;
-		ret["completed_time"] = m_completed_time;
+		w.int_item("seed_mode", m_seed_mode);
+		w.int_item("super_seeding", m_super_seeding);
 
-		ret["save_path"] = m_save_path;
+		w.int_item("added_time", m_added_time);
+		w.int_item("completed_time", m_completed_time);
 
-		if (!m_url.empty()) ret["url"] = m_url;
-		if (!m_uuid.empty()) ret["uuid"] = m_uuid;
-		if (!m_source_feed_url.empty()) ret["feed"] = m_source_feed_url;
+		w.string_item("save_path", m_save_path);
+
+		if (!m_url.empty()) w.string_item("url", m_url);
+		if (!m_uuid.empty()) w.string_item("uuid", m_uuid);
+		if (!m_source_feed_url.empty()) w.string_item("feed", m_source_feed_url);
 		
 		const sha1_hash& info_hash = torrent_file().info_hash();
-		ret["info-hash"] = std::string((char*)info_hash.begin(), (char*)info_hash.end());
+		w.string_item("info-hash", (char const*)info_hash.begin(), 20);
 
 		if (valid_metadata())
 		{
+			// the info dictionary is already bencoded, copy it verbatim
 			if (m_magnet_link || (m_save_resume_flags & torrent_handle::save_info_dict))
-				ret["info"] = bdecode(&torrent_file().metadata()[0]
-					, &torrent_file().metadata()[0] + torrent_file().metadata_size());
+			{
+				w.key("info");
+				w.raw(&torrent_file().metadata()[0], torrent_file().metadata_size());
+			}
+
+			// this is enough to add the torrent back without its metadata
+			// and load that on demand, through the session's load function
+			w.string_item("name", torrent_file().name());
+			w.int_item("piece_length", torrent_file().piece_length());
+			w.int_item("total_size", torrent_file().total_size());
 		}
 
 		// blocks per piece
 		int num_blocks_per_piece =
 			static_cast<int>(torrent_file().piece_length()) / block_size();
-		ret["blocks per piece"] = num_blocks_per_piece;
+		w.int_item("blocks per piece", num_blocks_per_piece);
 
 		if (m_torrent_file->is_merkle_torrent())
 		{
 			// we need to save the whole merkle hash tree
 			// in order to resume
-			std::string& tree_str = ret["merkle tree"].string();
 			std::vector<sha1_hash> const& tree = m_torrent_file->merkle_tree();
-			tree_str.resize(tree.size() * 20);
-			std::memcpy(&tree_str[0], &tree[0], tree.size() * 20);
+			w.key("merkle tree");
+			char* tree_str = w.alloc_string(tree.size() * 20);
+			if (!tree.empty()) std::memcpy(tree_str, &tree[0], tree.size() * 20);
 		}
 
 		// if this torrent is a seed, we won't have a piece picker
@@ -6795,8 +6957,8 @@ namespace libtorrent
 				= m_picker->get_download_queue();
 
 			// unfinished pieces
-			ret["unfinished"] = entry::list_type();
-			entry::list_type& up = ret["unfinished"].list();
+			w.key("unfinished");
+			w.begin_list();
 
 			// info for each unfinished piece
 			for (std::vector<piece_picker::downloading_piece>::const_iterator i
@@ -6804,15 +6966,13 @@ namespace libtorrent
 			{
 				if (i->finished == 0) continue;
 
-				entry piece_struct(entry::dictionary_t);
+				w.begin_dict();
 
-				// the unfinished piece's index
-				piece_struct["piece"] = i->index;
-
-				std::string bitmask;
 				const int num_bitmask_bytes
 					= (std::max)(num_blocks_per_piece / 8, 1);
 
+				w.key("bitmask");
+				char* bitmask = w.alloc_string(num_bitmask_bytes);
 				for (int j = 0; j < num_bitmask_bytes; ++j)
 				{
 					unsigned char v = 0;
@@ -6820,18 +6980,21 @@ namespace libtorrent
 					for (int k = 0; k < bits; ++k)
 						v |= (i->info[j*8+k].state == piece_picker::block_info::state_finished)
 						? (1 << k) : 0;
-					bitmask.append(1, v);
+					bitmask[j] = v;
 					TORRENT_ASSERT(bits == 8 || j == num_bitmask_bytes - 1);
 				}
-				piece_struct["bitmask"] = bitmask;
-				// push the struct onto the unfinished-piece list
-				up.push_back(piece_struct);
+
+				// the unfinished piece's index
+				w.int_item("piece", i->index);
+				w.end();
 			}
+			w.end();
 		}
 
-		// save trackers
-		entry::list_type& tr_list = ret["trackers"].list();
-		tr_list.push_back(entry::list_type());
+		// save trackers. One list per tier
+		w.key("trackers");
+		w.begin_list();
+		w.begin_list();
 		int tier = 0;
 		for (std::vector<announce_entry>::const_iterator i = m_trackers.begin()
 			, end(m_trackers.end()); i != end; ++i)
@@ -6840,31 +7003,39 @@ namespace libtorrent
 			// TODO: 1 save the send_stats state instead of throwing them away
 			// it may pose an issue when downgrading though
 			if (i->send_stats == false) continue;
-			if (i->tier == tier)
-			{
-				tr_list.back().list().push_back(i->url);
-			}
-			else
+			if (i->tier != tier)
 			{
-				tr_list.push_back(entry::list_t);
-				tr_list.back().list().push_back(i->url);
+				w.end();
+				w.begin_list();
 				tier = i->tier;
 			}
+			w.string(i->url);
 		}
+		w.end();
+		w.end();
 
 		// save web seeds
 		if (!m_web_seeds.empty())
 		{
-			entry::list_type& url_list = ret["url-list"].list();
-			entry::list_type& httpseed_list = ret["httpseeds"].list();
+			w.key("url-list");
+			w.begin_list();
 			for (std::list<web_seed_entry>::const_iterator i = m_web_seeds.begin()
 				, end(m_web_seeds.end()); i != end; ++i)
 			{
 				if (i->type == web_seed_entry::url_seed)
-					url_list.push_back(i->url);
-				else if (i->type == web_seed_entry::http_seed)
-					httpseed_list.push_back(i->url);
+					w.string(i->url);
 			}
+			w.end();
+
+			w.key("httpseeds");
+			w.begin_list();
+			for (std::list<web_seed_entry>::const_iterator i = m_web_seeds.begin()
+				, end(m_web_seeds.end()); i != end; ++i)
+			{
+				if (i->type == web_seed_entry::http_seed)
+					w.string(i->url);
+			}
+			w.end();
 		}
 
 		// write have bitmask
@@ -6873,23 +7044,24 @@ namespace libtorrent
 		// for the piece
 		// bit 0: set if we have the piece
 		// bit 1: set if we have verified the piece (in seed mode)
-		entry::string_type& pieces = ret["pieces"].string();
-		pieces.resize(m_torrent_file->num_pieces());
+		int const num_pieces = m_torrent_file->num_pieces();
+		w.key("pieces");
+		char* pieces = w.alloc_string(num_pieces);
 		if (!has_picker())
 		{
-			std::memset(&pieces[0], m_have_all, pieces.size());
+			std::memset(pieces, m_have_all, num_pieces);
 		}
 		else if (has_picker())
 		{
-			for (int i = 0, end(pieces.size()); i < end; ++i)
+			for (int i = 0; i < num_pieces; ++i)
 				pieces[i] = m_picker->have_piece(i) ? 1 : 0;
 		}
 
 		if (m_seed_mode)
 		{
-			TORRENT_ASSERT(m_verified.size() == pieces.size());
-			TORRENT_ASSERT(m_verifying.size() == pieces.size());
-			for (int i = 0, end(pieces.size()); i < end; ++i)
+			TORRENT_ASSERT(m_verified.size() == num_pieces);
+			TORRENT_ASSERT(m_verifying.size() == num_pieces);
+			for (int i = 0; i < num_pieces; ++i)
 				pieces[i] |= m_verified[i] ? 2 : 0;
 		}
 
@@ -6900,21 +7072,27 @@ namespace libtorrent
 		if (&m_torrent_file->files() != &m_torrent_file->orig_files()
 			&& m_torrent_file->files().num_files() == m_torrent_file->orig_files().num_files())
 		{
-			entry::list_type& fl = ret["mapped_files"].list();
+			w.key("mapped_files");
+			w.begin_list();
 			file_storage const& fs = m_torrent_file->files();
 			for (int i = 0; i < fs.num_files(); ++i)
 			{
-				fl.push_back(fs.file_path(i));
+				w.string(fs.file_path(i));
 			}
+			w.end();
 		}
 
 		// write local peers
 
-		std::back_insert_iterator<entry::string_type> peers(ret["peers"].string());
-		std::back_insert_iterator<entry::string_type> banned_peers(ret["banned_peers"].string());
+		std::string peers_str;
+		std::string banned_peers_str;
+		std::back_insert_iterator<std::string> peers(peers_str);
+		std::back_insert_iterator<std::string> banned_peers(banned_peers_str);
 #if TORRENT_USE_IPV6
-		std::back_insert_iterator<entry::string_type> peers6(ret["peers6"].string());
-		std::back_insert_iterator<entry::string_type> banned_peers6(ret["banned_peers6"].string());
+		std::string peers6_str;
+		std::string banned_peers6_str;
+		std::back_insert_iterator<std::string> peers6(peers6_str);
+		std::back_insert_iterator<std::string> banned_peers6(banned_peers6_str);
 #endif
 
 		int num_saved_peers = 0;
@@ -7012,22 +7190,29 @@ namespace libtorrent
 			}
 		}
 
-		ret["upload_rate_limit"] = upload_limit();
-		ret["download_rate_limit"] = download_limit();
-		ret["max_connections"] = max_connections();
-		ret["max_uploads"] = max_uploads();
-		ret["paused"] = is_torrent_paused();
-		ret["announce_to_dht"] = m_announce_to_dht;
-		ret["announce_to_trackers"] = m_announce_to_trackers;
-		ret["announce_to_lsd"] = m_announce_to_lsd;
-		ret["auto_managed"] = m_auto_managed;
+		w.string_item("peers", peers_str);
+		w.string_item("banned_peers", banned_peers_str);
+#if TORRENT_USE_IPV6
+		w.string_item("peers6", peers6_str);
+		w.string_item("banned_peers6", banned_peers6_str);
+#endif
+
+		w.int_item("upload_rate_limit", upload_limit());
+		w.int_item("download_rate_limit", download_limit());
+		w.int_item("max_connections", max_connections());
+		w.int_item("max_uploads", max_uploads());
+		w.int_item("paused", is_torrent_paused());
+		w.int_item("announce_to_dht", m_announce_to_dht);
+		w.int_item("announce_to_trackers", m_announce_to_trackers);
+		w.int_item("announce_to_lsd", m_announce_to_lsd);
+		w.int_item("auto_managed", m_auto_managed);
 
 		// write piece priorities
 		// but only if they are not set to the default
 		if (has_picker())
 		{
 			bool default_prio = true;
-			for (int i = 0, end(m_torrent_file->num_pieces()); i < end; ++i)
+			for (int i = 0; i < num_pieces; ++i)
 			{
 				if (m_picker->piece_priority(i) == 1) continue;
 				default_prio = false;
@@ -7036,19 +7221,84 @@ namespace libtorrent
 
 			if (!default_prio)
 			{
-				entry::string_type& piece_priority = ret["piece_priority"].string();
-				piece_priority.resize(m_torrent_file->num_pieces());
-
-				for (int i = 0, end(piece_priority.size()); i < end; ++i)
+				w.key("piece_priority");
+				char* piece_priority = w.alloc_string(num_pieces);
+				for (int i = 0; i < num_pieces; ++i)
 					piece_priority[i] = m_picker->piece_priority(i);
 			}
 		}
 
 		// write file priorities
-		entry::list_type& file_priority = ret["file_priority"].list();
-		file_priority.clear();
+		w.key("file_priority");
+		w.begin_list();
 		for (int i = 0, end(m_file_priority.size()); i < end; ++i)
-			file_priority.push_back(m_file_priority[i]);
+			w.integer(m_file_priority[i]);
+		w.end();
+
+		w.end();
+	}
+
+	void torrent::write_resume_settings(entry& rd) const
+	{
+		if (rd.type() != entry::dictionary_t) rd = entry(entry::dictionary_t);
+
+		rd["total_uploaded"] = m_total_uploaded;
+		rd["total_downloaded"] = m_total_downloaded;
+		rd["active_time"] = active_time();
+		rd["finished_time"] = finished_time();
+		rd["seeding_time"] = seeding_time();
+		rd["last_seen_complete"] = m_last_seen_complete;
+		rd["num_complete"] = m_complete;
+		rd["num_incomplete"] = m_incomplete;
+		rd["num_downloaded"] = m_downloaded;
+
+		rd["upload_rate_limit"] = upload_limit();
+		rd["download_rate_limit"] = download_limit();
+		rd["max_connections"] = max_connections();
+		rd["max_uploads"] = max_uploads();
+		rd["seed_mode"] = m_seed_mode;
+		rd["super_seeding"] = m_super_seeding;
+		rd["auto_managed"] = m_auto_managed;
+		rd["sequential_download"] = m_sequential_download;
+		rd["paused"] = is_torrent_paused();
+		rd["announce_to_dht"] = m_announce_to_dht;
+		rd["announce_to_trackers"] = m_announce_to_trackers;
+		rd["announce_to_lsd"] = m_announce_to_lsd;
+
+		rd["save_path"] = m_save_path;
+		rd["added_time"] = m_added_time;
+		rd["completed_time"] = m_completed_time;
+
+		rd["trackers"] = entry(entry::list_t);
+		entry::list_type& tr_list = rd["trackers"].list();
+		tr_list.push_back(entry::list_type());
+		int tier = 0;
+		for (std::vector<announce_entry>::const_iterator i = m_trackers.begin()
+			, end(m_trackers.end()); i != end; ++i)
+		{
+			if (i->send_stats == false) continue;
+			if (i->tier != tier)
+			{
+				tr_list.push_back(entry::list_type());
+				tier = i->tier;
+			}
+			tr_list.back().list().push_back(i->url);
+		}
+	}
+
+	void torrent::write_resume_data(entry& ret) const
+	{
+		// any fields already in ``ret`` (i.e. the ones written by the
+		// storage) are kept
+		entry storage_rd;
+		storage_rd.swap(ret);
+		entry_writer w(ret);
+		write_resume_data_impl(w, &storage_rd);
+	}
+
+	void torrent::write_resume_data(bencode_writer& w, entry const* storage_rd) const
+	{
+		write_resume_data_impl(w, storage_rd);
 	}
 
 	void torrent::get_full_peer_list(std::vector<peer_list_entry>& v) const
@@ -8033,6 +8283,9 @@ namespace libtorrent
 
 		// no need for this anymore
 		std::vector<boost::uint64_t>().swap(m_file_progress);
+
+		// nor for the piece hashes, unless we're asked to re-check the files
+		m_torrent_file->evict_piece_hashes();
 		if (!m_announcing) return;
 
 		ptime now = time_now();
@@ -8149,6 +8402,10 @@ namespace libtorrent
 				, end(m_trackers.end()); i != end; ++i)
 				i->complete_sent = true;
 
+			// checking the files may have read all the piece hashes, and a
+			// seed doesn't need them
+			m_torrent_file->evict_piece_hashes();
+
 			if (m_state != torrent_status::finished
 				&& m_state != torrent_status::seeding)
 				finished();
@@ -8907,7 +9164,11 @@ namespace libtorrent
 			return;
 		}
 
-		if (!m_storage.get())
+		// torrents that haven't been loaded yet don't have a storage
+		bool const deferred = m_deferred_init && m_resume_data
+			&& (flags & torrent_handle::save_info_dict) == 0;
+
+		if (!m_storage.get() && !deferred)
 		{
 			alerts().post_alert(save_resume_data_failed_alert(get_handle()
 				, errors::destructing_torrent));
@@ -8921,11 +9182,46 @@ namespace libtorrent
 			return;
 		}
 
+		bool const modified = m_need_save_resume_data;
 		m_need_save_resume_data = false;
 		m_last_saved_resume = m_ses.session_time();
 		m_save_resume_flags = boost::uint8_t(flags);
 		state_updated();
 
+		if (deferred)
+		{
+			// this torrent hasn't been loaded since it was added, so the
+			// pieces and files in the resume data it was added with are still
+			// current. Hand that back instead of loading the torrent just to
+			// generate it again. Settings changed in the meantime (like the
+			// rate limits or the paused state) are updated in it, and kept for
+			// the next time
+			if (modified)
+			{
+				entry rd = bdecode(m_resume_data->buf.begin(), m_resume_data->buf.end());
+				write_resume_settings(rd);
+				std::vector<char> buf;
+				bencode(std::back_inserter(buf), rd);
+				m_resume_data->buf.swap(buf);
+				error_code ec;
+				lazy_bdecode(&m_resume_data->buf[0], &m_resume_data->buf[0]
+					+ m_resume_data->buf.size(), m_resume_data->entry, ec);
+				TORRENT_ASSERT(!ec);
+			}
+
+			std::vector<char> buf = m_resume_data->buf;
+			if (flags & torrent_handle::save_bencoded)
+			{
+				alerts().post_alert(save_resume_data_alert(buf, get_handle()));
+			}
+			else
+			{
+				boost::shared_ptr<entry> rd(new entry(bdecode(buf.begin(), buf.end())));
+				alerts().post_alert(save_resume_data_alert(rd, get_handle()));
+			}
+			return;
+		}
+
 		TORRENT_ASSERT(m_storage);
 		if (m_state == torrent_status::checking_files
 			|| m_state == torrent_status::checking_resume_data)
@@ -8937,9 +9233,7 @@ namespace libtorrent
 				return;
 			}
 
-			boost::shared_ptr<entry> rd(new entry);
-			write_resume_data(*rd);
-			alerts().post_alert(save_resume_data_alert(rd, get_handle()));
+			post_resume_data(boost::shared_ptr<entry>(new entry));
 			return;
 		}
 
@@ -9260,6 +9554,10 @@ namespace libtorrent
 		TORRENT_ASSERT(is_single_thread());
 		if (is_paused()) return;
 
+		// a torrent added from its resume data alone is loaded (and its
+		// files checked) the first time it's started
+		if (m_deferred_init && !need_loaded()) return;
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		for (extension_list_t::iterator i = m_extensions.begin()
 			, end(m_extensions.end()); i != end; ++i)
@@ -9475,6 +9773,8 @@ namespace libtorrent
 		TORRENT_ASSERT(is_single_thread());
 		INVARIANT_CHECK;
 
+		cpu_sample sample(this, cpu_tick);
+
 		boost::weak_ptr<torrent> self(shared_from_this());
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
@@ -10786,6 +11086,10 @@ namespace libtorrent
 	{
 		picker().mark_as_checking(piece);
 
+		// the hash is needed once the disk thread is done hashing the piece.
+		// If it's not resident, it can be read in while that happens
+		m_torrent_file->prefetch_piece_hashes(piece, 1);
+
 		inc_refcount("verify_piece");
 		m_ses.disk_thread().async_hash(m_storage.get(), piece, 0
 			, boost::bind(&torrent::on_piece_verified, shared_from_this(), _1)
@@ -11172,6 +11476,14 @@ namespace libtorrent
 		// is building the status update alert
 		TORRENT_ASSERT(!m_ses.is_posting_torrent_updates());
 
+		// the next status snapshot needs to include this torrent
+		if (settings().get_int(settings_pack::status_snapshot_interval) > 0
+			&& !in_snapshot_update())
+		{
+			m_links[aux::session_interface::torrent_snapshot_updates].insert(
+				m_ses.torrent_list(aux::session_interface::torrent_snapshot_updates), this);
+		}
+
 		// we're not subscribing to this torrent, don't add it
 		if (!m_state_subscription) return;
 
@@ -11210,6 +11522,15 @@ namespace libtorrent
 		if (flags & torrent_handle::query_save_path)
 			st->save_path = save_path();
 
+		if (flags & torrent_handle::query_resource_usage)
+		{
+			st->tick_time = m_cpu_time[cpu_tick];
+			st->picker_time = m_cpu_time[cpu_picker];
+			st->peer_message_time = m_cpu_time[cpu_peer_messages];
+			piece_manager const* storage = m_storage.get();
+			m_ses.disk_thread().cached_blocks(&storage, &st->cached_blocks, 1);
+		}
+
 		if (flags & torrent_handle::query_torrent_file)
 			st->torrent_file = m_torrent_file;
 
@@ -11420,6 +11741,140 @@ namespace libtorrent
 		st->last_seen_complete = m_swarm_last_seen_complete;
 	}
 
+	boost::int64_t torrent::cpu_time_since_report()
+	{
+		boost::int64_t total = 0;
+		for (int i = 0; i < num_cpu_categories; ++i)
+			total += m_cpu_time[i];
+		boost::int64_t const ret = total - m_reported_cpu_time;
+		m_reported_cpu_time = total;
+		return ret;
+	}
+
+	void torrent::publish_status_snapshot(boost::uint32_t flags, int cached_blocks)
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		boost::shared_ptr<status_snapshot_entry> st(new status_snapshot_entry);
+		st->flags = flags;
+		// counting the cached blocks takes the cache mutex. The session has
+		// done that for all torrents at once
+		status(&st->status, flags & ~torrent_handle::query_resource_usage);
+		if (flags & torrent_handle::query_resource_usage)
+		{
+			st->status.tick_time = m_cpu_time[cpu_tick];
+			st->status.picker_time = m_cpu_time[cpu_picker];
+			st->status.peer_message_time = m_cpu_time[cpu_peer_messages];
+			st->status.cached_blocks = cached_blocks;
+		}
+		boost::atomic_store(&m_status_snapshot
+			, boost::shared_ptr<status_snapshot_entry const>(st));
+	}
+
+	void torrent::clear_status_snapshot()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		boost::atomic_store(&m_status_snapshot
+			, boost::shared_ptr<status_snapshot_entry const>());
+	}
+
+	bool torrent::status_delta(std::vector<char>& buf, boost::uint32_t fields)
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		boost::int64_t v[status_delta::num_fields];
+		std::fill(v, v + status_delta::num_fields, 0);
+
+		// the fields that need to be computed from the piece picker are
+		// only computed when asked for
+		boost::uint32_t const progress_fields
+			= status_delta_mask(status_delta::progress_ppm)
+			| status_delta_mask(status_delta::total_done)
+			| status_delta_mask(status_delta::total_wanted_done)
+			| status_delta_mask(status_delta::total_wanted);
+		if (fields & progress_fields)
+		{
+			size_type done;
+			size_type wanted_done;
+			size_type wanted;
+			bytes_done(done, wanted_done, wanted);
+			v[status_delta::total_done] = done;
+			v[status_delta::total_wanted_done] = wanted_done;
+			v[status_delta::total_wanted] = wanted;
+			if (!valid_metadata() || m_state == torrent_status::checking_files)
+				v[status_delta::progress_ppm] = m_progress_ppm;
+			else if (wanted == 0)
+				v[status_delta::progress_ppm] = 1000000;
+			else
+				v[status_delta::progress_ppm] = wanted_done * 1000000 / wanted;
+		}
+
+		if (fields & status_delta_mask(status_delta::flags))
+		{
+			int f = 0;
+			if (is_torrent_paused()) f |= status_delta::paused;
+			if (m_auto_managed) f |= status_delta::auto_managed;
+			if (is_seed()) f |= status_delta::is_seeding;
+			if (is_finished()) f |= status_delta::is_finished;
+			if (valid_metadata()) f |= status_delta::has_metadata;
+			if (m_upload_mode) f |= status_delta::upload_mode;
+			if (m_share_mode) f |= status_delta::share_mode;
+			if (m_super_seeding) f |= status_delta::super_seeding;
+			if (m_sequential_download) f |= status_delta::sequential_download;
+			if (m_error) f |= status_delta::has_error;
+			if (need_save_resume_data()) f |= status_delta::need_save_resume;
+			if (m_moving_storage) f |= status_delta::moving_storage;
+			if (is_loaded()) f |= status_delta::is_loaded;
+			v[status_delta::flags] = f;
+		}
+
+		v[status_delta::state] = valid_metadata()
+			? int(m_state) : int(torrent_status::downloading_metadata);
+		v[status_delta::total_download] = m_stat.total_payload_download()
+			+ m_stat.total_protocol_download();
+		v[status_delta::total_upload] = m_stat.total_payload_upload()
+			+ m_stat.total_protocol_upload();
+		v[status_delta::total_payload_download] = m_stat.total_payload_download();
+		v[status_delta::total_payload_upload] = m_stat.total_payload_upload();
+		v[status_delta::all_time_download] = m_total_downloaded;
+		v[status_delta::all_time_upload] = m_total_uploaded;
+		v[status_delta::download_rate] = m_stat.download_rate();
+		v[status_delta::upload_rate] = m_stat.upload_rate();
+		v[status_delta::download_payload_rate] = m_stat.download_payload_rate();
+		v[status_delta::upload_payload_rate] = m_stat.upload_payload_rate();
+		v[status_delta::num_peers] = int(m_connections.size()) - m_num_connecting;
+		v[status_delta::num_seeds] = num_seeds();
+		v[status_delta::num_complete] = (m_complete == 0xffffff) ? -1 : m_complete;
+		v[status_delta::num_incomplete] = (m_incomplete == 0xffffff) ? -1 : m_incomplete;
+		v[status_delta::num_connections] = int(m_connections.size());
+		v[status_delta::num_uploads] = m_num_uploads;
+		v[status_delta::list_peers] = m_peer_list ? m_peer_list->num_peers() : 0;
+		v[status_delta::list_seeds] = m_peer_list ? m_peer_list->num_seeds() : 0;
+		v[status_delta::queue_position] = queue_position();
+		v[status_delta::num_pieces] = valid_metadata() ? num_have() : 0;
+		v[status_delta::active_time] = active_time();
+		v[status_delta::finished_time] = finished_time();
+		v[status_delta::seeding_time] = seeding_time();
+
+		// the first time, or if the subscription changed, we don't know what
+		// the client has for the newly subscribed fields, so they are all
+		// included
+		if (m_delta_values.empty())
+			m_delta_values.resize(status_delta::num_fields, 0);
+		boost::uint32_t changed = fields & ~m_delta_fields;
+		for (int i = 0; i < status_delta::num_fields; ++i)
+		{
+			if ((fields & status_delta_mask(i)) == 0) continue;
+			if (m_delta_values[i] != v[i]) changed |= status_delta_mask(i);
+			m_delta_values[i] = v[i];
+		}
+		m_delta_fields = fields;
+
+		if (changed == 0) return false;
+		append_status_delta(buf, info_hash(), changed, v);
+		return true;
+	}
+
 	void torrent::add_redundant_bytes(int b, torrent::wasted_reason_t reason)
 	{
 		TORRENT_ASSERT(is_single_thread());
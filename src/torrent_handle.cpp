@@ -87,6 +87,10 @@ namespace libtorrent
 		, total_wanted(0)
 		, all_time_upload(0)
 		, all_time_download(0)
+		, tick_time(0)
+		, picker_time(0)
+		, peer_message_time(0)
+		, cached_blocks(0)
 		, added_time(0)
 		, completed_time(0)
 		, last_seen_complete(0)
@@ -207,6 +211,22 @@ namespace libtorrent
 	type r = def; \
 	if (t) aux::sync_call_ret_handle(t, r, boost::function<type(void)>(boost::bind(&torrent:: x, t, a1, a2)));
 
+	namespace
+	{
+		// returns the torrent's status snapshot, if it has one with all of
+		// ``flags``
+		boost::shared_ptr<status_snapshot_entry const> status_snapshot(
+			boost::weak_ptr<torrent> const& t, boost::uint32_t flags)
+		{
+			boost::shared_ptr<torrent> tp = t.lock();
+			if (!tp) return boost::shared_ptr<status_snapshot_entry const>();
+			boost::shared_ptr<status_snapshot_entry const> ret = tp->status_snapshot();
+			if (ret && !status_snapshot_covers(*ret, flags))
+				return boost::shared_ptr<status_snapshot_entry const>();
+			return ret;
+		}
+	}
+
 #ifndef BOOST_NO_EXCEPTIONS
 	void throw_invalid_handle()
 	{
@@ -436,6 +456,13 @@ namespace libtorrent
 
 	torrent_status torrent_handle::status(boost::uint32_t flags) const
 	{
+		// if the network thread publishes status snapshots with the fields
+		// we're asking for, don't wait for it. See
+		// settings_pack::status_snapshot_interval
+		boost::shared_ptr<status_snapshot_entry const> snapshot
+			= status_snapshot(m_torrent, flags);
+		if (snapshot) return snapshot->status;
+
 		torrent_status st;
 		TORRENT_SYNC_CALL2(status, &st, flags);
 		return st;
@@ -732,6 +759,10 @@ namespace libtorrent
 
 	std::string torrent_handle::name() const
 	{
+		boost::shared_ptr<status_snapshot_entry const> snapshot
+			= status_snapshot(m_torrent, query_name);
+		if (snapshot) return snapshot->status.name;
+
 		TORRENT_SYNC_CALL_RET(std::string, "", name);
 		return r;
 	}
@@ -53,6 +53,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/session_settings.hpp"
 #include "libtorrent/add_torrent_params.hpp"
 #include "libtorrent/magnet_uri.hpp"
+#include "libtorrent/allocator.hpp" // for page_size
 
 #ifdef _MSC_VER
 #pragma warning(push, 1)
@@ -74,6 +75,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/parse_url.hpp"
 #endif
 
+#if TORRENT_HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 namespace libtorrent
 {
 	
@@ -508,17 +513,15 @@ namespace libtorrent
 				, &file_hash, &fee, &mtime))
 				return false;
 
-			target.add_file(e, file_hash ? file_hash->string_ptr() + info_ptr_diff : 0);
-
 			// This is a memory optimization! Instead of having
 			// each entry keep a string for its filename, make it
 			// simply point into the info-section buffer
-			int last_index = target.num_files() - 1;
 
 			// this string pointer does not necessarily point into
 			// the m_info_section buffer.
 			char const* str_ptr = fee->string_ptr() + info_ptr_diff;
-			target.rename_file_borrow(last_index, str_ptr, fee->string_length());
+			target.add_file_borrow(str_ptr, fee->string_length(), e
+				, file_hash ? file_hash->string_ptr() + info_ptr_diff : 0);
 		}
 		return true;
 	}
@@ -691,6 +694,7 @@ namespace libtorrent
 		, m_multifile(t.m_multifile)
 		, m_private(t.m_private)
 		, m_i2p(t.m_i2p)
+		, m_mapped_info_section(false)
 	{
 #if TORRENT_USE_INVARIANT_CHECKS
 		t.check_invariant();
@@ -729,14 +733,11 @@ namespace libtorrent
 #else
 		std::set<std::string, string_less_no_case> files;
 #endif
-		std::vector<std::string> const& paths = m_files.paths();
-
 		// insert all directories first, to make sure no files
 		// are allowed to collied with them
-		for (std::vector<std::string>::const_iterator i = paths.begin()
-			, end(paths.end()); i != end; ++i)
+		for (int i = 0; i < m_files.num_paths(); ++i)
 		{
-			files.insert(combine_path(m_files.name(), *i));
+			files.insert(combine_path(m_files.name(), m_files.path(i)));
 		}
 
 		for (int i = 0; i < m_files.num_files(); ++i)
@@ -778,6 +779,7 @@ namespace libtorrent
 		m_files = f;
 		m_files.set_num_pieces(m_orig_files->num_pieces());
 		m_files.set_piece_length(m_orig_files->piece_length());
+		m_files.build_piece_index();
 	}
 
 #ifndef TORRENT_NO_DEPRECATE
@@ -790,6 +792,7 @@ namespace libtorrent
 		, m_multifile(false)
 		, m_private(false)
 		, m_i2p(false)
+		, m_mapped_info_section(false)
 	{
 		std::vector<char> tmp;
 		std::back_insert_iterator<std::vector<char> > out(tmp);
@@ -823,6 +826,7 @@ namespace libtorrent
 		, m_multifile(false)
 		, m_private(false)
 		, m_i2p(false)
+		, m_mapped_info_section(false)
 	{
 		error_code ec;
 		if (!parse_torrent_file(torrent_file, ec, flags))
@@ -839,6 +843,7 @@ namespace libtorrent
 		, m_multifile(false)
 		, m_private(false)
 		, m_i2p(false)
+		, m_mapped_info_section(false)
 	{
 		error_code ec;
 		lazy_entry e;
@@ -859,6 +864,7 @@ namespace libtorrent
 		, m_multifile(false)
 		, m_private(false)
 		, m_i2p(false)
+		, m_mapped_info_section(false)
 	{
 		std::vector<char> buf;
 		error_code ec;
@@ -885,6 +891,7 @@ namespace libtorrent
 		, m_multifile(false)
 		, m_private(false)
 		, m_i2p(false)
+		, m_mapped_info_section(false)
 	{
 		std::vector<char> buf;
 		std::string utf8;
@@ -921,6 +928,7 @@ namespace libtorrent
 		, m_multifile(false)
 		, m_private(false)
 		, m_i2p(false)
+		, m_mapped_info_section(false)
 	{
 		parse_torrent_file(torrent_file, ec, flags);
 
@@ -935,6 +943,7 @@ namespace libtorrent
 		, m_multifile(false)
 		, m_private(false)
 		, m_i2p(false)
+		, m_mapped_info_section(false)
 	{
 		lazy_entry e;
 		if (lazy_bdecode(buffer, buffer + size, e, ec) != 0)
@@ -944,6 +953,38 @@ namespace libtorrent
 		INVARIANT_CHECK;
 	}
 
+	torrent_info::torrent_info(boost::shared_array<char> info_section, int size
+		, error_code& ec, int flags)
+		: m_piece_hashes(0)
+		, m_creation_date(0)
+		, m_merkle_first_leaf(0)
+		, m_info_section_size(0)
+		, m_multifile(false)
+		, m_private(false)
+		, m_i2p(false)
+		, m_mapped_info_section(false)
+	{
+		lazy_entry e;
+		if (lazy_bdecode(info_section.get(), info_section.get() + size, e, ec) != 0)
+			return;
+
+		// parse_info_section() uses this buffer as is, rather than copying
+		// the info section out of it
+		m_info_section = info_section;
+		if (!parse_info_section(e, ec, flags))
+		{
+			m_info_section.reset();
+			m_info_section_size = 0;
+			m_piece_hashes = 0;
+			return;
+		}
+#if TORRENT_HAVE_MMAP
+		m_mapped_info_section = (flags & mapped_info_section) != 0;
+#endif
+
+		INVARIANT_CHECK;
+	}
+
 	torrent_info::torrent_info(std::string const& filename, error_code& ec, int flags)
 		: m_piece_hashes(0)
 		, m_creation_date(0)
@@ -952,6 +993,7 @@ namespace libtorrent
 		, m_multifile(false)
 		, m_private(false)
 		, m_i2p(false)
+		, m_mapped_info_section(false)
 	{
 		std::vector<char> buf;
 		int ret = load_file(filename, buf, ec);
@@ -975,6 +1017,7 @@ namespace libtorrent
 		, m_multifile(false)
 		, m_private(false)
 		, m_i2p(false)
+		, m_mapped_info_section(false)
 	{
 		std::vector<char> buf;
 		std::string utf8;
@@ -1005,6 +1048,7 @@ namespace libtorrent
 		, m_multifile(false)
 		, m_private(false)
 		, m_i2p(false)
+		, m_mapped_info_section(false)
 	{}
 
 	torrent_info::~torrent_info()
@@ -1026,6 +1070,7 @@ namespace libtorrent
 
 		m_info_section.reset();
 		m_info_section_size = 0;
+		m_mapped_info_section = false;
 
 		// if we have orig_files, we have to keep
 		// m_files around, since it means we have
@@ -1041,6 +1086,60 @@ namespace libtorrent
 		TORRENT_ASSERT(!is_loaded());
 	}
 
+	void torrent_info::set_unloaded_metadata(std::string const& name
+		, int piece_length, size_type total_size)
+	{
+		TORRENT_ASSERT(!is_valid());
+		TORRENT_ASSERT(piece_length > 0);
+		TORRENT_ASSERT(total_size > 0);
+
+		m_files.set_name(name);
+		m_files.set_piece_length(piece_length);
+		m_files.m_total_size = total_size;
+		m_files.set_num_pieces(int((total_size + piece_length - 1) / piece_length));
+
+		TORRENT_ASSERT(is_valid());
+		TORRENT_ASSERT(!is_loaded());
+	}
+
+	void torrent_info::prefetch_piece_hashes(int piece, int num) const
+	{
+#if TORRENT_HAVE_MMAP
+		if (!m_mapped_info_section || m_piece_hashes == 0) return;
+		TORRENT_ASSERT(piece >= 0);
+		TORRENT_ASSERT(num > 0);
+		if (piece + num > m_files.num_pieces()) num = m_files.num_pieces() - piece;
+		if (num <= 0) return;
+
+		// madvise() only accepts page aligned addresses. The mapping starts
+		// at a page boundary, so rounding down stays within it
+		uintptr_t const page_mask = page_size() - 1;
+		uintptr_t const start = uintptr_t(m_piece_hashes + piece * 20);
+		uintptr_t const end = start + num * 20;
+		uintptr_t const aligned = start & ~page_mask;
+		madvise(reinterpret_cast<void*>(aligned), end - aligned, MADV_WILLNEED);
+#endif
+	}
+
+	void torrent_info::evict_piece_hashes() const
+	{
+#if TORRENT_HAVE_MMAP
+		if (!m_mapped_info_section || m_piece_hashes == 0) return;
+
+		// only whole pages are dropped. The file names and other fields
+		// sharing the first and last page with the hashes stay. Since the
+		// mapping is of an unmodified file, dropping the pages only means
+		// they'll be read from the file again the next time they're used
+		uintptr_t const page_mask = page_size() - 1;
+		uintptr_t const start = (uintptr_t(m_piece_hashes) + page_mask)
+			& ~page_mask;
+		uintptr_t const end = uintptr_t(m_piece_hashes
+			+ m_files.num_pieces() * 20) & ~page_mask;
+		if (end <= start) return;
+		madvise(reinterpret_cast<void*>(start), end - start, MADV_DONTNEED);
+#endif
+	}
+
 	void torrent_info::copy_on_write()
 	{
 		TORRENT_ASSERT(is_loaded());
@@ -1073,6 +1172,7 @@ namespace libtorrent
 		SWAP(m_multifile, ti.m_multifile);
 		SWAP(m_private, ti.m_private);
 		SWAP(m_i2p, ti.m_i2p);
+		SWAP(m_mapped_info_section, ti.m_mapped_info_section);
 		swap(m_info_section, ti.m_info_section);
 		SWAP(m_info_section_size, ti.m_info_section_size);
 		swap(m_piece_hashes, ti.m_piece_hashes);
@@ -1111,10 +1211,14 @@ namespace libtorrent
 		h.update(section.first, section.second);
 		m_info_hash = h.final();
 
-		// copy the info section
+		// copy the info section, unless it's already in a buffer we hold a
+		// reference to
 		m_info_section_size = section.second;
-		m_info_section.reset(new char[m_info_section_size]);
-		std::memcpy(m_info_section.get(), section.first, m_info_section_size);
+		if (section.first != m_info_section.get())
+		{
+			m_info_section.reset(new char[m_info_section_size]);
+			std::memcpy(m_info_section.get(), section.first, m_info_section_size);
+		}
 		TORRENT_ASSERT(section.first[0] == 'd');
 		TORRENT_ASSERT(section.first[m_info_section_size-1] == 'e');
 
@@ -1218,6 +1322,7 @@ namespace libtorrent
 
 		files.set_num_pieces(int((files.total_size() + files.piece_length() - 1)
 			/ files.piece_length()));
+		files.build_piece_index();
 
 		lazy_entry const* pieces = info.dict_find_string("pieces");
 		lazy_entry const* root_hash = info.dict_find_string("root hash");
@@ -1636,9 +1741,12 @@ namespace libtorrent
 			TORRENT_ASSERT(m_files.file_name_ptr(i) != 0);
 			if (m_files.file_name_len(i) != -1)
 			{
-				// name needs to point into the allocated info section buffer
-				TORRENT_ASSERT(m_files.file_name_ptr(i) >= m_info_section.get());
-				TORRENT_ASSERT(m_files.file_name_ptr(i) < m_info_section.get() + m_info_section_size);
+				// name needs to point into the allocated info section buffer,
+				// unless the file has been renamed, or this torrent_info was
+				// copied. Then the name is in the file_storage's name pool
+				TORRENT_ASSERT((m_files.file_name_ptr(i) >= m_info_section.get()
+					&& m_files.file_name_ptr(i) < m_info_section.get() + m_info_section_size)
+					|| m_files.in_name_pool(m_files.file_name_ptr(i)));
 			}
 			else
 			{
@@ -59,6 +59,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/random.hpp"
 #include "libtorrent/io.hpp"
 #include "libtorrent/performance_counters.hpp" // for counters
+#include "libtorrent/metadata_block_picker.hpp"
 
 namespace libtorrent { namespace
 {
@@ -72,6 +73,12 @@ namespace libtorrent { namespace
 		// 160 kiB/s
 		send_buffer_limit = 0x4000 * 10,
 
+		// the number of metadata requests we keep outstanding to a peer
+		// that has not yet answered any of them. Once a peer has proven
+		// to be responsive, we keep more requests outstanding to it
+		initial_request_queue = 2,
+		max_request_queue = 4,
+
 		// this is the max number of requests we'll queue
 		// up. If we get more requests tha this, we'll
 		// start rejecting them, claiming we don't have
@@ -149,9 +156,19 @@ namespace libtorrent { namespace
 			, char const* buf, int size, int piece, int total_size);
 
 		// returns a piece of the metadata that
-		// we should request.
+		// we should request from the specified peer.
 		// returns -1 if we should hold off the request
-		int metadata_request(bool has_metadata);
+		int metadata_request(ut_metadata_peer_plugin& peer);
+
+		// called when a peer rejects our request for a block, or when
+		// the request times out. If the peer was the one we were waiting
+		// for, the block is made available to other peers right away
+		void cancel_request(ut_metadata_peer_plugin& peer, int piece);
+
+		// lets every peer fill up its request queue. This is called
+		// whenever more blocks may have become available to request,
+		// so that idle peers don't have to wait for their next tick
+		void request_more();
 
 		// this is called from the peer_connection for
 		// each piece of metadata it receives
@@ -175,10 +192,11 @@ namespace libtorrent { namespace
 			if (m_metadata_size > 0 || size <= 0 || size > 4 * 1024 * 1024) return;
 			m_metadata_size = size;
 			m_metadata.reset(new char[size]);
-			m_requested_metadata.resize(div_round_up(size, 16 * 1024));
+			m_picker.resize(div_round_up(size, 16 * 1024));
 		}
 
 	private:
+
 		torrent& m_torrent;
 
 		// this buffer is filled with the info-section of
@@ -190,20 +208,14 @@ namespace libtorrent { namespace
 		int m_metadata_progress;
 		mutable int m_metadata_size;
 
-		struct metadata_piece
-		{
-			metadata_piece(): num_requests(0), last_request(min_time()) {}
-			int num_requests;
-			ptime last_request;
-			boost::weak_ptr<ut_metadata_peer_plugin> source;
-			bool operator<(metadata_piece const& rhs) const
-			{ return num_requests < rhs.num_requests; }
-		};
+		// keeps track of which metadata blocks we have, and which
+		// peers the others have been requested from
+		metadata_block_picker m_picker;
 
-		// this vector keeps track of how many times each meatdata
-		// block has been requested and who we ended up getting it from
-		// std::numeric_limits<int>::max() means we have the piece
-		std::vector<metadata_piece> m_requested_metadata;
+		// the peers that may serve us metadata. Used to wake up idle
+		// peers when blocks become available to request. Cleared once
+		// we have the metadata
+		std::vector<boost::weak_ptr<ut_metadata_peer_plugin> > m_peers;
 	};
 
 
@@ -215,6 +227,7 @@ namespace libtorrent { namespace
 			, ut_metadata_plugin& tp)
 			: m_message_index(0)
 			, m_request_limit(min_time())
+			, m_rtt(-1)
 			, m_torrent(t)
 			, m_pc(pc)
 			, m_tp(tp)
@@ -249,7 +262,10 @@ namespace libtorrent { namespace
 			else
 				m_pc.set_has_metadata(false);
 
-			maybe_send_request();
+			// if this peer told us the size of the metadata, there may
+			// be more blocks to request for other peers too
+			if (metadata_size > 0) m_tp.request_more();
+			else maybe_send_request();
 			return true;
 		}
 
@@ -387,8 +403,7 @@ namespace libtorrent { namespace
 				break;
 			case 1: // data
 				{
-					std::vector<int>::iterator i = std::find(m_sent_requests.begin()
-						, m_sent_requests.end(), piece);
+					std::vector<sent_request>::iterator i = find_request(piece);
 
 					// unwanted piece?
 					if (i == m_sent_requests.end())
@@ -399,21 +414,31 @@ namespace libtorrent { namespace
 						return true;
 					}
 
+					// update the round-trip time estimate of this peer. It
+					// determines how long we wait for it before giving its
+					// blocks to other peers
+					int rtt = int(total_milliseconds(time_now() - i->sent));
+					m_rtt = m_rtt < 0 ? rtt : (m_rtt * 3 + rtt) / 4;
+
 					m_sent_requests.erase(i);
 					entry const* total_size = msg.find_key("total_size");
 					m_tp.received_metadata(*this, body.begin + len, body.left() - len, piece
 						, (total_size && total_size->type() == entry::int_t) ? total_size->integer() : 0);
-					maybe_send_request();
+
+					// the first block tells us the size of the metadata,
+					// which may let other peers request blocks as well
+					m_tp.request_more();
 				}
 				break;
 			case 2: // have no data
 				{
 					m_request_limit = (std::max)(time_now() + minutes(1), m_request_limit);
-					std::vector<int>::iterator i = std::find(m_sent_requests.begin()
-						, m_sent_requests.end(), piece);
+					std::vector<sent_request>::iterator i = find_request(piece);
 					// unwanted piece?
 					if (i == m_sent_requests.end()) return true;
 					m_sent_requests.erase(i);
+					m_tp.cancel_request(*this, piece);
+					m_tp.request_more();
 				}
 				break;
 			default:
@@ -428,7 +453,29 @@ namespace libtorrent { namespace
 
 		virtual void tick()
 		{
-			maybe_send_request();
+			// requests this peer hasn't answered in a long time are given
+			// up on. This frees up its request queue, and any late
+			// response is ignored. It also counts as a very slow response
+			// so we don't prefer this peer for tail blocks
+			ptime now = time_now();
+			time_duration limit = request_timeout() * 4;
+			bool cancelled = false;
+			for (int i = 0; i < int(m_sent_requests.size());)
+			{
+				time_duration age = now - m_sent_requests[i].sent;
+				if (age < limit) { ++i; continue; }
+				int piece = m_sent_requests[i].piece;
+				m_sent_requests.erase(m_sent_requests.begin() + i);
+				m_rtt = (std::max)(m_rtt, int(total_milliseconds(age)));
+#ifdef TORRENT_VERBOSE_LOGGING
+				m_pc.peer_log("*** UT_METADATA [ request timed out | piece: %d ]", piece);
+#endif
+				m_tp.cancel_request(*this, piece);
+				cancelled = true;
+			}
+
+			if (cancelled) m_tp.request_more();
+			else maybe_send_request();
 			while (!m_incoming_requests.empty()
 				&& m_pc.send_buffer_size() < send_buffer_limit)
 			{
@@ -438,25 +485,72 @@ namespace libtorrent { namespace
 			}
 		}
 
+		// fills this peer's request queue
 		void maybe_send_request()
 		{
-			if (m_pc.is_disconnecting()) return;
+			while (send_request());
+		}
 
-			// if we don't have any metadata, and this peer
-			// supports the request metadata extension
-			// and we aren't currently waiting for a request
-			// reply. Then, send a request for some metadata.
-			if (!m_torrent.valid_metadata()
-				&& m_message_index != 0
-				&& m_sent_requests.size() < 2
-				&& has_metadata())
-			{
-				int piece = m_tp.metadata_request(m_pc.has_metadata());
-				if (piece == -1) return;
+		// sends one request for metadata, if we don't have the metadata,
+		// this peer supports the request metadata extension and its request
+		// queue isn't full. Returns true if a request was sent
+		bool send_request()
+		{
+			if (m_pc.is_disconnecting()) return false;
 
-				m_sent_requests.push_back(piece);
-				write_metadata_packet(0, piece);
-			}
+			if (m_torrent.valid_metadata()
+				|| m_message_index == 0
+				|| !has_metadata()
+				|| int(m_sent_requests.size()) >= request_queue_size())
+				return false;
+
+			int piece = m_tp.metadata_request(*this);
+			if (piece == -1) return false;
+
+			sent_request r;
+			r.piece = piece;
+			r.sent = time_now();
+			m_sent_requests.push_back(r);
+			write_metadata_packet(0, piece);
+			return true;
+		}
+
+		int num_requests() const { return int(m_sent_requests.size()); }
+		int rtt() const { return m_rtt; }
+
+		void requested_pieces(std::vector<int>& ret) const
+		{
+			ret.clear();
+			for (std::vector<sent_request>::const_iterator i = m_sent_requests.begin()
+				, end(m_sent_requests.end()); i != end; ++i)
+				ret.push_back(i->piece);
+		}
+
+		// the number of requests we keep outstanding to this peer
+		int request_queue_size() const
+		{
+			if (m_rtt < 0) return initial_request_queue;
+			// a peer that took more than a few seconds to respond
+			// only gets one request at a time
+			if (m_rtt > 3000) return 1;
+			return max_request_queue;
+		}
+
+		// the time we wait for this peer to respond to a request before
+		// the block may be requested from other peers. Until we know the
+		// round-trip time of the peer, we allow 3 seconds
+		time_duration request_timeout() const
+		{
+			if (m_rtt < 0) return seconds(3);
+			return milliseconds((std::min)((std::max)(m_rtt * 3, 500), 10000));
+		}
+
+		bool has_requested(int piece) const
+		{
+			for (std::vector<sent_request>::const_iterator i = m_sent_requests.begin()
+				, end(m_sent_requests.end()); i != end; ++i)
+				if (i->piece == piece) return true;
+			return false;
 		}
 
 		bool has_metadata() const
@@ -471,6 +565,20 @@ namespace libtorrent { namespace
 
 	private:
 
+		struct sent_request
+		{
+			int piece;
+			ptime sent;
+		};
+
+		std::vector<sent_request>::iterator find_request(int piece)
+		{
+			std::vector<sent_request>::iterator i = m_sent_requests.begin();
+			for (; i != m_sent_requests.end(); ++i)
+				if (i->piece == piece) break;
+			return i;
+		}
+
 		// this is the message index the remote peer uses
 		// for metadata extension messages.
 		int m_message_index;
@@ -481,8 +589,12 @@ namespace libtorrent { namespace
 		// we receive metadata that fails the infohash check
 		ptime m_request_limit;
 
+		// the smoothed round-trip time of metadata requests to
+		// this peer, in milliseconds. -1 means unknown
+		int m_rtt;
+
 		// request queues
-		std::vector<int> m_sent_requests;
+		std::vector<sent_request> m_sent_requests;
 		std::vector<int> m_incoming_requests;
 		
 		torrent& m_torrent;
@@ -497,42 +609,82 @@ namespace libtorrent { namespace
 			return boost::shared_ptr<peer_plugin>();
 
 		bt_peer_connection* c = static_cast<bt_peer_connection*>(pc);
-		return boost::shared_ptr<peer_plugin>(new ut_metadata_peer_plugin(m_torrent, *c, *this));
+		boost::shared_ptr<ut_metadata_peer_plugin> ret(
+			new ut_metadata_peer_plugin(m_torrent, *c, *this));
+
+		if (!m_torrent.valid_metadata())
+		{
+			// forget about peers that have disconnected
+			m_peers.erase(std::remove_if(m_peers.begin(), m_peers.end()
+				, boost::bind(&boost::weak_ptr<ut_metadata_peer_plugin>::expired, _1))
+				, m_peers.end());
+			m_peers.push_back(ret);
+		}
+		return ret;
 	}
 
-	// has_metadata is false if the peer making the request has not announced
-	// that it has metadata. In this case, it shouldn't prevent other peers
-	// from requesting this block by setting a timeout on it.
-	int ut_metadata_plugin::metadata_request(bool has_metadata)
+	// blocks are spread across all peers that have metadata, rather than
+	// requesting them from whichever peer asks first. The wait for a peer
+	// to respond is based on its round-trip time, so that the blocks of
+	// an unresponsive peer are handed to other peers quickly.
+	int ut_metadata_plugin::metadata_request(ut_metadata_peer_plugin& peer)
 	{
-		std::vector<metadata_piece>::iterator i = std::min_element(
-			m_requested_metadata.begin(), m_requested_metadata.end());
-
-		if (m_requested_metadata.empty())
+		if (m_picker.num_blocks() == 0)
 		{
 			// if we don't know how many pieces there are
 			// just ask for piece 0
-			m_requested_metadata.resize(1);
-			i = m_requested_metadata.begin();
+			m_picker.resize(1);
 		}
 
-		int piece = i - m_requested_metadata.begin();
+		metadata_block_picker::peer_state st;
+		st.peer = peer.shared_from_this();
+		peer.requested_pieces(st.requested);
+		st.reserve = peer.m_pc.has_metadata();
+		st.timeout = peer.request_timeout();
+		st.rtt = peer.m_rtt;
+		return m_picker.pick(st, time_now());
+	}
 
-		// don't request the same block more than once every 3 seconds
-		ptime now = time_now();
-		if (m_requested_metadata[piece].last_request != min_time()
-			&& total_seconds(now - m_requested_metadata[piece].last_request) < 3)
-			return -1;
+	void ut_metadata_plugin::cancel_request(ut_metadata_peer_plugin& peer
+		, int piece)
+	{
+		m_picker.cancel(&peer, piece);
+	}
 
-		++m_requested_metadata[piece].num_requests;
+	// peers with fewer outstanding requests, and then with shorter
+	// round-trip times, get to pick blocks first. Peers whose round-trip
+	// time isn't known yet go last
+	bool pick_order(boost::shared_ptr<ut_metadata_peer_plugin> const& lhs
+		, boost::shared_ptr<ut_metadata_peer_plugin> const& rhs)
+	{
+		if (lhs->num_requests() != rhs->num_requests())
+			return lhs->num_requests() < rhs->num_requests();
+		int const lrtt = lhs->rtt() < 0 ? (std::numeric_limits<int>::max)() : lhs->rtt();
+		int const rrtt = rhs->rtt() < 0 ? (std::numeric_limits<int>::max)() : rhs->rtt();
+		return lrtt < rrtt;
+	}
 
-		// only set the timeout on this block, only if the peer
-		// has metadata. This is to prevent peers with no metadata
-		// to starve out sending requests to peers with metadata
-		if (has_metadata)
-			m_requested_metadata[piece].last_request = now;
+	void ut_metadata_plugin::request_more()
+	{
+		std::vector<boost::shared_ptr<ut_metadata_peer_plugin> > peers;
+		peers.reserve(m_peers.size());
+		for (int i = 0; i < int(m_peers.size()); ++i)
+		{
+			boost::shared_ptr<ut_metadata_peer_plugin> p = m_peers[i].lock();
+			if (p) peers.push_back(p);
+		}
+		std::sort(peers.begin(), peers.end(), &pick_order);
 
-		return piece;
+		// hand out one request per peer per round, rather than letting the
+		// first peer fill its whole queue. Otherwise, with only a few blocks
+		// to request, they would all go to the same peer. Sending requests
+		// does not add or remove peers, but it may end up disconnecting one
+		for (bool sent = true; sent;)
+		{
+			sent = false;
+			for (int i = 0; i < int(peers.size()); ++i)
+				if (peers[i]->send_request()) sent = true;
+		}
 	}
 
 	inline bool ut_metadata_plugin::received_metadata(
@@ -561,11 +713,11 @@ namespace libtorrent { namespace
 			}
 
 			m_metadata.reset(new char[total_size]);
-			m_requested_metadata.resize(div_round_up(total_size, 16 * 1024));
+			m_picker.resize(div_round_up(total_size, 16 * 1024));
 			m_metadata_size = total_size;
 		}
 
-		if (piece < 0 || piece >= int(m_requested_metadata.size()))
+		if (piece < 0 || piece >= m_picker.num_blocks())
 		{
 #ifdef TORRENT_VERBOSE_LOGGING
 			source.m_pc.peer_log("*** UT_METADATA [ piece: %d INVALID ]", piece);				
@@ -589,16 +741,22 @@ namespace libtorrent { namespace
 			return false;
 		}
 
+		if (m_picker.have(piece))
+		{
+			// we requested this block from more than one peer, and
+			// another one beat this one to it
+#ifdef TORRENT_VERBOSE_LOGGING
+			source.m_pc.peer_log("*** UT_METADATA [ piece: %d ALREADY RECEIVED ]", piece);
+#endif
+			m_torrent.add_redundant_bytes(size, torrent::piece_unknown);
+			return false;
+		}
+
 		std::memcpy(&m_metadata[piece * 16 * 1024], buf, size);
 		// mark this piece has 'have'
-		m_requested_metadata[piece].num_requests = (std::numeric_limits<int>::max)();
-		m_requested_metadata[piece].source = source.shared_from_this();
+		m_picker.received(source.shared_from_this(), piece);
 
-		bool have_all = std::count_if(m_requested_metadata.begin()
-			, m_requested_metadata.end(), boost::bind(&metadata_piece::num_requests, _1)
-			== (std::numeric_limits<int>::max)()) == int(m_requested_metadata.size());
-
-		if (!have_all) return false;
+		if (!m_picker.have_all()) return false;
 
 		if (!m_torrent.set_metadata(&m_metadata[0], m_metadata_size))
 		{
@@ -611,15 +769,14 @@ namespace libtorrent { namespace
 				// of which peers we use)
 				// if we only have one block, and thus requested it from a single
 				// peer, we bump up the retry time a lot more to try other peers
-				bool single_peer = m_requested_metadata.size() == 1;
-				for (int i = 0; i < int(m_requested_metadata.size()); ++i)
+				bool single_peer = m_picker.num_blocks() == 1;
+				std::vector<boost::shared_ptr<void> > sources;
+				m_picker.sources(sources);
+				m_picker.reset();
+				for (int i = 0; i < int(sources.size()); ++i)
 				{
-					m_requested_metadata[i].num_requests = 0;
-					boost::shared_ptr<ut_metadata_peer_plugin> peer
-						= m_requested_metadata[i].source.lock();
-					if (!peer) continue;
-
-					peer->failed_hash_check(single_peer ? now + minutes(5) : now);
+					boost::static_pointer_cast<ut_metadata_peer_plugin>(sources[i])
+						->failed_hash_check(single_peer ? now + minutes(5) : now);
 				}
 			}
 			return false;
@@ -632,7 +789,8 @@ namespace libtorrent { namespace
 		metadata();
 
 		// clear the storage for the bitfield
-		std::vector<metadata_piece>().swap(m_requested_metadata);
+		m_picker.clear();
+		std::vector<boost::weak_ptr<ut_metadata_peer_plugin> >().swap(m_peers);
 
 		return true;
 	}
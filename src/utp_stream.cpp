@@ -40,6 +40,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/random.hpp"
 #include "libtorrent/invariant_check.hpp"
 #include "libtorrent/performance_counters.hpp"
+#include "libtorrent/event_trace.hpp"
 #include <boost/cstdint.hpp>
 
 #define TORRENT_UTP_LOG 0
@@ -2169,6 +2170,7 @@ void utp_socket_impl::experienced_loss(int seq_nr)
 
 	// cut window size in 2
 	m_cwnd = (std::max)(m_cwnd * m_sm->loss_multiplier() / 100, boost::int64_t(m_mtu << 16));
+	TORRENT_TRACE_EVENT(utp_cwnd, this, boost::uint32_t(m_cwnd >> 16), m_bytes_in_flight);
 	m_loss_seq_nr = m_seq_nr;
 	UTP_LOGV("%8p: Lost packet %d caused cwnd cut\n", this, seq_nr);
 
@@ -3309,6 +3311,7 @@ void utp_socket_impl::do_ledbat(int acked_bytes, int delay, int in_flight)
 	}
 
 	TORRENT_ASSERT(m_cwnd >= 0);
+	TORRENT_TRACE_EVENT(utp_cwnd, this, boost::uint32_t(m_cwnd >> 16), m_bytes_in_flight);
 
 	int window_size_left = (std::min)(int(m_cwnd >> 16), int(m_adv_wnd)) - in_flight + acked_bytes;
 	if (window_size_left >= m_mtu)
@@ -3416,6 +3419,7 @@ void utp_socket_impl::tick(ptime now)
 		}
 
 		TORRENT_ASSERT(m_cwnd >= 0);
+		TORRENT_TRACE_EVENT(utp_cwnd, this, boost::uint32_t(m_cwnd >> 16), m_bytes_in_flight);
 
 		m_timeout = now + milliseconds(packet_timeout());
 	
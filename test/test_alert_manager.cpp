@@ -0,0 +1,235 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/alert_manager.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/torrent_handle.hpp"
+#include "libtorrent/time.hpp"
+
+#include "test.hpp"
+
+#include <vector>
+#include <deque>
+#include <iostream>
+
+using namespace libtorrent;
+
+void post_blocks(alert_manager& mgr, int num, int start = 0)
+{
+	for (int i = start; i < start + num; ++i)
+	{
+		mgr.post_alert(block_finished_alert(torrent_handle()
+			, tcp::endpoint(), peer_id(), i, 0));
+	}
+}
+
+void test_limit()
+{
+	alert_manager mgr(100, 0xffffffff);
+
+	// discardable alerts are dropped once the queue is full
+	post_blocks(mgr, 200);
+	std::vector<alert*> alerts;
+	int num_resume = 0;
+	mgr.get_all(&alerts, num_resume);
+	TEST_EQUAL(alerts.size(), 100);
+	TEST_EQUAL(num_resume, 0);
+
+	for (int i = 0; i < int(alerts.size()); ++i)
+	{
+		block_finished_alert const* a = alert_cast<block_finished_alert>(alerts[i]);
+		TEST_CHECK(a);
+		if (a == 0) continue;
+		TEST_EQUAL(a->block_index, i);
+	}
+
+	// popping frees up the queue again
+	post_blocks(mgr, 10);
+	mgr.get_all(&alerts, num_resume);
+	TEST_EQUAL(alerts.size(), 10);
+}
+
+void test_generations()
+{
+	alert_manager mgr(1000, 0xffffffff);
+	std::vector<alert*> alerts;
+	int num_resume = 0;
+
+	post_blocks(mgr, 10, 0);
+	mgr.get_all(&alerts, num_resume);
+	TEST_EQUAL(alerts.size(), 10);
+
+	// alerts posted after the pop must not disturb the ones we
+	// were handed
+	post_blocks(mgr, 10, 100);
+	for (int i = 0; i < int(alerts.size()); ++i)
+		TEST_EQUAL(static_cast<block_finished_alert*>(alerts[i])->block_index, i);
+
+	mgr.get_all(&alerts, num_resume);
+	TEST_EQUAL(alerts.size(), 10);
+	for (int i = 0; i < int(alerts.size()); ++i)
+		TEST_EQUAL(static_cast<block_finished_alert*>(alerts[i])->block_index, 100 + i);
+
+	mgr.get_all(&alerts, num_resume);
+	TEST_CHECK(alerts.empty());
+	TEST_CHECK(!mgr.pending());
+
+	// alerts posted by pointer and alerts with strings survive
+	// being moved between generations
+	mgr.post_alert_ptr(new portmap_log_alert(0, "posted by pointer, with a long message"));
+	alert const& ref = portmap_log_alert(1, "posted by reference, with a long message");
+	mgr.post_alert(ref);
+	mgr.post_alert(portmap_log_alert(2, "posted by value, with a long message"));
+	TEST_CHECK(mgr.pending());
+	mgr.get_all(&alerts, num_resume);
+	TEST_EQUAL(alerts.size(), 3);
+	for (int i = 0; i < int(alerts.size()); ++i)
+	{
+		portmap_log_alert const* a = alert_cast<portmap_log_alert>(alerts[i]);
+		TEST_CHECK(a);
+		if (a == 0) continue;
+		TEST_EQUAL(a->map_type, i);
+	}
+	TEST_EQUAL(static_cast<portmap_log_alert*>(alerts[2])->msg
+		, "posted by value, with a long message");
+}
+
+void test_legacy_pop()
+{
+	alert_manager mgr(1000, 0xffffffff);
+	int num_resume = 0;
+
+	post_blocks(mgr, 5);
+	TEST_EQUAL(mgr.wait_for_alert(milliseconds(0))->type(), block_finished_alert::alert_type);
+
+	// pop one at a time. These are owned by the caller
+	std::auto_ptr<alert> a = mgr.get(num_resume);
+	TEST_CHECK(a.get());
+	TEST_EQUAL(static_cast<block_finished_alert*>(a.get())->block_index, 0);
+	a = mgr.get(num_resume);
+	TEST_EQUAL(static_cast<block_finished_alert*>(a.get())->block_index, 1);
+
+	// and the rest as a deque
+	std::deque<alert*> alerts;
+	mgr.get_all(&alerts, num_resume);
+	TEST_EQUAL(alerts.size(), 3);
+	for (int i = 0; i < int(alerts.size()); ++i)
+	{
+		TEST_EQUAL(static_cast<block_finished_alert*>(alerts[i])->block_index, i + 2);
+		delete alerts[i];
+	}
+	TEST_CHECK(!mgr.pending());
+	TEST_CHECK(mgr.get(num_resume).get() == 0);
+}
+
+void test_pop_without_drain()
+{
+	alert_manager mgr(1000, 0xffffffff);
+	int num_resume = 0;
+
+	// a client that pops one alert at a time, but never catches up
+	// with the alerts being posted, must not make the alert_manager
+	// hold on to all the alerts it has popped
+	post_blocks(mgr, 10);
+	int next = 0;
+	for (int i = 0; i < 1000; ++i)
+	{
+		post_blocks(mgr, 1, 10 + i);
+		std::auto_ptr<alert> a = mgr.get(num_resume);
+		TEST_CHECK(a.get());
+		if (a.get() == 0) break;
+		TEST_EQUAL(static_cast<block_finished_alert*>(a.get())->block_index, next);
+		++next;
+		TEST_CHECK(mgr.num_held_alerts() <= 200);
+	}
+
+	// the alerts that were moved to the other generation are still
+	// handed out in order, by both interfaces
+	std::vector<alert*> alerts;
+	mgr.get_all(&alerts, num_resume);
+	TEST_EQUAL(alerts.size(), 10);
+	for (int i = 0; i < int(alerts.size()); ++i)
+		TEST_EQUAL(static_cast<block_finished_alert*>(alerts[i])->block_index, next + i);
+	mgr.get_all(&alerts, num_resume);
+	TEST_CHECK(alerts.empty());
+	TEST_EQUAL(mgr.num_held_alerts(), 0);
+}
+
+// measures the rate at which a client can receive block-level alerts,
+// when popping them in batches
+void test_alert_rate()
+{
+	int const batch = 1000;
+	int const rounds = 1000;
+	alert_manager mgr(batch, 0xffffffff);
+	int num_resume = 0;
+
+	std::vector<alert*> alerts;
+	ptime start = time_now_hires();
+	for (int r = 0; r < rounds; ++r)
+	{
+		post_blocks(mgr, batch);
+		mgr.get_all(&alerts, num_resume);
+		TEST_EQUAL(int(alerts.size()), batch);
+	}
+	ptime mid = time_now_hires();
+
+	// the legacy interface, where every alert is a heap allocated copy
+	std::deque<alert*> copies;
+	for (int r = 0; r < rounds; ++r)
+	{
+		post_blocks(mgr, batch);
+		mgr.get_all(&copies, num_resume);
+		TEST_EQUAL(int(copies.size()), batch);
+		for (std::deque<alert*>::iterator i = copies.begin()
+			, end(copies.end()); i != end; ++i)
+			delete *i;
+		copies.clear();
+	}
+	ptime end = time_now_hires();
+
+	boost::int64_t const num = boost::int64_t(batch) * rounds;
+	std::cerr << "arena alerts: " << (num * 1000000 / (total_microseconds(mid - start) + 1))
+		<< " alerts/s" << std::endl;
+	std::cerr << "copied alerts: " << (num * 1000000 / (total_microseconds(end - mid) + 1))
+		<< " alerts/s" << std::endl;
+}
+
+int test_main()
+{
+	test_limit();
+	test_generations();
+	test_legacy_pop();
+	test_pop_without_drain();
+	test_alert_rate();
+	return 0;
+}
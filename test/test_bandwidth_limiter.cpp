@@ -457,6 +457,62 @@ void test_no_starvation(int limit)
 	TEST_CHECK(close_to(p->m_quota / sample_time, limit / 200 / num_peers, 5));
 }
 
+// this is a benchmark as much as a test. It queues a large number of
+// rate limited peers, spread over a number of torrents, and measures the
+// time spent distributing quota as well as how evenly it's distributed
+// (Jain's fairness index, where 1 is perfectly fair)
+void test_fairness_benchmark(int num_torrents, int peers_per_torrent, int limit)
+{
+	std::cerr << "\ntest fairness benchmark " << num_torrents
+		<< " torrents x " << peers_per_torrent << " peers"
+		<< " g: " << limit << std::endl;
+	bandwidth_manager manager(0);
+	global_bwc.throttle(limit);
+
+	// the torrents are rate limited too, but together they may use twice
+	// the global limit
+	std::vector<bandwidth_channel> torrents(num_torrents);
+	for (int i = 0; i < num_torrents; ++i)
+		torrents[i].throttle(2 * limit / num_torrents);
+
+	connections_t v;
+	for (int i = 0; i < num_torrents; ++i)
+		spawn_connections(v, manager, torrents[i], peers_per_torrent, "p");
+
+	std::for_each(v.begin(), v.end()
+		, boost::bind(&peer_connection::start, _1));
+
+	libtorrent::aux::session_settings s;
+	initialize_default_settings(s);
+	int tick_interval = s.get_int(settings_pack::tick_interval);
+	int num_ticks = int(sample_time * 1000 / tick_interval);
+
+	ptime start = time_now_hires();
+	for (int i = 0; i < num_ticks; ++i)
+		manager.update_quotas(milliseconds(tick_interval));
+	ptime end = time_now_hires();
+
+	std::cerr << "update_quotas: " << (total_microseconds(end - start) / num_ticks)
+		<< " us per tick (" << v.size() << " peers, "
+		<< manager.num_active_channels() << " active channels, "
+		<< manager.num_active_groups() << " groups)" << std::endl;
+
+	double sum = 0.;
+	double sum_sq = 0.;
+	for (connections_t::iterator i = v.begin()
+		, end(v.end()); i != end; ++i)
+	{
+		double rate = (*i)->m_quota / sample_time;
+		sum += rate;
+		sum_sq += rate * rate;
+	}
+	double fairness = sum * sum / (v.size() * sum_sq);
+	std::cerr << "sum: " << sum << " target: " << limit
+		<< " fairness: " << fairness << std::endl;
+	TEST_CHECK(close_to(sum, limit, limit * 0.05f));
+	TEST_CHECK(fairness > 0.9);
+}
+
 int test_main()
 {
 	using namespace libtorrent;
@@ -490,6 +546,7 @@ int test_main()
 	test_peer_priority(40000, false);
 	test_peer_priority(40000, true);
 	test_no_starvation(40000);
+	test_fairness_benchmark(10, 500, 10000000);
 
 	return 0;
 }
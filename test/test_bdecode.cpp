@@ -0,0 +1,300 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/bdecode.hpp"
+#include <cstring>
+#include <string>
+
+#include "test.hpp"
+
+using namespace libtorrent;
+
+int test_main()
+{
+	// ** integers **
+	{
+		char b[] = "i12453e";
+		bdecode_node e;
+		error_code ec;
+		int ret = bdecode(b, b + sizeof(b)-1, e, ec);
+		TEST_CHECK(ret == 0);
+		TEST_CHECK(!ec);
+		std::pair<const char*, int> section = e.data_section();
+		TEST_CHECK(std::memcmp(b, section.first, section.second) == 0);
+		TEST_CHECK(section.second == sizeof(b) - 1);
+		TEST_CHECK(e.type() == bdecode_node::int_t);
+		TEST_CHECK(e.int_value() == 12453);
+	}
+
+	{
+		char b[] = "i-9223372036854775807e";
+		bdecode_node e;
+		error_code ec;
+		int ret = bdecode(b, b + sizeof(b)-1, e, ec);
+		TEST_CHECK(ret == 0);
+		TEST_CHECK(e.int_value() == -9223372036854775807LL);
+	}
+
+	// ** strings **
+	{
+		char b[] = "26:abcdefghijklmnopqrstuvwxyz";
+		bdecode_node e;
+		error_code ec;
+		int ret = bdecode(b, b + sizeof(b)-1, e, ec);
+		TEST_CHECK(ret == 0);
+		std::pair<const char*, int> section = e.data_section();
+		TEST_CHECK(std::memcmp(b, section.first, section.second) == 0);
+		TEST_CHECK(section.second == sizeof(b) - 1);
+		TEST_CHECK(e.type() == bdecode_node::string_t);
+		TEST_CHECK(e.string_value() == "abcdefghijklmnopqrstuvwxyz");
+		TEST_CHECK(e.string_length() == 26);
+		TEST_CHECK(std::memcmp(e.string_ptr(), b + 3, 26) == 0);
+	}
+
+	{
+		char b[] = "0:";
+		bdecode_node e;
+		error_code ec;
+		int ret = bdecode(b, b + sizeof(b)-1, e, ec);
+		TEST_CHECK(ret == 0);
+		TEST_CHECK(e.type() == bdecode_node::string_t);
+		TEST_CHECK(e.string_length() == 0);
+		TEST_CHECK(e.string_value() == "");
+	}
+
+	// ** lists **
+	{
+		char b[] = "li12453e3:aaali1ei2eee";
+		bdecode_node e;
+		error_code ec;
+		int ret = bdecode(b, b + sizeof(b)-1, e, ec);
+		TEST_CHECK(ret == 0);
+		std::pair<const char*, int> section = e.data_section();
+		TEST_CHECK(std::memcmp(b, section.first, section.second) == 0);
+		TEST_CHECK(section.second == sizeof(b) - 1);
+		TEST_CHECK(e.type() == bdecode_node::list_t);
+		TEST_EQUAL(e.list_size(), 3);
+		TEST_CHECK(e.list_at(0).type() == bdecode_node::int_t);
+		TEST_CHECK(e.list_at(1).type() == bdecode_node::string_t);
+		TEST_CHECK(e.list_at(2).type() == bdecode_node::list_t);
+		TEST_CHECK(e.list_int_value_at(0) == 12453);
+		TEST_CHECK(e.list_string_value_at(1) == "aaa");
+		TEST_CHECK(e.list_at(1).string_length() == 3);
+		TEST_EQUAL(e.list_at(2).list_size(), 2);
+		TEST_CHECK(e.list_at(2).list_int_value_at(1) == 2);
+		// looking up an earlier item after a later one
+		TEST_CHECK(e.list_int_value_at(0) == 12453);
+		section = e.list_at(1).data_section();
+		TEST_CHECK(std::memcmp("3:aaa", section.first, section.second) == 0);
+		TEST_CHECK(section.second == 5);
+		section = e.list_at(2).data_section();
+		TEST_CHECK(std::memcmp("li1ei2ee", section.first, section.second) == 0);
+		TEST_CHECK(section.second == 8);
+	}
+
+	{
+		char b[] = "le";
+		bdecode_node e;
+		error_code ec;
+		int ret = bdecode(b, b + sizeof(b)-1, e, ec);
+		TEST_CHECK(ret == 0);
+		TEST_CHECK(e.type() == bdecode_node::list_t);
+		TEST_EQUAL(e.list_size(), 0);
+	}
+
+	// ** dictionaries **
+	{
+		char b[] = "d1:ai12453e1:b3:aaa1:c3:bbb1:dl1:xee";
+		bdecode_node e;
+		error_code ec;
+		int ret = bdecode(b, b + sizeof(b)-1, e, ec);
+		TEST_CHECK(ret == 0);
+		std::pair<const char*, int> section = e.data_section();
+		TEST_CHECK(std::memcmp(b, section.first, section.second) == 0);
+		TEST_CHECK(section.second == sizeof(b) - 1);
+		TEST_CHECK(e.type() == bdecode_node::dict_t);
+		TEST_EQUAL(e.dict_size(), 4);
+		TEST_CHECK(e.dict_find("a").type() == bdecode_node::int_t);
+		TEST_CHECK(e.dict_find_int_value("a") == 12453);
+		TEST_CHECK(e.dict_find_int_value("b", 7) == 7);
+		TEST_CHECK(e.dict_find_string_value("b") == "aaa");
+		TEST_CHECK(e.dict_find_string_value("c") == "bbb");
+		TEST_CHECK(e.dict_find_string_value("a", "def") == "def");
+		TEST_CHECK(e.dict_find_list("d"));
+		TEST_CHECK(!e.dict_find_dict("d"));
+		TEST_CHECK(!e.dict_find("x"));
+		TEST_CHECK(e.dict_find(std::string("b")).string_value() == "aaa");
+		TEST_CHECK(e.dict_find_list("d").list_string_value_at(0) == "x");
+
+		std::pair<std::string, bdecode_node> item = e.dict_at(1);
+		TEST_CHECK(item.first == "b");
+		TEST_CHECK(item.second.string_value() == "aaa");
+		item = e.dict_at(3);
+		TEST_CHECK(item.first == "d");
+		TEST_CHECK(item.second.type() == bdecode_node::list_t);
+		item = e.dict_at(0);
+		TEST_CHECK(item.first == "a");
+		TEST_CHECK(item.second.int_value() == 12453);
+	}
+
+	// keys may contain zeroes
+	{
+		char b[] = "d3:a\0bi1e1:bi2ee";
+		bdecode_node e;
+		error_code ec;
+		int ret = bdecode(b, b + sizeof(b)-1, e, ec);
+		TEST_CHECK(ret == 0);
+		TEST_CHECK(e.dict_find(std::string("a\0b", 3)).int_value() == 1);
+		TEST_CHECK(!e.dict_find("a"));
+		TEST_CHECK(e.dict_find_int_value("b") == 2);
+	}
+
+	// ** copying and swapping **
+	{
+		char b[] = "d1:ai1e1:bli2ei3eee";
+		bdecode_node e1;
+		error_code ec;
+		int ret = bdecode(b, b + sizeof(b)-1, e1, ec);
+		TEST_CHECK(ret == 0);
+
+		bdecode_node e2(e1);
+		bdecode_node l = e2.dict_find_list("b");
+		e1.clear();
+		TEST_CHECK(e1.type() == bdecode_node::none_t);
+		TEST_CHECK(e2.dict_find_int_value("a") == 1);
+		TEST_EQUAL(l.list_size(), 2);
+		TEST_CHECK(l.list_int_value_at(1) == 3);
+
+		bdecode_node e3;
+		e3.swap(e2);
+		TEST_CHECK(e2.type() == bdecode_node::none_t);
+		TEST_CHECK(e3.dict_find_int_value("a") == 1);
+
+		bdecode_node e4 = e3.non_owning();
+		TEST_CHECK(e4.dict_find_list("b").list_int_value_at(0) == 2);
+	}
+
+	// ** reusing a node **
+	{
+		char b1[] = "li1ei2ei3ee";
+		char b2[] = "d1:xi4ee";
+		bdecode_node e;
+		error_code ec;
+		int ret = bdecode(b1, b1 + sizeof(b1)-1, e, ec);
+		TEST_CHECK(ret == 0);
+		TEST_EQUAL(e.list_size(), 3);
+		ret = bdecode(b2, b2 + sizeof(b2)-1, e, ec);
+		TEST_CHECK(ret == 0);
+		TEST_CHECK(e.type() == bdecode_node::dict_t);
+		TEST_CHECK(e.dict_find_int_value("x") == 4);
+	}
+
+	// ** errors **
+	{
+		char const* invalid[] =
+		{
+			"", // empty buffer
+			"i12", // unterminated integer
+			"i1x2e", // invalid integer
+			"ie", // missing digits
+			"5:abc", // string too short
+			"10", // missing colon
+			"l1:a", // unterminated list
+			"di1ei2ee", // integer key
+			"d1:ae", // missing value
+			"e", // unexpected end
+			"x", // invalid token
+			"i99999999999999999999999e", // overflow
+			"123456789:a", // header too long
+		};
+
+		for (int i = 0; i < int(sizeof(invalid)/sizeof(invalid[0])); ++i)
+		{
+			bdecode_node e;
+			error_code ec;
+			int ret = bdecode(invalid[i], invalid[i] + std::strlen(invalid[i]), e, ec);
+			TEST_CHECK(ret != 0);
+			TEST_CHECK(ec);
+			TEST_CHECK(e.type() == bdecode_node::none_t);
+		}
+	}
+
+	{
+		char b[] = "d1:ai1e1:bx";
+		bdecode_node e;
+		error_code ec;
+		int pos = 0;
+		int ret = bdecode(b, b + sizeof(b)-1, e, ec, &pos);
+		TEST_CHECK(ret != 0);
+		TEST_EQUAL(pos, 10);
+		TEST_CHECK(ec == error_code(bdecode_errors::expected_value));
+	}
+
+	// ** limits **
+	{
+		char b[] = "lllleeee";
+		bdecode_node e;
+		error_code ec;
+		int ret = bdecode(b, b + sizeof(b)-1, e, ec, 0, 3);
+		TEST_CHECK(ret != 0);
+		TEST_CHECK(ec == error_code(bdecode_errors::depth_exceeded));
+
+		ret = bdecode(b, b + sizeof(b)-1, e, ec, 0, 4);
+		TEST_CHECK(ret == 0);
+	}
+
+	{
+		char b[] = "li1ei2ei3ee";
+		bdecode_node e;
+		error_code ec;
+		int ret = bdecode(b, b + sizeof(b)-1, e, ec, 0, 100, 3);
+		TEST_CHECK(ret != 0);
+		TEST_CHECK(ec == error_code(bdecode_errors::limit_exceeded));
+
+		ret = bdecode(b, b + sizeof(b)-1, e, ec, 0, 100, 5);
+		TEST_CHECK(ret == 0);
+	}
+
+	// ** printing **
+	{
+		char b[] = "d1:ai1e1:bl3:abcee";
+		bdecode_node e;
+		error_code ec;
+		int ret = bdecode(b, b + sizeof(b)-1, e, ec);
+		TEST_CHECK(ret == 0);
+		TEST_EQUAL(print_entry(e, true), "{ 'a': 1, 'b': [ 'abc' ] }");
+	}
+
+	return 0;
+}
+
@@ -31,19 +31,116 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "libtorrent/lazy_entry.hpp"
+#include "libtorrent/bdecode.hpp"
+#include "libtorrent/bencode.hpp"
 #include <boost/lexical_cast.hpp>
 #include <iostream>
+#include <vector>
+#include <cstdlib>
 
 #include "test.hpp"
 #include "libtorrent/time.hpp"
 
 using namespace libtorrent;
 
+// builds a bencoded structure resembling a .torrent file with many files
+std::string make_large_torrent(int num_files)
+{
+	entry e;
+	entry::list_type& files = e["info"]["files"].list();
+	for (int i = 0; i < num_files; ++i)
+	{
+		entry f;
+		f["length"] = 1000 + i;
+		entry::list_type& path = f["path"].list();
+		path.push_back(entry("directory"));
+		path.push_back(entry("file-" + boost::lexical_cast<std::string>(i)));
+		files.push_back(f);
+	}
+	e["info"]["name"] = "test";
+	e["info"]["piece length"] = 16 * 1024;
+	e["info"]["pieces"] = std::string(20 * num_files, 'a');
+	std::string ret;
+	bencode(std::back_inserter(ret), e);
+	return ret;
+}
+
+std::string random_string(int len)
+{
+	std::string ret(len, '\0');
+	for (int i = 0; i < len; ++i) ret[i] = char(rand());
+	return ret;
+}
+
+// builds DHT messages shaped like the ones a busy node receives. Most
+// of the traffic is queries and responses to get_peers and find_node,
+// with node IDs, tokens and compact node and peer lists as binary strings
+std::vector<std::string> make_krpc_messages()
+{
+	std::vector<entry> msgs;
+
+	entry ping;
+	ping["y"] = "q";
+	ping["t"] = random_string(2);
+	ping["q"] = "ping";
+	ping["a"]["id"] = random_string(20);
+	msgs.push_back(ping);
+
+	entry find_node = ping;
+	find_node["q"] = "find_node";
+	find_node["a"]["target"] = random_string(20);
+	msgs.push_back(find_node);
+
+	entry get_peers = ping;
+	get_peers["q"] = "get_peers";
+	get_peers["a"]["info_hash"] = random_string(20);
+	msgs.push_back(get_peers);
+	msgs.push_back(get_peers);
+
+	entry announce = get_peers;
+	announce["q"] = "announce_peer";
+	announce["a"]["port"] = 6881;
+	announce["a"]["implied_port"] = 1;
+	announce["a"]["token"] = random_string(8);
+	msgs.push_back(announce);
+
+	entry nodes;
+	nodes["y"] = "r";
+	nodes["t"] = random_string(2);
+	nodes["ip"] = random_string(6);
+	nodes["r"]["id"] = random_string(20);
+	nodes["r"]["nodes"] = random_string(26 * 8);
+	msgs.push_back(nodes);
+	msgs.push_back(nodes);
+
+	entry values = nodes;
+	values["r"]["token"] = random_string(8);
+	entry::list_type& peers = values["r"]["values"].list();
+	for (int i = 0; i < 20; ++i)
+		peers.push_back(entry(random_string(6)));
+	msgs.push_back(values);
+
+	entry error;
+	error["y"] = "e";
+	error["t"] = random_string(2);
+	error["e"].list().push_back(entry(203));
+	error["e"].list().push_back(entry("Protocol Error"));
+	msgs.push_back(error);
+
+	std::vector<std::string> ret;
+	for (int i = 0; i < int(msgs.size()); ++i)
+	{
+		ret.push_back(std::string());
+		bencode(std::back_inserter(ret.back()), msgs[i]);
+	}
+	return ret;
+}
+
 int test_main()
 {
 	using namespace libtorrent;
 
-	ptime start(time_now());
+	ptime start(time_now_hires());
 
 	for (int i = 0; i < 100000; ++i)
 	{
@@ -52,9 +149,128 @@ int test_main()
 		error_code ec;
 		lazy_bdecode(b, b + sizeof(b)-1, e, ec);
 	}
-	ptime stop(time_now());
+	ptime stop(time_now_hires());
+
+	std::cout << "lazy_bdecode: done in " << total_microseconds(stop - start) / 100000.
+		<< " seconds per million message" << std::endl;
+
+	start = time_now_hires();
+	{
+		// the node is reused, which lets bdecode() reuse its token array
+		bdecode_node e;
+		for (int i = 0; i < 100000; ++i)
+		{
+			char b[] = "d1:ai12453e1:b3:aaa1:c3:bbbe";
+			error_code ec;
+			bdecode(b, b + sizeof(b)-1, e, ec);
+		}
+	}
+	stop = time_now_hires();
+
+	std::cout << "bdecode: done in " << total_microseconds(stop - start) / 100000.
+		<< " seconds per million message" << std::endl;
+
+	// decode a large torrent-like structure and look up every file in it
+	std::string buf = make_large_torrent(50000);
+	int const rounds = 10;
+
+	boost::int64_t lazy_total = 0;
+	start = time_now_hires();
+	for (int i = 0; i < rounds; ++i)
+	{
+		lazy_entry e;
+		error_code ec;
+		int ret = lazy_bdecode(&buf[0], &buf[0] + buf.size(), e, ec);
+		TEST_CHECK(ret == 0);
+		lazy_entry const* files = e.dict_find_dict("info")->dict_find_list("files");
+		for (int j = 0; j < files->list_size(); ++j)
+			lazy_total += files->list_at(j)->dict_find_int_value("length");
+	}
+	stop = time_now_hires();
+
+	std::cout << "lazy_bdecode: " << buf.size() << " bytes in "
+		<< total_microseconds(stop - start) / 1000. / rounds << " ms" << std::endl;
+
+	boost::int64_t total = 0;
+	start = time_now_hires();
+	for (int i = 0; i < rounds; ++i)
+	{
+		bdecode_node e;
+		error_code ec;
+		int ret = bdecode(&buf[0], &buf[0] + buf.size(), e, ec);
+		TEST_CHECK(ret == 0);
+		bdecode_node files = e.dict_find_dict("info").dict_find_list("files");
+		for (int j = 0; j < files.list_size(); ++j)
+			total += files.list_at(j).dict_find_int_value("length");
+	}
+	stop = time_now_hires();
+
+	std::cout << "bdecode: " << buf.size() << " bytes in "
+		<< total_microseconds(stop - start) / 1000. / rounds << " ms" << std::endl;
+
+	// both decoders must agree
+	TEST_EQUAL(total, lazy_total);
+
+	// decode DHT messages and look up the fields the DHT looks at
+	std::vector<std::string> krpc = make_krpc_messages();
+	int const num_messages = 1000000;
+
+	lazy_total = 0;
+	start = time_now_hires();
+	{
+		lazy_entry e;
+		for (int i = 0; i < num_messages; ++i)
+		{
+			std::string const& m = krpc[i % krpc.size()];
+			error_code ec;
+			int ret = lazy_bdecode(m.c_str(), m.c_str() + m.size(), e, ec);
+			TEST_CHECK(ret == 0);
+			lazy_entry const* y = e.dict_find_string("y");
+			TEST_CHECK(y && y->string_length() == 1);
+			lazy_total += e.dict_find_string("t")->string_length();
+			lazy_entry const* args = e.dict_find_dict("a");
+			if (args == 0) args = e.dict_find_dict("r");
+			if (args == 0) continue;
+			lazy_total += args->dict_find_string("id")->string_length();
+			lazy_total += args->dict_find_int_value("port");
+			lazy_entry const* n = args->dict_find_string("nodes");
+			if (n) lazy_total += n->string_length();
+		}
+	}
+	stop = time_now_hires();
+
+	std::cout << "lazy_bdecode: " << total_microseconds(stop - start) * 1000.
+		/ num_messages << " ns per DHT message" << std::endl;
+
+	total = 0;
+	start = time_now_hires();
+	{
+		bdecode_node e;
+		for (int i = 0; i < num_messages; ++i)
+		{
+			std::string const& m = krpc[i % krpc.size()];
+			error_code ec;
+			int ret = bdecode(m.c_str(), m.c_str() + m.size(), e, ec);
+			TEST_CHECK(ret == 0);
+			bdecode_node y = e.dict_find_string("y");
+			TEST_CHECK(y && y.string_length() == 1);
+			total += e.dict_find_string("t").string_length();
+			bdecode_node args = e.dict_find_dict("a");
+			if (!args) args = e.dict_find_dict("r");
+			if (!args) continue;
+			total += args.dict_find_string("id").string_length();
+			total += args.dict_find_int_value("port");
+			bdecode_node n = args.dict_find_string("nodes");
+			if (n) total += n.string_length();
+		}
+	}
+	stop = time_now_hires();
+
+	std::cout << "bdecode: " << total_microseconds(stop - start) * 1000.
+		/ num_messages << " ns per DHT message" << std::endl;
+
+	TEST_EQUAL(total, lazy_total);
 
-	std::cout << "done in " << total_milliseconds(stop - start) / 100. << " seconds per million message" << std::endl;
 	return 0;
 }
 
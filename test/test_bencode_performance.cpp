@@ -0,0 +1,186 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/bencode_writer.hpp"
+#include "libtorrent/entry.hpp"
+#include <iostream>
+
+#include "test.hpp"
+#include "libtorrent/time.hpp"
+
+using namespace libtorrent;
+
+// the response to a DHT find_node query
+void dht_response_entry(std::vector<char>& buf, std::string const& nodes)
+{
+	entry e;
+	e["y"] = "r";
+	e["t"] = "aa";
+	e["ip"] = std::string("\x7f\x00\x00\x01\x1a\xe1", 6);
+	entry& r = e["r"];
+	r["id"] = std::string(20, 'a');
+	r["nodes"] = nodes;
+	r["p"] = 6881;
+	e["v"] = "LT\x01\x01";
+	buf.clear();
+	bencode(std::back_inserter(buf), e);
+}
+
+void dht_response_writer(bencode_writer& w, std::string const& nodes)
+{
+	w.buffer().clear();
+	w.begin_dict();
+	w.string_item("ip", "\x7f\x00\x00\x01\x1a\xe1", 6);
+	w.key("r");
+	w.begin_dict();
+	w.string_item("id", std::string(20, 'a'));
+	w.string_item("nodes", nodes);
+	w.int_item("p", 6881);
+	w.end();
+	w.string_item("t", "aa", 2);
+	w.string_item("v", "LT\x01\x01", 4);
+	w.string_item("y", "r", 1);
+	w.end();
+}
+
+// a structure resembling fast resume data
+void resume_entry(std::vector<char>& buf, int num_pieces, int num_files)
+{
+	entry e;
+	e["file-format"] = "libtorrent resume file";
+	e["file-version"] = 1;
+	e["total_uploaded"] = 1234567;
+	e["total_downloaded"] = 7654321;
+	e["save_path"] = "/home/user/downloads";
+	e["info-hash"] = std::string(20, 'b');
+	entry::string_type& pieces = e["pieces"].string();
+	pieces.resize(num_pieces);
+	for (int i = 0; i < num_pieces; ++i) pieces[i] = i & 1;
+	entry::list_type& trackers = e["trackers"].list();
+	trackers.push_back(entry::list_type());
+	trackers.back().list().push_back(entry("http://tracker.example.com/announce"));
+	trackers.back().list().push_back(entry("udp://tracker.example.com:6969"));
+	e["peers"] = std::string(600, 'c');
+	entry::list_type& prio = e["file_priority"].list();
+	for (int i = 0; i < num_files; ++i) prio.push_back(entry(1));
+	e["paused"] = 0;
+	e["auto_managed"] = 1;
+	buf.clear();
+	bencode(std::back_inserter(buf), e);
+}
+
+void resume_writer(bencode_writer& w, int num_pieces, int num_files)
+{
+	w.buffer().clear();
+	w.begin_dict();
+	w.string_item("file-format", "libtorrent resume file");
+	w.int_item("file-version", 1);
+	w.int_item("total_uploaded", 1234567);
+	w.int_item("total_downloaded", 7654321);
+	w.string_item("save_path", "/home/user/downloads");
+	w.string_item("info-hash", std::string(20, 'b'));
+	w.key("pieces");
+	char* pieces = w.alloc_string(num_pieces);
+	for (int i = 0; i < num_pieces; ++i) pieces[i] = i & 1;
+	w.key("trackers");
+	w.begin_list();
+	w.begin_list();
+	w.string("http://tracker.example.com/announce");
+	w.string("udp://tracker.example.com:6969");
+	w.end();
+	w.end();
+	w.string_item("peers", std::string(600, 'c'));
+	w.key("file_priority");
+	w.begin_list();
+	for (int i = 0; i < num_files; ++i) w.integer(1);
+	w.end();
+	w.int_item("paused", 0);
+	w.int_item("auto_managed", 1);
+	w.end();
+}
+
+int test_main()
+{
+	using namespace libtorrent;
+
+	std::string const nodes(8 * 26, 'n');
+	int const dht_rounds = 100000;
+
+	std::vector<char> entry_buf;
+	ptime start(time_now_hires());
+	for (int i = 0; i < dht_rounds; ++i)
+		dht_response_entry(entry_buf, nodes);
+	ptime stop(time_now_hires());
+
+	std::cout << "entry: DHT response in "
+		<< total_microseconds(stop - start) * 1000. / dht_rounds
+		<< " ns" << std::endl;
+
+	std::vector<char> writer_buf;
+	bencode_writer w(writer_buf);
+	start = time_now_hires();
+	for (int i = 0; i < dht_rounds; ++i)
+		dht_response_writer(w, nodes);
+	stop = time_now_hires();
+
+	std::cout << "bencode_writer: DHT response in "
+		<< total_microseconds(stop - start) * 1000. / dht_rounds
+		<< " ns" << std::endl;
+
+	TEST_CHECK(entry_buf == writer_buf);
+
+	int const resume_rounds = 1000;
+	start = time_now_hires();
+	for (int i = 0; i < resume_rounds; ++i)
+		resume_entry(entry_buf, 20000, 1000);
+	stop = time_now_hires();
+
+	std::cout << "entry: " << entry_buf.size() << " bytes resume data in "
+		<< total_microseconds(stop - start) / double(resume_rounds)
+		<< " us" << std::endl;
+
+	start = time_now_hires();
+	for (int i = 0; i < resume_rounds; ++i)
+		resume_writer(w, 20000, 1000);
+	stop = time_now_hires();
+
+	std::cout << "bencode_writer: " << writer_buf.size() << " bytes resume data in "
+		<< total_microseconds(stop - start) / double(resume_rounds)
+		<< " us" << std::endl;
+
+	// the keys were written out of order, but the writer sorts them
+	TEST_CHECK(entry_buf == writer_buf);
+
+	return 0;
+}
+
@@ -32,9 +32,11 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/bencode.hpp"
 #include "libtorrent/lazy_entry.hpp"
+#include "libtorrent/bencode_writer.hpp"
 #include <boost/lexical_cast.hpp>
 #include <iostream>
 #include <cstring>
+#include <climits>
 
 #include "test.hpp"
 
@@ -292,6 +294,20 @@ int test_main()
 		TEST_CHECK(ret != 0);
 		TEST_EQUAL(ec, error_code(bdecode_errors::depth_exceeded
 			, get_bdecode_category()));
+
+		// a huge depth limit doesn't overflow the parser's stack. The parse
+		// stack is kept on the heap when it's this deep
+		ec.clear();
+		ret = lazy_bdecode(b, b + sizeof(b), e, ec, 0, INT_MAX);
+		TEST_EQUAL(ret, 0);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(e.type(), lazy_entry::list_t);
+
+		// and with a short buffer, the stack isn't deeper than the buffer
+		ret = lazy_bdecode(b + 1022, b + 1026, e, ec, 0, INT_MAX);
+		TEST_EQUAL(ret, 0);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(e.list_size(), 1);
 	}
 
 	// test the item limit
@@ -584,6 +600,137 @@ int test_main()
 		TEST_CHECK(ec == bdecode_errors::expected_colon);
 	}
 
+	// ** bencode_writer **
+	{
+		std::vector<char> buf;
+		bencode_writer w(buf);
+		w.begin_dict();
+		w.int_item("a", 12453);
+		w.string_item("b", "aaa");
+		w.key("c");
+		w.begin_list();
+		w.integer(-1);
+		w.string("spam");
+		w.begin_dict();
+		w.end();
+		w.end();
+		w.end();
+		TEST_CHECK(w.done());
+		TEST_EQUAL(std::string(buf.begin(), buf.end())
+			, "d1:ai12453e1:b3:aaa1:cli-1e4:spamdeee");
+	}
+
+	// keys written out of order are sorted, nested dictionaries
+	// independently of their parents
+	{
+		std::vector<char> buf;
+		bencode_writer w(buf);
+		w.begin_dict();
+		w.string_item("spam", "eggs");
+		w.key("dict");
+		w.begin_dict();
+		w.int_item("z", 1);
+		w.int_item("y", 2);
+		w.int_item("x", 3);
+		w.end();
+		w.int_item("cow", 1);
+		w.string_item("a", "b");
+		w.end();
+		TEST_CHECK(w.done());
+		std::string const out(buf.begin(), buf.end());
+		TEST_EQUAL(out, "d1:a1:b3:cowi1e4:dictd1:xi3e1:yi2e1:zi1ee4:spam4:eggse");
+
+		// it must encode the same as the equivalent entry
+		entry e;
+		e["spam"] = "eggs";
+		e["dict"]["z"] = 1;
+		e["dict"]["y"] = 2;
+		e["dict"]["x"] = 3;
+		e["cow"] = 1;
+		e["a"] = "b";
+		TEST_EQUAL(out, encode(e));
+	}
+
+	// a key that's a prefix of another sorts first
+	{
+		std::vector<char> buf;
+		bencode_writer w(buf);
+		w.begin_dict();
+		w.int_item("ab", 1);
+		w.int_item("a", 2);
+		w.end();
+		TEST_EQUAL(std::string(buf.begin(), buf.end()), "d1:ai2e2:abi1ee");
+	}
+
+	// raw values, entries and preallocated strings
+	{
+		std::vector<char> buf;
+		bencode_writer w(buf);
+		w.begin_dict();
+		w.key("info");
+		w.raw("d4:name4:teste", 14);
+		w.key("e");
+		entry e;
+		e["x"] = 1;
+		w.value(e);
+		w.key("s");
+		char* ptr = w.alloc_string(3);
+		std::memcpy(ptr, "abc", 3);
+		w.end();
+		TEST_EQUAL(std::string(buf.begin(), buf.end())
+			, "d1:ed1:xi1ee4:infod4:name4:teste1:s3:abce");
+	}
+
+	// the writer appends to the buffer and can be reused
+	{
+		std::vector<char> buf;
+		bencode_writer w(buf);
+		w.integer(1);
+		w.string("x");
+		TEST_EQUAL(std::string(buf.begin(), buf.end()), "i1e1:x");
+		buf.clear();
+		w.begin_list();
+		w.end();
+		TEST_EQUAL(std::string(buf.begin(), buf.end()), "le");
+	}
+
+	// ** entry_writer **
+	// builds the same structure as the bencode_writer, as an entry
+	{
+		entry out;
+		entry_writer w(out);
+		TEST_CHECK(!w.done());
+		w.begin_dict();
+		w.string_item("spam", "eggs");
+		w.key("dict");
+		w.begin_dict();
+		w.int_item("z", 1);
+		w.int_item("y", 2);
+		w.end();
+		w.key("l");
+		w.begin_list();
+		w.integer(-1);
+		w.string("x", 1);
+		w.begin_list();
+		w.end();
+		w.end();
+		w.key("info");
+		w.raw("d4:name4:teste", 14);
+		w.key("e");
+		entry e;
+		e["x"] = 1;
+		w.value(e);
+		w.key("s");
+		char* ptr = w.alloc_string(3);
+		std::memcpy(ptr, "abc", 3);
+		w.key("empty");
+		w.alloc_string(0);
+		w.end();
+		TEST_CHECK(w.done());
+		TEST_EQUAL(encode(out), "d4:dictd1:yi2e1:zi1ee1:ed1:xi1ee5:empty0:"
+			"4:infod4:name4:teste1:lli-1e1:xlee1:s3:abc4:spam4:eggse");
+	}
+
 	return 0;
 }
 
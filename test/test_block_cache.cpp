@@ -400,7 +400,9 @@ void test_arc_unghost()
 
 	// the block is now a ghost. If we cache-hit it,
 	// it should be promoted back to the main list
+	TEST_EQUAL(bc.num_ghost_hits(), 0);
 	bc.cache_hit(pe, (void*)1, false);
+	TEST_EQUAL(bc.num_ghost_hits(), 1);
 
 	bc.update_stats_counters(c);
 	TEST_EQUAL(c[counters::write_cache_blocks], 0);
@@ -418,6 +420,65 @@ void test_arc_unghost()
 	bc.clear(jobs);
 }
 
+void test_resize()
+{
+	TEST_SETUP;
+
+	INSERT(0, 0);
+	INSERT(1, 0);
+
+	TEST_CHECK(bc.set_max_use(100));
+	TEST_EQUAL(bc.max_use(), 100);
+	counters c;
+	bc.update_stats_counters(c);
+	TEST_EQUAL(c[counters::cache_size_limit], 100);
+	TEST_CHECK(!bc.exceeded_max_size());
+
+	// shrinking the cache below the number of blocks in use makes it
+	// exceed its size, and trigger a trim
+	TEST_CHECK(bc.set_max_use(1));
+	TEST_CHECK(bc.exceeded_max_size());
+
+	tailqueue jobs;
+	bc.clear(jobs);
+}
+
+void test_adaptive_cache_target()
+{
+	boost::uint64_t const ram = 1000;
+
+	// no ghost hits and plenty of free memory. Stay put
+	TEST_EQUAL(adaptive_cache_target(1000, 100, 10000, 0, 500, ram, 500, 10), 1000);
+
+	// at least 1% of the reads hit a ghost list. Grow by a quarter
+	TEST_EQUAL(adaptive_cache_target(1000, 100, 10000, 5, 500, ram, 500, 10), 1250);
+	TEST_EQUAL(adaptive_cache_target(1000, 100, 10000, 5, 0, ram, 500, 10), 1250);
+	// but not when fewer than that did
+	TEST_EQUAL(adaptive_cache_target(1000, 100, 10000, 4, 500, ram, 500, 10), 1000);
+	// a small cache grows by at least 16 blocks
+	TEST_EQUAL(adaptive_cache_target(20, 0, 10000, 1, 1, ram, 500, 10), 36);
+	// and never past the upper bound
+	TEST_EQUAL(adaptive_cache_target(1000, 100, 1100, 5, 500, ram, 500, 10), 1100);
+
+	// when available memory is below the threshold, shrink by an eighth,
+	// regardless of ghost hits
+	TEST_EQUAL(adaptive_cache_target(1000, 100, 10000, 0, 500, ram, 99, 10), 875);
+	TEST_EQUAL(adaptive_cache_target(1000, 100, 10000, 50, 500, ram, 99, 10), 875);
+	TEST_EQUAL(adaptive_cache_target(1000, 100, 10000, 0, 500, ram, 100, 10), 1000);
+	// but never below the lower bound
+	TEST_EQUAL(adaptive_cache_target(1000, 900, 10000, 0, 500, ram, 99, 10), 900);
+	// a negative lower bound is treated as 0
+	TEST_EQUAL(adaptive_cache_target(7, -10, 10000, 0, 500, ram, 99, 10), 7);
+
+	// if the amount of RAM isn't known, only ghost hits matter
+	TEST_EQUAL(adaptive_cache_target(1000, 100, 10000, 0, 500, 0, 0, 10), 1000);
+	TEST_EQUAL(adaptive_cache_target(1000, 100, 10000, 5, 500, ram, 0, 10), 1250);
+
+	// a size outside of the bounds is pulled back into them
+	TEST_EQUAL(adaptive_cache_target(50, 100, 10000, 0, 500, ram, 500, 10), 100);
+	TEST_EQUAL(adaptive_cache_target(20000, 100, 10000, 0, 500, ram, 500, 10), 10000);
+}
+
 void test_iovec()
 {
 	TEST_SETUP;
@@ -466,6 +527,8 @@ int test_main()
 	test_evict();
 	test_arc_promote();
 	test_arc_unghost();
+	test_resize();
+	test_adaptive_cache_target();
 	test_iovec();
 	test_unaligned_read();
 
@@ -319,10 +319,125 @@ void test_chained_buffer()
 	TEST_CHECK(buffer_list.empty());
 }
 
+void test_chained_buffer_wrap()
+{
+	char const* data = "0123456789abcdefghijklmnopqrstuvwxyz";
+	{
+		chained_buffer b;
+		std::string expect;
+
+		// push and pop buffers to have the chain wrap around the end
+		// of its internal ring a few times, and grow while wrapped
+		int pos = 0;
+		for (int round = 0; round < 6; ++round)
+		{
+			for (int i = 0; i < 5 + round * 3; ++i)
+			{
+				char* buf = allocate_buffer(3);
+				std::memcpy(buf, data + pos % 30, 3);
+				expect.append(data + pos % 30, 3);
+				pos += 3;
+				b.append_buffer(buf, 3, 3, &free_buffer, (void*)0x1337);
+			}
+			TEST_EQUAL(b.size(), int(expect.size()));
+			TEST_CHECK(compare_chained_buffer(b, expect.c_str(), expect.size()));
+
+			b.pop_front(7);
+			expect.erase(0, 7);
+			TEST_EQUAL(b.size(), int(expect.size()));
+			TEST_CHECK(compare_chained_buffer(b, expect.c_str(), expect.size()));
+		}
+		TEST_EQUAL(int(buffer_list.size()), (int(expect.size()) + 2) / 3);
+	}
+	TEST_CHECK(buffer_list.empty());
+}
+
+void test_chained_buffer_tail()
+{
+	char const* data = "0123456789abcdefghijklmnopqrstuvwxyz";
+	{
+		chained_buffer b;
+		std::string expect;
+		for (int i = 0; i < 4; ++i)
+		{
+			char* buf = allocate_buffer(10);
+			std::memcpy(buf, data + i * 5, 5);
+			expect.append(data + i * 5, 5);
+			b.append_buffer(buf, 10, 5, &free_buffer, (void*)0x1337);
+		}
+		b.pop_front(2);
+		expect.erase(0, 2);
+
+		std::vector<libtorrent::asio::mutable_buffer> vec;
+		for (int tail = 0; tail <= b.size(); ++tail)
+		{
+			b.build_mutable_iovec_tail(tail, vec);
+			std::vector<char> flat(tail + 1);
+			TEST_EQUAL(copy_buffers(vec, &flat[0]), tail);
+			TEST_CHECK(std::memcmp(&flat[0], expect.c_str() + expect.size() - tail, tail) == 0);
+		}
+
+		// mutating the tail buffers must modify the chain
+		b.build_mutable_iovec_tail(7, vec);
+		for (std::vector<libtorrent::asio::mutable_buffer>::iterator i = vec.begin()
+			, end(vec.end()); i != end; ++i)
+		{
+			std::memset(libtorrent::asio::buffer_cast<char*>(*i), 'x'
+				, libtorrent::asio::buffer_size(*i));
+		}
+		expect.replace(expect.size() - 7, 7, 7, 'x');
+		TEST_CHECK(compare_chained_buffer(b, expect.c_str(), expect.size()));
+	}
+	TEST_CHECK(buffer_list.empty());
+}
+
+void test_chained_buffer_iov_max()
+{
+	// a single write can't take more than TORRENT_IOV_MAX buffers. On
+	// platforms without a limit, there's nothing to test
+	if (TORRENT_IOV_MAX > 100000) return;
+	int const num_bufs = int(TORRENT_IOV_MAX) + 10;
+	{
+		chained_buffer b;
+		std::string expect;
+		for (int i = 0; i < num_bufs; ++i)
+		{
+			char* buf = allocate_buffer(4);
+			char const c = char('a' + i % 26);
+			std::memset(buf, c, 4);
+			expect.append(3, c);
+			b.append_buffer(buf, 4, 3, &free_buffer, (void*)0x1337);
+		}
+		TEST_EQUAL(b.size(), num_bufs * 3);
+
+		// the write is truncated at TORRENT_IOV_MAX buffers
+		std::vector<libtorrent::asio::const_buffer> const& vec = b.build_iovec(b.size());
+		TEST_EQUAL(int(vec.size()), int(TORRENT_IOV_MAX));
+		std::vector<char> flat(b.size());
+		int const sent = copy_buffers(vec, &flat[0]);
+		TEST_EQUAL(sent, int(TORRENT_IOV_MAX) * 3);
+		TEST_CHECK(std::memcmp(&flat[0], expect.c_str(), sent) == 0);
+		b.pop_front(sent);
+		expect.erase(0, sent);
+
+		// and the rest is sent by the next one
+		TEST_EQUAL(b.size(), 10 * 3);
+		std::vector<libtorrent::asio::const_buffer> const& rest = b.build_iovec(b.size());
+		TEST_EQUAL(int(rest.size()), 10);
+		TEST_CHECK(compare_chained_buffer(b, expect.c_str(), expect.size()));
+		b.pop_front(b.size());
+		TEST_CHECK(b.empty());
+	}
+	TEST_CHECK(buffer_list.empty());
+}
+
 int test_main()
 {
 	test_buffer();
 	test_chained_buffer();
+	test_chained_buffer_wrap();
+	test_chained_buffer_tail();
+	test_chained_buffer_iov_max();
 	return 0;
 }
 
@@ -0,0 +1,78 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/chained_buffer.hpp"
+#include "libtorrent/socket.hpp"
+#include "libtorrent/time.hpp"
+
+#include "test.hpp"
+
+#include <vector>
+#include <iostream>
+#include <cstring>
+
+using namespace libtorrent;
+
+void nop_free(char*, void*, block_cache_reference) {}
+
+// this simulates the send buffer of a seeding connection. Every round,
+// a few small protocol messages and a block payload are queued up, then
+// sent with a single vectored write
+int test_main()
+{
+	chained_buffer b;
+	char msg[128];
+	std::vector<char> block(0x4000);
+	std::memset(msg, 0, sizeof(msg));
+
+	int const rounds = 200000;
+	boost::int64_t sent = 0;
+	ptime start = time_now_hires();
+	for (int i = 0; i < rounds; ++i)
+	{
+		for (int k = 0; k < 4; ++k)
+			b.append_buffer(msg, sizeof(msg), 13, &nop_free, NULL);
+		b.append_buffer(&block[0], block.size(), block.size(), &nop_free, NULL);
+
+		std::vector<libtorrent::asio::const_buffer> const& vec = b.build_iovec(b.size());
+		TEST_EQUAL(int(vec.size()), 5);
+		sent += b.size();
+		b.pop_front(b.size());
+	}
+	ptime end = time_now_hires();
+	TEST_CHECK(b.empty());
+
+	std::cerr << "chained_buffer: " << (total_microseconds(end - start) * 1000 / rounds)
+		<< " ns per send (" << (sent / rounds) << " bytes, 5 buffers)" << std::endl;
+	return 0;
+}
+
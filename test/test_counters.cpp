@@ -0,0 +1,225 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/thread.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/session.hpp" // for latency_percentile
+#include "test.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+#include <vector>
+#include <iostream>
+
+using namespace libtorrent;
+
+void increment(counters* c, int n)
+{
+	for (int i = 0; i < n; ++i)
+	{
+		c->inc_stats_counter(counters::num_blocks_read);
+		c->inc_stats_counter(counters::num_read_ops, 2);
+		c->inc_stats_counter(counters::num_running_disk_jobs, 1);
+		c->inc_stats_counter(counters::num_running_disk_jobs, -1);
+	}
+}
+
+void test_threads()
+{
+	counters c;
+	int const num_threads = 4;
+	int const n = 1000000;
+
+	ptime start = time_now_hires();
+	std::vector<thread*> threads;
+	for (int i = 0; i < num_threads; ++i)
+		threads.push_back(new thread(boost::bind(&increment, &c, n)));
+	for (int i = 0; i < num_threads; ++i)
+	{
+		threads[i]->join();
+		delete threads[i];
+	}
+	ptime end = time_now_hires();
+
+	TEST_EQUAL(c[counters::num_blocks_read], boost::int64_t(num_threads) * n);
+	TEST_EQUAL(c[counters::num_read_ops], boost::int64_t(num_threads) * n * 2);
+	TEST_EQUAL(c[counters::num_running_disk_jobs], 0);
+
+	std::cerr << "counters: " << (total_microseconds(end - start) * 1000
+		/ (boost::int64_t(n) * 4))
+		<< " ns per increment, " << num_threads << " threads" << std::endl;
+}
+
+boost::atomic<int> num_done(0);
+
+void add_gauge(counters* c, int n, int value)
+{
+	for (int i = 0; i < n; ++i)
+	{
+		c->inc_stats_counter(counters::num_peers_connected, value);
+		c->inc_stats_counter(counters::num_blocks_read);
+	}
+	++num_done;
+}
+
+// a gauge incremented on one thread and decremented on another may sum up
+// to a negative value while they run. Reading it then, or setting counters
+// at the same time, is fine
+void test_concurrent_access()
+{
+	counters c;
+	int const n = 1000000;
+
+	thread up(boost::bind(&add_gauge, &c, n, 1));
+	thread down(boost::bind(&add_gauge, &c, n, -1));
+
+	std::vector<boost::int64_t> values(counters::num_counters, 0);
+	for (int i = 0; num_done < 2; ++i)
+	{
+		c.snapshot(&values[0]);
+		if (i == 100) c.set_value(counters::num_blocks_read, 0);
+	}
+	up.join();
+	down.join();
+
+	TEST_EQUAL(c[counters::num_peers_connected], 0);
+	// the increments made after set_value() are kept
+	TEST_CHECK(c[counters::num_blocks_read] >= 0);
+	TEST_CHECK(c[counters::num_blocks_read] <= 2 * n);
+	c.set_value(counters::num_blocks_read, 7);
+	TEST_EQUAL(c[counters::num_blocks_read], 7);
+}
+
+void test_set_value()
+{
+	counters c;
+	c.inc_stats_counter(counters::num_peers_connected, 5);
+	TEST_EQUAL(c[counters::num_peers_connected], 5);
+	c.set_value(counters::num_peers_connected, 2);
+	TEST_EQUAL(c[counters::num_peers_connected], 2);
+	c.inc_stats_counter(counters::num_peers_connected, -1);
+	TEST_EQUAL(c[counters::num_peers_connected], 1);
+
+	c.set_value(counters::num_peers_connected, 100);
+	c.blend_stats_counter(counters::num_peers_connected, 0, 50);
+	TEST_EQUAL(c[counters::num_peers_connected], 50);
+
+	counters copy(c);
+	TEST_EQUAL(copy[counters::num_peers_connected], 50);
+	copy.inc_stats_counter(counters::num_peers_connected);
+	TEST_EQUAL(copy[counters::num_peers_connected], 51);
+	TEST_EQUAL(c[counters::num_peers_connected], 50);
+}
+
+void test_snapshot()
+{
+	counters c;
+	std::vector<boost::int64_t> values(counters::num_counters, 0);
+	std::vector<boost::int64_t> delta(counters::num_counters, 0);
+
+	c.inc_stats_counter(counters::num_blocks_written, 10);
+	c.snapshot(&values[0]);
+	TEST_EQUAL(values[counters::num_blocks_written], 10);
+	for (int i = 0; i < counters::num_counters; ++i)
+		TEST_EQUAL(values[i], c[i]);
+
+	c.inc_stats_counter(counters::num_blocks_written, 3);
+	c.inc_stats_counter(counters::num_peers_connected, 2);
+	c.snapshot_delta(&values[0], &delta[0]);
+	TEST_EQUAL(values[counters::num_blocks_written], 13);
+	TEST_EQUAL(delta[counters::num_blocks_written], 3);
+	TEST_EQUAL(delta[counters::num_peers_connected], 2);
+	TEST_EQUAL(delta[counters::num_blocks_read], 0);
+
+	// polling is meant to be cheap enough to do very frequently
+	int const polls = 10000;
+	ptime start = time_now_hires();
+	for (int i = 0; i < polls; ++i)
+		c.snapshot_delta(&values[0], &delta[0]);
+	ptime end = time_now_hires();
+	std::cerr << "snapshot: " << (total_microseconds(end - start) * 1000 / polls)
+		<< " ns per snapshot_delta" << std::endl;
+}
+
+void test_latency_histogram()
+{
+	TEST_EQUAL(counters::latency_bucket(0), 0);
+	TEST_EQUAL(counters::latency_bucket(7), 0);
+	TEST_EQUAL(counters::latency_bucket(8), 1);
+	TEST_EQUAL(counters::latency_bucket(15), 1);
+	TEST_EQUAL(counters::latency_bucket(16), 2);
+	TEST_EQUAL(counters::latency_bucket(1000), 7);
+	TEST_EQUAL(counters::latency_bucket((1 << 23) - 1), 20);
+	TEST_EQUAL(counters::latency_bucket(1 << 23), 21);
+	TEST_EQUAL(counters::latency_bucket(boost::int64_t(1) << 40), 21);
+
+	counters c;
+	// 990 samples at 100 us, 9 at 5 ms and 1 at 1 s
+	for (int i = 0; i < 990; ++i)
+		c.add_latency_sample(counters::disk_read_latency3, 100);
+	for (int i = 0; i < 9; ++i)
+		c.add_latency_sample(counters::disk_read_latency3, 5000);
+	c.add_latency_sample(counters::disk_read_latency3, 1000000);
+
+	TEST_EQUAL(c[counters::disk_read_latency7], 990);
+	TEST_EQUAL(c[counters::disk_read_latency13], 9);
+	TEST_EQUAL(c[counters::disk_read_latency20], 1);
+	TEST_EQUAL(c[counters::disk_write_latency3], 0);
+
+	boost::uint64_t buckets[counters::num_latency_buckets];
+	for (int i = 0; i < counters::num_latency_buckets; ++i)
+		buckets[i] = c[counters::disk_read_latency3 + i];
+
+	// the estimates land in the right bucket
+	boost::int64_t p50 = latency_percentile(buckets, 500000);
+	TEST_CHECK(p50 >= 64 && p50 <= 128);
+	boost::int64_t p99 = latency_percentile(buckets, 990000);
+	TEST_CHECK(p99 >= 64 && p99 <= 128);
+	boost::int64_t p999 = latency_percentile(buckets, 999000);
+	TEST_CHECK(p999 >= 4096 && p999 <= 8192);
+	boost::int64_t max = latency_percentile(buckets, 1000000);
+	TEST_CHECK(max >= (1 << 19) && max <= (1 << 20));
+
+	boost::uint64_t empty[counters::num_latency_buckets] = {0};
+	TEST_EQUAL(latency_percentile(empty, 500000), 0);
+}
+
+int test_main()
+{
+	test_threads();
+	test_concurrent_access();
+	test_set_value();
+	test_snapshot();
+	test_latency_histogram();
+	return 0;
+}
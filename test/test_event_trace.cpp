@@ -0,0 +1,240 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/event_trace.hpp"
+#include "libtorrent/thread.hpp"
+#include "libtorrent/socket.hpp" // for asio::error
+#include "libtorrent/disk_io_job.hpp"
+
+#include "test.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+using namespace libtorrent;
+
+#ifdef TORRENT_EVENT_TRACE
+
+// rings are freed when their thread exits. The recording threads block
+// here until the main thread has dumped the trace
+struct thread_gate
+{
+	thread_gate(): recorded(0), released(false) {}
+
+	void record_and_wait(int num, boost::uint32_t tag)
+	{
+		for (int i = 0; i < num; ++i)
+			record_trace_event(trace_event::block_request, &tag, tag, i);
+
+		mutex::scoped_lock l(m);
+		++recorded;
+		cond.notify_all();
+		while (!released) cond.wait(l);
+	}
+
+	void wait_for(int num_threads)
+	{
+		mutex::scoped_lock l(m);
+		while (recorded < num_threads) cond.wait(l);
+	}
+
+	void release()
+	{
+		mutex::scoped_lock l(m);
+		released = true;
+		cond.notify_all();
+	}
+
+	mutex m;
+	condition_variable cond;
+	int recorded;
+	bool released;
+};
+
+struct trace_file
+{
+	boost::uint32_t dropped_threads;
+	std::vector<std::string> job_names;
+	std::vector<trace_event> events;
+};
+
+bool read_trace(char const* filename, trace_file& ret)
+{
+	FILE* f = fopen(filename, "rb");
+	TEST_CHECK(f != 0);
+	if (f == 0) return false;
+
+	char header[24];
+	TEST_EQUAL(fread(header, 1, sizeof(header), f), sizeof(header));
+	TEST_CHECK(memcmp(header, "LTTRACE2", 8) == 0);
+	boost::uint32_t byte_order;
+	boost::uint32_t record_size;
+	boost::uint32_t num_names;
+	memcpy(&byte_order, header + 8, 4);
+	memcpy(&record_size, header + 12, 4);
+	memcpy(&ret.dropped_threads, header + 16, 4);
+	memcpy(&num_names, header + 20, 4);
+	TEST_EQUAL(byte_order, 0x01020304);
+	TEST_EQUAL(record_size, sizeof(trace_event));
+
+	for (int i = 0; i < int(num_names); ++i)
+	{
+		std::string name;
+		int c;
+		while ((c = fgetc(f)) > 0) name += char(c);
+		ret.job_names.push_back(name);
+	}
+
+	trace_event e;
+	while (fread(&e, sizeof(e), 1, f) == 1) ret.events.push_back(e);
+	fclose(f);
+	remove(filename);
+	return true;
+}
+
+void test_dump()
+{
+	boost::uint32_t main_tag = 1;
+	for (int i = 0; i < 100; ++i)
+		record_trace_event(trace_event::block_request, &main_tag, main_tag, i);
+
+	// this thread records more events than fit in its ring
+	thread_gate gate;
+	thread t(boost::bind(&thread_gate::record_and_wait, &gate, 100000, 2));
+	gate.wait_for(1);
+
+	error_code ec;
+	dump_event_trace("event_trace.bin", ec);
+	TEST_CHECK(!ec);
+	gate.release();
+	t.join();
+
+	trace_file trace;
+	if (!read_trace("event_trace.bin", trace)) return;
+
+	TEST_EQUAL(trace.dropped_threads, 0);
+	TEST_EQUAL(int(trace.job_names.size()), int(disk_io_job::num_job_ids));
+	if (!trace.job_names.empty())
+	{
+		TEST_EQUAL(trace.job_names[disk_io_job::read], "read");
+		TEST_EQUAL(trace.job_names.back(), "tick_storage");
+	}
+
+	int main_events = 0;
+	int thread_events = 0;
+	boost::uint32_t last_arg = 0;
+	boost::uint64_t last_timestamp = 0;
+	for (int i = 0; i < int(trace.events.size()); ++i)
+	{
+		trace_event const& ev = trace.events[i];
+		TEST_EQUAL(ev.type, trace_event::block_request);
+		if (ev.arg0 == 1)
+		{
+			TEST_EQUAL(ev.arg1, main_events);
+			++main_events;
+			continue;
+		}
+		TEST_EQUAL(ev.arg0, 2);
+
+		// the oldest events of the thread have been overwritten, the ones
+		// that are left are the most recent, in order
+		if (thread_events > 0)
+		{
+			TEST_EQUAL(ev.arg1, last_arg + 1);
+			TEST_CHECK(ev.timestamp >= last_timestamp);
+		}
+		last_arg = ev.arg1;
+		last_timestamp = ev.timestamp;
+		++thread_events;
+	}
+	TEST_EQUAL(main_events, 100);
+	TEST_CHECK(thread_events > 0 && thread_events < 100000);
+	TEST_EQUAL(last_arg, 100000 - 1);
+
+	// the thread has exited, and its ring is gone with it
+	dump_event_trace("event_trace.bin", ec);
+	TEST_CHECK(!ec);
+	trace = trace_file();
+	if (!read_trace("event_trace.bin", trace)) return;
+	TEST_EQUAL(trace.events.size(), 100);
+}
+
+// threads beyond the number of rings aren't traced, but reported
+void test_dropped_threads()
+{
+	int const num_threads = 70;
+	thread_gate gate;
+	std::vector<boost::shared_ptr<thread> > threads;
+	for (int i = 0; i < num_threads; ++i)
+	{
+		threads.push_back(boost::make_shared<thread>(boost::bind(
+			&thread_gate::record_and_wait, &gate, 1, 3)));
+	}
+	gate.wait_for(num_threads);
+
+	error_code ec;
+	dump_event_trace("event_trace.bin", ec);
+	TEST_CHECK(!ec);
+	gate.release();
+	for (int i = 0; i < num_threads; ++i) threads[i]->join();
+
+	trace_file trace;
+	if (!read_trace("event_trace.bin", trace)) return;
+
+	// the main thread holds one of the rings
+	int traced = 0;
+	for (int i = 0; i < int(trace.events.size()); ++i)
+		if (trace.events[i].arg0 == 3) ++traced;
+	TEST_EQUAL(traced, 63);
+	TEST_EQUAL(trace.dropped_threads, num_threads - traced);
+}
+
+#endif
+
+int test_main()
+{
+#ifdef TORRENT_EVENT_TRACE
+	test_dump();
+	test_dropped_threads();
+#else
+	error_code ec;
+	dump_event_trace("event_trace.bin", ec);
+	TEST_CHECK(ec == asio::error::operation_not_supported);
+#endif
+	return 0;
+}
+
@@ -35,6 +35,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/file_storage.hpp"
 #include "libtorrent/file.hpp"
+#include <algorithm>
 
 using namespace libtorrent;
 
@@ -121,6 +122,104 @@ int test_main()
 #endif
 	}
 
+	{
+		// test copying. The copy must not refer to any memory owned
+		// by the original
+		file_storage* st = new file_storage;
+		setup_test_storage(*st);
+		st->rename_file(1, combine_path("test", combine_path("c", "e")));
+
+		std::string name(5000, 'x');
+		st->add_file(combine_path("test", name), 10);
+
+		file_storage copy(*st);
+		file_storage assigned;
+		assigned = *st;
+		delete st;
+
+		TEST_EQUAL(copy.num_files(), 5);
+		TEST_EQUAL(copy.file_path(0), combine_path("test", "a"));
+		TEST_EQUAL(copy.file_path(1), combine_path("test", combine_path("c", "e")));
+		TEST_EQUAL(copy.file_path(3), combine_path("test", combine_path("c", "b")));
+		TEST_EQUAL(copy.file_name(4), name);
+		TEST_EQUAL(assigned.file_path(2), combine_path("test", combine_path("c", "a")));
+		TEST_EQUAL(assigned.file_name(4), name);
+		TEST_EQUAL(assigned.total_size(), 100010);
+	}
+
+	{
+		// test add_file_borrow. The name is not copied
+		char const names[] = "abcdef";
+		file_storage st;
+		file_entry e;
+		e.path = combine_path("test", "abc");
+		e.size = 100;
+		st.add_file_borrow(names, 3, e);
+		e.path = combine_path("test", combine_path("d", "def"));
+		st.add_file_borrow(names + 3, 3, e);
+
+		TEST_CHECK(st.file_name_ptr(0) == names);
+		TEST_EQUAL(st.file_name_len(0), 3);
+		TEST_EQUAL(st.file_path(0), combine_path("test", "abc"));
+		TEST_EQUAL(st.file_path(1), combine_path("test", combine_path("d", "def")));
+		TEST_EQUAL(st.num_paths(), 2);
+
+		file_storage copy(st);
+		TEST_CHECK(copy.file_name_ptr(0) != names);
+		TEST_EQUAL(copy.file_path(1), combine_path("test", combine_path("d", "def")));
+	}
+
+	{
+		// directories are only stored once, no matter the order the files
+		// are added in
+		file_storage st;
+		for (int i = 0; i < 300; ++i)
+		{
+			char name[100];
+			snprintf(name, sizeof(name), "test/dir%d/file%d", i % 3, i);
+			st.add_file(name, 10);
+		}
+		TEST_EQUAL(st.num_paths(), 3);
+		TEST_EQUAL(st.file_path(299), combine_path("test", combine_path("dir2", "file299")));
+		TEST_EQUAL(st.file_path(4), combine_path("test", combine_path("dir1", "file4")));
+		TEST_EQUAL(st.total_size(), 3000);
+	}
+
+	{
+		// directories are interned one path component at a time. Parent
+		// directories are shared, and stored once
+		file_storage st;
+		for (int i = 0; i < 300; ++i)
+		{
+			char name[100];
+			snprintf(name, sizeof(name), "test/a/sub%d/b/file%d", i % 3, i);
+			st.add_file(name, 10);
+		}
+		st.add_file("test/c/file", 10);
+		st.add_file("test/root_file", 10);
+		// a, a/sub0-2, a/sub0-2/b, c and the root directory
+		TEST_EQUAL(st.num_paths(), 9);
+		TEST_EQUAL(st.file_path(5), combine_path("test", combine_path("a"
+			, combine_path("sub2", combine_path("b", "file5")))));
+		TEST_EQUAL(st.file_path(300), combine_path("test", combine_path("c", "file")));
+		TEST_EQUAL(st.file_path(301), combine_path("test", "root_file"));
+
+		std::vector<std::string> paths;
+		for (int i = 0; i < st.num_paths(); ++i) paths.push_back(st.path(i));
+		TEST_CHECK(std::find(paths.begin(), paths.end()
+			, combine_path("a", combine_path("sub1", "b"))) != paths.end());
+		TEST_CHECK(std::find(paths.begin(), paths.end(), "a") != paths.end());
+		TEST_CHECK(std::find(paths.begin(), paths.end(), "") != paths.end());
+
+		// the directory names must survive the original going away
+		file_storage* tmp = new file_storage(st);
+		file_storage copy(*tmp);
+		delete tmp;
+		TEST_EQUAL(copy.num_paths(), 9);
+		TEST_EQUAL(copy.file_path(5), combine_path("test", combine_path("a"
+			, combine_path("sub2", combine_path("b", "file5")))));
+	}
+
 	{
 		file_storage fs;
 		fs.set_piece_length(512);
@@ -147,6 +246,64 @@ int test_main()
 		TEST_EQUAL(rq.length, 841);
 	}
 
+	{
+		// map_block() gives the same answer with and without the piece
+		// index, and when mapping into a small buffer, one chunk at a time
+		file_storage fs;
+		for (int i = 0; i < 200; ++i)
+		{
+			char name[100];
+			snprintf(name, sizeof(name), "test/file%d", i);
+			// some empty files, some spanning several pieces
+			fs.add_file(name, (i * 97) % 300 + (i % 50 == 0 ? 1000 : 0)
+				- (i % 7 == 0 ? (i * 97) % 300 : 0));
+		}
+		fs.set_piece_length(256);
+		fs.set_num_pieces(int((fs.total_size() + 255) / 256));
+
+		std::vector<std::vector<file_slice> > expected;
+		for (int i = 0; i < fs.num_pieces(); ++i)
+			expected.push_back(fs.map_block(i, 0, fs.piece_size(i)));
+
+		fs.build_piece_index();
+		for (int i = 0; i < fs.num_pieces(); ++i)
+		{
+			std::vector<file_slice> slices = fs.map_block(i, 0, fs.piece_size(i));
+			TEST_EQUAL(slices.size(), expected[i].size());
+
+			int offset = 0;
+			int left = fs.piece_size(i);
+			int n = 0;
+			while (left > 0)
+			{
+				file_slice f;
+				TEST_EQUAL(fs.map_block(i, offset, left, &f, 1), 1);
+				if (n >= int(slices.size())) break;
+				TEST_EQUAL(f.file_index, expected[i][n].file_index);
+				TEST_EQUAL(f.offset, expected[i][n].offset);
+				TEST_EQUAL(f.size, expected[i][n].size);
+				TEST_EQUAL(slices[n].file_index, expected[i][n].file_index);
+				offset += f.size;
+				left -= f.size;
+				++n;
+			}
+			TEST_EQUAL(n, int(expected[i].size()));
+		}
+
+		for (int i = 0; i < fs.num_files(); ++i)
+		{
+			if (fs.file_size(i) == 0) continue;
+			TEST_EQUAL(fs.file_index_at_offset(fs.file_offset(i)), i);
+			TEST_EQUAL(fs.file_index_at_offset(fs.file_offset(i)
+				+ fs.file_size(i) - 1), i);
+		}
+
+		// adding a file drops the index
+		fs.add_file("test/last", 1000);
+		fs.set_num_pieces(int((fs.total_size() + 255) / 256));
+		TEST_EQUAL(fs.file_index_at_offset(fs.total_size() - 1), fs.num_files() - 1);
+	}
+
 	return 0;
 }
 
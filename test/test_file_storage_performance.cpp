@@ -0,0 +1,237 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/entry.hpp"
+#include "libtorrent/file.hpp" // for combine_path
+#include <iostream>
+#include <cstdio>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "test.hpp"
+#include "libtorrent/time.hpp"
+
+using namespace libtorrent;
+
+// the number of bytes currently allocated on the heap, or 0 if we
+// don't know how to ask the allocator
+boost::int64_t heap_size()
+{
+#ifdef __GLIBC__
+	struct mallinfo mi = mallinfo();
+	return boost::int64_t(mi.uordblks) + mi.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+std::string file_name(int i)
+{
+	char name[50];
+	snprintf(name, sizeof(name), "track %05d - some longer title.flac", i);
+	return name;
+}
+
+std::string dir_name(int i)
+{
+	char name[50];
+	snprintf(name, sizeof(name), "album %03d", i / 100);
+	return name;
+}
+
+// a deeper directory tree, with 5 files per leaf directory. Files are
+// returned in an order that doesn't follow the directories
+std::string nested_path(int i, int num_files)
+{
+	int const dir = i % (num_files / 5);
+	char name[100];
+	snprintf(name, sizeof(name), "artist %03d/album %02d/disc %d/track %05d.flac"
+		, dir / 40, (dir / 2) % 20, dir % 2, i);
+	return name;
+}
+
+// a multi-file torrent with many small files, 100 per directory
+void generate_torrent(std::vector<char>& buf, int num_files)
+{
+	entry info;
+	info["name"] = "collection";
+	info["piece length"] = 0x40000;
+	entry::list_type& files = info["files"].list();
+	boost::int64_t total_size = 0;
+	for (int i = 0; i < num_files; ++i)
+	{
+		entry f;
+		f["length"] = 0x10000 + i;
+		total_size += 0x10000 + i;
+		entry::list_type& path = f["path"].list();
+		path.push_back(entry(dir_name(i)));
+		path.push_back(entry(file_name(i)));
+		files.push_back(f);
+	}
+	int const num_pieces = int((total_size + 0x40000 - 1) / 0x40000);
+	info["pieces"] = std::string(num_pieces * 20, 'a');
+
+	entry t;
+	t["info"] = info;
+	buf.clear();
+	bencode(std::back_inserter(buf), t);
+}
+
+void print(char const* name, ptime start, ptime stop
+	, boost::int64_t heap, int num_files)
+{
+	std::cout << name << ": " << total_milliseconds(stop - start) << " ms";
+	if (heap > 0)
+		std::cout << " heap: " << heap / 1024 << " kiB ("
+			<< heap / num_files << " bytes per file)";
+	std::cout << std::endl;
+}
+
+int test_main()
+{
+	int const num_files = 100000;
+
+	// building a file_storage one file at a time, the way create_torrent
+	// does it
+	boost::int64_t heap = heap_size();
+	ptime start = time_now_hires();
+	file_storage* fs = new file_storage;
+	for (int i = 0; i < num_files; ++i)
+		fs->add_file(combine_path("collection", combine_path(dir_name(i)
+			, file_name(i))), 0x10000 + i);
+	ptime stop = time_now_hires();
+	print("add_file", start, stop, heap_size() - heap, num_files);
+
+	TEST_EQUAL(fs->num_files(), num_files);
+	TEST_EQUAL(fs->file_path(12345), combine_path("collection"
+		, combine_path(dir_name(12345), file_name(12345))));
+
+	// copying it, the way torrent_info's copy constructor does
+	heap = heap_size();
+	start = time_now_hires();
+	file_storage* copy = new file_storage(*fs);
+	stop = time_now_hires();
+	print("copy", start, stop, heap_size() - heap, num_files);
+
+	delete fs;
+	TEST_EQUAL(copy->num_files(), num_files);
+	TEST_EQUAL(copy->file_path(num_files - 1), combine_path("collection"
+		, combine_path(dir_name(num_files - 1), file_name(num_files - 1))));
+	delete copy;
+
+	// files in a deeper directory tree, not added directory by directory
+	heap = heap_size();
+	start = time_now_hires();
+	fs = new file_storage;
+	for (int i = 0; i < num_files; ++i)
+		fs->add_file(combine_path("collection", nested_path(i, num_files)), 0x10000);
+	stop = time_now_hires();
+	print("add_file (nested)", start, stop, heap_size() - heap, num_files);
+	TEST_EQUAL(fs->file_path(4321), combine_path("collection"
+		, nested_path(4321, num_files)));
+	std::cout << "directories: " << fs->num_paths() << std::endl;
+	delete fs;
+
+	// loading a .torrent file. The file names are not copied out of the
+	// info-dictionary in this case
+	std::vector<char> buf;
+	generate_torrent(buf, num_files);
+	std::cout << "torrent file: " << buf.size() / 1024 << " kiB" << std::endl;
+
+	heap = heap_size();
+	start = time_now_hires();
+	error_code ec;
+	torrent_info* ti = new torrent_info(&buf[0], int(buf.size()), ec);
+	stop = time_now_hires();
+	print("torrent_info", start, stop, heap_size() - heap, num_files);
+
+	TEST_CHECK(!ec);
+	if (ec) std::cout << ec.message() << std::endl;
+	TEST_EQUAL(ti->num_files(), num_files);
+	TEST_EQUAL(ti->files().file_path(777), combine_path("collection"
+		, combine_path(dir_name(777), file_name(777))));
+	TEST_EQUAL(ti->files().file_size(777), 0x10000 + 777);
+
+	// and copying the torrent_info, which also copies the borrowed names
+	heap = heap_size();
+	start = time_now_hires();
+	torrent_info* ti_copy = new torrent_info(*ti);
+	stop = time_now_hires();
+	print("torrent_info copy", start, stop, heap_size() - heap, num_files);
+
+	delete ti;
+	TEST_EQUAL(ti_copy->files().file_path(777), combine_path("collection"
+		, combine_path(dir_name(777), file_name(777))));
+	delete ti_copy;
+
+	// mapping every block of every piece to files, the way the disk I/O
+	// does, with and without the piece index
+	file_storage blocks;
+	for (int i = 0; i < num_files; ++i)
+		blocks.add_file(combine_path("collection", combine_path(dir_name(i)
+			, file_name(i))), 0x1000 + i % 0x8000);
+	blocks.set_piece_length(0x40000);
+	blocks.set_num_pieces(int((blocks.total_size() + 0x3ffff) / 0x40000));
+
+	for (int round = 0; round < 2; ++round)
+	{
+		if (round == 1) blocks.build_piece_index();
+
+		boost::int64_t num_slices = 0;
+		int num_blocks = 0;
+		file_slice slices[16];
+		start = time_now_hires();
+		for (int p = 0; p < blocks.num_pieces(); ++p)
+		{
+			int const piece_size = blocks.piece_size(p);
+			for (int b = 0; b < piece_size; b += 0x4000)
+			{
+				int const len = (std::min)(piece_size - b, 0x4000);
+				num_slices += blocks.map_block(p, b, len, slices, 16);
+				++num_blocks;
+			}
+		}
+		stop = time_now_hires();
+		std::cout << "map_block (" << (round == 0 ? "no index" : "piece index")
+			<< "): " << total_microseconds(stop - start) * 1000. / num_blocks
+			<< " ns per block, " << double(num_slices) / num_blocks
+			<< " files per block" << std::endl;
+	}
+
+	return 0;
+}
+
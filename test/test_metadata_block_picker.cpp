@@ -0,0 +1,190 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "test.hpp"
+#include "libtorrent/metadata_block_picker.hpp"
+#include "libtorrent/time.hpp"
+
+#include <boost/make_shared.hpp>
+
+using namespace libtorrent;
+
+typedef metadata_block_picker::peer_state peer_state;
+
+peer_state make_peer(bool reserve = true, int rtt = -1)
+{
+	peer_state ret;
+	ret.peer = boost::make_shared<int>(0);
+	ret.reserve = reserve;
+	ret.timeout = seconds(3);
+	ret.rtt = rtt;
+	return ret;
+}
+
+// picks a block for ``p`` and records it as requested by it
+int pick(metadata_block_picker& picker, peer_state& p, ptime now)
+{
+	int const ret = picker.pick(p, now);
+	if (ret >= 0) p.requested.push_back(ret);
+	return ret;
+}
+
+// blocks are spread across peers, and a block reserved for one peer isn't
+// handed to another until the request times out or is cancelled
+void test_assignment()
+{
+	ptime const now = time_now();
+	metadata_block_picker picker;
+	picker.resize(3);
+
+	peer_state a = make_peer();
+	peer_state b = make_peer();
+
+	TEST_EQUAL(pick(picker, a, now), 0);
+	TEST_EQUAL(pick(picker, b, now), 1);
+	TEST_EQUAL(pick(picker, a, now), 2);
+	// every block is reserved, and b's round-trip time isn't known, so it
+	// doesn't get a speculative request
+	TEST_EQUAL(pick(picker, b, now), -1);
+
+	// a peer without metadata doesn't reserve the block it picks
+	peer_state c = make_peer(false);
+	metadata_block_picker picker2;
+	picker2.resize(1);
+	TEST_EQUAL(pick(picker2, c, now), 0);
+	TEST_EQUAL(pick(picker2, b, now), 0);
+	// but a peer never gets the same block twice
+	TEST_EQUAL(pick(picker2, c, now), -1);
+
+	// receiving blocks
+	TEST_CHECK(!picker.have(0));
+	TEST_CHECK(picker.received(a.peer, 0));
+	TEST_CHECK(picker.have(0));
+	// a second copy is redundant
+	TEST_CHECK(!picker.received(b.peer, 0));
+	TEST_CHECK(picker.received(b.peer, 1));
+	TEST_CHECK(!picker.have_all());
+	TEST_CHECK(picker.received(a.peer, 2));
+	TEST_CHECK(picker.have_all());
+
+	std::vector<boost::shared_ptr<void> > sources;
+	picker.sources(sources);
+	TEST_EQUAL(sources.size(), 3);
+	TEST_EQUAL(std::count(sources.begin(), sources.end(), a.peer), 2);
+	TEST_EQUAL(std::count(sources.begin(), sources.end(), b.peer), 1);
+
+	// after a failed hash check, everything is requested again
+	picker.reset();
+	TEST_EQUAL(picker.num_blocks(), 3);
+	TEST_CHECK(!picker.have(0));
+	a.requested.clear();
+	TEST_EQUAL(pick(picker, a, now), 0);
+}
+
+// a block is handed to another peer once it times out, or right away when
+// the peer it's reserved for cancels it
+void test_timeout()
+{
+	ptime const now = time_now();
+	metadata_block_picker picker;
+	picker.resize(2);
+
+	peer_state a = make_peer();
+	peer_state b = make_peer();
+	b.timeout = seconds(10);
+	peer_state c = make_peer();
+
+	TEST_EQUAL(pick(picker, a, now), 0);
+	TEST_EQUAL(pick(picker, b, now), 1);
+	TEST_EQUAL(pick(picker, c, now), -1);
+	TEST_EQUAL(pick(picker, c, now + seconds(2)), -1);
+
+	// a's reservation has timed out, b's hasn't
+	TEST_EQUAL(pick(picker, c, now + seconds(4)), 0);
+
+	// only the peer the block is reserved for can cancel it
+	picker.cancel(a.peer.get(), 1);
+	TEST_EQUAL(pick(picker, a, now + seconds(4)), -1);
+	picker.cancel(b.peer.get(), 1);
+	TEST_EQUAL(pick(picker, a, now + seconds(4)), 1);
+
+	// cancelling a block we have doesn't make it available again
+	TEST_CHECK(picker.received(c.peer, 0));
+	picker.cancel(c.peer.get(), 0);
+	peer_state d = make_peer();
+	TEST_EQUAL(pick(picker, d, now + seconds(20)), 1);
+	TEST_EQUAL(pick(picker, d, now + seconds(20)), -1);
+}
+
+// once every block is outstanding, a peer expected to respond before a
+// request times out is sent a duplicate request for the block that's been
+// outstanding the longest. Each block is duplicated at most once
+void test_speculative()
+{
+	ptime const now = time_now();
+	metadata_block_picker picker;
+	picker.resize(2);
+
+	peer_state slow = make_peer();
+	slow.timeout = seconds(10);
+	TEST_EQUAL(pick(picker, slow, now), 0);
+	TEST_EQUAL(pick(picker, slow, now + seconds(1)), 1);
+
+	// a peer that's expected to respond after the requests time out
+	peer_state late = make_peer(true, 20000);
+	TEST_EQUAL(pick(picker, late, now + seconds(1)), -1);
+
+	// a peer without metadata never gets speculative requests
+	peer_state no_metadata = make_peer(false, 100);
+	TEST_EQUAL(pick(picker, no_metadata, now + seconds(1)), -1);
+
+	peer_state fast = make_peer(true, 100);
+	TEST_EQUAL(pick(picker, fast, now + seconds(1)), 0);
+	TEST_EQUAL(pick(picker, fast, now + seconds(1)), 1);
+
+	// both blocks have been duplicated now
+	peer_state fast2 = make_peer(true, 100);
+	TEST_EQUAL(pick(picker, fast2, now + seconds(1)), -1);
+
+	// whichever response arrives first is used
+	TEST_CHECK(picker.received(fast.peer, 0));
+	TEST_CHECK(!picker.received(slow.peer, 0));
+}
+
+int test_main()
+{
+	test_assignment();
+	test_timeout();
+	test_speculative();
+	return 0;
+}
@@ -0,0 +1,212 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "test.hpp"
+#include "libtorrent/metadata_cache.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/entry.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/file.hpp"
+#include "libtorrent/error_code.hpp"
+
+using namespace libtorrent;
+
+// a bencoded info-dictionary of a torrent with ``num_files`` files
+std::vector<char> make_info(char const* name, int num_files)
+{
+	entry info;
+	info["name"] = name;
+	info["piece length"] = 0x4000;
+	entry::list_type& files = info["files"].list();
+	int total_size = 0;
+	for (int i = 0; i < num_files; ++i)
+	{
+		char filename[100];
+		snprintf(filename, sizeof(filename), "file-%d", i);
+		entry f;
+		f["length"] = 1000 + i;
+		f["path"].list().push_back(entry(filename));
+		files.push_back(f);
+		total_size += 1000 + i;
+	}
+	int const num_pieces = (total_size + 0x3fff) / 0x4000;
+	std::string hashes(num_pieces * 20, 0);
+	for (int i = 0; i < num_pieces * 20; ++i) hashes[i] = char(i / 20 + i);
+	info["pieces"] = hashes;
+	std::vector<char> ret;
+	bencode(std::back_inserter(ret), info);
+	return ret;
+}
+
+int test_main()
+{
+	error_code ec;
+	std::string const dir = combine_path(complete("."), "test_metadata_cache");
+	remove_all(dir, ec);
+	ec.clear();
+
+	metadata_cache cache(dir);
+
+	std::vector<char> info_a = make_info("a", 10);
+	std::vector<char> info_b = make_info("b", 3);
+	// a torrent_info that refers to the buffer it's constructed from
+	boost::shared_ptr<torrent_info> a;
+	{
+		boost::shared_array<char> buf(new char[info_a.size()]);
+		memcpy(buf.get(), &info_a[0], info_a.size());
+		a.reset(new torrent_info(buf, int(info_a.size()), ec));
+		TEST_CHECK(!ec);
+		if (ec) fprintf(stderr, "torrent_info: %s\n", ec.message().c_str());
+		TEST_CHECK(a->metadata().get() == buf.get());
+		TEST_EQUAL(a->num_files(), 10);
+		TEST_EQUAL(a->files().file_path(3), combine_path("a", "file-3"));
+	}
+	sha1_hash const ih_a = a->info_hash();
+	sha1_hash const ih_b = hasher(&info_b[0], int(info_b.size())).final();
+
+	TEST_CHECK(!cache.has(ih_a));
+	boost::shared_ptr<torrent_info> ti = cache.load(ih_a, ec);
+	TEST_CHECK(!ti);
+	TEST_CHECK(ec);
+	ec.clear();
+
+	// the cache directory is created on the first save
+	cache.save(*a, ec);
+	TEST_CHECK(!ec);
+	if (ec) fprintf(stderr, "save: %s\n", ec.message().c_str());
+	cache.save(&info_b[0], int(info_b.size()), ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(cache.has(ih_a));
+	TEST_CHECK(cache.has(ih_b));
+
+	// saving a torrent that's already in the cache is fine
+	cache.save(*a, ec);
+	TEST_CHECK(!ec);
+
+	std::vector<sha1_hash> torrents;
+	cache.torrents(torrents);
+	TEST_EQUAL(torrents.size(), 2);
+	TEST_CHECK(std::find(torrents.begin(), torrents.end(), ih_a) != torrents.end());
+	TEST_CHECK(std::find(torrents.begin(), torrents.end(), ih_b) != torrents.end());
+
+	ti = cache.load(ih_a, ec);
+	TEST_CHECK(ti);
+	TEST_CHECK(!ec);
+	if (ti)
+	{
+		TEST_CHECK(ti->info_hash() == ih_a);
+		TEST_EQUAL(ti->num_files(), 10);
+		TEST_EQUAL(ti->files().file_path(9), combine_path("a", "file-9"));
+		TEST_EQUAL(ti->num_pieces(), a->num_pieces());
+		TEST_CHECK(ti->hash_for_piece(0) == a->hash_for_piece(0));
+		TEST_EQUAL(ti->metadata_size(), int(info_a.size()));
+
+		// removing it from the cache doesn't affect a torrent already
+		// loaded from it
+		cache.remove(ih_a, ec);
+		TEST_CHECK(!ec);
+		TEST_CHECK(!cache.has(ih_a));
+		TEST_EQUAL(ti->files().file_path(2), combine_path("a", "file-2"));
+
+		// and a copy is independent of the cache file
+		torrent_info copy(*ti);
+		ti.reset();
+		TEST_EQUAL(copy.files().file_path(4), combine_path("a", "file-4"));
+	}
+
+	// a file whose content doesn't match its info-hash is rejected
+	cache.save(*a, ec);
+	TEST_CHECK(!ec);
+	FILE* f = fopen(cache.path(ih_b).c_str(), "wb");
+	TEST_CHECK(f != NULL);
+	if (f)
+	{
+		fwrite(&info_a[0], 1, info_a.size(), f);
+		fclose(f);
+	}
+	ti = cache.load(ih_b, ec);
+	TEST_CHECK(!ti);
+	TEST_CHECK(ec == error_code(errors::mismatching_info_hash, get_libtorrent_category()));
+	ec.clear();
+
+	// and so is one that isn't bencoded
+	f = fopen(cache.path(ih_b).c_str(), "wb");
+	if (f)
+	{
+		fputs("not bencoded", f);
+		fclose(f);
+	}
+	ti = cache.load(ih_b, ec);
+	TEST_CHECK(!ti);
+	TEST_CHECK(ec);
+	ec.clear();
+
+	// piece hashes that are evicted are read back from the file when
+	// they're used
+	std::vector<char> info_c = make_info("c", 5000);
+	cache.save(&info_c[0], int(info_c.size()), ec);
+	TEST_CHECK(!ec);
+	sha1_hash const ih_c = hasher(&info_c[0], int(info_c.size())).final();
+	boost::shared_array<char> buf_c(new char[info_c.size()]);
+	memcpy(buf_c.get(), &info_c[0], info_c.size());
+	torrent_info heap_c(buf_c, int(info_c.size()), ec);
+	TEST_CHECK(!ec);
+	ti = cache.load(ih_c, ec);
+	TEST_CHECK(ti);
+	if (ti)
+	{
+		TEST_CHECK(ti->num_pieces() > 300);
+		ti->prefetch_piece_hashes(0, 10);
+		ti->prefetch_piece_hashes(ti->num_pieces() - 2, 10);
+		for (int i = 0; i < ti->num_pieces(); ++i)
+			TEST_CHECK(ti->hash_for_piece(i) == heap_c.hash_for_piece(i));
+		ti->evict_piece_hashes();
+		for (int i = 0; i < ti->num_pieces(); ++i)
+			TEST_CHECK(ti->hash_for_piece(i) == heap_c.hash_for_piece(i));
+		TEST_EQUAL(ti->files().file_path(4999), combine_path("c", "file-4999"));
+	}
+
+	// and for a torrent_info not backed by a file, it does nothing
+	heap_c.evict_piece_hashes();
+	heap_c.prefetch_piece_hashes(0, 1);
+	TEST_CHECK(heap_c.hash_for_piece(1) == sha1_hash(&info_c[0]
+		+ (heap_c.hash_for_piece_ptr(1) - buf_c.get())));
+
+	remove_all(dir, ec);
+	return 0;
+}
+
@@ -37,6 +37,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/pe_crypto.hpp"
 #include "libtorrent/session.hpp"
 #include "libtorrent/random.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/chained_buffer.hpp"
 
 #include "setup_transfer.hpp"
 #include "test.hpp"
@@ -168,6 +170,224 @@ void test_enc_handler(libtorrent::encryption_handler* a, libtorrent::encryption_
 	}
 }
 
+// encrypting a buffer split up in an iovec must produce the same
+// stream as encrypting it in one call
+void test_enc_iovec(libtorrent::encryption_handler* a, libtorrent::encryption_handler* b)
+{
+	using namespace libtorrent;
+
+	std::vector<char> buf(100000);
+	std::generate(buf.begin(), buf.end(), &std::rand);
+	std::vector<char> cmp_buf = buf;
+
+	std::vector<asio::mutable_buffer> iovec;
+	int pos = 0;
+	while (pos < int(buf.size()))
+	{
+		int len = (std::min)(int(buf.size()) - pos, 1 + rand() % 20000);
+		iovec.push_back(asio::mutable_buffer(&buf[pos], len));
+		pos += len;
+	}
+
+	a->encrypt(iovec);
+	b->decrypt(&buf[0], buf.size());
+	TEST_CHECK(buf == cmp_buf);
+
+	b->encrypt(&buf[0], buf.size());
+	a->decrypt(iovec);
+	TEST_CHECK(buf == cmp_buf);
+}
+
+// known answer tests from RFC 6229. rc4_handler discards the first 1024
+// bytes of the keystream, so the first byte it produces is the one at
+// offset 1024
+struct rc4_vector
+{
+	char const* key;
+	int key_len;
+	// the keystream at offsets 1024, 1520 and 4096
+	char const* stream[3];
+};
+
+rc4_vector const rc4_vectors[] =
+{
+	{ "\x01\x02\x03\x04\x05", 5,
+		{ "\x30\xab\xbc\xc7\xc2\x0b\x01\x60\x9f\x23\xee\x2d\x5f\x6b\xb7\xdf"
+		, "\x32\x94\xf7\x44\xd8\xf9\x79\x05\x07\xe7\x0f\x62\xe5\xbb\xce\xea"
+		, "\xff\x25\xb5\x89\x95\x99\x67\x07\xe5\x1f\xbd\xf0\x8b\x34\xd8\x75" } },
+	{ "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f\x10", 16,
+		{ "\xbd\xf0\x32\x4e\x60\x83\xdc\xc6\xd3\xce\xdd\x3c\xa8\xc5\x3c\x16"
+		, "\xb4\x01\x10\xc4\x19\x0b\x56\x22\xa9\x61\x16\xb0\x01\x7e\xd2\x97"
+		, "\xa3\x6a\x4c\x30\x1a\xe8\xac\x13\x61\x0c\xcb\xc1\x22\x56\xca\xcc" } },
+	{ "\xeb\xb4\x62\x27\xc6\xcc\x8b\x37\x64\x19\x10\x83\x32\x22\x77\x2a", 16,
+		{ "\xb5\x15\xa8\xc5\x01\x17\x54\xf5\x90\x03\x05\x8b\xdb\x81\x51\x4e"
+		, "\x3c\x70\x04\x7e\x8c\xbc\x03\x8e\x3b\x98\x20\xdb\x60\x1d\xa4\x95"
+		, "\x5b\xbe\xb4\x78\x7d\x59\xe5\x37\x3f\xdb\xea\x6c\x6f\x75\xc2\x9b" } },
+};
+
+void test_rc4_vectors()
+{
+	using namespace libtorrent;
+
+	int const offsets[] = { 1024, 1520, 4096 };
+
+	for (int i = 0; i < int(sizeof(rc4_vectors) / sizeof(rc4_vectors[0])); ++i)
+	{
+		rc4_vector const& v = rc4_vectors[i];
+
+		// encrypting zeroes yields the keystream. Feed it in uneven pieces,
+		// to cover the tail of the unrolled loop too
+		rc4_handler h;
+		h.set_outgoing_key((unsigned char const*)v.key, v.key_len);
+		std::vector<char> stream(4096 + 16 - 1024, 0);
+		int pos = 0;
+		for (int len = 1; pos < int(stream.size()); ++len)
+		{
+			int const n = (std::min)(len, int(stream.size()) - pos);
+			h.encrypt(&stream[pos], n);
+			pos += n;
+		}
+		for (int k = 0; k < 3; ++k)
+			TEST_CHECK(std::memcmp(&stream[offsets[k] - 1024], v.stream[k], 16) == 0);
+
+		// and the same through the iovec interface, which is what the
+		// send buffer is encrypted with
+		rc4_handler h2;
+		h2.set_outgoing_key((unsigned char const*)v.key, v.key_len);
+		std::vector<char> stream2(stream.size(), 0);
+		std::vector<asio::mutable_buffer> iovec;
+		iovec.push_back(asio::mutable_buffer(&stream2[0], 3));
+		iovec.push_back(asio::mutable_buffer(&stream2[3], 1000));
+		iovec.push_back(asio::mutable_buffer(&stream2[1003], stream2.size() - 1003));
+		h2.encrypt(iovec);
+		TEST_CHECK(stream2 == stream);
+	}
+
+#if !defined TORRENT_USE_OPENSSL && !defined TORRENT_USE_GCRYPT
+	// the built-in implementation, from the start of the keystream
+	rc4 state;
+	rc4_init((unsigned char const*)rc4_vectors[0].key, rc4_vectors[0].key_len, &state);
+	unsigned char buf[32];
+	std::memset(buf, 0, sizeof(buf));
+	rc4_encrypt(buf, 7, &state);
+	rc4_encrypt(buf + 7, sizeof(buf) - 7, &state);
+	TEST_CHECK(std::memcmp(buf
+		, "\xb2\x39\x63\x05\xf0\x3d\xc0\x27\xcc\xc3\x52\x4a\x0a\x11\x18\xa8"
+		"\x69\x82\x94\x4f\x18\xfc\x82\xd5\x89\xc4\x03\xa4\x7a\x0d\x09\x19", 32) == 0);
+#endif
+}
+
+void free_test_buffer(char* buf, void*, libtorrent::block_cache_reference)
+{
+	std::free(buf);
+}
+
+// mirrors bt_peer_connection's deferred encryption. Messages are appended
+// to the send buffer in plain text, and the tail of not-yet-encrypted
+// bytes is encrypted in one pass before each write. Meanwhile, the front
+// of the buffer is drained by the socket. The receiver must see the same
+// byte stream as was queued
+void test_deferred_encryption(libtorrent::encryption_handler* a
+	, libtorrent::encryption_handler* b)
+{
+	using namespace libtorrent;
+
+	std::vector<char> plain;
+	std::vector<char> received;
+	chained_buffer send_buffer;
+	std::vector<asio::mutable_buffer> iovec;
+	int pending = 0;
+
+	for (int round = 0; round < 200; ++round)
+	{
+		// queue a few messages. Some fill the room left in the last buffer
+		// and some get buffers of their own
+		int const num_messages = 1 + rand() % 4;
+		for (int m = 0; m < num_messages; ++m)
+		{
+			int const len = 1 + rand() % 3000;
+			std::vector<char> msg(len);
+			std::generate(msg.begin(), msg.end(), &std::rand);
+			plain.insert(plain.end(), msg.begin(), msg.end());
+
+			int const room = (std::min)(send_buffer.space_in_last_buffer(), len);
+			if (room > 0) send_buffer.append(&msg[0], room);
+			if (len > room)
+			{
+				// leave some room at the end for later messages
+				int const size = len - room + rand() % 2000;
+				char* buf = (char*)std::malloc(size);
+				std::memcpy(buf, &msg[room], len - room);
+				send_buffer.append_buffer(buf, size, len - room
+					, &free_test_buffer, NULL);
+			}
+			pending += len;
+		}
+
+		// setup_send()
+		send_buffer.build_mutable_iovec_tail(pending, iovec);
+		a->encrypt(iovec);
+		pending = 0;
+
+		// the socket writes part of the buffer. The last round flushes
+		// what's left
+		int to_send = round == 199 ? send_buffer.size()
+			: rand() % (send_buffer.size() + 1);
+		while (to_send > 0)
+		{
+			std::vector<asio::const_buffer> const& vec = send_buffer.build_iovec(to_send);
+			int sent = 0;
+			for (std::vector<asio::const_buffer>::const_iterator i = vec.begin()
+				, end(vec.end()); i != end; ++i)
+			{
+				char const* p = asio::buffer_cast<char const*>(*i);
+				received.insert(received.end(), p, p + asio::buffer_size(*i));
+				sent += int(asio::buffer_size(*i));
+			}
+			send_buffer.pop_front(sent);
+			to_send -= sent;
+		}
+	}
+	TEST_EQUAL(send_buffer.size(), 0);
+
+	TEST_EQUAL(received.size(), plain.size());
+	TEST_CHECK(received != plain);
+	b->decrypt(&received[0], received.size());
+	TEST_CHECK(received == plain);
+}
+
+// measures the throughput of encrypting a send window made up of
+// block-sized buffers, one buffer at a time and as a single iovec
+void test_enc_speed(libtorrent::encryption_handler* h)
+{
+	using namespace libtorrent;
+
+	int const block_size = 0x4000;
+	int const num_blocks = 64;
+	int const rounds = 64;
+	std::vector<char> buf(block_size * num_blocks);
+	std::generate(buf.begin(), buf.end(), &std::rand);
+
+	std::vector<asio::mutable_buffer> iovec;
+	for (int i = 0; i < num_blocks; ++i)
+		iovec.push_back(asio::mutable_buffer(&buf[i * block_size], block_size));
+
+	ptime start = time_now_hires();
+	for (int r = 0; r < rounds; ++r)
+		for (int i = 0; i < num_blocks; ++i)
+			h->encrypt(&buf[i * block_size], block_size);
+	ptime mid = time_now_hires();
+	for (int r = 0; r < rounds; ++r)
+		h->encrypt(iovec);
+	ptime end = time_now_hires();
+
+	boost::int64_t const bytes = boost::int64_t(rounds) * buf.size();
+	fprintf(stderr, "RC4 per buffer: %.1f MB/s\n"
+		, bytes / double(total_microseconds(mid - start) + 1));
+	fprintf(stderr, "RC4 iovec: %.1f MB/s\n"
+		, bytes / double(total_microseconds(end - mid) + 1));
+}
+
 #endif
 
 int test_main()
@@ -209,6 +429,10 @@ int test_main()
 	rc42.set_incoming_key(&test1_key[0], 20);
 	rc42.set_outgoing_key(&test2_key[0], 20);
 	test_enc_handler(&rc41, &rc42);
+	test_enc_iovec(&rc41, &rc42);
+	test_deferred_encryption(&rc41, &rc42);
+	test_rc4_vectors();
+	test_enc_speed(&rc41);
 	
 #ifdef TORRENT_USE_VALGRIND
 	const int timeout = 10;
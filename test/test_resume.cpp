@@ -35,6 +35,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/torrent_info.hpp"
 #include "libtorrent/random.hpp"
 #include "libtorrent/create_torrent.hpp"
+#include "libtorrent/alert_types.hpp"
 
 #include <boost/make_shared.hpp>
 
@@ -166,10 +167,186 @@ void default_tests(torrent_status const& s)
 	TEST_EQUAL(s.completed_time, 1348);
 }
 
+int num_loads = 0;
+std::vector<char> lazy_torrent;
+
+void load_lazy_torrent(sha1_hash const& ih, std::vector<char>& buf, error_code& ec)
+{
+	++num_loads;
+	buf = lazy_torrent;
+}
+
+// adds a torrent unloaded, with every piece in its resume data marked
+// ``have`` and with priority ``prio``, and returns its status
+torrent_status lazy_status(boost::shared_ptr<torrent_info> ti, char have, char prio)
+{
+	std::vector<char> buf = generate_resume_data(ti.get());
+	entry rd = bdecode(buf.begin(), buf.end());
+	rd["name"] = ti->name();
+	rd["piece_length"] = ti->piece_length();
+	rd["total_size"] = ti->total_size();
+	rd["pieces"] = std::string(ti->num_pieces(), have);
+	rd["piece_priority"] = std::string(ti->num_pieces(), prio);
+	rd["paused"] = 1;
+
+	libtorrent::session ses;
+	ses.set_load_function(&load_lazy_torrent);
+
+	add_torrent_params p;
+	p.info_hash = ti->info_hash();
+	p.flags = add_torrent_params::flag_paused;
+	p.save_path = ".";
+	bencode(std::back_inserter(p.resume_data), rd);
+
+	torrent_handle h = ses.add_torrent(p);
+	return h.status();
+}
+
+// a torrent added with resume data that has the metadata summary, but
+// not the metadata, is added unloaded and loaded when it's started
+void test_lazy_load()
+{
+	boost::shared_ptr<torrent_info> ti = generate_torrent();
+
+	std::string torrent = "d4:info";
+	torrent.append(ti->metadata().get(), ti->metadata_size());
+	torrent += "e";
+	lazy_torrent.assign(torrent.begin(), torrent.end());
+	num_loads = 0;
+
+	std::vector<char> buf = generate_resume_data(ti.get());
+	entry rd = bdecode(buf.begin(), buf.end());
+	rd["name"] = ti->name();
+	rd["piece_length"] = ti->piece_length();
+	rd["total_size"] = ti->total_size();
+	rd["paused"] = 1;
+
+	libtorrent::session ses;
+	ses.set_load_function(&load_lazy_torrent);
+
+	add_torrent_params p;
+	p.info_hash = ti->info_hash();
+	p.flags = add_torrent_params::flag_paused;
+	p.save_path = ".";
+	bencode(std::back_inserter(p.resume_data), rd);
+
+	torrent_handle h = ses.add_torrent(p);
+	torrent_status s = h.status();
+	TEST_EQUAL(s.info_hash, ti->info_hash());
+	TEST_CHECK(s.has_metadata);
+	TEST_EQUAL(s.paused, true);
+	TEST_EQUAL(num_loads, 0);
+
+	h.resume();
+	s = h.status();
+	TEST_EQUAL(num_loads, 1);
+	TEST_EQUAL(s.paused, false);
+	TEST_EQUAL(s.error, "");
+
+	// whether an unloaded torrent is finished is taken from its resume
+	// data, for the auto manager to queue it as a seed or as a download
+	num_loads = 0;
+	s = lazy_status(ti, 0, 1);
+	TEST_EQUAL(s.is_seeding, false);
+	TEST_EQUAL(s.is_finished, false);
+	s = lazy_status(ti, 1, 1);
+	TEST_EQUAL(s.is_seeding, true);
+	TEST_EQUAL(s.is_finished, true);
+	// the pieces we don't have aren't wanted
+	s = lazy_status(ti, 0, 0);
+	TEST_EQUAL(s.is_seeding, false);
+	TEST_EQUAL(s.is_finished, true);
+	TEST_EQUAL(num_loads, 0);
+}
+
+// the settings in the resume data of an unloaded torrent apply right away,
+// and changes made to them before it's loaded are saved
+void test_lazy_resume_settings()
+{
+	boost::shared_ptr<torrent_info> ti = generate_torrent();
+
+	std::string torrent = "d4:info";
+	torrent.append(ti->metadata().get(), ti->metadata_size());
+	torrent += "e";
+	lazy_torrent.assign(torrent.begin(), torrent.end());
+
+	std::vector<char> buf = generate_resume_data(ti.get());
+	entry rd = bdecode(buf.begin(), buf.end());
+	rd["name"] = ti->name();
+	rd["piece_length"] = ti->piece_length();
+	rd["total_size"] = ti->total_size();
+	rd["pieces"] = std::string(ti->num_pieces(), '\x01');
+
+	{
+		// a torrent saved as force-started (not paused and not auto-managed)
+		// is started, and loaded, even when added with the default flags
+		num_loads = 0;
+		libtorrent::session ses;
+		ses.set_load_function(&load_lazy_torrent);
+
+		add_torrent_params p;
+		p.info_hash = ti->info_hash();
+		p.save_path = ".";
+		bencode(std::back_inserter(p.resume_data), rd);
+
+		torrent_handle h = ses.add_torrent(p);
+		torrent_status s = h.status();
+		TEST_EQUAL(num_loads, 1);
+		TEST_EQUAL(s.paused, false);
+		TEST_EQUAL(s.auto_managed, false);
+	}
+
+	num_loads = 0;
+	rd["paused"] = 1;
+	libtorrent::session ses;
+	ses.set_load_function(&load_lazy_torrent);
+
+	add_torrent_params p;
+	p.info_hash = ti->info_hash();
+	p.save_path = ".";
+	bencode(std::back_inserter(p.resume_data), rd);
+
+	torrent_handle h = ses.add_torrent(p);
+	torrent_status s = h.status();
+	TEST_EQUAL(s.paused, true);
+	TEST_EQUAL(s.auto_managed, false);
+	TEST_EQUAL(s.connections_limit, 1345);
+	TEST_EQUAL(h.upload_limit(), 1343);
+
+	h.set_upload_limit(1000);
+	h.set_max_connections(100);
+
+	// the changes are saved, along with the pieces from the resume data,
+	// without loading the torrent. A second save still has them
+	for (int i = 0; i < 2; ++i)
+	{
+		h.save_resume_data();
+		std::auto_ptr<alert> a = wait_for_alert(ses, save_resume_data_alert::alert_type);
+		TEST_CHECK(a.get());
+		if (a.get() == 0) break;
+		entry const& saved = *alert_cast<save_resume_data_alert>(a.get())->resume_data;
+		TEST_EQUAL(saved["upload_rate_limit"].integer(), 1000);
+		TEST_EQUAL(saved["max_connections"].integer(), 100);
+		TEST_EQUAL(saved["paused"].integer(), 1);
+		TEST_EQUAL(saved["pieces"].string(), std::string(ti->num_pieces(), '\x01'));
+	}
+	TEST_EQUAL(num_loads, 0);
+
+	// loading it doesn't revert the changes to the resume data
+	h.resume();
+	s = h.status();
+	TEST_EQUAL(num_loads, 1);
+	TEST_EQUAL(s.connections_limit, 100);
+	TEST_EQUAL(h.upload_limit(), 1000);
+}
+
 int test_main()
 {
 	torrent_status s;
 
+	test_lazy_load();
+	test_lazy_resume_settings();
+
 	fprintf(stderr, "flags: 0\n");
 	s = test_resume_flags(0);
 	default_tests(s);
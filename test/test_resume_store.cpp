@@ -0,0 +1,332 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "test.hpp"
+#include "libtorrent/resume_store.hpp"
+#include "libtorrent/file.hpp"
+#include "libtorrent/error_code.hpp"
+
+using namespace libtorrent;
+
+std::vector<char> make_payload(char c, int size)
+{
+	return std::vector<char>(size, c);
+}
+
+// overwrites the byte at ``offset`` in the file at ``path``
+void poke(std::string const& path, long offset, char c)
+{
+	FILE* f = fopen(path.c_str(), "r+b");
+	TEST_CHECK(f != NULL);
+	if (f == NULL) return;
+	fseek(f, offset, SEEK_SET);
+	fputc(c, f);
+	fclose(f);
+}
+
+void append(std::string const& path, char const* buf, int size)
+{
+	FILE* f = fopen(path.c_str(), "ab");
+	TEST_CHECK(f != NULL);
+	if (f == NULL) return;
+	fwrite(buf, 1, size, f);
+	fclose(f);
+}
+
+int test_main()
+{
+	error_code ec;
+	std::string const path = combine_path(complete("."), "test_resume_store.dat");
+	remove(path, ec);
+	ec.clear();
+
+	sha1_hash const a("aaaaaaaaaaaaaaaaaaaa");
+	sha1_hash const b("bbbbbbbbbbbbbbbbbbbb");
+	sha1_hash const c("cccccccccccccccccccc");
+
+	std::vector<char> buf;
+
+	{
+		resume_store s;
+		s.open(path, ec);
+		TEST_CHECK(!ec);
+		TEST_CHECK(s.is_open());
+		TEST_EQUAL(s.num_torrents(), 0);
+		TEST_EQUAL(s.garbage(), 0);
+
+		s.save(a, make_payload('a', 100), ec);
+		TEST_CHECK(!ec);
+		s.save(b, make_payload('b', 2000), ec);
+		TEST_CHECK(!ec);
+		s.save(c, make_payload('c', 0), ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.num_torrents(), 3);
+		TEST_EQUAL(s.garbage(), 0);
+
+		TEST_CHECK(s.load(b, buf, ec));
+		TEST_CHECK(buf == make_payload('b', 2000));
+		TEST_CHECK(s.load(c, buf, ec));
+		TEST_CHECK(buf.empty());
+		TEST_CHECK(!s.load(sha1_hash(0), buf, ec));
+		TEST_CHECK(!ec);
+
+		// saving the same resume data again doesn't write anything
+		boost::int64_t const size = s.file_size();
+		s.save(a, make_payload('a', 100), ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.file_size(), size);
+
+		// but changed resume data supersedes the old record
+		s.save(a, make_payload('A', 150), ec);
+		TEST_CHECK(!ec);
+		TEST_CHECK(s.file_size() > size);
+		TEST_CHECK(s.garbage() > 0);
+		TEST_CHECK(s.load(a, buf, ec));
+		TEST_CHECK(buf == make_payload('A', 150));
+
+		s.remove(c, ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.num_torrents(), 2);
+		TEST_CHECK(!s.load(c, buf, ec));
+
+		s.flush(ec);
+		TEST_CHECK(!ec);
+	}
+
+	// the index is rebuilt when the store is opened again
+	boost::int64_t file_size = 0;
+	{
+		resume_store s;
+		s.open(path, ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.num_torrents(), 2);
+		TEST_CHECK(s.load(a, buf, ec));
+		TEST_CHECK(buf == make_payload('A', 150));
+		TEST_CHECK(s.load(b, buf, ec));
+		TEST_CHECK(buf == make_payload('b', 2000));
+		TEST_CHECK(!s.load(c, buf, ec));
+		TEST_CHECK(s.garbage() > 0);
+
+		std::vector<sha1_hash> torrents;
+		s.torrents(torrents);
+		TEST_EQUAL(torrents.size(), 2);
+
+		file_size = s.file_size();
+	}
+
+	// a record cut short at the end of the file is discarded
+	{
+		char partial[20];
+		memset(partial, 0, sizeof(partial));
+		append(path, partial, sizeof(partial));
+
+		resume_store s;
+		s.open(path, ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.file_size(), file_size);
+		TEST_EQUAL(s.num_torrents(), 2);
+
+		// and new records are written in its place
+		s.save(c, make_payload('c', 10), ec);
+		TEST_CHECK(!ec);
+	}
+
+	{
+		resume_store s;
+		s.open(path, ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.num_torrents(), 3);
+		TEST_CHECK(s.load(c, buf, ec));
+		TEST_CHECK(buf == make_payload('c', 10));
+
+		// compacting drops the superseded records
+		s.compact(ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.garbage(), 0);
+		TEST_CHECK(s.file_size() < file_size);
+		TEST_EQUAL(s.num_torrents(), 3);
+		TEST_CHECK(s.load(a, buf, ec));
+		TEST_CHECK(buf == make_payload('A', 150));
+		TEST_CHECK(s.load(c, buf, ec));
+		TEST_CHECK(buf == make_payload('c', 10));
+		file_size = s.file_size();
+	}
+
+	// a corrupt payload is detected when it's loaded
+	{
+		// the last byte of the file is the last byte of the last payload
+		poke(path, long(file_size - 1), 'x');
+
+		resume_store s;
+		s.open(path, ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.num_torrents(), 3);
+		int num_corrupt = 0;
+		sha1_hash const hashes[] = {a, b, c};
+		for (int i = 0; i < 3; ++i)
+		{
+			if (s.load(hashes[i], buf, ec)) continue;
+			TEST_CHECK(ec == error_code(errors::resume_record_corrupt));
+			ec.clear();
+			++num_corrupt;
+		}
+		TEST_EQUAL(num_corrupt, 1);
+	}
+
+	// a record with a corrupt header is skipped, but the records after it
+	// are kept, and the file isn't truncated
+	{
+		// after compacting, the first record is a's. Its info-hash starts
+		// 16 bytes into its header, which follows the 8 byte file header
+		poke(path, 8 + 16, 'x');
+
+		resume_store s;
+		s.open(path, ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.num_torrents(), 2);
+		TEST_CHECK(!s.load(a, buf, ec));
+		TEST_CHECK(!ec);
+		TEST_CHECK(s.load(b, buf, ec));
+		TEST_CHECK(buf == make_payload('b', 2000));
+		TEST_EQUAL(s.file_size(), file_size);
+
+		// the skipped record is reported. Its info-hash is what's corrupt,
+		// so it can't be told which torrent it belonged to
+		TEST_EQUAL(s.corrupt_records(), 1);
+		std::vector<sha1_hash> corrupt;
+		s.corrupt_torrents(corrupt);
+		TEST_CHECK(corrupt.empty());
+		// the skipped record is garbage
+		TEST_CHECK(s.garbage() >= 36 + 150);
+
+		// and a new record for a is appended at the end
+		s.save(a, make_payload('a', 10), ec);
+		TEST_CHECK(!ec);
+		TEST_CHECK(s.file_size() > file_size);
+	}
+
+	{
+		resume_store s;
+		s.open(path, ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.num_torrents(), 3);
+		TEST_CHECK(s.load(a, buf, ec));
+		TEST_CHECK(buf == make_payload('a', 10));
+	}
+
+	// a corrupt record whose info-hash is intact supersedes the earlier
+	// records of its torrent. A corrupt removal record must not bring the
+	// torrent back with its old resume data
+	{
+		remove(path, ec);
+		ec.clear();
+		resume_store s;
+		s.open(path, ec);
+		TEST_CHECK(!ec);
+		s.save(a, make_payload('a', 100), ec);
+		s.save(c, make_payload('c', 10), ec);
+		s.save(b, make_payload('b', 50), ec);
+		s.remove(a, ec);
+		s.save(b, make_payload('B', 60), ec);
+		s.remove(c, ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.num_torrents(), 1);
+		file_size = s.file_size();
+	}
+
+	{
+		// the flags of the removal records of a (followed by another
+		// record) and c (the last record in the file)
+		long const remove_a = 8 + (36 + 100) + (36 + 10) + (36 + 50);
+		long const remove_c = remove_a + 36 + (36 + 60);
+		TEST_EQUAL(remove_c + 36, file_size);
+		poke(path, remove_a + 4, 'x');
+		poke(path, remove_c + 4, 'x');
+
+		resume_store s;
+		s.open(path, ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.corrupt_records(), 2);
+		TEST_EQUAL(s.num_torrents(), 1);
+		TEST_CHECK(!s.load(a, buf, ec));
+		TEST_CHECK(!s.load(c, buf, ec));
+		TEST_CHECK(!ec);
+		TEST_CHECK(s.load(b, buf, ec));
+		TEST_CHECK(buf == make_payload('B', 60));
+
+		std::vector<sha1_hash> corrupt;
+		s.corrupt_torrents(corrupt);
+		TEST_EQUAL(corrupt.size(), 2);
+		TEST_CHECK(std::find(corrupt.begin(), corrupt.end(), a) != corrupt.end());
+		TEST_CHECK(std::find(corrupt.begin(), corrupt.end(), c) != corrupt.end());
+
+		// saving the torrent again makes it current
+		s.save(a, make_payload('a', 20), ec);
+		TEST_CHECK(!ec);
+	}
+
+	{
+		resume_store s;
+		s.open(path, ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.num_torrents(), 2);
+		TEST_CHECK(s.load(a, buf, ec));
+		TEST_CHECK(buf == make_payload('a', 20));
+
+		// c stays removed, even though its corrupt removal record was cut
+		// off with the end of the file
+		TEST_CHECK(!s.load(c, buf, ec));
+		TEST_CHECK(!ec);
+		TEST_EQUAL(s.corrupt_records(), 1);
+		std::vector<sha1_hash> corrupt;
+		s.corrupt_torrents(corrupt);
+		TEST_CHECK(corrupt.empty());
+	}
+
+	// a file that isn't a resume store
+	{
+		poke(path, 0, 'x');
+		resume_store s;
+		s.open(path, ec);
+		TEST_CHECK(ec == error_code(errors::invalid_resume_store));
+		TEST_CHECK(!s.is_open());
+		ec.clear();
+	}
+
+	remove(path, ec);
+	return 0;
+}
+
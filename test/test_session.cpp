@@ -82,6 +82,24 @@ int test_main()
 	ses.apply_settings(sett);
 	TEST_CHECK(ses.get_settings().get_int(settings_pack::unchoke_slots_limit) == 8);
 
+	// session_stats_alert reports the change of every counter since the
+	// previous one was posted
+	std::vector<boost::uint64_t> prev_values;
+	for (int i = 0; i < 2; ++i)
+	{
+		ses.post_session_stats();
+		a = wait_for_alert(ses, session_stats_alert::alert_type, "ses1");
+		session_stats_alert* sa = alert_cast<session_stats_alert>(a.get());
+		TEST_CHECK(sa);
+		if (sa == NULL) break;
+
+		TEST_EQUAL(sa->deltas.size(), sa->values.size());
+		if (prev_values.empty()) prev_values.resize(sa->values.size(), 0);
+		for (int k = 0; k < int(sa->values.size()); ++k)
+			TEST_EQUAL(sa->deltas[k], boost::int64_t(sa->values[k] - prev_values[k]));
+		prev_values = sa->values;
+	}
+
 	// make sure the destructor waits properly
 	// for the asynchronous call to set the alert
 	// mask completes, before it goes on to destruct
@@ -36,6 +36,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/socket.hpp"
 
 #include <string>
+#include <limits>
 
 using namespace libtorrent;
 using namespace libtorrent::detail;
@@ -113,6 +114,60 @@ int test_main()
 #endif
 	TEST_EQUAL(list[0], udp::endpoint(address_v4::from_string("16.5.128.1"), 1337));
 
+	// test bandwidth_delay_product
+	// 1 MB/s over 100 ms
+	TEST_EQUAL(bandwidth_delay_product(1000000, 100), 100000);
+	// RTTs below 20 ms (including no estimate at all) are rounded up
+	TEST_EQUAL(bandwidth_delay_product(1000000, 0), 20000);
+	TEST_EQUAL(bandwidth_delay_product(1000000, 5), 20000);
+	TEST_EQUAL(bandwidth_delay_product(0, 100), 0);
+	// saturates instead of overflowing
+	TEST_EQUAL(bandwidth_delay_product(boost::int64_t(1) << 40, 10000)
+		, (std::numeric_limits<int>::max)());
+
+	// test socket_buffer_target
+	TEST_EQUAL(socket_buffer_target(100000, 4 * 1024 * 1024), 200000);
+	// capped at max_size
+	TEST_EQUAL(socket_buffer_target(4 * 1024 * 1024, 1024 * 1024), 1024 * 1024);
+	TEST_EQUAL(socket_buffer_target((std::numeric_limits<int>::max)(), 1024 * 1024), 1024 * 1024);
+	// never below 16 kiB, unless that exceeds max_size
+	TEST_EQUAL(socket_buffer_target(0, 4 * 1024 * 1024), 16 * 1024);
+	TEST_EQUAL(socket_buffer_target(100, 8 * 1024), 8 * 1024);
+
+	// test tcp_rtt. The kernel has an estimate as soon as the handshake
+	// completes, on both ends of the connection
+	{
+		io_service ios;
+		tcp::acceptor acceptor(ios);
+		acceptor.open(tcp::v4(), ec);
+		TEST_CHECK(!ec);
+		acceptor.bind(tcp::endpoint(address_v4::loopback(), 0), ec);
+		TEST_CHECK(!ec);
+		acceptor.listen(5, ec);
+		TEST_CHECK(!ec);
+
+		tcp::socket client(ios);
+		tcp::socket server(ios);
+		client.connect(acceptor.local_endpoint(ec), ec);
+		TEST_CHECK(!ec);
+		acceptor.accept(server, ec);
+		TEST_CHECK(!ec);
+
+		int deviation = -1;
+		int const rtt = tcp_rtt(client, &deviation);
+		int const server_rtt = tcp_rtt(server);
+#if defined TORRENT_LINUX
+		// over loopback this is well below a millisecond
+		TEST_CHECK(rtt >= 0);
+		TEST_CHECK(rtt < 1000);
+		TEST_CHECK(deviation >= 0);
+		TEST_CHECK(server_rtt >= 0);
+#else
+		TEST_CHECK(rtt >= -1);
+		TEST_CHECK(server_rtt >= -1);
+#endif
+	}
+
 	return 0;
 }
 
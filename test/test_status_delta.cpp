@@ -0,0 +1,118 @@
+/*
+
+Copyright (c) 2014, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/status_delta.hpp"
+#include "libtorrent/hasher.hpp"
+
+#include "test.hpp"
+
+#include <vector>
+#include <cstring> // for memcpy
+
+using namespace libtorrent;
+
+void test_roundtrip()
+{
+	boost::int64_t values[status_delta::num_fields];
+	for (int i = 0; i < status_delta::num_fields; ++i)
+		values[i] = boost::int64_t(i) * 1000000000000LL - 5;
+
+	std::vector<char> buf;
+	sha1_hash ih1 = hasher("a", 1).final();
+	sha1_hash ih2 = hasher("b", 1).final();
+
+	boost::uint32_t fields1 = status_delta_mask(status_delta::state)
+		| status_delta_mask(status_delta::download_rate)
+		| status_delta_mask(status_delta::seeding_time);
+	append_status_delta(buf, ih1, fields1, values);
+	append_status_delta(buf, ih2, 0, values);
+	boost::uint32_t fields3 = (boost::uint32_t(1) << status_delta::num_fields) - 1;
+	append_status_delta(buf, ih1, fields3, values);
+
+	TEST_EQUAL(int(buf.size()), 24 * 3 + (3 + status_delta::num_fields) * 8);
+
+	status_delta_reader r(&buf[0], buf.size());
+	TEST_CHECK(r.next());
+	TEST_CHECK(r.info_hash() == ih1);
+	TEST_EQUAL(r.fields(), fields1);
+	TEST_CHECK(r.has(status_delta::state));
+	TEST_CHECK(!r.has(status_delta::upload_rate));
+	TEST_EQUAL(r.value(status_delta::state), values[status_delta::state]);
+	TEST_EQUAL(r.value(status_delta::download_rate), values[status_delta::download_rate]);
+	TEST_EQUAL(r.value(status_delta::seeding_time), values[status_delta::seeding_time]);
+
+	TEST_CHECK(r.next());
+	TEST_CHECK(r.info_hash() == ih2);
+	TEST_EQUAL(r.fields(), 0);
+
+	TEST_CHECK(r.next());
+	TEST_CHECK(r.info_hash() == ih1);
+	TEST_EQUAL(r.fields(), fields3);
+	for (int i = 0; i < status_delta::num_fields; ++i)
+		TEST_EQUAL(r.value(i), values[i]);
+
+	TEST_CHECK(!r.next());
+	TEST_CHECK(!r.next());
+}
+
+void test_truncated()
+{
+	boost::int64_t values[status_delta::num_fields] = {0};
+	std::vector<char> buf;
+	append_status_delta(buf, sha1_hash(0), status_delta_mask(status_delta::flags)
+		| status_delta_mask(status_delta::num_peers), values);
+
+	// a record cut short is not returned
+	for (int i = 0; i < int(buf.size()); ++i)
+	{
+		status_delta_reader r(&buf[0], i);
+		TEST_CHECK(!r.next());
+	}
+
+	// neither is one with fields we don't know about
+	boost::uint32_t bad = 0x80000000;
+	TEST_CHECK(status_delta::num_fields < 32);
+	memcpy(&buf[20], &bad, sizeof(bad));
+	status_delta_reader r(&buf[0], buf.size());
+	TEST_CHECK(!r.next());
+
+	status_delta_reader empty(NULL, 0);
+	TEST_CHECK(!empty.next());
+}
+
+int test_main()
+{
+	test_roundtrip();
+	test_truncated();
+	return 0;
+}
+
@@ -48,6 +48,8 @@ POSSIBILITY OF SUCH DAMAGE.
 using namespace libtorrent;
 namespace lt = libtorrent;
 
+bool all_torrents(torrent_status const&) { return true; }
+
 void test_running_torrent(boost::shared_ptr<torrent_info> info, size_type file_size)
 {
 	settings_pack pack;
@@ -159,6 +161,175 @@ void test_running_torrent(boost::shared_ptr<torrent_info> info, size_type file_s
 		}
 		TEST_CHECK(passed);
 	}
+
+	// apply a batch of operations in one call, with one error per operation
+	std::vector<torrent_operation> ops;
+	ops.push_back(torrent_operation(h, torrent_operation::set_upload_limit, 1000));
+	ops.push_back(torrent_operation(torrent_handle(), torrent_operation::pause));
+	ops.push_back(torrent_operation(h, torrent_operation::set_max_uploads, 1));
+	ops.push_back(torrent_operation(h, torrent_operation::set_download_limit, 2000));
+	ops.push_back(torrent_operation(h, torrent_operation::set_priority, 256));
+	ops.push_back(torrent_operation(h, torrent_operation::set_priority, -1));
+	ops.push_back(torrent_operation(h, torrent_operation::set_priority, 255));
+	std::vector<error_code> results = ses.apply_torrent_operations(ops);
+	TEST_EQUAL(results.size(), 7);
+	if (results.size() == 7)
+	{
+		TEST_CHECK(!results[0]);
+		TEST_CHECK(results[1] == error_code(errors::invalid_torrent_handle
+			, get_libtorrent_category()));
+		TEST_CHECK(results[2] == boost::asio::error::invalid_argument);
+		TEST_CHECK(!results[3]);
+		TEST_CHECK(results[4] == boost::asio::error::invalid_argument);
+		TEST_CHECK(results[5] == boost::asio::error::invalid_argument);
+		TEST_CHECK(!results[6]);
+	}
+	TEST_EQUAL(h.upload_limit(), 1000);
+	TEST_EQUAL(h.download_limit(), 2000);
+	TEST_EQUAL(h.status(0).priority, 255);
+	h.set_priority(0);
+
+	// bits beyond the last status_delta field are ignored
+	ses.post_torrent_deltas(0xffffffff);
+	std::auto_ptr<alert> da = wait_for_alert(ses, state_delta_alert::alert_type
+		, "post_torrent_deltas");
+	TEST_CHECK(da.get());
+	if (state_delta_alert* sd = alert_cast<state_delta_alert>(da.get()))
+	{
+		status_delta_reader r(sd->buffer.empty() ? NULL : &sd->buffer[0]
+			, int(sd->buffer.size()));
+		while (r.next())
+			TEST_EQUAL(r.fields() >> status_delta::num_fields, 0);
+	}
+
+	// with status snapshots enabled, the status is served from the last
+	// snapshot, as long as it has the fields asked for. Enabling them
+	// publishes the first snapshot right away
+	settings_pack snapshots;
+	// the interval is long enough for no other snapshot to be published
+	// during the test
+	snapshots.set_int(settings_pack::status_snapshot_interval, 60);
+	ses.apply_settings(snapshots);
+	TEST_EQUAL(ses.get_settings().get_int(settings_pack::status_snapshot_interval), 60);
+
+	st = h.status(0);
+	TEST_EQUAL(st.info_hash, info->info_hash());
+	TEST_EQUAL(st.name, info->name());
+	st = h.status(torrent_handle::query_name);
+	TEST_EQUAL(st.name, info->name());
+	TEST_EQUAL(h.name(), info->name());
+
+	// by default, the snapshots have every field, so the default flags
+	// of status() are served from them
+	boost::shared_ptr<status_snapshot_entry const> snapshot
+		= h.native_handle()->status_snapshot();
+	TEST_CHECK(snapshot);
+	if (snapshot) TEST_CHECK(status_snapshot_covers(*snapshot, 0xffffffff));
+	st = h.status();
+	TEST_EQUAL(st.pieces.size(), info->num_pieces());
+
+	// with snapshots that don't include the pieces, asking for them goes
+	// to the network thread
+	snapshots.set_int(settings_pack::status_snapshot_flags
+		, torrent_handle::query_torrent_file | torrent_handle::query_name
+		| torrent_handle::query_save_path);
+	ses.apply_settings(snapshots);
+	// get_settings() waits for the settings to be applied
+	TEST_EQUAL(ses.get_settings().get_int(settings_pack::status_snapshot_flags)
+		& torrent_handle::query_pieces, 0);
+	snapshot = h.native_handle()->status_snapshot();
+	TEST_CHECK(snapshot);
+	if (snapshot) TEST_CHECK(!status_snapshot_covers(*snapshot, 0xffffffff));
+	st = h.status(torrent_handle::query_pieces);
+	TEST_EQUAL(st.pieces.size(), info->num_pieces());
+
+	std::vector<torrent_status> all;
+	ses.get_torrent_status(&all, &all_torrents);
+	TEST_EQUAL(all.size(), 1);
+	if (!all.empty()) TEST_CHECK(all[0].handle == h);
+	if (!all.empty()) TEST_EQUAL(all[0].pieces.size(), 0);
+	ses.refresh_torrent_status(&all, torrent_handle::query_pieces);
+	TEST_EQUAL(all.size(), 1);
+	if (!all.empty()) TEST_EQUAL(all[0].pieces.size(), info->num_pieces());
+	all.clear();
+	ses.get_torrent_status(&all, &all_torrents, torrent_handle::query_pieces);
+	TEST_EQUAL(all.size(), 1);
+	if (!all.empty()) TEST_EQUAL(all[0].pieces.size(), info->num_pieces());
+	TEST_EQUAL(ses.get_torrents().size(), 1);
+
+	// adding and removing torrents invalidates the session's snapshot,
+	// rather than serving the old set of torrents until the next one
+	add_torrent_params p2;
+	p2.info_hash = hasher("test_torrent_snapshot", 21).final();
+	p2.save_path = ".";
+	torrent_handle h2 = ses.add_torrent(p2, ec);
+	TEST_CHECK(!ec);
+	TEST_EQUAL(ses.get_torrents().size(), 2);
+	all.clear();
+	ses.get_torrent_status(&all, &all_torrents);
+	TEST_EQUAL(all.size(), 2);
+	st = h2.status(0);
+	TEST_EQUAL(st.info_hash, p2.info_hash);
+
+	ses.remove_torrent(h2);
+	for (int i = 0; i < 50 && ses.get_torrents().size() != 1; ++i)
+		test_sleep(100);
+	TEST_EQUAL(ses.get_torrents().size(), 1);
+	all.clear();
+	ses.get_torrent_status(&all, &all_torrents);
+	TEST_EQUAL(all.size(), 1);
+	if (!all.empty()) TEST_CHECK(all[0].handle == h);
+
+	// without cpu_sample_rate, no cpu time is accounted for
+	st = h.status(torrent_handle::query_resource_usage);
+	TEST_EQUAL(st.tick_time, 0);
+	TEST_EQUAL(st.picker_time, 0);
+	TEST_EQUAL(st.peer_message_time, 0);
+
+	// sample every operation, and report the top torrents every second
+	settings_pack usage;
+	usage.set_int(settings_pack::alert_mask, alert::storage_notification
+		| alert::stats_notification);
+	usage.set_int(settings_pack::status_snapshot_interval, 0);
+	usage.set_int(settings_pack::cpu_sample_rate, 1);
+	usage.set_int(settings_pack::top_torrents_interval, 1);
+	usage.set_int(settings_pack::top_torrents_count, 5);
+	ses.apply_settings(usage);
+
+	std::auto_ptr<alert> ta = wait_for_alert(ses, top_torrents_alert::alert_type
+		, "top_torrents");
+	TEST_CHECK(ta.get());
+	if (top_torrents_alert* tt = alert_cast<top_torrents_alert>(ta.get()))
+	{
+		TEST_EQUAL(tt->interval, 1);
+		TEST_CHECK(tt->cpu.size() <= 1);
+		TEST_CHECK(tt->cache.size() <= 1);
+		for (int i = 0; i < int(tt->cpu.size()); ++i)
+		{
+			TEST_CHECK(tt->cpu[i].handle == h);
+			TEST_CHECK(tt->cpu[i].cpu_time > 0);
+		}
+		for (int i = 0; i < int(tt->cache.size()); ++i)
+		{
+			TEST_CHECK(tt->cache[i].handle == h);
+			TEST_CHECK(tt->cache[i].cached_blocks > 0);
+		}
+	}
+
+	// the torrent has been ticked at least once since, with the sampling
+	// enabled. The times only ever grow
+	st = h.status(torrent_handle::query_resource_usage);
+	TEST_CHECK(st.tick_time >= 0);
+	TEST_CHECK(st.picker_time >= 0);
+	TEST_CHECK(st.peer_message_time >= 0);
+	TEST_CHECK(st.cached_blocks >= 0);
+	boost::int64_t const tick_time = st.tick_time;
+	test_sleep(1500);
+	st = h.status(torrent_handle::query_resource_usage);
+	TEST_CHECK(st.tick_time >= tick_time);
+	// without the flag, the fields are not filled in
+	st = h.status(0);
+	TEST_EQUAL(st.tick_time, 0);
 }
 
 int test_main()
@@ -0,0 +1,138 @@
+#!/usr/bin/env python
+# Copyright Arvid Norberg 2014. Use, modification and distribution is
+# subject to the Boost Software License, Version 1.0. (See accompanying
+# file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+# converts a file written by libtorrent::dump_event_trace() into the Chrome
+# trace event JSON format. Load the output in chrome://tracing
+#
+# usage: parse_event_trace.py trace-file [output-file]
+
+import sys, struct, json
+
+# these must match trace_event::type_t in include/libtorrent/event_trace.hpp
+disk_job_submit = 0
+disk_job_start = 1
+disk_job_done = 2
+disk_job_handler = 3
+block_request = 4
+block_received = 5
+choked_by_peer = 6
+unchoked_by_peer = 7
+choke_peer = 8
+unchoke_peer = 9
+utp_cwnd = 10
+
+# the names of disk_io_job::action_t, read from the trace file
+job_names = []
+
+instant_names = {
+	choked_by_peer: 'choked by peer',
+	unchoked_by_peer: 'unchoked by peer',
+	choke_peer: 'choke peer',
+	unchoke_peer: 'unchoke peer' }
+
+def job_name(action):
+	if action < len(job_names): return job_names[action]
+	return 'job %d' % action
+
+def read_events(filename):
+	f = open(filename, 'rb')
+	header = f.read(24)
+	if len(header) != 24 or header[0:8] != b'LTTRACE2':
+		print('%s is not an event trace' % filename)
+		sys.exit(1)
+
+	# the file is written in the byte order of the machine that recorded
+	# it. Figure out which one it is from the byte order mark
+	if struct.unpack('<I', header[8:12])[0] == 0x01020304: order = '<'
+	elif struct.unpack('>I', header[8:12])[0] == 0x01020304: order = '>'
+	else:
+		print('invalid byte order mark')
+		sys.exit(1)
+
+	record_size, dropped, num_names = struct.unpack(order + 'III', header[12:24])
+	if dropped > 0:
+		print('warning: %d threads were not traced' % dropped)
+
+	for i in range(num_names):
+		name = b''
+		while True:
+			c = f.read(1)
+			if len(c) == 0 or c == b'\0': break
+			name += c
+		job_names.append(name.decode('utf-8'))
+
+	record = struct.Struct(order + 'QQIIHHI')
+	if record_size < record.size:
+		print('unexpected record size: %d' % record_size)
+		sys.exit(1)
+
+	events = []
+	while True:
+		buf = f.read(record_size)
+		if len(buf) < record_size: break
+		events.append(record.unpack(buf[0:record.size]))
+	f.close()
+	return events
+
+def convert(events):
+	out = []
+	if len(events) == 0: return out
+
+	# the trace is grouped by thread. Chrome wants it sorted by time
+	events.sort(key = lambda e: e[0])
+	start = events[0][0]
+
+	for timestamp, obj, arg0, arg1, kind, thread, reserved in events:
+		e = { 'ts': (timestamp - start) / 1000.0, 'pid': 0, 'tid': thread }
+
+		if kind == disk_job_submit or kind == disk_job_handler:
+			# the time from submitting a job until its handler is called
+			e['ph'] = 'b' if kind == disk_job_submit else 'e'
+			e['cat'] = 'disk'
+			e['name'] = job_name(arg0)
+			e['id'] = '%x' % obj
+			e['args'] = { 'piece': arg1 }
+		elif kind == disk_job_start or kind == disk_job_done:
+			# the time a disk thread spent performing a job
+			e['ph'] = 'B' if kind == disk_job_start else 'E'
+			e['cat'] = 'disk'
+			e['name'] = job_name(arg0)
+			e['args'] = { 'piece': arg1 }
+		elif kind == block_request or kind == block_received:
+			e['ph'] = 'b' if kind == block_request else 'e'
+			e['cat'] = 'request'
+			e['name'] = 'block'
+			e['id'] = '%x:%d:%d' % (obj, arg0, arg1)
+			e['args'] = { 'peer': '%x' % obj, 'piece': arg0, 'block': arg1 }
+		elif kind in instant_names:
+			e['ph'] = 'i'
+			e['s'] = 't'
+			e['cat'] = 'choke'
+			e['name'] = instant_names[kind]
+			e['args'] = { 'peer': '%x' % obj }
+		elif kind == utp_cwnd:
+			e['ph'] = 'C'
+			e['cat'] = 'utp'
+			e['name'] = 'cwnd %x' % obj
+			e['args'] = { 'cwnd': arg0, 'in-flight': arg1 }
+		else:
+			continue
+
+		out.append(e)
+	return out
+
+if len(sys.argv) < 2:
+	print('usage: parse_event_trace.py trace-file [output-file]')
+	sys.exit(1)
+
+output = 'event_trace.json'
+if len(sys.argv) > 2: output = sys.argv[2]
+
+events = read_events(sys.argv[1])
+f = open(output, 'w')
+json.dump({ 'traceEvents': convert(events), 'displayTimeUnit': 'ms' }, f)
+f.close()
+print('wrote %d events to %s' % (len(events), output))
+